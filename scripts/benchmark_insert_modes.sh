@@ -0,0 +1,66 @@
+#!/bin/bash
+set -e
+
+# Compares --insert-mode values and copy on the real insert path. The same mc blocks are replayed from a segment log,
+# recorded once with --sink segment-log, into a fresh database with the binary schema for every mode, and the time
+# until the replay has inserted all of them is reported with the per table timings of the last statistics report.
+# The connection is taken from PGHOST, PGPORT, PGUSER and PGPASSWORD, the database is dropped and created for each
+# run. Arguments after the first two are passed to tondb-scanner, e.g.
+#   PGHOST=127.0.0.1 ./scripts/benchmark_insert_modes.sh ./build/tondb-scanner /data/segment-log --insert-parallel-actors 8
+
+SCANNER=${1:?Please pass the tondb-scanner binary}
+SEGMENT_LOG=${2:?Please pass a segment log directory}
+shift 2
+
+PGHOST=${PGHOST:-127.0.0.1}
+PGPORT=${PGPORT:-5432}
+PGUSER=${PGUSER:-postgres}
+export PGHOST PGPORT PGUSER PGPASSWORD
+DBNAME=${BENCHMARK_DBNAME:-ton_index_benchmark}
+TIMEOUT=${BENCHMARK_TIMEOUT:-3600}
+
+SCRIPTS=$(dirname "$0")
+WORKDIR=$(mktemp -d)
+SCANNER_PID=""
+trap '[ -n "$SCANNER_PID" ] && kill "$SCANNER_PID" 2> /dev/null; rm -rf "$WORKDIR"' EXIT
+
+RESULTS=()
+for MODE in values copy; do
+  dropdb --if-exists "$DBNAME"
+  createdb "$DBNAME"
+  "$SCRIPTS/init_postgres_schema.sh" -q -d "$DBNAME" > /dev/null
+
+  LOG="$WORKDIR/$MODE.log"
+  START=$(date +%s.%N)
+  "$SCANNER" --host "$PGHOST" --port "$PGPORT" --user "$PGUSER" --password "$PGPASSWORD" --dbname "$DBNAME" \
+    --key-format binary --insert-mode "$MODE" --replay-segment-log "$SEGMENT_LOG" "$@" > "$LOG" 2>&1 &
+  SCANNER_PID=$!
+
+  # the replay reports finished once every block it read was inserted
+  until grep -q "Replay finished" "$LOG"; do
+    if ! kill -0 "$SCANNER_PID" 2> /dev/null; then
+      echo "tondb-scanner exited during the $MODE run, see its log:"
+      tail -n 20 "$LOG"
+      exit 1
+    fi
+    if (( $(echo "$(date +%s.%N) - $START > $TIMEOUT" | bc) )); then
+      echo "The $MODE run did not finish in ${TIMEOUT}s"
+      exit 1
+    fi
+    sleep 0.2
+  done
+  END=$(date +%s.%N)
+  # one more statistics report covers the last batches
+  sleep 11
+  kill "$SCANNER_PID"
+  wait "$SCANNER_PID" 2> /dev/null || true
+  SCANNER_PID=""
+
+  BLOCKS=$(grep -o "Replay finished: [0-9]*" "$LOG" | grep -o "[0-9]*$")
+  ELAPSED=$(echo "$END - $START" | bc)
+  RESULTS+=("$(printf "%-7s %8s mc blocks %10.1fs %10.1f mc blocks/s" "$MODE" "$BLOCKS" "$ELAPSED" "$(echo "$BLOCKS / $ELAPSED" | bc -l)")")
+  echo "$MODE per table: $(grep -o "per table: .*" "$LOG" | tail -n 1 | cut -c 12-)"
+done
+
+dropdb --if-exists "$DBNAME"
+printf "%s\n" "${RESULTS[@]}"
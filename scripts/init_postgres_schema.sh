@@ -1,3 +1,241 @@
 #!/bin/bash
 set -e
 
+# Creates the schema used with --key-format binary: hashes are 32 byte bytea and addresses are (workchain, bytea) pairs.
+# The text schema is created by ton-indexer. Arguments are passed to psql, e.g.
+#   ./scripts/init_postgres_schema.sh -h 127.0.0.1 -p 5432 -U postgres -d ton_index
+# With --partitioned as the first argument blocks, transactions and account_states are created range partitioned
+# by mc_seqno for use with --partition-size, the partitions are created by the scanner. Postgres requires the
+# partition key in every unique constraint, so their primary keys get mc_seqno appended. A block or transaction
+# belongs to exactly one mc block, the key stays as unique as before. An account state hash may be reached again in a
+# later mc block though: the unpartitioned table keeps one row per hash, the partitioned one a row per hash and
+# mc_seqno, all of them with the same state. Readers looking up a state by hash should take any one of them.
+
+MC_SEQNO=""
+PARTITIONED=""
+BLOCKS_KEY="workchain, shard, seqno"
+HASH_KEY="hash"
+if [ "$1" = "--partitioned" ]; then
+    shift
+    MC_SEQNO="mc_seqno integer not null,"
+    PARTITIONED="partition by range (mc_seqno)"
+    BLOCKS_KEY="workchain, shard, seqno, mc_seqno"
+    HASH_KEY="hash, mc_seqno"
+fi
+
+psql -v ON_ERROR_STOP=1 "$@" <<EOF
+create table if not exists blocks (
+    workchain integer not null,
+    shard bigint not null,
+    seqno integer not null,
+    root_hash bytea,
+    file_hash bytea,
+    mc_block_workchain integer,
+    mc_block_shard bigint,
+    mc_block_seqno integer,
+    global_id integer,
+    version integer,
+    after_merge boolean,
+    before_split boolean,
+    after_split boolean,
+    want_split boolean,
+    key_block boolean,
+    vert_seqno_incr boolean,
+    flags integer,
+    gen_utime bigint,
+    start_lt bigint,
+    end_lt bigint,
+    validator_list_hash_short integer,
+    gen_catchain_seqno integer,
+    min_ref_mc_seqno integer,
+    prev_key_block_seqno integer,
+    vert_seqno integer,
+    master_ref_seqno integer,
+    rand_seed bytea,
+    created_by bytea,
+    tx_count integer,
+    $MC_SEQNO
+    primary key ($BLOCKS_KEY)
+) $PARTITIONED;
+create index if not exists blocks_mc_block_idx on blocks (mc_block_workchain, mc_block_shard, mc_block_seqno);
+
+create table if not exists transactions (
+    block_workchain integer,
+    block_shard bigint,
+    block_seqno integer,
+    account_workchain integer,
+    account bytea,
+    hash bytea not null,
+    lt bigint,
+    prev_trans_hash bytea,
+    prev_trans_lt bigint,
+    now integer,
+    orig_status varchar,
+    end_status varchar,
+    total_fees bigint,
+    account_state_hash_before bytea,
+    account_state_hash_after bytea,
+    description jsonb,
+    $MC_SEQNO
+    primary key ($HASH_KEY)
+) $PARTITIONED;
+create index if not exists transactions_block_idx on transactions (block_workchain, block_shard, block_seqno);
+create index if not exists transactions_account_lt_idx on transactions (account_workchain, account, lt);
+
+create table if not exists message_contents (
+    hash bytea not null primary key,
+    body text
+);
+
+create table if not exists messages (
+    hash bytea not null primary key,
+    source_workchain integer,
+    source bytea,
+    destination_workchain integer,
+    destination bytea,
+    value bigint,
+    fwd_fee bigint,
+    ihr_fee bigint,
+    created_lt bigint,
+    created_at bigint,
+    opcode integer,
+    ihr_disabled boolean,
+    bounce boolean,
+    bounced boolean,
+    import_fee bigint,
+    body_hash bytea,
+    init_state_hash bytea
+);
+create index if not exists messages_source_idx on messages (source_workchain, source, created_lt);
+create index if not exists messages_destination_idx on messages (destination_workchain, destination, created_lt);
+
+create table if not exists transaction_messages (
+    transaction_hash bytea not null,
+    message_hash bytea not null,
+    direction varchar not null,
+    primary key (transaction_hash, message_hash, direction)
+);
+create index if not exists transaction_messages_message_idx on transaction_messages (message_hash);
+
+create table if not exists account_states (
+    hash bytea not null,
+    account_workchain integer,
+    account bytea,
+    balance bigint,
+    account_status varchar,
+    frozen_hash bytea,
+    code_hash bytea,
+    data_hash bytea,
+    $MC_SEQNO
+    primary key ($HASH_KEY)
+) $PARTITIONED;
+create index if not exists account_states_account_idx on account_states (account_workchain, account);
+
+create table if not exists jetton_transfers (
+    transaction_hash bytea not null primary key,
+    query_id numeric,
+    amount numeric,
+    source_workchain integer,
+    source bytea,
+    destination_workchain integer,
+    destination bytea,
+    jetton_wallet_address_workchain integer,
+    jetton_wallet_address bytea,
+    response_destination_workchain integer,
+    response_destination bytea,
+    custom_payload text,
+    forward_ton_amount numeric,
+    forward_payload text
+);
+
+create table if not exists jetton_burns (
+    transaction_hash bytea not null primary key,
+    query_id numeric,
+    owner_workchain integer,
+    owner bytea,
+    jetton_wallet_address_workchain integer,
+    jetton_wallet_address bytea,
+    amount numeric,
+    response_destination_workchain integer,
+    response_destination bytea,
+    custom_payload text
+);
+
+create table if not exists nft_transfers (
+    transaction_hash bytea not null primary key,
+    query_id numeric,
+    nft_item_address_workchain integer,
+    nft_item_address bytea,
+    old_owner_workchain integer,
+    old_owner bytea,
+    new_owner_workchain integer,
+    new_owner bytea,
+    response_destination_workchain integer,
+    response_destination bytea,
+    custom_payload text,
+    forward_amount numeric,
+    forward_payload text
+);
+
+-- commit markers written with --parallel-tables, an mc block is complete only when its seqno is here
+create table if not exists mc_block_commits (
+    seqno integer not null primary key,
+    committed_at timestamp not null default now()
+);
+
+-- mc blocks the database rejected, their seqnos are skipped until the row is deleted
+create table if not exists insert_dead_letters (
+    mc_seqno integer not null primary key,
+    error text not null,
+    failed_at timestamp not null default now()
+);
+
+-- jetton and NFT entities are read back by the detectors and keep the text layout
+create table if not exists jetton_wallets (
+    address varchar not null primary key,
+    balance numeric,
+    owner varchar,
+    jetton varchar,
+    last_transaction_lt bigint,
+    code_hash varchar,
+    data_hash varchar
+);
+
+create table if not exists jetton_masters (
+    address varchar not null primary key,
+    total_supply numeric,
+    mintable boolean,
+    admin_address varchar,
+    jetton_content jsonb,
+    jetton_wallet_code_hash varchar,
+    data_hash varchar,
+    code_hash varchar,
+    last_transaction_lt bigint,
+    code_boc varchar,
+    data_boc varchar
+);
+
+create table if not exists nft_collections (
+    address varchar not null primary key,
+    next_item_index numeric,
+    owner_address varchar,
+    collection_content jsonb,
+    data_hash varchar,
+    code_hash varchar,
+    last_transaction_lt bigint,
+    code_boc varchar,
+    data_boc varchar
+);
+
+create table if not exists nft_items (
+    address varchar not null primary key,
+    init boolean,
+    index numeric,
+    collection_address varchar,
+    owner_address varchar,
+    content jsonb,
+    last_transaction_lt bigint,
+    code_hash varchar,
+    data_hash varchar
+);
+EOF
@@ -0,0 +1,67 @@
+#!/bin/bash
+set -e
+
+# Checks that concurrent insert batches writing overlapping rows don't deadlock. Several tondb-scanner processes
+# replay the same segment log, recorded once with --sink segment-log, into one fresh database with the binary schema,
+# each with many insert actors and small batches. Every process writes every block, so concurrent batches of
+# different processes share all their rows, and consecutive batches of one process share the messages sent in one
+# batch and received in the next. The run fails if any process logged a deadlock, a batch that failed for good or
+# a dead letter. The connection is taken from PGHOST, PGPORT, PGUSER and PGPASSWORD, arguments after the first four
+# are passed to tondb-scanner, e.g.
+#   PGHOST=127.0.0.1 ./scripts/stress_ordered_inserts.sh ./build/tondb-scanner /data/segment-log 4 8 --parallel-tables
+
+SCANNER=${1:?Please pass the tondb-scanner binary}
+SEGMENT_LOG=${2:?Please pass a segment log directory}
+PROCESSES=${3:-4}
+ACTORS=${4:-8}
+shift 4 || shift $#
+
+PGHOST=${PGHOST:-127.0.0.1}
+PGPORT=${PGPORT:-5432}
+PGUSER=${PGUSER:-postgres}
+export PGHOST PGPORT PGUSER PGPASSWORD
+DBNAME=${STRESS_DBNAME:-ton_index_stress}
+TIMEOUT=${STRESS_TIMEOUT:-3600}
+
+SCRIPTS=$(dirname "$0")
+WORKDIR=$(mktemp -d)
+PIDS=()
+trap 'for PID in "${PIDS[@]}"; do kill "$PID" 2> /dev/null || true; done; rm -rf "$WORKDIR"' EXIT
+
+dropdb --if-exists "$DBNAME"
+createdb "$DBNAME"
+"$SCRIPTS/init_postgres_schema.sh" -q -d "$DBNAME" > /dev/null
+
+for I in $(seq 1 "$PROCESSES"); do
+  "$SCANNER" --host "$PGHOST" --port "$PGPORT" --user "$PGUSER" --password "$PGPASSWORD" --dbname "$DBNAME" \
+    --key-format binary --insert-parallel-actors "$ACTORS" --max-db-connections $((ACTORS * 2)) --insert-batch-size 16 \
+    --replay-segment-log "$SEGMENT_LOG" "$@" > "$WORKDIR/scanner$I.log" 2>&1 &
+  PIDS+=($!)
+done
+
+START=$(date +%s)
+for I in $(seq 1 "$PROCESSES"); do
+  until grep -q "Replay finished" "$WORKDIR/scanner$I.log"; do
+    if ! kill -0 "${PIDS[$((I - 1))]}" 2> /dev/null; then
+      echo "tondb-scanner $I exited, see its log:"
+      tail -n 20 "$WORKDIR/scanner$I.log"
+      exit 1
+    fi
+    if (( $(date +%s) - START > TIMEOUT )); then
+      echo "The replay did not finish in ${TIMEOUT}s"
+      exit 1
+    fi
+    sleep 1
+  done
+done
+echo "$PROCESSES processes with $ACTORS insert actors each replayed the log in $(( $(date +%s) - START ))s"
+
+DEADLOCKS=$(cat "$WORKDIR"/scanner*.log | grep -c "deadlock detected" || true)
+# retries log the same database error, only batches given up on count
+FAILED=$(cat "$WORKDIR"/scanner*.log | grep -c "Giving up on a batch" || true)
+DEAD_LETTERS=$(psql -d "$DBNAME" -tAc "select count(*) from insert_dead_letters")
+dropdb --if-exists "$DBNAME"
+echo "deadlocks: $DEADLOCKS, batches failed for good: $FAILED, dead letters: $DEAD_LETTERS"
+if [ "$DEADLOCKS" != "0" ] || [ "$FAILED" != "0" ] || [ "$DEAD_LETTERS" != "0" ]; then
+  exit 1
+fi
@@ -0,0 +1,311 @@
+#include "CompositeInsertManager.h"
+
+
+CompositeInsertManager::CompositeInsertManager(std::vector<Sink> sinks, AckPolicy policy, size_t max_lag_bytes)
+  : policy_(policy), max_lag_bytes_(max_lag_bytes) {
+  CHECK(!sinks.empty());
+  for (auto &sink : sinks) {
+    SinkState state;
+    state.sink = std::move(sink);
+    sinks_.push_back(std::move(state));
+  }
+}
+
+td::Result<CompositeInsertManager::AckPolicy> CompositeInsertManager::parse_ack_policy(td::Slice name) {
+  if (name == "all") {
+    return AckPolicy::all;
+  }
+  if (name == "primary") {
+    return AckPolicy::primary;
+  }
+  if (name == "quorum") {
+    return AckPolicy::quorum;
+  }
+  return td::Status::Error(PSLICE() << "unknown ack policy " << name << ", expected all, primary or quorum");
+}
+
+void CompositeInsertManager::start_up() {
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+size_t CompositeInsertManager::required_acks(AckPolicy policy, size_t sinks_count) {
+  switch (policy) {
+    case AckPolicy::all: return sinks_count;
+    case AckPolicy::primary: return 1;
+    case AckPolicy::quorum: return sinks_count / 2 + 1;
+  }
+  return sinks_count;
+}
+
+size_t CompositeInsertManager::required_acks() const {
+  return required_acks(policy_, sinks_.size());
+}
+
+bool CompositeInsertManager::acknowledge(AckPolicy policy, size_t sinks_count, Ack &ack, size_t sink,
+                                         td::Result<td::Unit> R) {
+  if (R.is_ok()) {
+    ack.succeeded++;
+  } else {
+    ack.failed++;
+  }
+  if (ack.resolved) {
+    return false;
+  }
+  if (policy == AckPolicy::primary) {
+    if (sink != 0) {
+      return false;
+    }
+    ack.resolved = true;
+    ack.promise.set_result(std::move(R));
+    return true;
+  }
+  auto required = required_acks(policy, sinks_count);
+  if (ack.succeeded >= required) {
+    ack.resolved = true;
+    ack.promise.set_value(td::Unit());
+    return true;
+  }
+  // the failures leave too few sinks to reach the required acks, R is the failure that decided it
+  if (sinks_count - ack.failed < required) {
+    ack.resolved = true;
+    ack.promise.set_error(R.move_as_error());
+    return true;
+  }
+  return false;
+}
+
+bool CompositeInsertManager::acknowledge(Ack &ack, size_t sink, td::Result<td::Unit> R) {
+  if (R.is_error()) {
+    R = R.move_as_error_prefix(PSLICE() << "sink " << sinks_[sink].sink.name << ": ");
+  }
+  return acknowledge(policy_, sinks_.size(), ack, sink, std::move(R));
+}
+
+void CompositeInsertManager::insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) {
+  auto pending = std::make_shared<PendingBlock>();
+  pending->mc_seqno = block_ds->blocks_[0].seqno;
+  pending->bytes = block_ds->estimated_size();
+  pending->received_at = td::Timestamp::now();
+  pending->block = std::move(block_ds);
+  pending->ack.promise = std::move(promise);
+  for (size_t i = 0; i < sinks_.size(); i++) {
+    sinks_[i].queue.push_back(pending);
+    sinks_[i].queued_bytes += pending->bytes;
+    dispatch(i);
+  }
+}
+
+// A sink gets blocks while its credit lasts, one at a time when it has nothing in flight, like the scanner does
+void CompositeInsertManager::dispatch(size_t sink) {
+  auto &state = sinks_[sink];
+  while (!state.queue.empty() && (state.credit > 0 || state.inserting.empty())) {
+    auto pending = std::move(state.queue.front());
+    state.queue.pop_front();
+    state.queued_bytes -= pending->bytes;
+    state.credit -= static_cast<td::int64>(pending->bytes);
+    state.inserting.emplace(pending->mc_seqno, pending);
+    state.inserting_bytes += pending->bytes;
+
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), sink, pending](td::Result<td::Unit> R) {
+      td::actor::send_closure(SelfId, &CompositeInsertManager::sink_inserted, sink, pending, std::move(R));
+    });
+    td::actor::send_closure(state.sink.actor, &InsertManagerInterface::insert, pending->block, std::move(P));
+  }
+  if (!state.queue.empty()) {
+    request_credit(sink);
+  }
+}
+
+void CompositeInsertManager::request_credit(size_t sink) {
+  auto &state = sinks_[sink];
+  if (state.credit_requested) {
+    return;
+  }
+  state.credit_requested = true;
+  auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), sink](td::Result<td::int64> R) {
+    td::actor::send_closure(SelfId, &CompositeInsertManager::got_credit, sink, R.is_ok() ? R.move_as_ok() : 0);
+  });
+  td::actor::send_closure(state.sink.actor, &InsertManagerInterface::get_insert_credit, std::move(P));
+}
+
+void CompositeInsertManager::got_credit(size_t sink, td::int64 credit) {
+  auto &state = sinks_[sink];
+  state.credit_requested = false;
+  state.credit = credit;
+  // a full sink is asked again when one of its inserts completes or on the next alarm
+  if (credit > 0) {
+    dispatch(sink);
+  }
+}
+
+void CompositeInsertManager::sink_inserted(size_t sink, PendingBlockPtr pending, td::Result<td::Unit> R) {
+  auto &state = sinks_[sink];
+  auto range = state.inserting.equal_range(pending->mc_seqno);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == pending) {
+      state.inserting.erase(it);
+      break;
+    }
+  }
+  state.inserting_bytes -= pending->bytes;
+  if (R.is_ok()) {
+    state.inserted++;
+  } else {
+    state.failed++;
+    LOG(WARNING) << "Sink " << state.sink.name << " failed to insert mc seqno " << pending->mc_seqno << ": " << R.error();
+  }
+  acknowledge(pending->ack, sink, std::move(R));
+  dispatch(sink);
+}
+
+void CompositeInsertManager::get_insert_credit(td::Promise<td::int64> promise) {
+  td::int64 credit = std::numeric_limits<td::int64>::max();
+  for (const auto &state : sinks_) {
+    credit = std::min(credit, static_cast<td::int64>(max_lag_bytes_) - static_cast<td::int64>(state.lag_bytes()));
+  }
+  promise.set_value(std::move(credit));
+}
+
+void CompositeInsertManager::get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) {
+  auto request = std::make_shared<ExistingSeqnosRequest>();
+  request->results.resize(sinks_.size());
+  request->remaining = sinks_.size();
+  request->promise = std::move(promise);
+  for (size_t i = 0; i < sinks_.size(); i++) {
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), request, i](td::Result<std::vector<std::uint32_t>> R) {
+      td::actor::send_closure(SelfId, &CompositeInsertManager::got_existing_seqnos, request, i, std::move(R));
+    });
+    td::actor::send_closure(sinks_[i].sink.actor, &InsertManagerInterface::get_existing_seqnos, std::move(P));
+  }
+}
+
+// A seqno exists if enough sinks have it for the ack policy. With all, a sink missing it gets it again when it is
+// rescanned, with primary or quorum the lagging sinks keep the gap.
+void CompositeInsertManager::got_existing_seqnos(std::shared_ptr<ExistingSeqnosRequest> request, size_t sink,
+                                                 td::Result<std::vector<std::uint32_t>> R) {
+  if (R.is_error()) {
+    if (request->error.is_ok() && (policy_ != AckPolicy::primary || sink == 0)) {
+      request->error = R.move_as_error_prefix(PSLICE() << "sink " << sinks_[sink].sink.name << ": ");
+    }
+  } else {
+    request->results[sink] = R.move_as_ok();
+    LOG(INFO) << "Sink " << sinks_[sink].sink.name << " has " << request->results[sink].size() << " mc seqnos";
+  }
+  if (--request->remaining > 0) {
+    return;
+  }
+  if (request->error.is_error()) {
+    request->promise.set_error(std::move(request->error));
+    return;
+  }
+  if (policy_ == AckPolicy::primary) {
+    request->promise.set_value(std::move(request->results[0]));
+    return;
+  }
+  std::map<std::uint32_t, size_t> counts;
+  for (const auto &seqnos : request->results) {
+    for (auto seqno : seqnos) {
+      counts[seqno]++;
+    }
+  }
+  std::vector<std::uint32_t> result;
+  for (const auto &[seqno, count] : counts) {
+    if (count >= required_acks()) {
+      result.push_back(seqno);
+    }
+  }
+  request->promise.set_value(std::move(result));
+}
+
+void CompositeInsertManager::tip_reached() {
+  for (auto &state : sinks_) {
+    td::actor::send_closure(state.sink.actor, &InsertManagerInterface::tip_reached);
+  }
+}
+
+void CompositeInsertManager::fan_out(td::Promise<td::Unit> promise, std::function<void(size_t, td::Promise<td::Unit>)> send) {
+  auto ack = std::make_shared<Ack>();
+  ack->promise = std::move(promise);
+  for (size_t i = 0; i < sinks_.size(); i++) {
+    send(i, td::PromiseCreator::lambda([SelfId = actor_id(this), ack, i](td::Result<td::Unit> R) {
+      td::actor::send_closure(SelfId, &CompositeInsertManager::entity_acknowledged, ack, i, std::move(R));
+    }));
+  }
+}
+
+void CompositeInsertManager::entity_acknowledged(std::shared_ptr<Ack> ack, size_t sink, td::Result<td::Unit> R) {
+  if (R.is_error()) {
+    LOG(WARNING) << "Sink " << sinks_[sink].sink.name << " failed to upsert entity: " << R.error();
+  }
+  acknowledge(*ack, sink, std::move(R));
+}
+
+void CompositeInsertManager::report_lag() {
+  for (const auto &state : sinks_) {
+    double oldest = 0;
+    if (!state.queue.empty()) {
+      oldest = td::Timestamp::now().at() - state.queue.front()->received_at.at();
+    }
+    for (const auto &[seqno, pending] : state.inserting) {
+      oldest = std::max(oldest, td::Timestamp::now().at() - pending->received_at.at());
+    }
+    LOG(INFO) << "Sink " << state.sink.name << ": " << state.queue.size() << " queued and " << state.inserting.size()
+              << " inserting mc blocks (" << state.lag_bytes() / (1 << 20) << "MB of " << max_lag_bytes_ / (1 << 20)
+              << "MB lag), oldest " << static_cast<int>(oldest) << "s, " << state.inserted << " inserted, "
+              << state.failed << " failed";
+  }
+}
+
+void CompositeInsertManager::alarm() {
+  // credit of a full sink is refreshed here, it does not report when it has room again
+  for (size_t i = 0; i < sinks_.size(); i++) {
+    if (!sinks_[i].queue.empty()) {
+      request_credit(i);
+    }
+  }
+  if (next_report_.is_in_past()) {
+    report_lag();
+    next_report_ = td::Timestamp::in(10.0);
+  }
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+void CompositeInsertManager::upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) {
+  fan_out(std::move(promise), [&](size_t i, td::Promise<td::Unit> P) {
+    td::actor::send_closure(sinks_[i].sink.actor, &InsertManagerInterface::upsert_jetton_wallet, jetton_wallet, std::move(P));
+  });
+}
+
+void CompositeInsertManager::get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) {
+  td::actor::send_closure(sinks_[0].sink.actor, &InsertManagerInterface::get_jetton_wallets, std::move(addresses), std::move(promise));
+}
+
+void CompositeInsertManager::upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) {
+  fan_out(std::move(promise), [&](size_t i, td::Promise<td::Unit> P) {
+    td::actor::send_closure(sinks_[i].sink.actor, &InsertManagerInterface::upsert_jetton_master, jetton_master, std::move(P));
+  });
+}
+
+void CompositeInsertManager::get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) {
+  td::actor::send_closure(sinks_[0].sink.actor, &InsertManagerInterface::get_jetton_masters, std::move(addresses), std::move(promise));
+}
+
+void CompositeInsertManager::upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) {
+  fan_out(std::move(promise), [&](size_t i, td::Promise<td::Unit> P) {
+    td::actor::send_closure(sinks_[i].sink.actor, &InsertManagerInterface::upsert_nft_collection, nft_collection, std::move(P));
+  });
+}
+
+void CompositeInsertManager::get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) {
+  td::actor::send_closure(sinks_[0].sink.actor, &InsertManagerInterface::get_nft_collections, std::move(addresses), std::move(promise));
+}
+
+void CompositeInsertManager::upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) {
+  fan_out(std::move(promise), [&](size_t i, td::Promise<td::Unit> P) {
+    td::actor::send_closure(sinks_[i].sink.actor, &InsertManagerInterface::upsert_nft_item, nft_item, std::move(P));
+  });
+}
+
+void CompositeInsertManager::get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) {
+  td::actor::send_closure(sinks_[0].sink.actor, &InsertManagerInterface::get_nft_items, std::move(addresses), std::move(promise));
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <map>
+#include "InsertManager.h"
+
+
+// Writes every block to several sinks, the first one is the primary. Each sink has its own queue and receives
+// blocks as fast as its own insert credit allows, batching stays with the sink. A sink may fall behind the others
+// by up to max_lag_bytes of queued and unacknowledged blocks; the credit of the composite is what the most lagging
+// sink has left, so only then the scanner slows down. The insert promise resolves by the ack policy:
+//   all      every sink inserted the block, a failure fails the promise and the seqno is scanned again
+//   primary  the primary inserted it, failures of the other sinks are counted and logged
+//   quorum   a majority of sinks inserted it
+// Existing seqnos are those the policy would have acknowledged. Entity upserts go to every sink and resolve by the
+// same policy, entity reads are answered by the primary.
+class CompositeInsertManager: public InsertManagerInterface {
+public:
+  enum class AckPolicy { all, primary, quorum };
+
+  struct Sink {
+    std::string name;
+    td::actor::ActorId<InsertManagerInterface> actor;
+  };
+
+  CompositeInsertManager(std::vector<Sink> sinks, AckPolicy policy, size_t max_lag_bytes);
+
+  static td::Result<AckPolicy> parse_ack_policy(td::Slice name);
+
+  // results of one operation sent to every sink
+  struct Ack {
+    td::Promise<td::Unit> promise;
+    size_t succeeded{0};
+    size_t failed{0};
+    bool resolved{false};
+  };
+  static size_t required_acks(AckPolicy policy, size_t sinks_count);
+  // counts the result of one of sinks_count sinks, true once the ack reached a result, the promise is resolved then
+  static bool acknowledge(AckPolicy policy, size_t sinks_count, Ack &ack, size_t sink, td::Result<td::Unit> R);
+
+  void start_up() override;
+  void alarm() override;
+
+  void insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) override;
+  void get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) override;
+  void tip_reached() override;
+  void get_insert_credit(td::Promise<td::int64> promise) override;
+
+  void upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) override;
+  void get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) override;
+  void upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) override;
+  void get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) override;
+  void upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) override;
+  void get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) override;
+  void upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) override;
+  void get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) override;
+
+private:
+  struct PendingBlock {
+    ParsedBlockPtr block;
+    uint32_t mc_seqno;
+    size_t bytes;
+    td::Timestamp received_at;
+    Ack ack;
+  };
+  using PendingBlockPtr = std::shared_ptr<PendingBlock>;
+
+  struct ExistingSeqnosRequest {
+    std::vector<std::vector<std::uint32_t>> results;
+    size_t remaining;
+    td::Status error;
+    td::Promise<std::vector<std::uint32_t>> promise;
+  };
+
+  struct SinkState {
+    Sink sink;
+    std::deque<PendingBlockPtr> queue;
+    size_t queued_bytes{0};
+    // sent to the sink, not acknowledged yet, by mc seqno
+    std::multimap<uint32_t, PendingBlockPtr> inserting;
+    size_t inserting_bytes{0};
+    td::int64 credit{0};
+    bool credit_requested{false};
+
+    size_t inserted{0};
+    size_t failed{0};
+
+    size_t lag_bytes() const { return queued_bytes + inserting_bytes; }
+  };
+
+  AckPolicy policy_;
+  size_t max_lag_bytes_;
+  std::vector<SinkState> sinks_;
+  td::Timestamp next_report_;
+
+  size_t required_acks() const;
+  // a failure is prefixed with the sink name
+  bool acknowledge(Ack &ack, size_t sink, td::Result<td::Unit> R);
+  void fan_out(td::Promise<td::Unit> promise, std::function<void(size_t, td::Promise<td::Unit>)> send);
+  void entity_acknowledged(std::shared_ptr<Ack> ack, size_t sink, td::Result<td::Unit> R);
+
+  void dispatch(size_t sink);
+  void request_credit(size_t sink);
+  void got_credit(size_t sink, td::int64 credit);
+  void sink_inserted(size_t sink, PendingBlockPtr pending, td::Result<td::Unit> R);
+  void got_existing_seqnos(std::shared_ptr<ExistingSeqnosRequest> request, size_t sink, td::Result<std::vector<std::uint32_t>> R);
+  void report_lag();
+};
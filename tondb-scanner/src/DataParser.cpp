@@ -8,6 +8,7 @@
 #include "validator/interfaces/block.h"
 #include "validator/interfaces/shard.h"
 #include "convert-utils.h"
+#include "ton/ton-shard.h"
 
 using namespace ton::validator; //TODO: remove this
 
@@ -49,6 +50,7 @@ td::Status ParseQuery::parse_impl() {
     result->blocks_.push_back(schema_block);
   }
   result->mc_block_ = mc_block_;
+  TRY_RESULT_ASSIGN(result->account_index_, ShardAccountIndex::build(mc_block_));
   return td::Status::OK();
 }
 
@@ -58,8 +60,8 @@ schema::Block ParseQuery::parse_block(const ton::BlockIdExt& blk_id, block::gen:
   block.workchain = blk_id.id.workchain;
   block.shard = static_cast<int64_t>(blk_id.id.shard);
   block.seqno = blk_id.id.seqno;
-  block.root_hash = td::base64_encode(blk_id.root_hash.as_slice());
-  block.file_hash = td::base64_encode(blk_id.file_hash.as_slice());
+  block.root_hash = blk_id.root_hash;
+  block.file_hash = blk_id.file_hash;
   if (mc_block) {
       block.mc_block_workchain = mc_block.value().workchain;
       block.mc_block_shard = mc_block.value().shard;
@@ -87,8 +89,8 @@ schema::Block ParseQuery::parse_block(const ton::BlockIdExt& blk_id, block::gen:
   if (!info.not_master || tlb::unpack_cell(info.master_ref, mcref)) {
       block.master_ref_seqno = mcref.seq_no;
   }
-  block.rand_seed = td::base64_encode(extra.rand_seed.as_slice());
-  block.created_by = td::base64_encode(extra.created_by.as_slice());
+  block.rand_seed = extra.rand_seed;
+  block.created_by = extra.created_by;
   return block;
 }
 
@@ -630,7 +632,7 @@ td::Result<schema::AccountState> ParseQuery::parse_account(td::Ref<vm::Cell> acc
       if (!tlb::csr_unpack(storage.state, frozen)) {
         return td::Status::Error("Failed to unpack AccountState frozen");
       }
-      schema_account.frozen_hash = td::base64_encode(frozen.state_hash.as_slice());
+      schema_account.frozen_hash = frozen.state_hash;
       break;
     }
     case block::gen::AccountState::account_active: {
@@ -646,12 +648,12 @@ td::Result<schema::AccountState> ParseQuery::parse_account(td::Ref<vm::Cell> acc
       auto& code_cs = state_init.code.write();
       if (code_cs.fetch_long(1) != 0) {
         schema_account.code = code_cs.prefetch_ref();
-        schema_account.code_hash = td::base64_encode(schema_account.code->get_hash().as_slice());
+        schema_account.code_hash = td::Bits256(schema_account.code->get_hash().bits());
       }
       auto& data_cs = state_init.data.write();
       if (data_cs.fetch_long(1) != 0) {
         schema_account.data = data_cs.prefetch_ref();
-        schema_account.data_hash = td::base64_encode(schema_account.data->get_hash().as_slice());
+        schema_account.data_hash = td::Bits256(schema_account.data->get_hash().bits());
       }
       break;
     }
@@ -660,3 +662,66 @@ td::Result<schema::AccountState> ParseQuery::parse_account(td::Ref<vm::Cell> acc
   }
   return schema_account;
 }
+
+td::Result<ShardAccountIndexPtr> ShardAccountIndex::build(const MasterchainBlockDataState& mc_block) {
+  auto index = std::make_shared<ShardAccountIndex>();
+  for (const auto& block_ds : mc_block) {
+    block::gen::ShardStateUnsplit::Record sstate;
+    if (!tlb::unpack_cell(block_ds.block_state->root_cell(), sstate)) {
+      return td::Status::Error("Failed to unpack ShardStateUnsplit");
+    }
+    index->shards_.push_back({block_ds.block_state->get_shard(), vm::load_cell_slice_ref(sstate.accounts)});
+  }
+  return ShardAccountIndexPtr(std::move(index));
+}
+
+td::Result<schema::AccountState> ShardAccountIndex::get_account(const block::StdAddress& address) const {
+  auto key = std::make_pair(address.workchain, address.addr);
+  auto& stripe = memo_[MemoKeyHasher()(key) % memo_stripes];
+  {
+    std::lock_guard<std::mutex> guard(stripe.mutex);
+    auto memoized = stripe.entries.get(key);
+    if (memoized) {
+      if (memoized->is_error()) {
+        return memoized->error().clone();
+      }
+      return memoized->ok();
+    }
+  }
+  // two threads may look up the same account at once, both get the same result
+  auto result = lookup(address);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+  if (result.is_error()) {
+    stripe.entries.put(key, result.error().clone());
+  } else {
+    stripe.entries.put(key, result.ok());
+  }
+  return result;
+}
+
+td::Result<schema::AccountState> ShardAccountIndex::lookup(const block::StdAddress& address) const {
+  auto prefix = ton::extract_addr_prefix(address.workchain, address.addr);
+  for (const auto& shard : shards_) {
+    if (!ton::shard_contains(shard.shard, prefix)) {
+      continue;
+    }
+    // the dictionary object caches state on lookups, a local one keeps the shared root read only
+    vm::AugmentedDictionary accounts_dict(shard.accounts_root, 256, block::tlb::aug_ShardAccounts);
+    auto shard_account_csr = accounts_dict.lookup(address.addr);
+    if (shard_account_csr.is_null()) {
+      return td::Status::Error("Account not found in accounts_dict");
+    }
+    td::Ref<vm::Cell> account_root = shard_account_csr->prefetch_ref();
+
+    int account_tag = block::gen::t_Account.get_tag(vm::load_cell_slice(account_root));
+    switch (account_tag) {
+    case block::gen::Account::account_none:
+      return td::Status::Error("Account is empty");
+    case block::gen::Account::account:
+      return ParseQuery::parse_account(account_root);
+    default:
+      return td::Status::Error("Unknown account tag");
+    }
+  }
+  return td::Status::Error("Account not found in shards");
+}
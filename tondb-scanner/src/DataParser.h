@@ -1,5 +1,46 @@
 #pragma once
+#include <array>
+#include <mutex>
 #include "IndexData.h"
+#include "LruCache.h"
+#include "vm/dict.h"
+
+
+// Account lookup over the shard states of one mc block. The shard states are unpacked once when the block is parsed,
+// lookups are routed by address prefix and memoized, so repeated fallbacks to the shard state are cheap.
+// Thread safe, one instance is shared by all detectors through ParsedBlock. The shard roots are immutable once built
+// and every lookup walks them with its own dictionary, so lookups run in parallel; only the bounded memo is locked,
+// one stripe at a time.
+class ShardAccountIndex {
+public:
+  static td::Result<ShardAccountIndexPtr> build(const MasterchainBlockDataState& mc_block);
+
+  td::Result<schema::AccountState> get_account(const block::StdAddress& address) const;
+
+private:
+  static constexpr size_t memo_stripes = 16;
+  static constexpr size_t max_memo_entries_per_stripe = 4096;
+
+  struct ShardAccounts {
+    ton::ShardIdFull shard;
+    td::Ref<vm::CellSlice> accounts_root;
+  };
+  std::vector<ShardAccounts> shards_;
+
+  using MemoKey = std::pair<ton::WorkchainId, td::Bits256>;
+  struct MemoKeyHasher {
+    std::size_t operator()(const MemoKey& key) const {
+      return Bits256Hasher()(key.second) ^ static_cast<std::size_t>(key.first);
+    }
+  };
+  struct MemoStripe {
+    std::mutex mutex;
+    LruCache<MemoKey, td::Result<schema::AccountState>, MemoKeyHasher> entries{max_memo_entries_per_stripe};
+  };
+  mutable std::array<MemoStripe, memo_stripes> memo_;
+
+  td::Result<schema::AccountState> lookup(const block::StdAddress& address) const;
+};
 
 
 class ParseQuery: public td::actor::Actor {
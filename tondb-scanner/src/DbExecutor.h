@@ -0,0 +1,16 @@
+#pragma once
+#include "td/actor/actor.h"
+
+
+// Actors doing blocking libpq calls run on a dedicated scheduler node, so network round trips and long commits
+// never park the threads that read, parse blocks and run TVM. Results reach the requesting actors through promises.
+constexpr size_t cpu_scheduler_threads = 32;
+constexpr size_t db_scheduler_threads = 8;
+constexpr td::uint8 db_scheduler_id = 1;
+
+template <class ActorT, class... ArgsT>
+td::actor::ActorOwn<ActorT> create_db_actor(td::Slice name, ArgsT &&...args) {
+  return td::actor::create_actor<ActorT>(
+      td::actor::ActorOptions().with_name(name).on_scheduler(td::actor::core::SchedulerId{db_scheduler_id}),
+      std::forward<ArgsT>(args)...);
+}
@@ -380,7 +380,7 @@ public:
   }
 };
 
-void DbScanner::start_up() {
+void DbScanner::request_existing_seqnos() {
   auto P = td::PromiseCreator::lambda([SelfId = actor_id(this)](td::Result<std::vector<std::uint32_t>> R) {
     td::actor::send_closure(SelfId, &DbScanner::got_existing_seqnos, std::move(R));
   });
@@ -389,9 +389,11 @@ void DbScanner::start_up() {
 
 void DbScanner::got_existing_seqnos(td::Result<std::vector<std::uint32_t>> R) {
   if (R.is_error()) {
-    LOG(ERROR) << "Error inserting to PG: " << R.move_as_error();
+    LOG(ERROR) << "Failed to get existing mc seqnos, retrying in 5s: " << R.move_as_error();
+    alarm_timestamp() = td::Timestamp::in(5.0);
     return;
   }
+  existing_seqnos_loaded_ = true;
   for (auto value : R.move_as_ok()) {
     existing_mc_seqnos_.insert(value);
   }
@@ -403,6 +405,7 @@ void DbScanner::run() {
   db_ = td::actor::create_actor<ton::validator::RootDb>("db", td::actor::ActorId<ton::validator::ValidatorManager>(), db_root_);
   db_caching_ = td::actor::create_actor<DbCacheWrapper>("cache_db", db_.get(), max_parallel_fetch_actors_);
   event_processor_ = td::actor::create_actor<EventProcessor>("event_processor", insert_manager_);
+  request_existing_seqnos();
 }
 
 void DbScanner::update_last_mc_seqno() {
@@ -431,6 +434,13 @@ void DbScanner::set_last_mc_seqno(int mc_seqno) {
         LOG(INFO) << "Skipped existing seqnos: " << skipping_count;
   }
   last_known_seqno_ = mc_seqno;
+
+  // seqnos are erased from seqnos_in_progress_ only after they are inserted
+  if (!tip_reached_ && seqnos_to_process_.empty() && seqnos_in_progress_.empty()) {
+    tip_reached_ = true;
+    LOG(INFO) << "Reached the tip at mc seqno " << mc_seqno;
+    td::actor::send_closure(insert_manager_, &InsertManagerInterface::tip_reached);
+  }
 }
 
 void DbScanner::catch_up_with_primary() {
@@ -440,8 +450,22 @@ void DbScanner::catch_up_with_primary() {
   td::actor::send_closure(db_, &RootDb::try_catch_up_with_primary, std::move(R));
 }
 
+td::int64 DbScanner::in_flight_bytes() const {
+  return static_cast<td::int64>((fetching_count_ + parsing_count_) * avg_block_bytes_) + static_cast<td::int64>(detecting_bytes_);
+}
+
+void DbScanner::got_insert_credit(td::int64 credit) {
+  insert_credit_ = credit;
+  schedule_for_processing();
+}
+
 void DbScanner::schedule_for_processing() {
   while (!seqnos_to_process_.empty() && seqnos_in_progress_.size() < max_parallel_fetch_actors_) {
+    // with nothing in flight one seqno is always admitted, so a single block larger than the limit can't stall the scanner
+    bool idle = fetching_count_ + parsing_count_ + detecting_count_ == 0;
+    if (!idle && in_flight_bytes() + static_cast<td::int64>(avg_block_bytes_) > insert_credit_) {
+      break;
+    }
     auto mc_seqno = seqnos_to_process_.front();
     seqnos_to_process_.pop();
 
@@ -452,10 +476,12 @@ void DbScanner::schedule_for_processing() {
     LOG(DEBUG) << "Creating IndexQuery for mc seqno " << mc_seqno;
     td::actor::create_actor<IndexQuery>("indexquery", mc_seqno, db_.get(), db_caching_.get(), std::move(R)).release();
     seqnos_in_progress_.insert(mc_seqno);
+    fetching_count_++;
   }
 }
 
 void DbScanner::seqno_fetched(int mc_seqno, td::Result<MasterchainBlockDataState> blocks_data_state) {
+  fetching_count_--;
   if (blocks_data_state.is_error()) {
     LOG(ERROR) << "mc_seqno " << mc_seqno << " failed to fetch BlockDataState: " << blocks_data_state.move_as_error();
     reschedule_seqno(mc_seqno);
@@ -466,15 +492,21 @@ void DbScanner::seqno_fetched(int mc_seqno, td::Result<MasterchainBlockDataState
     td::actor::send_closure(SelfId, &DbScanner::seqno_parsed, mc_seqno, std::move(res));
   });
 
+  parsing_count_++;
   td::actor::send_closure(parse_manager_, &ParseManager::parse, mc_seqno, blocks_data_state.move_as_ok(), std::move(R));
 }
 
 void DbScanner::seqno_parsed(int mc_seqno, td::Result<ParsedBlockPtr> parsed_block) {
+  parsing_count_--;
   if (parsed_block.is_error()) {
     LOG(ERROR) << "mc_seqno " << mc_seqno << " failed to parse BlockDataState: " << parsed_block.move_as_error();
     reschedule_seqno(mc_seqno);
     return;
   }
+  auto block_bytes = parsed_block.ok()->estimated_size();
+  avg_block_bytes_ = 0.1 * block_bytes + 0.9 * avg_block_bytes_;
+  detecting_count_++;
+  detecting_bytes_ += block_bytes;
 
   auto R = td::PromiseCreator::lambda([SelfId = actor_id(this), mc_seqno, parsed_block = parsed_block.ok()](td::Result<td::Unit> res) {
     td::actor::send_closure(SelfId, &DbScanner::interfaces_processed, mc_seqno, std::move(parsed_block), std::move(res));
@@ -484,6 +516,9 @@ void DbScanner::seqno_parsed(int mc_seqno, td::Result<ParsedBlockPtr> parsed_blo
 }
 
 void DbScanner::interfaces_processed(int mc_seqno, ParsedBlockPtr parsed_block, td::Result<td::Unit> result) {
+  auto block_bytes = parsed_block->estimated_size();
+  detecting_count_--;
+  detecting_bytes_ -= block_bytes;
   if (result.is_error()) {
     LOG(ERROR) << "mc_seqno " << mc_seqno << " failed to process interfaces: " << result.move_as_error();
     reschedule_seqno(mc_seqno);
@@ -499,6 +534,11 @@ void DbScanner::interfaces_processed(int mc_seqno, ParsedBlockPtr parsed_block,
     }
   });
 
+  // the block data and account index are needed only by the detectors, a queued block keeps just its rows
+  parsed_block->mc_block_.clear();
+  parsed_block->account_index_.reset();
+  // the block is counted by the insert manager from now on, until the next credit refresh take it from the snapshot
+  insert_credit_ -= block_bytes;
   td::actor::send_closure(insert_manager_, &InsertManagerInterface::insert, std::move(parsed_block), std::move(R));
 }
 
@@ -513,6 +553,10 @@ void DbScanner::reschedule_seqno(int mc_seqno) {
 }
 
 void DbScanner::alarm() {
+  if (!existing_seqnos_loaded_) {
+    request_existing_seqnos();
+    return;
+  }
   alarm_timestamp() = td::Timestamp::in(1.0);
   if (db_.empty()) {
     return;
@@ -520,5 +564,24 @@ void DbScanner::alarm() {
 
   td::actor::send_closure(actor_id(this), &DbScanner::update_last_mc_seqno);
   td::actor::send_closure(actor_id(this), &DbScanner::catch_up_with_primary);
-  td::actor::send_closure(actor_id(this), &DbScanner::schedule_for_processing);
+  auto P = td::PromiseCreator::lambda([SelfId = actor_id(this)](td::Result<td::int64> R) {
+    if (R.is_ok()) {
+      td::actor::send_closure(SelfId, &DbScanner::got_insert_credit, R.move_as_ok());
+    }
+  });
+  td::actor::send_closure(insert_manager_, &InsertManagerInterface::get_insert_credit, std::move(P));
+
+  if (next_report_.is_in_past()) {
+    report_stages();
+    next_report_ = td::Timestamp::in(10.0);
+  }
+}
+
+void DbScanner::report_stages() {
+  LOG(INFO) << "Scanner stages: fetching " << fetching_count_ << ", parsing " << parsing_count_
+            << " (~" << static_cast<td::int64>((fetching_count_ + parsing_count_) * avg_block_bytes_) / (1 << 20) << "MB)"
+            << ", detecting " << detecting_count_ << " (" << detecting_bytes_ / (1 << 20) << "MB)"
+            << ", insert credit " << insert_credit_ / (1 << 20) << "MB"
+            << ", avg mc block " << static_cast<td::int64>(avg_block_bytes_) / (1 << 10) << "KB"
+            << ", waiting " << seqnos_to_process_.size();
 }
\ No newline at end of file
@@ -24,8 +24,21 @@ private:
   std::queue<std::uint32_t> seqnos_to_process_;
   std::set<std::uint32_t> seqnos_in_progress_;
   std::set<std::uint32_t> existing_mc_seqnos_;
+  // scanning starts once the insert manager returned the existing seqnos, the request is retried until it does
+  bool existing_seqnos_loaded_{false};
   int max_parallel_fetch_actors_{2048};
   std::uint32_t last_known_seqno_{0};
+  bool tip_reached_{false};
+
+  // Seqnos are admitted only while the estimated bytes of the blocks in flight fit into the insert manager credit.
+  // Blocks being fetched or parsed are counted at the average parsed block size, blocks in detection by their own size.
+  td::int64 insert_credit_{0};
+  double avg_block_bytes_{256 << 10};
+  int fetching_count_{0};
+  int parsing_count_{0};
+  int detecting_count_{0};
+  size_t detecting_bytes_{0};
+  td::Timestamp next_report_;
 
 public:
   DbScanner(td::actor::ActorId<InsertManagerInterface> insert_manager, td::actor::ActorId<ParseManager> parse_manager) 
@@ -44,7 +57,10 @@ public:
     max_parallel_fetch_actors_ = max_parallel_fetch_actors;
   }
 
-  void start_up() override;
+  // replaces the sink given to the constructor, only before run()
+  void set_insert_manager(td::actor::ActorId<InsertManagerInterface> insert_manager) {
+    insert_manager_ = insert_manager;
+  }
 
   void alarm() override;
 
@@ -55,9 +71,13 @@ private:
   void set_last_mc_seqno(int mc_seqno);
   void catch_up_with_primary();
   void schedule_for_processing();
+  void got_insert_credit(td::int64 credit);
+  td::int64 in_flight_bytes() const;
+  void report_stages();
   void seqno_fetched(int mc_seqno, td::Result<MasterchainBlockDataState> blocks_data_state);
   void seqno_parsed(int mc_seqno, td::Result<ParsedBlockPtr> parsed_block);
   void interfaces_processed(int mc_seqno, ParsedBlockPtr parsed_block, td::Result<td::Unit> result);
+  void request_existing_seqnos();
   void got_existing_seqnos(td::Result<std::vector<std::uint32_t>> R);
   void seqno_completed(int mc_seqno);
   void reschedule_seqno(int mc_seqno);
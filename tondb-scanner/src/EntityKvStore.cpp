@@ -0,0 +1,183 @@
+#include "SerializationHelpers.h"
+#include "EntityKvStore.h"
+#include "InsertManager.h"
+
+
+using namespace serialization;
+
+template <class StorerT>
+void store(const JettonWalletData &wallet, StorerT &storer) {
+  td::store(wallet.balance, storer);
+  td::store(wallet.address, storer);
+  td::store(wallet.owner, storer);
+  td::store(wallet.jetton, storer);
+  td::store(wallet.last_transaction_lt, storer);
+  store_hash(wallet.code_hash, storer);
+  store_hash(wallet.data_hash, storer);
+}
+
+template <class ParserT>
+void parse(JettonWalletData &wallet, ParserT &parser) {
+  td::parse(wallet.balance, parser);
+  td::parse(wallet.address, parser);
+  td::parse(wallet.owner, parser);
+  td::parse(wallet.jetton, parser);
+  td::parse(wallet.last_transaction_lt, parser);
+  parse_hash(wallet.code_hash, parser);
+  parse_hash(wallet.data_hash, parser);
+}
+
+template <class StorerT>
+void store(const JettonMasterData &master, StorerT &storer) {
+  td::store(master.address, storer);
+  td::store(master.total_supply, storer);
+  td::store(master.mintable, storer);
+  store_optional(master.admin_address, storer);
+  store_content(master.jetton_content, storer);
+  store_hash(master.jetton_wallet_code_hash, storer);
+  store_hash(master.data_hash, storer);
+  store_hash(master.code_hash, storer);
+  td::store(master.last_transaction_lt, storer);
+  store_cell(master.code_cell, storer);
+  store_cell(master.data_cell, storer);
+}
+
+template <class ParserT>
+void parse(JettonMasterData &master, ParserT &parser) {
+  td::parse(master.address, parser);
+  td::parse(master.total_supply, parser);
+  td::parse(master.mintable, parser);
+  parse_optional(master.admin_address, parser);
+  parse_content(master.jetton_content, parser);
+  parse_hash(master.jetton_wallet_code_hash, parser);
+  parse_hash(master.data_hash, parser);
+  parse_hash(master.code_hash, parser);
+  td::parse(master.last_transaction_lt, parser);
+  parse_cell(master.code_cell, parser);
+  parse_cell(master.data_cell, parser);
+}
+
+template <class StorerT>
+void store(const NFTCollectionData &collection, StorerT &storer) {
+  td::store(collection.address, storer);
+  store_int(collection.next_item_index, storer);
+  store_optional(collection.owner_address, storer);
+  store_content(collection.collection_content, storer);
+  store_hash(collection.data_hash, storer);
+  store_hash(collection.code_hash, storer);
+  td::store(collection.last_transaction_lt, storer);
+  store_cell(collection.code_cell, storer);
+  store_cell(collection.data_cell, storer);
+}
+
+template <class ParserT>
+void parse(NFTCollectionData &collection, ParserT &parser) {
+  td::parse(collection.address, parser);
+  parse_int(collection.next_item_index, parser);
+  parse_optional(collection.owner_address, parser);
+  parse_content(collection.collection_content, parser);
+  parse_hash(collection.data_hash, parser);
+  parse_hash(collection.code_hash, parser);
+  td::parse(collection.last_transaction_lt, parser);
+  parse_cell(collection.code_cell, parser);
+  parse_cell(collection.data_cell, parser);
+}
+
+template <class StorerT>
+void store(const NFTItemData &item, StorerT &storer) {
+  td::store(item.address, storer);
+  td::store(item.init, storer);
+  store_int(item.index, storer);
+  td::store(item.collection_address, storer);
+  td::store(item.owner_address, storer);
+  store_content(item.content, storer);
+  td::store(item.last_transaction_lt, storer);
+  store_hash(item.code_hash, storer);
+  store_hash(item.data_hash, storer);
+}
+
+template <class ParserT>
+void parse(NFTItemData &item, ParserT &parser) {
+  td::parse(item.address, parser);
+  td::parse(item.init, parser);
+  parse_int(item.index, parser);
+  td::parse(item.collection_address, parser);
+  td::parse(item.owner_address, parser);
+  parse_content(item.content, parser);
+  td::parse(item.last_transaction_lt, parser);
+  parse_hash(item.code_hash, parser);
+  parse_hash(item.data_hash, parser);
+}
+
+td::Result<std::unique_ptr<EntityKvStore>> EntityKvStore::open(std::string path) {
+  auto db = td::RocksDb::open(path);
+  if (db.is_error()) {
+    return db.move_as_error_prefix(PSLICE() << "Error opening entity store " << path << ": ");
+  }
+  return std::unique_ptr<EntityKvStore>(new EntityKvStore(db.move_as_ok()));
+}
+
+template <class T>
+td::Status EntityKvStore::upsert_entity(td::Slice kind, const T &entity) {
+  auto key = PSTRING() << kind << ":" << entity.address;
+  std::string value;
+  TRY_RESULT(status, db_.get(key, value));
+  if (status == td::KeyValue::GetStatus::Ok) {
+    T stored;
+    if (td::unserialize(stored, value).is_ok() && stored.last_transaction_lt > entity.last_transaction_lt) {
+      return td::Status::OK();
+    }
+  }
+  return db_.set(key, td::serialize(entity));
+}
+
+template <class T>
+td::Result<std::vector<T>> EntityKvStore::get_entities(td::Slice kind, const std::vector<std::string> &addresses) {
+  std::vector<T> entities;
+  for (const auto &address : addresses) {
+    std::string value;
+    TRY_RESULT(status, db_.get(PSTRING() << kind << ":" << address, value));
+    if (status != td::KeyValue::GetStatus::Ok) {
+      continue;
+    }
+    T entity;
+    auto S = td::unserialize(entity, value);
+    if (S.is_error()) {
+      return td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Corrupted " << kind << " " << address << " in entity store: " << S);
+    }
+    entities.push_back(std::move(entity));
+  }
+  return entities;
+}
+
+td::Status EntityKvStore::upsert(const JettonWalletData &wallet) {
+  return upsert_entity("jetton_wallet", wallet);
+}
+
+td::Status EntityKvStore::upsert(const JettonMasterData &master) {
+  return upsert_entity("jetton_master", master);
+}
+
+td::Status EntityKvStore::upsert(const NFTCollectionData &collection) {
+  return upsert_entity("nft_collection", collection);
+}
+
+td::Status EntityKvStore::upsert(const NFTItemData &item) {
+  return upsert_entity("nft_item", item);
+}
+
+td::Result<std::vector<JettonWalletData>> EntityKvStore::get_jetton_wallets(const std::vector<std::string> &addresses) {
+  return get_entities<JettonWalletData>("jetton_wallet", addresses);
+}
+
+td::Result<std::vector<JettonMasterData>> EntityKvStore::get_jetton_masters(const std::vector<std::string> &addresses) {
+  return get_entities<JettonMasterData>("jetton_master", addresses);
+}
+
+td::Result<std::vector<NFTCollectionData>> EntityKvStore::get_nft_collections(const std::vector<std::string> &addresses) {
+  return get_entities<NFTCollectionData>("nft_collection", addresses);
+}
+
+td::Result<std::vector<NFTItemData>> EntityKvStore::get_nft_items(const std::vector<std::string> &addresses) {
+  return get_entities<NFTItemData>("nft_item", addresses);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "td/db/RocksDb.h"
+#include "IndexData.h"
+
+
+// Jetton and NFT entities of a sink without a database, kept in a local RocksDB. Keys are the entity kind and the
+// address, an upsert replaces the stored entity only if it is not older by last_transaction_lt, the same rule
+// EntityUpsertWriter applies in Postgres. Addresses without a stored entity are left out of the get results.
+class EntityKvStore {
+public:
+  static td::Result<std::unique_ptr<EntityKvStore>> open(std::string path);
+
+  td::Status upsert(const JettonWalletData &wallet);
+  td::Status upsert(const JettonMasterData &master);
+  td::Status upsert(const NFTCollectionData &collection);
+  td::Status upsert(const NFTItemData &item);
+
+  td::Result<std::vector<JettonWalletData>> get_jetton_wallets(const std::vector<std::string> &addresses);
+  td::Result<std::vector<JettonMasterData>> get_jetton_masters(const std::vector<std::string> &addresses);
+  td::Result<std::vector<NFTCollectionData>> get_nft_collections(const std::vector<std::string> &addresses);
+  td::Result<std::vector<NFTItemData>> get_nft_items(const std::vector<std::string> &addresses);
+
+private:
+  explicit EntityKvStore(td::RocksDb db) : db_(std::move(db)) {}
+
+  template <class T>
+  td::Status upsert_entity(td::Slice kind, const T &entity);
+  template <class T>
+  td::Result<std::vector<T>> get_entities(td::Slice kind, const std::vector<std::string> &addresses);
+
+  td::RocksDb db_;
+};
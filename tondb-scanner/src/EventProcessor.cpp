@@ -19,162 +19,205 @@ void EventProcessor::process(ParsedBlockPtr block, td::Promise<> &&promise) {
       promise.set_error(res.move_as_error_prefix("Failed to process account states for mc block " + std::to_string(block->blocks_[0].seqno) + ": "));
       return;
     }
-    std::vector<schema::Transaction> transactions;
-    for (const auto& block : block->blocks_) {
-      for (const auto& transaction : block.transactions) {
-        transactions.push_back(transaction);
-      }
-    }
-    td::actor::send_closure(SelfId, &EventProcessor::process_transactions, std::move(transactions), promise.wrap([block](std::vector<BlockchainEvent> events) {
+    td::actor::send_closure(SelfId, &EventProcessor::process_transactions, block, promise.wrap([block](std::vector<BlockchainEvent> events) {
       block->events_ = std::move(events);
       return td::Unit();
     }));
   });
-  process_states(block->account_states_, block->mc_block_, std::move(P));
+  process_states(block, std::move(P));
 }
 
-void EventProcessor::process_states(const std::vector<schema::AccountState>& account_states, const MasterchainBlockDataState& blocks_ds, td::Promise<td::Unit> &&promise) {
-  td::MultiPromise mp;
-  auto ig = mp.init_guard();
-  ig.add_promise(std::move(promise));
-  for (const auto& account_state : account_states) {
+template <>
+td::actor::ActorId<JettonMasterDetector> EventProcessor::detector<JettonMasterData>() const {
+  return jetton_master_detector_.get();
+}
+
+template <>
+td::actor::ActorId<JettonWalletDetector> EventProcessor::detector<JettonWalletData>() const {
+  return jetton_wallet_detector_.get();
+}
+
+template <>
+td::actor::ActorId<NFTCollectionDetector> EventProcessor::detector<NFTCollectionData>() const {
+  return nft_collection_detector_.get();
+}
+
+template <>
+td::actor::ActorId<NFTItemDetector> EventProcessor::detector<NFTItemData>() const {
+  return nft_item_detector_.get();
+}
+
+namespace {
+// wraps detector result: only db errors fail the block, any other error means the account doesn't have the interface
+template <class T>
+td::Promise<T> detection_promise(const char* interface_name, block::StdAddress address, td::Promise<td::Unit> promise) {
+  return td::PromiseCreator::lambda([interface_name, address, promise = std::move(promise)](td::Result<T> data) mutable {
+    if (data.is_error()) {
+      if (data.error().code() == ErrorCode::DB_ERROR) {
+        LOG(ERROR) << "Error inserting entity " << interface_name << " to db " << convert::to_raw_address(address) << ": " << data.error().message();
+        promise.set_error(data.move_as_error());
+        return;
+      }
+    } else {
+      LOG(DEBUG) << "Detected interface " << interface_name << " for " << convert::to_raw_address(address);
+    }
+    promise.set_value(td::Unit());
+  });
+}
+}
+
+// Router stage: every account is taken once per mc block (its latest state), the code hashes are classified 
+// by InterfaceManager in one request and each state is sent only to the detectors it may match.
+void EventProcessor::process_states(ParsedBlockPtr block, td::Promise<td::Unit> &&promise) {
+  const auto& account_states = block->account_states_;
+  std::unordered_map<AccountKey, size_t, AccountKeyHasher> latest_states;
+  for (size_t i = 0; i < account_states.size(); i++) {
+    const auto& account_state = account_states[i];
+    if (account_state.code.is_null() || account_state.data.is_null()) {
+      continue;
+    }
     auto raw_address = convert::to_raw_address(account_state.account);
     if (raw_address == "-1:5555555555555555555555555555555555555555555555555555555555555555" || 
         raw_address == "-1:3333333333333333333333333333333333333333333333333333333333333333") {
       continue;
     }
-    auto& address = account_state.account;
-    
-    auto code_cell = account_state.code;
-    auto data_cell = account_state.data; 
-    if (code_cell.is_null() || data_cell.is_null()) {
-      continue;
+    AccountKey key{account_state.account.workchain, account_state.account.addr};
+    auto it = latest_states.find(key);
+    if (it == latest_states.end()) {
+      latest_states.emplace(key, i);
+    } else if (account_states[it->second].last_trans_lt < account_state.last_trans_lt) {
+      it->second = i;
     }
+  }
+
+  std::vector<size_t> state_indices;
+  std::vector<vm::CellHash> code_hashes;
+  state_indices.reserve(latest_states.size());
+  code_hashes.reserve(latest_states.size());
+  for (const auto& [key, index] : latest_states) {
+    state_indices.push_back(index);
+    code_hashes.push_back(account_states[index].code->get_hash());
+  }
+  if (state_indices.empty()) {
+    promise.set_value(td::Unit());
+    return;
+  }
+
+  auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), block, state_indices = std::move(state_indices), promise = std::move(promise)](td::Result<std::vector<uint32_t>> R) mutable {
+    if (R.is_error()) {
+      promise.set_error(R.move_as_error_prefix("Failed to get code hash interfaces: "));
+      return;
+    }
+    td::actor::send_closure(SelfId, &EventProcessor::route_states, std::move(block), std::move(state_indices), R.move_as_ok(), std::move(promise));
+  });
+  td::actor::send_closure(interface_manager_, &InterfaceManager::get_candidate_interfaces, std::move(code_hashes), std::move(P));
+}
+
+void EventProcessor::route_states(ParsedBlockPtr block, std::vector<size_t> state_indices, std::vector<uint32_t> candidate_interfaces, td::Promise<td::Unit> &&promise) {
+  td::MultiPromise mp;
+  auto ig = mp.init_guard();
+  ig.add_promise(std::move(promise));
+  const auto& account_index = block->account_index_;
+  for (size_t i = 0; i < state_indices.size(); i++) {
+    const auto& account_state = block->account_states_[state_indices[i]];
+    const auto& address = account_state.account;
+    auto candidates = candidate_interfaces[i];
     auto last_tx_lt = account_state.last_trans_lt;
-    auto P1 = td::PromiseCreator::lambda([this, code_cell, address, promise = ig.get_promise()](td::Result<JettonMasterData> master_data) mutable {
-      if (master_data.is_error()) {
-        if (master_data.error().code() == ErrorCode::DB_ERROR) {
-          LOG(ERROR) << "Error inserting entity JETTON_MASTER to db " << convert::to_raw_address(address) << ": " << master_data.error().message();
-          promise.set_error(master_data.move_as_error());
-          return;
-        }
-      } else {
-        LOG(DEBUG) << "Detected interface JETTON_MASTER for " << convert::to_raw_address(address);
-      }
-      promise.set_value(td::Unit());
-    });
-    td::actor::send_closure(jetton_master_detector_, &JettonMasterDetector::detect, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(P1));
-
-    auto P2 = td::PromiseCreator::lambda([this, code_cell, address, promise = ig.get_promise()](td::Result<JettonWalletData> wallet_data) mutable {
-      if (wallet_data.is_error()) {
-        if (wallet_data.error().code() == ErrorCode::DB_ERROR) {
-          LOG(ERROR) << "Error inserting entity JETTON_WALLET to db " << convert::to_raw_address(address) << ": " << wallet_data.error().message();
-          promise.set_error(wallet_data.move_as_error());
-          return;
-        }
-      } else {
-        LOG(DEBUG) << "Detected interface JETTON_WALLET for " << convert::to_raw_address(address);
-      }
-      promise.set_value(td::Unit());
-    });
-    td::actor::send_closure(jetton_wallet_detector_, &JettonWalletDetector::detect, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(P2));
-
-    auto P3 = td::PromiseCreator::lambda([this, code_cell, address, promise = ig.get_promise()](td::Result<NFTCollectionData> nft_collection_data) mutable {
-      if (nft_collection_data.is_error()) {
-        if (nft_collection_data.error().code() == ErrorCode::DB_ERROR) {
-          LOG(ERROR) << "Error inserting entity NFT_COLLECTION to db " << convert::to_raw_address(address) << ": " << nft_collection_data.error().message();
-          promise.set_error(nft_collection_data.move_as_error());
-          return;
-        }
-      } else {
-        LOG(DEBUG) << "Detected interface NFT_COLLECTION for " << convert::to_raw_address(address);
-      }
-      promise.set_value(td::Unit());
-    });
-    td::actor::send_closure(nft_collection_detector_, &NFTCollectionDetector::detect, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(P3));
-
-    auto P4 = td::PromiseCreator::lambda([this, code_cell, address, promise = ig.get_promise()](td::Result<NFTItemData> nft_item_data) mutable {
-      if (nft_item_data.is_error()) {
-        if (nft_item_data.error().code() == ErrorCode::DB_ERROR) {
-          LOG(ERROR) << "Error inserting entity NFT_ITEM to db " << convert::to_raw_address(address) << ": " << nft_item_data.error().message();
-          promise.set_error(nft_item_data.move_as_error());
-          return;
-        }
-      } else {
-        LOG(DEBUG) << "Detected interface NFT_ITEM for " << convert::to_raw_address(address);
+
+    for_each_type(Interfaces{}, [&](auto interface_tag) {
+      using T = typename decltype(interface_tag)::type;
+      if (candidates & interface_bit(InterfaceTraits<T>::interface)) {
+        td::actor::send_closure(detector<T>(), &DetectorFor<T>::type::detect, address, account_state.code, account_state.data, last_tx_lt, account_index, 
+          detection_promise<T>(InterfaceTraits<T>::name, address, ig.get_promise()));
       }
-      promise.set_value(td::Unit());
     });
-    td::actor::send_closure(nft_item_detector_, &NFTItemDetector::detect, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(P4));
   }
 }
 
-std::mutex events_mutex;
-void EventProcessor::process_transactions(const std::vector<schema::Transaction>& transactions, td::Promise<std::vector<BlockchainEvent>> &&promise) {
-  LOG(DEBUG) << "Detecting tokens transactions " << transactions.size();
+namespace {
+// events parsed from a block together with the contracts that emitted them, one per emitting interface
+struct ParsedEvents {
+  std::vector<BlockchainEvent> events;
+  std::vector<block::StdAddress> emitters;
 
-  auto events = std::make_shared<std::vector<BlockchainEvent>>();
+  template <class T>
+  void add(td::Result<T> event, const schema::Transaction& tx) {
+    if (event.is_error()) {
+      LOG(DEBUG) << "Failed to parse event (tx hash " << tx.hash << "): " << event.error();
+      return;
+    }
+    events.push_back(event.move_as_ok());
+    emitters.push_back(tx.account);
+  }
+};
+}
 
-  auto P = td::PromiseCreator::lambda([SelfId=actor_id(this), events, promise = std::move(promise)](td::Result<td::Unit> res) mutable {
+// Events are decoded in a single pass right here, detectors are only asked once per block
+// whether the emitting contracts are known Jetton Wallets or NFT Items.
+void EventProcessor::process_transactions(ParsedBlockPtr block, td::Promise<std::vector<BlockchainEvent>> &&promise) {
+  auto parsed = std::make_shared<std::array<ParsedEvents, Interfaces::size>>();
+  size_t tx_count = 0;
+  size_t events_count = 0;
+  for (const auto& shard_block : block->blocks_) {
+    for (const auto& tx : shard_block.transactions) {
+      tx_count++;
+      if (!tx.in_msg || tx.in_msg.value().body.is_null()) {
+        // tx doesn't have in_msg, skipping
+        continue;
+      }
+      auto cs = vm::load_cell_slice_ref(tx.in_msg.value().body);
+      auto tag = tokens::gen::t_InternalMsgBody.check_tag(*cs);
+      for_each_type(Events{}, [&](auto event_tag) {
+        using E = typename decltype(event_tag)::type;
+        if (tag == EventTraits<E>::tag) {
+          (*parsed)[InterfaceTraits<typename EventTraits<E>::Emitter>::interface].add(parse_event<E>(tx, cs), tx);
+          events_count++;
+        }
+      });
+    }
+  }
+  LOG(DEBUG) << "Detecting tokens transactions " << tx_count << ", candidate events: " << events_count;
+
+  // every detector writes only its own slot, the slots are read after all of them are done
+  auto known = std::make_shared<std::array<std::vector<bool>, Interfaces::size>>();
+  auto P = td::PromiseCreator::lambda([parsed, known, events_count, promise = std::move(promise)](td::Result<td::Unit> res) mutable {
     if (res.is_error()) {
       promise.set_error(res.move_as_error_prefix("Failed to process events: "));
       return;
     }
-    promise.set_value(std::move(*events));
+    std::vector<BlockchainEvent> events;
+    events.reserve(events_count);
+    for (size_t slot = 0; slot < Interfaces::size; slot++) {
+      for (size_t i = 0; i < (*known)[slot].size(); i++) {
+        if ((*known)[slot][i]) {
+          events.push_back(std::move((*parsed)[slot].events[i]));
+        }
+      }
+    }
+    promise.set_value(std::move(events));
   });
 
   td::MultiPromise mp;
   auto ig = mp.init_guard();
   ig.add_promise(std::move(P));
 
-  for (auto& tx : transactions) {
-    if (!tx.in_msg || tx.in_msg.value().body.is_null()) {
-      // tx doesn't have in_msg, skipping
-      continue;
-    }
-
-    // template lambda to process td::Result<T> event
-    auto process = [events, &tx, &ig](auto&& event, td::Promise<> promise) mutable {
-      if (event.is_error()) {
-        LOG(DEBUG) << "Failed to parse event (tx hash " << tx.hash << "): " << event.error();
-        if (event.error().code() == ErrorCode::DB_ERROR) {
-          // we set promise to error only in case of db error
-          promise.set_error(event.move_as_error());
-          return;
-        }
-      } else {
-        LOG(DEBUG) << "Event: " << event.ok().transaction_hash;
-        std::lock_guard<std::mutex> guard(events_mutex);
-        events->push_back(event.move_as_ok());
+  for_each_type(Interfaces{}, [&](auto interface_tag) {
+    using T = typename decltype(interface_tag)::type;
+    if constexpr (InterfaceTraits<T>::emits_events) {
+      constexpr auto slot = InterfaceTraits<T>::interface;
+      auto& emitters = (*parsed)[slot].emitters;
+      if (emitters.empty()) {
+        return;
       }
-      promise.set_value(td::Unit());
-    };
-
-    auto cs = vm::load_cell_slice_ref(tx.in_msg.value().body);
-    switch (tokens::gen::t_InternalMsgBody.check_tag(*cs)) {
-      case tokens::gen::InternalMsgBody::transfer_jetton: 
-        td::actor::send_closure(jetton_wallet_detector_, &JettonWalletDetector::parse_transfer, tx, cs, 
-          td::PromiseCreator::lambda([process, promise = ig.get_promise()](td::Result<JettonTransfer> transfer) mutable { 
-            process(std::move(transfer), std::move(promise));
-          })
-        );
-        break;
-      case tokens::gen::InternalMsgBody::burn: 
-        td::actor::send_closure(jetton_wallet_detector_, &JettonWalletDetector::parse_burn, tx, cs, 
-          td::PromiseCreator::lambda([process, promise = ig.get_promise()](td::Result<JettonBurn> burn) mutable { 
-            process(std::move(burn), std::move(promise));
-          })
-        );
-        break;
-      case tokens::gen::InternalMsgBody::transfer_nft: 
-        td::actor::send_closure(nft_item_detector_, &NFTItemDetector::parse_transfer, tx, cs, 
-          td::PromiseCreator::lambda([process, promise = ig.get_promise()](td::Result<NFTTransfer> transfer) mutable { 
-            process(std::move(transfer), std::move(promise));
-          })
-        );
-        break;
-      default:
-        continue;
+      td::actor::send_closure(detector<T>(), &DetectorFor<T>::type::check_known, std::move(emitters), 
+        td::PromiseCreator::lambda([known, promise = ig.get_promise()](td::Result<std::vector<bool>> R) mutable {
+          if (R.is_error()) {
+            promise.set_error(R.move_as_error());
+            return;
+          }
+          (*known)[slot] = R.move_as_ok();
+          promise.set_value(td::Unit());
+        }));
     }
-  }
-}
\ No newline at end of file
+  });
+}
@@ -5,6 +5,8 @@
 class EventProcessor: public td::actor::Actor {
 private:
   td::actor::ActorOwn<InterfaceManager> interface_manager_;
+  // masters and collections of the same standard share code
+  std::shared_ptr<CodeCellCache> code_cells_;
   td::actor::ActorOwn<JettonMasterDetector> jetton_master_detector_;
   td::actor::ActorOwn<JettonWalletDetector> jetton_wallet_detector_;
   td::actor::ActorOwn<NFTCollectionDetector> nft_collection_detector_;
@@ -12,15 +14,20 @@ private:
 public:
   EventProcessor(td::actor::ActorId<InsertManagerInterface> insert_manager): 
     interface_manager_(td::actor::create_actor<InterfaceManager>("interface_manager", insert_manager)),
-    jetton_master_detector_(td::actor::create_actor<JettonMasterDetector>("jetton_master_detector", interface_manager_.get(), insert_manager)), 
+    code_cells_(std::make_shared<CodeCellCache>()),
+    jetton_master_detector_(td::actor::create_actor<JettonMasterDetector>("jetton_master_detector", interface_manager_.get(), insert_manager, code_cells_)), 
     jetton_wallet_detector_(td::actor::create_actor<JettonWalletDetector>("jetton_wallet_detector", jetton_master_detector_.get(), interface_manager_.get(), insert_manager)),
-    nft_collection_detector_(td::actor::create_actor<NFTCollectionDetector>("nft_collection_detector", interface_manager_.get(), insert_manager)),
+    nft_collection_detector_(td::actor::create_actor<NFTCollectionDetector>("nft_collection_detector", interface_manager_.get(), insert_manager, code_cells_)),
     nft_item_detector_(td::actor::create_actor<NFTItemDetector>("nft_item_detector", interface_manager_.get(), insert_manager, nft_collection_detector_.get())) {
   }
 
   void process(ParsedBlockPtr block, td::Promise<> &&promise);
 
 private:
-  void process_states(const std::vector<schema::AccountState>& account_states, const MasterchainBlockDataState& blocks_ds, td::Promise<td::Unit> &&promise);
-  void process_transactions(const std::vector<schema::Transaction>& transactions, td::Promise<std::vector<BlockchainEvent>> &&promise);
+  template <class T>
+  td::actor::ActorId<typename DetectorFor<T>::type> detector() const;
+
+  void process_states(ParsedBlockPtr block, td::Promise<td::Unit> &&promise);
+  void route_states(ParsedBlockPtr block, std::vector<size_t> state_indices, std::vector<uint32_t> candidate_interfaces, td::Promise<td::Unit> &&promise);
+  void process_transactions(ParsedBlockPtr block, td::Promise<std::vector<BlockchainEvent>> &&promise);
 };
\ No newline at end of file
@@ -225,8 +225,8 @@ struct Block {
   int32_t workchain;
   int64_t shard;
   int32_t seqno;
-  std::string root_hash;
-  std::string file_hash;
+  td::Bits256 root_hash;
+  td::Bits256 file_hash;
 
   td::optional<int32_t> mc_block_workchain;
   td::optional<int64_t> mc_block_shard;
@@ -250,8 +250,8 @@ struct Block {
   int32_t prev_key_block_seqno;
   int32_t vert_seqno;
   td::optional<int32_t> master_ref_seqno;
-  std::string rand_seed;
-  std::string created_by;
+  td::Bits256 rand_seed;
+  td::Bits256 created_by;
 
   std::vector<Transaction> transactions;
 };
@@ -261,11 +261,11 @@ struct AccountState {
   block::StdAddress account;
   uint64_t balance;
   std::string account_status; // "uninit", "frozen", "active"
-  td::optional<std::string> frozen_hash;
+  td::optional<td::Bits256> frozen_hash;
   td::Ref<vm::Cell> code;
-  td::optional<std::string> code_hash;
+  td::optional<td::Bits256> code_hash;
   td::Ref<vm::Cell> data;
-  td::optional<std::string> data_hash;
+  td::optional<td::Bits256> data_hash;
   uint64_t last_trans_lt;
 };
 
@@ -281,8 +281,8 @@ struct JettonMasterData {
   vm::CellHash data_hash;
   vm::CellHash code_hash;
   uint64_t last_transaction_lt;
-  std::string code_boc;
-  std::string data_boc;
+  td::Ref<vm::Cell> code_cell;
+  td::Ref<vm::Cell> data_cell;
 };
 
 struct JettonWalletData {
@@ -326,8 +326,8 @@ struct NFTCollectionData {
   vm::CellHash data_hash;
   vm::CellHash code_hash;
   uint64_t last_transaction_lt;
-  std::string code_boc;
-  std::string data_boc;
+  td::Ref<vm::Cell> code_cell;
+  td::Ref<vm::Cell> data_cell;
 };
 
 struct NFTItemData {
@@ -364,13 +364,41 @@ using BlockchainEvent = std::variant<JettonTransfer,
                                      JettonBurn,
                                      NFTTransfer>;
 
+class ShardAccountIndex;
+using ShardAccountIndexPtr = std::shared_ptr<const ShardAccountIndex>;
+
 struct ParsedBlock {
   MasterchainBlockDataState mc_block_;
+  // lookup of any account in the shard states of this mc block, shared by the interface detectors
+  ShardAccountIndexPtr account_index_;
 
   std::vector<schema::Block> blocks_;
   std::vector<schema::AccountState> account_states_;
 
   std::vector<BlockchainEvent> events_;
+
+  // Rough size of the rows this mc block produces, used to bound queues and size insert batches
+  size_t estimated_size() const {
+    auto message_bytes = [](const schema::Message& msg) {
+      return 250 + msg.body_boc.size() + (msg.init_state_boc ? msg.init_state_boc.value().size() : 0);
+    };
+    size_t bytes = 0;
+    for (const auto& blk : blocks_) {
+      bytes += 300;
+      for (const auto& transaction : blk.transactions) {
+        bytes += 500;
+        if (transaction.in_msg) {
+          bytes += message_bytes(transaction.in_msg.value());
+        }
+        for (const auto& msg : transaction.out_msgs) {
+          bytes += message_bytes(msg);
+        }
+      }
+    }
+    bytes += account_states_.size() * 200;
+    bytes += events_.size() * 400;
+    return bytes;
+  }
   
   template <class T>
   std::vector<T> get_events() {
@@ -0,0 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "td/actor/actor.h"
+#include "td/utils/Time.h"
+#include "IndexData.h"
+
+
+// Parsed blocks of an insert batch, they are kept until it commits so a failed batch is retried without refetching
+struct InsertBatch {
+  std::vector<ParsedBlockPtr> blocks;
+  std::vector<td::Promise<td::Unit>> promises;
+  size_t bytes{0};
+  int attempt{0};
+  // the batch is not retried before this time
+  td::Timestamp not_before;
+};
+
+// Delay before retry `attempt` (starting from 1): doubles from min_delay and is capped at max_delay
+inline double insert_retry_delay(int attempt, double min_delay, double max_delay) {
+  if (attempt <= 1) {
+    return std::min(min_delay, max_delay);
+  }
+  // the cap is reached long before the shift overflows
+  return std::min(max_delay, min_delay * static_cast<double>(1ull << std::min(attempt - 1, 62)));
+}
+
+// Splits a batch of two or more mc blocks in halves keeping the block order, the first half is the smaller one
+inline std::pair<InsertBatch, InsertBatch> split_insert_batch(InsertBatch batch) {
+  auto half = batch.blocks.size() / 2;
+  InsertBatch first;
+  InsertBatch second;
+  for (size_t i = 0; i < batch.blocks.size(); i++) {
+    auto &part = i < half ? first : second;
+    part.bytes += batch.blocks[i]->estimated_size();
+    part.blocks.push_back(std::move(batch.blocks[i]));
+    part.promises.push_back(std::move(batch.promises[i]));
+  }
+  return {std::move(first), std::move(second)};
+}
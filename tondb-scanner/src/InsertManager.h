@@ -1,4 +1,5 @@
 #pragma once
+#include <limits>
 #include "td/actor/actor.h"
 #include "IndexData.h"
 
@@ -9,9 +10,12 @@ enum ErrorCode {
   GET_METHOD_WRONG_RESULT = 503,
   ADDITIONAL_CHECKS_FAILED = 504,
   EVENT_PARSING_ERROR = 505,
+  // the database rejected the rows themselves, retrying the same rows fails again
+  DB_DATA_ERROR = 506,
 
   CODE_HASH_NOT_FOUND = 600,
-  ENTITY_NOT_FOUND = 601
+  ENTITY_NOT_FOUND = 601,
+  DETECTION_SUPERSEDED = 602
 };
 
 class InsertManagerInterface: public td::actor::Actor {
@@ -19,23 +23,30 @@ public:
   virtual void insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) = 0;
 
   virtual void get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) = 0;
+  // all seqnos up to the newest known mc seqno are inserted
+  virtual void tip_reached() {}
+  // estimated bytes of parsed blocks the manager accepts before its queue is full, negative when over the limit
+  virtual void get_insert_credit(td::Promise<td::int64> promise) {
+    promise.set_value(std::numeric_limits<td::int64>::max());
+  }
 
   virtual void upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) = 0;
-  virtual void get_jetton_wallet(std::string address, td::Promise<JettonWalletData> promise) = 0;
+  virtual void get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) = 0;
 
   virtual void upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) = 0;
-  virtual void get_jetton_master(std::string address, td::Promise<JettonMasterData> promise) = 0;
+  virtual void get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) = 0;
 
   virtual void upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) = 0;
-  virtual void get_nft_collection(std::string address, td::Promise<NFTCollectionData> promise) = 0;
+  virtual void get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) = 0;
 
   virtual void upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) = 0;
-  virtual void get_nft_item(std::string address, td::Promise<NFTItemData> promise) = 0;
+  virtual void get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) = 0;
 
   // helper template functions
   template <class T>
   void upsert_entity(T entity, td::Promise<td::Unit> promise);
 
+  // missing addresses are omitted from the result
   template <class T>
-  void get_entity(std::string address, td::Promise<T> promise);
+  void get_entities(std::vector<std::string> addresses, td::Promise<std::vector<T>> promise);
 };
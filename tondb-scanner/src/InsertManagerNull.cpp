@@ -0,0 +1,180 @@
+#include <algorithm>
+#include "td/utils/Time.h"
+#include "InsertManagerNull.h"
+#include "InsertManagerPostgres.h"
+
+
+namespace {
+
+// keeps the entity unless the stored one is newer, as EntityUpsertWriter does
+template <class T>
+void upsert_entity(LruCache<std::string, T> &entities, T entity) {
+  auto stored = entities.get(entity.address);
+  if (stored && stored->last_transaction_lt > entity.last_transaction_lt) {
+    return;
+  }
+  auto address = entity.address;
+  entities.put(address, std::move(entity));
+}
+
+template <class T>
+std::vector<T> get_entities(LruCache<std::string, T> &entities, const std::vector<std::string> &addresses) {
+  std::vector<T> result;
+  for (const auto &address : addresses) {
+    auto stored = entities.get(address);
+    if (stored) {
+      result.push_back(*stored);
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+void InsertManagerNull::start_up() {
+  LOG(INFO) << "Null sink, parsed blocks are counted and discarded" << (options_.encode_rows ? " after encoding their rows" : "");
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+void InsertManagerNull::insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) {
+  if (!first_insert_at_) {
+    first_insert_at_ = td::Timestamp::now();
+    last_report_at_ = first_insert_at_;
+    next_report_ = td::Timestamp::in(10.0);
+  }
+  total_.mc_blocks++;
+  total_.blocks += block_ds->blocks_.size();
+  for (const auto &block : block_ds->blocks_) {
+    total_.transactions += block.transactions.size();
+    for (const auto &transaction : block.transactions) {
+      total_.messages += transaction.out_msgs.size() + (transaction.in_msg ? 1 : 0);
+    }
+  }
+  total_.account_states += block_ds->account_states_.size();
+  total_.events += block_ds->events_.size();
+  if (options_.encode_rows) {
+    auto start = td::Time::now();
+    total_.bytes += encode_rows(*block_ds);
+    encode_time_ += td::Time::now() - start;
+  } else {
+    total_.bytes += block_ds->estimated_size();
+  }
+  promise.set_value(td::Unit());
+}
+
+// Rows are built as InsertBatchMcSeqnos builds them, without the partition key column. Messages aren't deduplicated
+// within the batch as there, so a message seen by two transactions of the block is encoded twice.
+size_t InsertManagerNull::encode_rows(const ParsedBlock &block) {
+  size_t bytes = 0;
+  auto append = [&](const PgRow &row) {
+    encode_buffer_.clear();
+    append_copy_row(encode_buffer_, row.values());
+    bytes += encode_buffer_.size();
+  };
+  auto key_format = options_.key_format;
+  for (const auto &blk : block.blocks_) {
+    append(InsertBatchMcSeqnos::block_row(key_format, blk, std::nullopt));
+    for (const auto &transaction : blk.transactions) {
+      append(InsertBatchMcSeqnos::transaction_row(key_format, blk, transaction, std::nullopt));
+      if (transaction.in_msg) {
+        append(InsertBatchMcSeqnos::message_row(key_format, transaction.in_msg.value()));
+      }
+      for (const auto &msg : transaction.out_msgs) {
+        append(InsertBatchMcSeqnos::message_row(key_format, msg));
+      }
+    }
+  }
+  for (const auto &account_state : block.account_states_) {
+    append(InsertBatchMcSeqnos::account_state_row(key_format, account_state, std::nullopt));
+  }
+  return bytes;
+}
+
+void InsertManagerNull::report() {
+  auto now = td::Timestamp::now();
+  auto rates = [](const Counters &c, double seconds) -> std::string {
+    seconds = std::max(seconds, 1e-3);
+    return PSTRING() << static_cast<size_t>(c.mc_blocks / seconds) << " mc blocks/s, "
+                     << static_cast<size_t>(c.blocks / seconds) << " blocks/s, "
+                     << static_cast<size_t>(c.transactions / seconds) << " tx/s, "
+                     << static_cast<size_t>(c.messages / seconds) << " msgs/s, "
+                     << static_cast<size_t>(c.events / seconds) << " events/s, "
+                     << static_cast<size_t>(c.bytes / seconds) / (1 << 20) << "MB/s";
+  };
+  Counters interval;
+  interval.mc_blocks = total_.mc_blocks - last_.mc_blocks;
+  interval.blocks = total_.blocks - last_.blocks;
+  interval.transactions = total_.transactions - last_.transactions;
+  interval.messages = total_.messages - last_.messages;
+  interval.account_states = total_.account_states - last_.account_states;
+  interval.events = total_.events - last_.events;
+  interval.bytes = total_.bytes - last_.bytes;
+
+  LOG(INFO) << "Null sink: " << total_.mc_blocks << " mc blocks, " << total_.blocks << " blocks, "
+            << total_.transactions << " tx, " << total_.messages << " msgs, " << total_.account_states
+            << " account states, " << total_.events << " events, " << total_.bytes / (1 << 20) << "MB"
+            << (options_.encode_rows ? " encoded" : " estimated");
+  LOG(INFO) << "Null sink since first insert: " << rates(total_, now.at() - first_insert_at_.at());
+  LOG(INFO) << "Null sink last interval: " << rates(interval, now.at() - last_report_at_.at());
+  if (options_.encode_rows && total_.mc_blocks) {
+    LOG(INFO) << "Null sink row encoding: " << encode_time_ << "s total, avg "
+              << encode_time_ / total_.mc_blocks * 1000 << "ms per mc block";
+  }
+  last_ = total_;
+  last_report_at_ = now;
+}
+
+void InsertManagerNull::alarm() {
+  if (next_report_ && next_report_.is_in_past()) {
+    report();
+    next_report_ = td::Timestamp::in(10.0);
+  }
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+void InsertManagerNull::get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) {
+  promise.set_value(std::vector<std::uint32_t>());
+}
+
+void InsertManagerNull::tip_reached() {
+  if (first_insert_at_) {
+    LOG(INFO) << "Null sink reached the tip";
+    report();
+  }
+}
+
+void InsertManagerNull::upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) {
+  upsert_entity(jetton_wallets_, std::move(jetton_wallet));
+  promise.set_value(td::Unit());
+}
+
+void InsertManagerNull::get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) {
+  promise.set_value(get_entities(jetton_wallets_, addresses));
+}
+
+void InsertManagerNull::upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) {
+  upsert_entity(jetton_masters_, std::move(jetton_master));
+  promise.set_value(td::Unit());
+}
+
+void InsertManagerNull::get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) {
+  promise.set_value(get_entities(jetton_masters_, addresses));
+}
+
+void InsertManagerNull::upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) {
+  upsert_entity(nft_collections_, std::move(nft_collection));
+  promise.set_value(td::Unit());
+}
+
+void InsertManagerNull::get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) {
+  promise.set_value(get_entities(nft_collections_, addresses));
+}
+
+void InsertManagerNull::upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) {
+  upsert_entity(nft_items_, std::move(nft_item));
+  promise.set_value(td::Unit());
+}
+
+void InsertManagerNull::get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) {
+  promise.set_value(get_entities(nft_items_, addresses));
+}
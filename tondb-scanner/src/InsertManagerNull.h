@@ -0,0 +1,74 @@
+#pragma once
+#include "InsertManager.h"
+#include "PgTableWriter.h"
+#include "LruCache.h"
+
+
+// Discards every inserted ParsedBlock and only counts it, for measuring how fast the scanner fetches, parses and
+// detects without any database in the way. Inserts resolve at once and the insert credit is unlimited, so the
+// scanner runs as fast as its own stages allow. With encode_rows the blocks, transactions, messages and account
+// states rows are also built and encoded as COPY lines, the work the Postgres sink does before anything reaches the
+// server. Throughput since the first insert and over the last report interval is logged every 10 seconds. The latest
+// jetton and NFT entities are kept in bounded LRU caches, so the detectors see mostly the same entities as with a
+// database and a full chain replay doesn't grow the memory without limit.
+class InsertManagerNull: public InsertManagerInterface {
+public:
+  struct Options {
+    bool encode_rows{false};
+    PgKeyFormat key_format{PgKeyFormat::Text};
+    // per entity type
+    size_t max_cached_entities{1 << 20};
+  };
+
+  explicit InsertManagerNull(Options options)
+      : options_(options)
+      , jetton_wallets_(options.max_cached_entities)
+      , jetton_masters_(options.max_cached_entities)
+      , nft_collections_(options.max_cached_entities)
+      , nft_items_(options.max_cached_entities) {}
+
+  void start_up() override;
+  void alarm() override;
+
+  void insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) override;
+  void get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) override;
+  void tip_reached() override;
+  void upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) override;
+  void get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) override;
+  void upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) override;
+  void get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) override;
+  void upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) override;
+  void get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) override;
+  void upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) override;
+  void get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) override;
+
+private:
+  struct Counters {
+    size_t mc_blocks{0};
+    size_t blocks{0};
+    size_t transactions{0};
+    size_t messages{0};
+    size_t account_states{0};
+    size_t events{0};
+    size_t bytes{0};
+  };
+
+  Options options_;
+  Counters total_;
+  // totals at the previous report
+  Counters last_;
+  td::Timestamp first_insert_at_;
+  td::Timestamp last_report_at_;
+  td::Timestamp next_report_;
+  double encode_time_{0};
+  // reused between blocks to keep allocations out of the measured time
+  std::string encode_buffer_;
+
+  LruCache<std::string, JettonWalletData> jetton_wallets_;
+  LruCache<std::string, JettonMasterData> jetton_masters_;
+  LruCache<std::string, NFTCollectionData> nft_collections_;
+  LruCache<std::string, NFTItemData> nft_items_;
+
+  size_t encode_rows(const ParsedBlock &block);
+  void report();
+};
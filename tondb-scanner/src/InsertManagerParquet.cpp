@@ -0,0 +1,611 @@
+#include <sstream>
+#include "td/utils/filesystem.h"
+#include "td/utils/misc.h"
+#include "td/utils/port/Clocks.h"
+#include "td/utils/port/FileFd.h"
+#include "td/utils/port/path.h"
+#include "td/utils/port/Stat.h"
+#include "InsertManagerParquet.h"
+#include "convert-utils.h"
+
+
+namespace {
+
+constexpr size_t row_group_rows = 1 << 16;
+
+std::shared_ptr<arrow::DataType> hash_type() {
+  return arrow::fixed_size_binary(32);
+}
+
+// addresses, statuses and other strings with few distinct values
+std::shared_ptr<arrow::DataType> dictionary_type() {
+  return arrow::dictionary(arrow::int32(), arrow::utf8());
+}
+
+std::shared_ptr<arrow::DataType> opcode_type() {
+  return arrow::dictionary(arrow::int32(), arrow::int32());
+}
+
+const std::map<std::string, std::vector<ParquetColumn>> &parquet_tables() {
+  static const std::map<std::string, std::vector<ParquetColumn>> tables = {
+    {"blocks", {
+      {"mc_seqno", arrow::uint32()}, {"workchain", arrow::int32()}, {"shard", arrow::int64()}, {"seqno", arrow::int32()},
+      {"root_hash", hash_type()}, {"file_hash", hash_type()}, {"mc_block_workchain", arrow::int32()},
+      {"mc_block_shard", arrow::int64()}, {"mc_block_seqno", arrow::int32()}, {"global_id", arrow::int32()},
+      {"version", arrow::int32()}, {"after_merge", arrow::boolean()}, {"before_split", arrow::boolean()},
+      {"after_split", arrow::boolean()}, {"want_split", arrow::boolean()}, {"key_block", arrow::boolean()},
+      {"vert_seqno_incr", arrow::boolean()}, {"flags", arrow::int32()}, {"gen_utime", arrow::int32()},
+      {"start_lt", arrow::uint64()}, {"end_lt", arrow::uint64()}, {"validator_list_hash_short", arrow::int32()},
+      {"gen_catchain_seqno", arrow::int32()}, {"min_ref_mc_seqno", arrow::int32()}, {"prev_key_block_seqno", arrow::int32()},
+      {"vert_seqno", arrow::int32()}, {"master_ref_seqno", arrow::int32()}, {"rand_seed", hash_type()},
+      {"created_by", hash_type()}, {"tx_count", arrow::uint64()}}},
+    {"transactions", {
+      {"mc_seqno", arrow::uint32()}, {"block_workchain", arrow::int32()}, {"block_shard", arrow::int64()},
+      {"block_seqno", arrow::int32()}, {"account", dictionary_type()}, {"hash", hash_type()}, {"lt", arrow::uint64()},
+      {"prev_trans_hash", hash_type()}, {"prev_trans_lt", arrow::uint64()}, {"now", arrow::uint32()},
+      {"orig_status", dictionary_type()}, {"end_status", dictionary_type()}, {"total_fees", arrow::uint64()},
+      {"account_state_hash_before", hash_type()}, {"account_state_hash_after", hash_type()},
+      {"description_type", dictionary_type()}}},
+    // one row per message of a transaction, transaction_messages of the Postgres schema folded in
+    {"messages", {
+      {"mc_seqno", arrow::uint32()}, {"transaction_hash", hash_type()}, {"direction", dictionary_type()},
+      {"hash", hash_type()}, {"source", dictionary_type()}, {"destination", dictionary_type()}, {"value", arrow::uint64()},
+      {"fwd_fee", arrow::uint64()}, {"ihr_fee", arrow::uint64()}, {"created_lt", arrow::uint64()},
+      {"created_at", arrow::uint32()}, {"opcode", opcode_type()}, {"ihr_disabled", arrow::boolean()},
+      {"bounce", arrow::boolean()}, {"bounced", arrow::boolean()}, {"import_fee", arrow::uint64()},
+      {"body_hash", hash_type()}, {"body", arrow::utf8()}, {"init_state_hash", hash_type()}, {"init_state", arrow::utf8()}}},
+    {"account_states", {
+      {"mc_seqno", arrow::uint32()}, {"hash", hash_type()}, {"account", dictionary_type()}, {"balance", arrow::uint64()},
+      {"account_status", dictionary_type()}, {"frozen_hash", hash_type()}, {"code_hash", hash_type()},
+      {"data_hash", hash_type()}, {"last_trans_lt", arrow::uint64()}}},
+    {"jetton_transfers", {
+      {"mc_seqno", arrow::uint32()}, {"transaction_hash", hash_type()}, {"query_id", arrow::uint64()},
+      {"amount", arrow::utf8()}, {"source", dictionary_type()}, {"destination", dictionary_type()},
+      {"jetton_wallet_address", dictionary_type()}, {"response_destination", dictionary_type()},
+      {"custom_payload", arrow::utf8()}, {"forward_ton_amount", arrow::utf8()}, {"forward_payload", arrow::utf8()}}},
+    {"jetton_burns", {
+      {"mc_seqno", arrow::uint32()}, {"transaction_hash", hash_type()}, {"query_id", arrow::uint64()},
+      {"owner", dictionary_type()}, {"jetton_wallet_address", dictionary_type()}, {"amount", arrow::utf8()},
+      {"response_destination", dictionary_type()}, {"custom_payload", arrow::utf8()}}},
+    {"nft_transfers", {
+      {"mc_seqno", arrow::uint32()}, {"transaction_hash", hash_type()}, {"query_id", arrow::uint64()},
+      {"nft_item_address", dictionary_type()}, {"old_owner", dictionary_type()}, {"new_owner", dictionary_type()},
+      {"response_destination", dictionary_type()}, {"custom_payload", arrow::utf8()}, {"forward_amount", arrow::utf8()},
+      {"forward_payload", arrow::utf8()}}},
+  };
+  return tables;
+}
+
+std::string account_status_name(schema::AccountStatus status) {
+  switch (status) {
+    case schema::AccountStatus::uninit: return "uninit";
+    case schema::AccountStatus::frozen: return "frozen";
+    case schema::AccountStatus::active: return "active";
+    case schema::AccountStatus::nonexist: return "nonexist";
+  }
+  return "unknown";
+}
+
+std::string description_type_name(const schema::TransactionDescr &description) {
+  static const char *names[] = {"ord", "storage", "tick_tock", "split_prepare", "split_install", "merge_prepare", "merge_install"};
+  return names[description.index()];
+}
+
+td::optional<std::string> to_dec_string(const td::RefInt256 &value) {
+  if (value.is_null()) {
+    return {};
+  }
+  return value->to_dec_string();
+}
+
+td::optional<std::string> to_boc(const td::Ref<vm::Cell> &cell) {
+  auto boc = convert::to_bytes(cell);
+  return boc.is_ok() ? boc.move_as_ok() : td::optional<std::string>{};
+}
+
+// mc seqnos as sorted ranges, "10-12,15"
+std::string format_seqnos(const std::set<uint32_t> &seqnos) {
+  std::ostringstream out;
+  for (auto it = seqnos.begin(); it != seqnos.end();) {
+    auto first = *it;
+    auto last = first;
+    while (++it != seqnos.end() && *it == last + 1) {
+      last = *it;
+    }
+    if (out.tellp() > 0) {
+      out << ",";
+    }
+    out << first;
+    if (last != first) {
+      out << "-" << last;
+    }
+  }
+  return out.str();
+}
+
+td::Status parse_seqnos(td::Slice ranges, std::set<uint32_t> &seqnos) {
+  for (auto range : td::full_split(ranges, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    auto bounds = td::split(range, '-');
+    TRY_RESULT(first, td::to_integer_safe<uint32_t>(bounds.first));
+    auto last = first;
+    if (!bounds.second.empty()) {
+      TRY_RESULT_ASSIGN(last, td::to_integer_safe<uint32_t>(bounds.second));
+    }
+    if (first > last) {
+      return td::Status::Error(PSLICE() << "Bad mc seqno range " << range);
+    }
+    // a 64 bit counter, the loop has to end after last == UINT32_MAX too
+    for (uint64_t seqno = first; seqno <= last; seqno++) {
+      seqnos.insert(static_cast<uint32_t>(seqno));
+    }
+  }
+  return td::Status::OK();
+}
+
+// a segment file is written as <dir>/.<table>-<segment id>.parquet.tmp and published as
+// <dir>/<table>-<first>-<last>-<segment id>.parquet
+td::Result<std::string> tmp_path_of(const std::string &path) {
+  auto slash = path.rfind('/');
+  auto name_start = slash == std::string::npos ? 0 : slash + 1;
+  auto id_start = path.rfind('-');
+  auto suffix = path.rfind(".parquet");
+  auto table_end = path.find('-', name_start);
+  if (id_start == std::string::npos || suffix == std::string::npos || table_end == std::string::npos
+      || id_start < name_start || suffix < id_start) {
+    return td::Status::Error(PSLICE() << "Bad Parquet file name " << path);
+  }
+  return PSTRING() << path.substr(0, name_start) << "." << path.substr(name_start, table_end - name_start) << "-"
+                   << path.substr(id_start + 1, suffix - id_start - 1) << ".parquet.tmp";
+}
+
+bool is_tmp_file(td::Slice name) {
+  auto slash = name.rfind('/');
+  auto base = slash == static_cast<size_t>(-1) ? name : name.substr(slash + 1);
+  return td::begins_with(base, ".") && td::ends_with(base, ".parquet.tmp");
+}
+
+}  // namespace
+
+td::Result<arrow::Compression::type> InsertManagerParquet::parse_compression(td::Slice name) {
+  auto type = arrow::util::Codec::GetCompressionType(name.str());
+  if (!type.ok()) {
+    return to_td_status(type.status());
+  }
+  if (!arrow::util::Codec::IsAvailable(*type)) {
+    return td::Status::Error(PSLICE() << "compression " << name << " is not available in this Arrow build");
+  }
+  return *type;
+}
+
+void InsertManagerParquet::start_up() {
+  auto S = init();
+  if (S.is_error()) {
+    LOG(FATAL) << "Failed to start Parquet sink in " << options_.directory << ": " << S;
+  }
+  next_segment_id_ = static_cast<int64_t>(td::Clocks::system() * 1000);
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+td::Status InsertManagerParquet::init() {
+  TRY_STATUS(td::mkpath(options_.directory + "/"));
+  properties_ = parquet::WriterProperties::Builder().compression(options_.compression)->build();
+  TRY_RESULT_ASSIGN(entities_, EntityKvStore::open(options_.directory + "/entities"));
+  TRY_STATUS(load_manifest());
+  return remove_tmp_files();
+}
+
+// manifest.tsv has a header line and one line per published file: table, partition start, path relative to the
+// directory, row count and the mc seqnos of its segment
+td::Status InsertManagerParquet::load_manifest() {
+  auto content = td::read_file_str(options_.directory + "/manifest.tsv");
+  if (content.is_error()) {
+    // no segment was published yet
+    return td::Status::OK();
+  }
+  auto lines = td::full_split(content.ok(), '\n');
+  for (size_t i = 1; i < lines.size(); i++) {
+    if (lines[i].empty()) {
+      continue;
+    }
+    auto fields = td::full_split(lines[i], '\t');
+    if (fields.size() != 5) {
+      return td::Status::Error(PSLICE() << "Bad manifest line: " << lines[i]);
+    }
+    TRY_STATUS(parse_seqnos(fields[4], existing_mc_seqnos_));
+    TRY_STATUS(finish_rename(fields[2].str()));
+    manifest_.push_back(lines[i].str());
+  }
+  LOG(INFO) << "Parquet manifest lists " << manifest_.size() << " files of " << existing_mc_seqnos_.size() << " mc seqnos";
+  return td::Status::OK();
+}
+
+// a file listed in the manifest may still have its temporary name if the process stopped right after the manifest
+// was replaced
+td::Status InsertManagerParquet::finish_rename(const std::string &file) {
+  auto path = options_.directory + "/" + file;
+  if (td::stat(path).is_ok()) {
+    return td::Status::OK();
+  }
+  TRY_RESULT(tmp_path, tmp_path_of(path));
+  if (td::stat(tmp_path).is_error()) {
+    return td::Status::Error(PSLICE() << "Parquet file " << file << " listed in the manifest is missing");
+  }
+  LOG(WARNING) << "Renaming " << tmp_path << " listed in the Parquet manifest to its final name";
+  return td::rename(tmp_path, path);
+}
+
+// temporary files left now belong to segments that were open at a stop or failed to publish, their mc seqnos are
+// not in the manifest and get rescanned
+td::Status InsertManagerParquet::remove_tmp_files() {
+  std::vector<std::string> tmp_files;
+  TRY_STATUS(td::walk_path(options_.directory, [&](td::CSlice name, td::WalkPath::Type type) {
+    if (type == td::WalkPath::Type::RegularFile && is_tmp_file(name)) {
+      tmp_files.push_back(name.str());
+    }
+    return td::WalkPath::Action::Continue;
+  }));
+  for (const auto &path : tmp_files) {
+    LOG(INFO) << "Removing unpublished Parquet file " << path;
+    TRY_STATUS(td::unlink(path));
+  }
+  return td::Status::OK();
+}
+
+td::Status InsertManagerParquet::write_manifest() {
+  std::string content = "table\tpartition\tfile\trows\tmc_seqnos\n";
+  for (const auto &line : manifest_) {
+    content += line;
+    content += "\n";
+  }
+  auto path = options_.directory + "/manifest.tsv";
+  auto tmp_path = path + ".tmp";
+  TRY_RESULT(fd, td::FileFd::open(tmp_path, td::FileFd::Write | td::FileFd::Create | td::FileFd::Truncate));
+  TRY_RESULT(written, fd.write(content));
+  if (written != content.size()) {
+    return td::Status::Error(PSLICE() << "Short write to " << tmp_path);
+  }
+  TRY_STATUS(fd.sync());
+  fd.close();
+  // readers see either the previous or the new manifest, never a partial one
+  return td::rename(tmp_path, path);
+}
+
+std::string InsertManagerParquet::partition_dir(const std::string &table, uint32_t partition) const {
+  return PSTRING() << options_.directory << "/" << table << "/mc_seqno=" << partition << "/";
+}
+
+ParquetTableWriter &InsertManagerParquet::table(Segment &segment, const std::string &name) {
+  auto &writer = segment.tables[name];
+  if (!writer) {
+    auto tmp_path = PSTRING() << partition_dir(name, segment.partition) << "." << name << "-" << segment.id << ".parquet.tmp";
+    writer = std::make_unique<ParquetTableWriter>(tmp_path, parquet_tables().at(name), properties_);
+  }
+  return *writer;
+}
+
+td::Status InsertManagerParquet::write_block(Segment &segment, const ParsedBlock &block) {
+  uint32_t mc_seqno = block.blocks_[0].seqno;
+  auto &blocks = table(segment, "blocks");
+  auto &transactions = table(segment, "transactions");
+  auto &messages = table(segment, "messages");
+  auto add_message = [&](const schema::Message &message, const schema::Transaction &transaction, const char *direction) {
+    messages.add(mc_seqno)
+      .add_hash(transaction.hash)
+      .add(direction)
+      .add_hash(message.hash)
+      .add(message.source)
+      .add(message.destination)
+      .add(message.value)
+      .add(message.fwd_fee)
+      .add(message.ihr_fee)
+      .add(message.created_lt)
+      .add(message.created_at)
+      .add(message.opcode)
+      .add(message.ihr_disabled)
+      .add(message.bounce)
+      .add(message.bounced)
+      .add(message.import_fee)
+      .add_hash(td::Bits256(message.body->get_hash().bits()))
+      .add(message.body_boc);
+    if (message.init_state.not_null()) {
+      messages.add_hash(td::Bits256(message.init_state->get_hash().bits()));
+    } else {
+      messages.add_null();
+    }
+    messages.add(message.init_state_boc).end_row();
+  };
+
+  for (const auto &blk : block.blocks_) {
+    blocks.add(mc_seqno)
+      .add(blk.workchain)
+      .add(blk.shard)
+      .add(blk.seqno)
+      .add_hash(blk.root_hash)
+      .add_hash(blk.file_hash)
+      .add(blk.mc_block_workchain)
+      .add(blk.mc_block_shard)
+      .add(blk.mc_block_seqno)
+      .add(blk.global_id)
+      .add(blk.version)
+      .add(blk.after_merge)
+      .add(blk.before_split)
+      .add(blk.after_split)
+      .add(blk.want_split)
+      .add(blk.key_block)
+      .add(blk.vert_seqno_incr)
+      .add(blk.flags)
+      .add(blk.gen_utime)
+      .add(blk.start_lt)
+      .add(blk.end_lt)
+      .add(blk.validator_list_hash_short)
+      .add(blk.gen_catchain_seqno)
+      .add(blk.min_ref_mc_seqno)
+      .add(blk.prev_key_block_seqno)
+      .add(blk.vert_seqno)
+      .add(blk.master_ref_seqno)
+      .add_hash(blk.rand_seed)
+      .add_hash(blk.created_by)
+      .add(static_cast<uint64_t>(blk.transactions.size()))
+      .end_row();
+
+    for (const auto &transaction : blk.transactions) {
+      transactions.add(mc_seqno)
+        .add(blk.workchain)
+        .add(blk.shard)
+        .add(blk.seqno)
+        .add(convert::to_raw_address(transaction.account))
+        .add_hash(transaction.hash)
+        .add(transaction.lt)
+        .add_hash(transaction.prev_trans_hash)
+        .add(transaction.prev_trans_lt)
+        .add(transaction.now)
+        .add(account_status_name(transaction.orig_status))
+        .add(account_status_name(transaction.end_status))
+        .add(transaction.total_fees)
+        .add_hash(transaction.account_state_hash_before)
+        .add_hash(transaction.account_state_hash_after)
+        .add(description_type_name(transaction.description))
+        .end_row();
+
+      if (transaction.in_msg) {
+        add_message(transaction.in_msg.value(), transaction, "in");
+      }
+      for (const auto &message : transaction.out_msgs) {
+        add_message(message, transaction, "out");
+      }
+    }
+  }
+
+  if (!block.account_states_.empty()) {
+    auto &account_states = table(segment, "account_states");
+    for (const auto &account_state : block.account_states_) {
+      account_states.add(mc_seqno)
+        .add_hash(account_state.hash)
+        .add(convert::to_raw_address(account_state.account))
+        .add(account_state.balance)
+        .add(account_state.account_status)
+        .add_hash(account_state.frozen_hash)
+        .add_hash(account_state.code_hash)
+        .add_hash(account_state.data_hash)
+        .add(account_state.last_trans_lt)
+        .end_row();
+    }
+  }
+
+  for (const auto &event : block.events_) {
+    if (auto transfer = std::get_if<JettonTransfer>(&event)) {
+      table(segment, "jetton_transfers").add(mc_seqno)
+        .add_hash(transfer->transaction_hash)
+        .add(transfer->query_id)
+        .add(to_dec_string(transfer->amount))
+        .add(transfer->source)
+        .add(transfer->destination)
+        .add(transfer->jetton_wallet)
+        .add(transfer->response_destination)
+        .add(to_boc(transfer->custom_payload))
+        .add(to_dec_string(transfer->forward_ton_amount))
+        .add(to_boc(transfer->forward_payload))
+        .end_row();
+    } else if (auto burn = std::get_if<JettonBurn>(&event)) {
+      table(segment, "jetton_burns").add(mc_seqno)
+        .add_hash(burn->transaction_hash)
+        .add(burn->query_id)
+        .add(burn->owner)
+        .add(burn->jetton_wallet)
+        .add(to_dec_string(burn->amount))
+        .add(burn->response_destination)
+        .add(to_boc(burn->custom_payload))
+        .end_row();
+    } else if (auto transfer = std::get_if<NFTTransfer>(&event)) {
+      table(segment, "nft_transfers").add(mc_seqno)
+        .add_hash(transfer->transaction_hash)
+        .add(transfer->query_id)
+        .add(convert::to_raw_address(transfer->nft_item))
+        .add(transfer->old_owner)
+        .add(transfer->new_owner)
+        .add(transfer->response_destination)
+        .add(to_boc(transfer->custom_payload))
+        .add(to_dec_string(transfer->forward_amount))
+        .add(to_boc(transfer->forward_payload))
+        .end_row();
+    }
+  }
+
+  // buffered rows of a table become a row group once there are enough of them
+  for (auto &[name, writer] : segment.tables) {
+    if (writer->buffered_rows() >= row_group_rows) {
+      TRY_STATUS(writer->flush());
+    }
+  }
+  return td::Status::OK();
+}
+
+void InsertManagerParquet::insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) {
+  uint32_t mc_seqno = block_ds->blocks_[0].seqno;
+  uint32_t partition = mc_seqno / options_.partition_size * options_.partition_size;
+  auto it = open_segments_.find(partition);
+  if (it == open_segments_.end()) {
+    Segment segment;
+    segment.partition = partition;
+    segment.id = PSTRING() << next_segment_id_++;
+    segment.opened_at = td::Timestamp::now();
+    for (const auto &[name, columns] : parquet_tables()) {
+      auto S = td::mkpath(partition_dir(name, partition));
+      if (S.is_error()) {
+        promise.set_error(S.move_as_error_prefix("Error creating Parquet partition directory: "));
+        return;
+      }
+    }
+    it = open_segments_.emplace(partition, std::move(segment)).first;
+  }
+  auto &segment = it->second;
+  auto S = write_block(segment, *block_ds);
+  segment.mc_seqnos.insert(mc_seqno);
+  segment.bytes += block_ds->estimated_size();
+  segment.promises.push_back(std::move(promise));
+  if (S.is_error()) {
+    // rows of the block may be partially appended, the whole segment is dropped and its seqnos rescanned
+    LOG(ERROR) << "Error writing mc seqno " << mc_seqno << " to Parquet: " << S;
+    for (auto &p : segment.promises) {
+      p.set_error(S.clone());
+    }
+    discard(segment);
+    open_segments_.erase(it);
+    return;
+  }
+  if (segment.bytes >= options_.roll_bytes) {
+    close_segment(partition);
+  }
+}
+
+td::Status InsertManagerParquet::publish(Segment &segment) {
+  auto seqnos = format_seqnos(segment.mc_seqnos);
+  auto first = *segment.mc_seqnos.begin();
+  auto last = *segment.mc_seqnos.rbegin();
+  std::vector<std::string> lines;
+  std::vector<std::pair<std::string, std::string>> renames;
+  for (auto &[name, writer] : segment.tables) {
+    if (writer->rows() == 0) {
+      continue;
+    }
+    auto file = PSTRING() << name << "/mc_seqno=" << segment.partition << "/" << name << "-" << first << "-" << last << "-"
+                          << segment.id << ".parquet";
+    TRY_STATUS(writer->finish());
+    bytes_written_ += writer->file_bytes();
+    lines.push_back(PSTRING() << name << "\t" << segment.partition << "\t" << file << "\t" << writer->rows() << "\t" << seqnos);
+    renames.push_back({writer->tmp_path(), options_.directory + "/" + file});
+  }
+  // the files stay under their temporary names until the manifest commits them, so a failed publish leaves no
+  // unlisted file under a final name
+  auto previous_size = manifest_.size();
+  manifest_.insert(manifest_.end(), lines.begin(), lines.end());
+  auto S = write_manifest();
+  if (S.is_error()) {
+    manifest_.resize(previous_size);
+    return S;
+  }
+  for (const auto &[tmp_path, path] : renames) {
+    auto R = td::rename(tmp_path, path);
+    if (R.is_error()) {
+      // the segment is committed, the rename is finished at the next start, see finish_rename
+      LOG(ERROR) << "Error renaming published Parquet file " << tmp_path << ": " << R;
+    }
+  }
+  return td::Status::OK();
+}
+
+void InsertManagerParquet::discard(Segment &segment) {
+  for (auto &[name, writer] : segment.tables) {
+    writer->discard();
+  }
+}
+
+void InsertManagerParquet::close_segment(uint32_t partition) {
+  auto it = open_segments_.find(partition);
+  if (it == open_segments_.end()) {
+    return;
+  }
+  auto segment = std::move(it->second);
+  open_segments_.erase(it);
+
+  auto S = publish(segment);
+  if (S.is_error()) {
+    LOG(ERROR) << "Error publishing Parquet segment of partition " << partition << ": " << S;
+    discard(segment);
+    for (auto &p : segment.promises) {
+      p.set_error(S.clone());
+    }
+    return;
+  }
+  existing_mc_seqnos_.insert(segment.mc_seqnos.begin(), segment.mc_seqnos.end());
+  segments_closed_++;
+  mc_blocks_written_ += segment.mc_seqnos.size();
+  LOG(INFO) << "Published Parquet segment " << segment.id << " of partition " << partition << ": "
+            << segment.mc_seqnos.size() << " mc blocks";
+  for (auto &p : segment.promises) {
+    p.set_value(td::Unit());
+  }
+}
+
+void InsertManagerParquet::alarm() {
+  std::vector<uint32_t> expired;
+  for (const auto &[partition, segment] : open_segments_) {
+    if (td::Timestamp::in(-options_.roll_seconds).at() > segment.opened_at.at()) {
+      expired.push_back(partition);
+    }
+  }
+  for (auto partition : expired) {
+    close_segment(partition);
+  }
+
+  if (next_report_.is_in_past()) {
+    size_t buffered = 0;
+    for (const auto &[partition, segment] : open_segments_) {
+      buffered += segment.mc_seqnos.size();
+    }
+    LOG(INFO) << "Parquet sink: " << open_segments_.size() << " open segments with " << buffered << " mc blocks, "
+              << segments_closed_ << " segments with " << mc_blocks_written_ << " mc blocks published, "
+              << bytes_written_ / (1 << 20) << "MB written";
+    next_report_ = td::Timestamp::in(10.0);
+  }
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+void InsertManagerParquet::get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) {
+  promise.set_value(std::vector<std::uint32_t>(existing_mc_seqnos_.begin(), existing_mc_seqnos_.end()));
+}
+
+void InsertManagerParquet::upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(jetton_wallet));
+}
+
+void InsertManagerParquet::get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) {
+  promise.set_result(entities_->get_jetton_wallets(addresses));
+}
+
+void InsertManagerParquet::upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(jetton_master));
+}
+
+void InsertManagerParquet::get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) {
+  promise.set_result(entities_->get_jetton_masters(addresses));
+}
+
+void InsertManagerParquet::upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(nft_collection));
+}
+
+void InsertManagerParquet::get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) {
+  promise.set_result(entities_->get_nft_collections(addresses));
+}
+
+void InsertManagerParquet::upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(nft_item));
+}
+
+void InsertManagerParquet::get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) {
+  promise.set_result(entities_->get_nft_items(addresses));
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <map>
+#include <set>
+#include <arrow/util/compression.h>
+#include "InsertManager.h"
+#include "EntityKvStore.h"
+#include "ParquetTableWriter.h"
+
+
+// Writes blocks, transactions, messages, account states and jetton/NFT events as Parquet files, without a database.
+// Files go to <directory>/<table>/mc_seqno=<partition start>/, every seqno partition has one open segment: a file per
+// table for the mc blocks of the partition received so far. A segment is closed when it reaches roll_bytes or
+// roll_seconds, its files are listed in <directory>/manifest.tsv, which is replaced atomically, and only then renamed
+// from their hidden temporary names to their final names. Insert promises resolve after that, and only mc seqnos
+// listed in the manifest are reported as existing, so segments open at a crash are rescanned. Temporary files of
+// failed segments are removed at once, those of segments open at a stop at the next start. Jetton and NFT entities
+// are kept in <directory>/entities.
+class InsertManagerParquet: public InsertManagerInterface {
+public:
+  struct Options {
+    std::string directory;
+    arrow::Compression::type compression{arrow::Compression::ZSTD};
+    size_t roll_bytes{128 << 20};
+    double roll_seconds{300};
+    uint32_t partition_size{100000};
+  };
+
+  explicit InsertManagerParquet(Options options) : options_(std::move(options)) {}
+
+  static td::Result<arrow::Compression::type> parse_compression(td::Slice name);
+
+  void start_up() override;
+  void alarm() override;
+
+  void insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) override;
+  void get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) override;
+  void upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) override;
+  void get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) override;
+  void upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) override;
+  void get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) override;
+  void upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) override;
+  void get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) override;
+  void upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) override;
+  void get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) override;
+
+private:
+  struct Segment {
+    uint32_t partition{0};
+    std::string id;
+    td::Timestamp opened_at;
+    size_t bytes{0};
+    std::map<std::string, std::unique_ptr<ParquetTableWriter>> tables;
+    std::set<uint32_t> mc_seqnos;
+    std::vector<td::Promise<td::Unit>> promises;
+  };
+
+  Options options_;
+  std::shared_ptr<parquet::WriterProperties> properties_;
+  std::unique_ptr<EntityKvStore> entities_;
+  std::map<uint32_t, Segment> open_segments_;
+  // one line per published file, see write_manifest
+  std::vector<std::string> manifest_;
+  std::set<uint32_t> existing_mc_seqnos_;
+  int64_t next_segment_id_{0};
+
+  size_t segments_closed_{0};
+  size_t mc_blocks_written_{0};
+  int64_t bytes_written_{0};
+  td::Timestamp next_report_;
+
+  td::Status init();
+  td::Status load_manifest();
+  td::Status write_manifest();
+  td::Status finish_rename(const std::string &file);
+  td::Status remove_tmp_files();
+  std::string partition_dir(const std::string &table, uint32_t partition) const;
+  ParquetTableWriter &table(Segment &segment, const std::string &name);
+  td::Status write_block(Segment &segment, const ParsedBlock &block);
+  td::Status publish(Segment &segment);
+  void discard(Segment &segment);
+  void close_segment(uint32_t partition);
+};
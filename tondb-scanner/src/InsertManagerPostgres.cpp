@@ -1,8 +1,13 @@
 #include <chrono>
+#include <algorithm>
+#include <limits>
 #include <mutex>
 #include "td/utils/JsonBuilder.h"
+#include "vm/boc.h"
 #include "InsertManagerPostgres.h"
 #include "convert-utils.h"
+#include "DbExecutor.h"
+#include "td/actor/MultiPromise.h"
 
 #define TO_SQL_BOOL(x) ((x) ? "TRUE" : "FALSE")
 #define TO_SQL_STRING(x) ("'" + (x) + "'")
@@ -23,6 +28,16 @@ std::string content_to_json_string(const std::map<std::string, std::string> &con
   return jetton_content_json.string_builder().as_cslice().str();
 }
 
+// Code and data cells are kept parsed in memory and are serialized to BOC only here, at the DB boundary
+std::string cell_to_boc_string(td::Ref<vm::Cell> cell) {
+  return td::base64_encode(vm::std_boc_serialize(cell).move_as_ok());
+}
+
+td::Result<td::Ref<vm::Cell>> boc_string_to_cell(const std::string &boc) {
+  TRY_RESULT(boc_bytes, td::base64_decode(boc));
+  return vm::std_boc_deserialize(boc_bytes);
+}
+
 struct BitArrayHasher {
   std::size_t operator()(const td::Bits256& k) const {
     std::size_t seed = 0;
@@ -32,159 +47,263 @@ struct BitArrayHasher {
     return seed;
   }
 };
-// This set is used as a synchronization mechanism to prevent multiple queries for the same message
-// Otherwise Posgres will throw an error deadlock_detected
-std::unordered_set<td::Bits256, BitArrayHasher> messages_in_progress;
-std::unordered_set<td::Bits256, BitArrayHasher> msg_bodies_in_progress;
-std::mutex messages_in_progress_mutex;
+// Constraint violations and malformed values fail again on every retry of the same rows, other errors (lost
+// connection, deadlock, statement timeout) may pass on the next attempt
+static td::Status insert_error(const std::exception &e, td::Slice prefix) {
+  bool data_error = dynamic_cast<const pqxx::data_exception *>(&e) != nullptr ||
+                    dynamic_cast<const pqxx::integrity_constraint_violation *>(&e) != nullptr;
+  return td::Status::Error(data_error ? ErrorCode::DB_DATA_ERROR : ErrorCode::DB_ERROR, PSLICE() << prefix << e.what());
+}
 
+// Rows of shared tables (messages, message_contents, account_states) may be written by several concurrent batches.
+// Every batch writes the tables in the same order and the rows of each table sorted by primary key, so two batches
+// wait for each other's uncommitted keys always in the same direction and can't deadlock. The losing batch skips
+// the key with ON CONFLICT DO NOTHING once the owner commits.
 void InsertBatchMcSeqnos::start_up() {
-  std::vector<schema::Message> messages;
-  std::vector<TxMsg> tx_msgs;
-  std::vector<MsgBody> msg_bodies;
-  {
-    std::lock_guard<std::mutex> guard(messages_in_progress_mutex);
-    for (const auto& mc_block : mc_blocks_) {
-      for (const auto& blk : mc_block->blocks_) {
-        for (const auto& transaction : blk.transactions) {
-          if (transaction.in_msg.has_value()) {
-            auto &msg = transaction.in_msg.value();
-            if (messages_in_progress.find(msg.hash) == messages_in_progress.end()) {
-              messages.push_back(msg);
-              messages_in_progress.insert(msg.hash);
-            }
-            td::Bits256 body_hash = msg.body->get_hash().bits();
-            if (msg_bodies_in_progress.find(body_hash) == msg_bodies_in_progress.end()) {
-              msg_bodies.push_back({td::base64_encode(body_hash.as_slice()), msg.body_boc});
-              msg_bodies_in_progress.insert(body_hash);
-            }
-            if (msg.init_state_boc) {
-              td::Bits256 init_state_hash = msg.init_state->get_hash().bits();
-              if (msg_bodies_in_progress.find(init_state_hash) == msg_bodies_in_progress.end()) {
-                msg_bodies.push_back({td::base64_encode(init_state_hash.as_slice()), msg.init_state_boc.value()});
-                msg_bodies_in_progress.insert(init_state_hash);
-              }
-            }
-            tx_msgs.push_back({td::base64_encode(transaction.hash.as_slice()), td::base64_encode(transaction.in_msg.value().hash.as_slice()), "in"});
-          }
-          for (const auto& msg : transaction.out_msgs) {
-            if (messages_in_progress.find(msg.hash) == messages_in_progress.end()) {
-              messages.push_back(msg);
-              messages_in_progress.insert(msg.hash);
-            }
-            td::Bits256 body_hash = msg.body->get_hash().bits();
-            if (msg_bodies_in_progress.find(body_hash) == msg_bodies_in_progress.end()) {
-              msg_bodies.push_back({td::base64_encode(body_hash.as_slice()), msg.body_boc});
-              msg_bodies_in_progress.insert(body_hash);
-            }
-            if (msg.init_state_boc) {
-              td::Bits256 init_state_hash = msg.init_state->get_hash().bits();
-              if (msg_bodies_in_progress.find(init_state_hash) == msg_bodies_in_progress.end()) {
-                msg_bodies.push_back({td::base64_encode(init_state_hash.as_slice()), msg.init_state_boc.value()});
-                msg_bodies_in_progress.insert(init_state_hash);
-              }
-            }
-            tx_msgs.push_back({td::base64_encode(transaction.hash.as_slice()), td::base64_encode(msg.hash.as_slice()), "out"});
-          }
+  std::unordered_set<td::Bits256, BitArrayHasher> message_hashes;
+  std::unordered_set<td::Bits256, BitArrayHasher> body_hashes;
+  auto add_message = [&](const schema::Message &msg) {
+    if (message_hashes.insert(msg.hash).second) {
+      messages_.push_back(msg);
+    }
+    td::Bits256 body_hash = msg.body->get_hash().bits();
+    if (body_hashes.insert(body_hash).second) {
+      msg_bodies_.push_back({body_hash, msg.body_boc});
+    }
+    if (msg.init_state_boc) {
+      td::Bits256 init_state_hash = msg.init_state->get_hash().bits();
+      if (body_hashes.insert(init_state_hash).second) {
+        msg_bodies_.push_back({init_state_hash, msg.init_state_boc.value()});
+      }
+    }
+  };
+  for (const auto& mc_block : mc_blocks_) {
+    for (const auto& blk : mc_block->blocks_) {
+      for (const auto& transaction : blk.transactions) {
+        if (transaction.in_msg.has_value()) {
+          add_message(transaction.in_msg.value());
+          tx_msgs_.push_back({transaction.hash, transaction.in_msg.value().hash, "in"});
+        }
+        for (const auto& msg : transaction.out_msgs) {
+          add_message(msg);
+          tx_msgs_.push_back({transaction.hash, msg.hash, "out"});
         }
       }
     }
   }
+  std::sort(messages_.begin(), messages_.end(), [](const schema::Message &a, const schema::Message &b) { return a.hash < b.hash; });
+  std::sort(msg_bodies_.begin(), msg_bodies_.end(), [](const MsgBody &a, const MsgBody &b) { return a.hash < b.hash; });
 
+  if (parallel_tables_) {
+    insert_table_groups();
+    return;
+  }
+
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    finish(connection.move_as_error());
+    return;
+  }
   try {
-    pqxx::connection c(connection_string_);
-    if (!c.is_open()) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-      return;
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    std::unique_ptr<pqxx::pipeline> pipeline;
+    if (mode_ == PgInsertMode::Values && !bulk_load_) {
+      pipeline = std::make_unique<pqxx::pipeline>(txn);
+      // issue every statement as soon as it is built, the server executes it while the next one is encoded
+      pipeline->retain(0);
+      pipeline_ = pipeline.get();
+    }
+    insert_blocks(txn, mc_blocks_);
+    insert_transactions(txn, mc_blocks_);
+    insert_messsages(txn, messages_, msg_bodies_, tx_msgs_);
+    insert_account_states(txn, mc_blocks_);
+    insert_jetton_transfers(txn, mc_blocks_);
+    insert_jetton_burns(txn, mc_blocks_);
+    insert_nft_transfers(txn, mc_blocks_);
+    if (pipeline) {
+      // waits for the statements still in flight, the first failed one throws here
+      auto start = td::Time::now();
+      pipeline->complete();
+      pipeline_wait_ = td::Time::now() - start;
+      pipeline_ = nullptr;
+      pipeline.reset();
     }
+    txn.commit();
+    finish(td::Unit());
+  } catch (const std::exception &e) {
+    finish(insert_error(e, "Error inserting to PG: "));
+  }
+}
 
-    pqxx::work txn(c);
+// Groups are sized so that the batch takes about as long as its largest table. Each group commits on its own,
+// rows are written with ON CONFLICT DO NOTHING, so a batch retried after a failed group only fills in the gaps.
+void InsertBatchMcSeqnos::insert_table_groups() {
+  td::MultiPromise mp;
+  auto ig = mp.init_guard();
+  ig.add_promise(td::PromiseCreator::lambda([SelfId = actor_id(this)](td::Result<td::Unit> R) {
+    td::actor::send_closure(SelfId, &InsertBatchMcSeqnos::table_groups_done, std::move(R));
+  }));
+
+  // the groups use members of this actor, it stays alive until all of them are done
+  auto add_group = [&](std::string name, std::function<void(pqxx::work&)> write) {
+    create_db_actor<InsertTableGroup>("insert_table_group", pool_, std::move(name), std::move(write), ig.get_promise()).release();
+  };
+  add_group("blocks", [this](pqxx::work &txn) {
     insert_blocks(txn, mc_blocks_);
     insert_transactions(txn, mc_blocks_);
-    insert_messsages(txn, messages, msg_bodies, tx_msgs);
+  });
+  add_group("messages", [this](pqxx::work &txn) {
+    insert_messsages(txn, messages_, msg_bodies_, tx_msgs_);
+  });
+  add_group("account_states", [this](pqxx::work &txn) {
     insert_account_states(txn, mc_blocks_);
+  });
+  add_group("events", [this](pqxx::work &txn) {
     insert_jetton_transfers(txn, mc_blocks_);
     insert_jetton_burns(txn, mc_blocks_);
     insert_nft_transfers(txn, mc_blocks_);
+  });
+}
+
+void InsertBatchMcSeqnos::table_groups_done(td::Result<td::Unit> R) {
+  if (R.is_error()) {
+    finish(R.move_as_error());
+    return;
+  }
+  // all rows are committed, the marker makes the batch visible to readers and to get_existing_seqnos
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    finish(connection.move_as_error());
+    return;
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    PgTableWriter writer(txn, "mc_block_commits", {"seqno"}, PgInsertMode::Values);
+    for (const auto& mc_block : mc_blocks_) {
+      writer.write_row(PgRow(key_format_, 1).add(mc_block->blocks_[0].seqno));
+    }
+    writer.finish();
     txn.commit();
+    finish(td::Unit());
+  } catch (const std::exception &e) {
+    finish(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error writing commit marker to PG: " << e.what()));
+  }
+}
 
+void InsertBatchMcSeqnos::finish(td::Result<td::Unit> R) {
+  if (R.is_ok()) {
     LOG(WARNING) << "Inserted " 
           << mc_blocks_.size() << " mc blocks, "
           << blocks_count_ << " blocks, " 
           << transactions_count_ << " txs, " 
           << messages_count_ << " msgs";
 
+    std::ostringstream timings;
+    for (const auto& [table, stats] : table_stats_) {
+      timings << " " << table << " " << stats.rows << " rows " << stats.time << "s";
+      write_stats_->add(table, stats);
+    }
+    if (pipeline_wait_ > 0) {
+      timings << " pipeline wait " << pipeline_wait_ << "s";
+    }
+    LOG(INFO) << "Insert timings (" << insert_mode_name(mode_) << (parallel_tables_ ? ", parallel tables" : "") << "):" << timings.str();
+
     promise_.set_value(td::Unit());
-  } catch (const std::exception &e) {
-    promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error inserting to PG: " << e.what()));
+  } else {
+    promise_.set_error(R.move_as_error());
   }
+  stop();
+}
 
-  {
-    std::lock_guard<std::mutex> guard(messages_in_progress_mutex);
-    for (const auto& msg : messages) {
-      messages_in_progress.erase(msg.hash);
-    }
+PgTableWriter InsertBatchMcSeqnos::disjoint_table_writer(pqxx::work &transaction, std::string table, std::vector<std::string> columns) {
+  if (bulk_load_) {
+    return PgTableWriter(transaction, std::move(table), std::move(columns), PgInsertMode::Copy, nullptr, "");
+  }
+  return PgTableWriter(transaction, std::move(table), std::move(columns), mode_, pipeline_);
+}
+
+void InsertBatchMcSeqnos::finish_table(PgTableWriter& writer) {
+  writer.finish();
+  std::lock_guard<std::mutex> guard(table_stats_mutex_);
+  table_stats_.push_back({writer.table(), writer.stats()});
+}
+
+void InsertTableGroup::start_up() {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    promise_.set_error(connection.move_as_error());
+    stop();
+    return;
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    write_(txn);
+    txn.commit();
+    promise_.set_value(td::Unit());
+  } catch (const std::exception &e) {
+    promise_.set_error(insert_error(e, PSLICE() << "Error inserting " << name_ << " to PG: "));
   }
   stop();
 }
 
-void InsertBatchMcSeqnos::insert_blocks(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks) {
-  std::ostringstream query;
-  query << "INSERT INTO blocks (workchain, shard, seqno, root_hash, file_hash, mc_block_workchain, "
-                                "mc_block_shard, mc_block_seqno, global_id, version, after_merge, before_split, "
-                                "after_split, want_split, key_block, vert_seqno_incr, flags, gen_utime, start_lt, "
-                                "end_lt, validator_list_hash_short, gen_catchain_seqno, min_ref_mc_seqno, "
-                                "prev_key_block_seqno, vert_seqno, master_ref_seqno, rand_seed, created_by, tx_count) VALUES ";
+PgRow InsertBatchMcSeqnos::block_row(PgKeyFormat key_format, const schema::Block& block, std::optional<uint32_t> mc_seqno) {
+  PgRow row(key_format, 30);
+  row.add(block.workchain)
+    .add(block.shard)
+    .add(block.seqno)
+    .add_hash(block.root_hash)
+    .add_hash(block.file_hash)
+    .add(block.mc_block_workchain)
+    .add(block.mc_block_shard)
+    .add(block.mc_block_seqno)
+    .add(block.global_id)
+    .add(block.version)
+    .add(block.after_merge)
+    .add(block.before_split)
+    .add(block.after_split)
+    .add(block.want_split)
+    .add(block.key_block)
+    .add(block.vert_seqno_incr)
+    .add(block.flags)
+    .add(block.gen_utime)
+    .add(block.start_lt)
+    .add(block.end_lt)
+    .add(block.validator_list_hash_short)
+    .add(block.gen_catchain_seqno)
+    .add(block.min_ref_mc_seqno)
+    .add(block.prev_key_block_seqno)
+    .add(block.vert_seqno)
+    .add(block.master_ref_seqno)
+    .add_hash(block.rand_seed)
+    .add_hash(block.created_by)
+    .add(block.transactions.size());
+  if (mc_seqno) {
+    row.add(mc_seqno.value());
+  }
+  return row;
+}
 
-  bool is_first = true;
+void InsertBatchMcSeqnos::insert_blocks(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks) {
+  auto columns = PgColumns(key_format_).add("workchain").add("shard").add("seqno").add("root_hash").add("file_hash").add("mc_block_workchain")
+    .add("mc_block_shard").add("mc_block_seqno").add("global_id").add("version").add("after_merge").add("before_split")
+    .add("after_split").add("want_split").add("key_block").add("vert_seqno_incr").add("flags").add("gen_utime").add("start_lt")
+    .add("end_lt").add("validator_list_hash_short").add("gen_catchain_seqno").add("min_ref_mc_seqno")
+    .add("prev_key_block_seqno").add("vert_seqno").add("master_ref_seqno").add("rand_seed").add("created_by").add("tx_count");
+  if (partitioned_) {
+    columns.add("mc_seqno");
+  }
+  auto writer = disjoint_table_writer(transaction, "blocks", columns.names());
   for (const auto& mc_block : mc_blocks) {
+    auto mc_seqno = partitioned_ ? std::optional<uint32_t>(mc_block->blocks_[0].seqno) : std::nullopt;
     for (const auto& block : mc_block->blocks_) {
-      if (is_first) {
-        is_first = false;
-      } else {
-        query << ", ";
-      }
-      query << "("
-            << block.workchain << ","
-            << block.shard << ","
-            << block.seqno << ","
-            << TO_SQL_STRING(block.root_hash) << ","
-            << TO_SQL_STRING(block.file_hash) << ","
-            << TO_SQL_OPTIONAL(block.mc_block_workchain) << ","
-            << TO_SQL_OPTIONAL(block.mc_block_shard) << ","
-            << TO_SQL_OPTIONAL(block.mc_block_seqno) << ","
-            << block.global_id << ","
-            << block.version << ","
-            << TO_SQL_BOOL(block.after_merge) << ","
-            << TO_SQL_BOOL(block.before_split) << ","
-            << TO_SQL_BOOL(block.after_split) << ","
-            << TO_SQL_BOOL(block.want_split) << ","
-            << TO_SQL_BOOL(block.key_block) << ","
-            << TO_SQL_BOOL(block.vert_seqno_incr) << ","
-            << block.flags << ","
-            << block.gen_utime << ","
-            << block.start_lt << ","
-            << block.end_lt << ","
-            << block.validator_list_hash_short << ","
-            << block.gen_catchain_seqno << ","
-            << block.min_ref_mc_seqno << ","
-            << block.prev_key_block_seqno << ","
-            << block.vert_seqno << ","
-            << TO_SQL_OPTIONAL(block.master_ref_seqno) << ","
-            << TO_SQL_STRING(block.rand_seed) << ","
-            << TO_SQL_STRING(block.created_by) << ","
-            << block.transactions.size()
-            << ")";
+      writer.write_row(block_row(key_format_, block, mc_seqno));
       ++blocks_count_;
     }
   }
-  if (is_first) {
-    return;
-  }
-  query << " ON CONFLICT DO NOTHING";
-
-  // LOG(DEBUG) << "Running SQL query: " << query.str();
-  transaction.exec0(query.str());
+  finish_table(writer);
 }
 
 std::string InsertBatchMcSeqnos::stringify(schema::ComputeSkipReason compute_skip_reason) {
@@ -429,47 +548,48 @@ std::string InsertBatchMcSeqnos::jsonify(schema::TransactionDescr descr) {
   return jb.string_builder().as_cslice().str();
 }
 
+PgRow InsertBatchMcSeqnos::transaction_row(PgKeyFormat key_format, const schema::Block& blk, const schema::Transaction& transaction,
+                                           std::optional<uint32_t> mc_seqno) {
+  PgRow row(key_format, 17);
+  row.add(blk.workchain)
+    .add(blk.shard)
+    .add(blk.seqno)
+    .add_address(transaction.account)
+    .add_hash(transaction.hash)
+    .add(transaction.lt)
+    .add_hash(transaction.prev_trans_hash)
+    .add(transaction.prev_trans_lt)
+    .add(transaction.now)
+    .add(stringify(transaction.orig_status))
+    .add(stringify(transaction.end_status))
+    .add(transaction.total_fees)
+    .add_hash(transaction.account_state_hash_before)
+    .add_hash(transaction.account_state_hash_after)
+    .add(jsonify(transaction.description));
+  if (mc_seqno) {
+    row.add(mc_seqno.value());
+  }
+  return row;
+}
+
 void InsertBatchMcSeqnos::insert_transactions(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks) {
-  std::ostringstream query;
-  query << "INSERT INTO transactions (block_workchain, block_shard, block_seqno, account, hash, lt, prev_trans_hash, prev_trans_lt, now, orig_status, end_status, "
-                                      "total_fees, account_state_hash_before, account_state_hash_after, description) VALUES ";
-  bool is_first = true;
+  auto columns = PgColumns(key_format_).add("block_workchain").add("block_shard").add("block_seqno").add_address("account").add("hash").add("lt")
+    .add("prev_trans_hash").add("prev_trans_lt").add("now").add("orig_status").add("end_status").add("total_fees")
+    .add("account_state_hash_before").add("account_state_hash_after").add("description");
+  if (partitioned_) {
+    columns.add("mc_seqno");
+  }
+  auto writer = disjoint_table_writer(transaction, "transactions", columns.names());
   for (const auto& mc_block : mc_blocks) {
+    auto mc_seqno = partitioned_ ? std::optional<uint32_t>(mc_block->blocks_[0].seqno) : std::nullopt;
     for (const auto &blk : mc_block->blocks_) {
       for (const auto& transaction : blk.transactions) {
-        if (is_first) {
-          is_first = false;
-        } else {
-          query << ", ";
-        }
-        query << "("
-              << blk.workchain << ","
-              << blk.shard << ","
-              << blk.seqno << ","
-              << TO_SQL_STRING(convert::to_raw_address(transaction.account)) << ","
-              << TO_SQL_STRING(td::base64_encode(transaction.hash.as_slice())) << ","
-              << transaction.lt << ","
-              << TO_SQL_STRING(td::base64_encode(transaction.prev_trans_hash.as_slice())) << ","
-              << transaction.prev_trans_lt << ","
-              << transaction.now << ","
-              << TO_SQL_STRING(stringify(transaction.orig_status)) << ","
-              << TO_SQL_STRING(stringify(transaction.end_status)) << ","
-              << transaction.total_fees << ","
-              << TO_SQL_STRING(td::base64_encode(transaction.account_state_hash_before.as_slice())) << ","
-              << TO_SQL_STRING(td::base64_encode(transaction.account_state_hash_after.as_slice())) << ","
-              << "'" << jsonify(transaction.description) << "'"
-              << ")";
+        writer.write_row(transaction_row(key_format_, blk, transaction, mc_seqno));
         ++transactions_count_;
       }
     }
   }
-  if (is_first) {
-    return;
-  }
-  query << " ON CONFLICT DO NOTHING";
-
-  // LOG(DEBUG) << "Running SQL query: " << query.str();
-  transaction.exec0(query.str());
+  finish_table(writer);
 }
 
 
@@ -484,758 +604,696 @@ void InsertBatchMcSeqnos::insert_messsages(pqxx::work &transaction, const std::v
   insert_messages_txs(tx_msgs, transaction);
 }
 
-const int max_chunk_size = 1000000;
-
 void InsertBatchMcSeqnos::insert_messages_contents(const std::vector<MsgBody>& message_bodies, pqxx::work& transaction) {
-  std::ostringstream query;
-  bool is_first = true;
-  auto exec_query = [&]() {
-    query << " ON CONFLICT DO NOTHING";
-    transaction.exec0(query.str());
-    query.str("");
-    query.clear();
-    query << "INSERT INTO message_contents (hash, body) VALUES ";
-    is_first = true;
-  };
-
-  query << "INSERT INTO message_contents (hash, body) VALUES ";
+  PgTableWriter writer(transaction, "message_contents", {"hash", "body"}, mode_, pipeline_);
   for (const auto& msg_body : message_bodies) {
-    if (is_first) {
-      is_first = false;
-    } else {
-      query << ", ";
-    }
-
-    query << "("
-          << "'" << msg_body.hash << "',"
-          << TO_SQL_STRING(msg_body.body)
-          << ")";
-
-    if (query.str().length() >= max_chunk_size) {
-      exec_query();
-    }
+    writer.write_row(PgRow(key_format_, 2).add_hash(msg_body.hash).add(msg_body.body));
   }
+  finish_table(writer);
+}
 
-  if (!is_first) {
-    exec_query();
+PgRow InsertBatchMcSeqnos::message_row(PgKeyFormat key_format, const schema::Message& message) {
+  PgRow row(key_format, 17);
+  row.add_hash(message.hash)
+    .add_address(message.source)
+    .add_address(message.destination)
+    .add(message.value)
+    .add(message.fwd_fee)
+    .add(message.ihr_fee)
+    .add(message.created_lt)
+    .add(message.created_at)
+    .add(message.opcode)
+    .add(message.ihr_disabled)
+    .add(message.bounce)
+    .add(message.bounced)
+    .add(message.import_fee)
+    .add_hash(td::Bits256(message.body->get_hash().bits()));
+  if (message.init_state.not_null()) {
+    row.add_hash(td::Bits256(message.init_state->get_hash().bits()));
+  } else {
+    row.add_null();
   }
+  return row;
 }
 
 void InsertBatchMcSeqnos::insert_messages_impl(const std::vector<schema::Message>& messages, pqxx::work& transaction) {
-  std::ostringstream query;
-  bool is_first = true;
-  auto exec_query = [&]() {
-    query << " ON CONFLICT DO NOTHING";
-    transaction.exec0(query.str());
-    query.str("");
-    query.clear();
-    query << "INSERT INTO messages (hash, source, destination, value, fwd_fee, ihr_fee, created_lt, created_at, opcode, "
-                                  "ihr_disabled, bounce, bounced, import_fee, body_hash, init_state_hash) VALUES ";
-    is_first = true;
-  };
-
-  query << "INSERT INTO messages (hash, source, destination, value, fwd_fee, ihr_fee, created_lt, created_at, opcode, "
-                                "ihr_disabled, bounce, bounced, import_fee, body_hash, init_state_hash) VALUES ";
+  auto columns = PgColumns(key_format_).add("hash").add_address("source").add_address("destination").add("value").add("fwd_fee")
+    .add("ihr_fee").add("created_lt").add("created_at").add("opcode").add("ihr_disabled").add("bounce").add("bounced")
+    .add("import_fee").add("body_hash").add("init_state_hash");
+  PgTableWriter writer(transaction, "messages", columns.names(), mode_, pipeline_);
   for (const auto& message : messages) {
-    if (is_first) {
-      is_first = false;
-    } else {
-      query << ", ";
-    }
-    query << "("
-          << "'" << td::base64_encode(message.hash.as_slice()) << "',"
-          << (message.source ? "'" + message.source.value() + "'" : "NULL") << ","
-          << (message.destination ? "'" + message.destination.value() + "'" : "NULL") << ","
-          << (message.value ? std::to_string(message.value.value()) : "NULL") << ","
-          << (message.fwd_fee ? std::to_string(message.fwd_fee.value()) : "NULL") << ","
-          << (message.ihr_fee ? std::to_string(message.ihr_fee.value()) : "NULL") << ","
-          << (message.created_lt ? std::to_string(message.created_lt.value()) : "NULL") << ","
-          << (message.created_at ? std::to_string(message.created_at.value()) : "NULL") << ","
-          << (message.opcode ? std::to_string(message.opcode.value()) : "NULL") << ","
-          << (message.ihr_disabled ? TO_SQL_BOOL(message.ihr_disabled.value()) : "NULL") << ","
-          << (message.bounce ? TO_SQL_BOOL(message.bounce.value()) : "NULL") << ","
-          << (message.bounced ? TO_SQL_BOOL(message.bounced.value()) : "NULL") << ","
-          << (message.import_fee ? std::to_string(message.import_fee.value()) : "NULL") << ","
-          << "'" << td::base64_encode(message.body->get_hash().as_slice()) << "',"
-          << (message.init_state.not_null() ? TO_SQL_STRING(td::base64_encode(message.init_state->get_hash().as_slice())) : "NULL")
-          << ")";
-
-
-    if (query.str().length() >= max_chunk_size) {
-      exec_query();
-    }
-  }
-
-  if (!is_first) {
-    exec_query();
+    writer.write_row(message_row(key_format_, message));
   }
+  finish_table(writer);
 }
 
 void InsertBatchMcSeqnos::insert_messages_txs(const std::vector<TxMsg>& tx_msgs, pqxx::work& transaction) {
-  std::ostringstream query;
-  bool is_first = true;
-  auto exec_query = [&]() {
-    query << " ON CONFLICT DO NOTHING";
-    transaction.exec0(query.str());
-    query.str("");
-    query.clear();
-    query << "INSERT INTO transaction_messages (transaction_hash, message_hash, direction) VALUES ";
-    is_first = true;
-  };
-
-  query << "INSERT INTO transaction_messages (transaction_hash, message_hash, direction) VALUES ";
+  auto writer = disjoint_table_writer(transaction, "transaction_messages", {"transaction_hash", "message_hash", "direction"});
   for (const auto& tx_msg : tx_msgs) {
-   if (is_first) {
-      is_first = false;
-    } else {
-      query << ", ";
-    }
-    query << "("
-          << TO_SQL_STRING(tx_msg.tx_hash) << ","
-          << TO_SQL_STRING(tx_msg.msg_hash) << ","
-          << TO_SQL_STRING(tx_msg.direction)
-          << ")";
-
-    if (query.str().length() >= max_chunk_size) {
-      exec_query();
-    }
+    writer.write_row(PgRow(key_format_, 3).add_hash(tx_msg.tx_hash).add_hash(tx_msg.msg_hash).add(tx_msg.direction));
   }
+  finish_table(writer);
+}
+
 
-  if (!is_first) {
-    exec_query();
+PgRow InsertBatchMcSeqnos::account_state_row(PgKeyFormat key_format, const schema::AccountState& account_state,
+                                             std::optional<uint32_t> mc_seqno) {
+  PgRow row(key_format, 9);
+  row.add_hash(account_state.hash)
+    .add_address(account_state.account)
+    .add(account_state.balance)
+    .add(account_state.account_status)
+    .add_hash(account_state.frozen_hash)
+    .add_hash(account_state.code_hash)
+    .add_hash(account_state.data_hash);
+  if (mc_seqno) {
+    row.add(mc_seqno.value());
   }
+  return row;
 }
 
-
 void InsertBatchMcSeqnos::insert_account_states(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks) {
-  std::ostringstream query;
-  query << "INSERT INTO account_states (hash, account, balance, account_status, frozen_hash, code_hash, data_hash) VALUES ";
-  bool is_first = true;
+  auto columns = PgColumns(key_format_).add("hash").add_address("account").add("balance").add("account_status")
+    .add("frozen_hash").add("code_hash").add("data_hash");
+  if (partitioned_) {
+    columns.add("mc_seqno");
+  }
+  // sorted by primary key like all shared tables, see start_up
+  std::vector<std::pair<uint32_t, const schema::AccountState *>> account_states;
   for (const auto& mc_block : mc_blocks) {
     for (const auto& account_state : mc_block->account_states_) {
-      if (is_first) {
-        is_first = false;
-      } else {
-        query << ", ";
-      }
-      query << "("
-            << TO_SQL_STRING(td::base64_encode(account_state.hash.as_slice())) << ","
-            << TO_SQL_STRING(convert::to_raw_address(account_state.account)) << ","
-            << account_state.balance << ","
-            << TO_SQL_STRING(account_state.account_status) << ","
-            << TO_SQL_OPTIONAL_STRING(account_state.frozen_hash) << ","
-            << TO_SQL_OPTIONAL_STRING(account_state.code_hash) << ","
-            << TO_SQL_OPTIONAL_STRING(account_state.data_hash)
-            << ")";
+      account_states.push_back({mc_block->blocks_[0].seqno, &account_state});
     }
   }
-  if (is_first) {
-    return;
+  std::sort(account_states.begin(), account_states.end(), [](const auto &a, const auto &b) {
+    return std::tie(a.second->hash, a.first) < std::tie(b.second->hash, b.first);
+  });
+  PgTableWriter writer(transaction, "account_states", columns.names(), mode_, pipeline_);
+  for (const auto& [mc_seqno, account_state] : account_states) {
+    writer.write_row(account_state_row(key_format_, *account_state, partitioned_ ? std::optional<uint32_t>(mc_seqno) : std::nullopt));
   }
-  query << " ON CONFLICT DO NOTHING";
-  // LOG(DEBUG) << "Running SQL query: " << query.str();
-  transaction.exec0(query.str());
+  finish_table(writer);
 }
 
 void InsertBatchMcSeqnos::insert_jetton_transfers(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks) {
-  std::ostringstream query;
-  query << "INSERT INTO jetton_transfers (transaction_hash, query_id, amount, source, destination, jetton_wallet_address, response_destination, custom_payload, forward_ton_amount, forward_payload) VALUES ";
-  bool is_first = true;
+  auto columns = PgColumns(key_format_).add("transaction_hash").add("query_id").add("amount").add_address("source").add_address("destination")
+    .add_address("jetton_wallet_address").add_address("response_destination").add("custom_payload").add("forward_ton_amount").add("forward_payload");
+  auto writer = disjoint_table_writer(transaction, "jetton_transfers", columns.names());
   for (const auto& mc_block : mc_blocks) {
     for (const auto& transfer : mc_block->get_events<JettonTransfer>()) {
-      if (is_first) {
-        is_first = false;
-      } else {
-        query << ", ";
-      }
       auto custom_payload_boc_r = convert::to_bytes(transfer.custom_payload);
       auto custom_payload_boc = custom_payload_boc_r.is_ok() ? custom_payload_boc_r.move_as_ok() : td::optional<std::string>{};
 
       auto forward_payload_boc_r = convert::to_bytes(transfer.forward_payload);
       auto forward_payload_boc = forward_payload_boc_r.is_ok() ? forward_payload_boc_r.move_as_ok() : td::optional<std::string>{};
 
-      query << "("
-            << TO_SQL_STRING(td::base64_encode(transfer.transaction_hash.as_slice())) << ","
-            << transfer.query_id << ","
-            << (transfer.amount.not_null() ? transfer.amount->to_dec_string() : "NULL") << ","
-            << TO_SQL_STRING(transfer.source) << ","
-            << TO_SQL_STRING(transfer.destination) << ","
-            << TO_SQL_STRING(transfer.jetton_wallet) << ","
-            << TO_SQL_STRING(transfer.response_destination) << ","
-            << TO_SQL_OPTIONAL_STRING(custom_payload_boc) << ","
-            << (transfer.forward_ton_amount.not_null() ? transfer.forward_ton_amount->to_dec_string() : "NULL") << ","
-            << TO_SQL_OPTIONAL_STRING(forward_payload_boc)
-            << ")";
+      writer.write_row(PgRow(key_format_, 14)
+        .add_hash(transfer.transaction_hash)
+        .add(transfer.query_id)
+        .add(transfer.amount)
+        .add_address(transfer.source)
+        .add_address(transfer.destination)
+        .add_address(transfer.jetton_wallet)
+        .add_address(transfer.response_destination)
+        .add(custom_payload_boc)
+        .add(transfer.forward_ton_amount)
+        .add(forward_payload_boc));
     }
   }
-  if (is_first) {
-    return;
-  }
-  query << " ON CONFLICT DO NOTHING";
-
-  // LOG(DEBUG) << "Running SQL query: " << query.str();
-  transaction.exec0(query.str());
+  finish_table(writer);
 }
 
 void InsertBatchMcSeqnos::insert_jetton_burns(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks) {
-  std::ostringstream query;
-  query << "INSERT INTO jetton_burns (transaction_hash, query_id, owner, jetton_wallet_address, amount, response_destination, custom_payload) VALUES ";
-  bool is_first = true;
+  auto columns = PgColumns(key_format_).add("transaction_hash").add("query_id").add_address("owner").add_address("jetton_wallet_address")
+    .add("amount").add_address("response_destination").add("custom_payload");
+  auto writer = disjoint_table_writer(transaction, "jetton_burns", columns.names());
   for (const auto& mc_block : mc_blocks) {
     for (const auto& burn : mc_block->get_events<JettonBurn>()) {
-      if (is_first) {
-        is_first = false;
-      } else {
-        query << ", ";
-      }
-
       auto custom_payload_boc_r = convert::to_bytes(burn.custom_payload);
       auto custom_payload_boc = custom_payload_boc_r.is_ok() ? custom_payload_boc_r.move_as_ok() : td::optional<std::string>{};
 
-      query << "("
-            << TO_SQL_STRING(td::base64_encode(burn.transaction_hash.as_slice())) << ","
-            << burn.query_id << ","
-            << TO_SQL_STRING(burn.owner) << ","
-            << TO_SQL_STRING(burn.jetton_wallet) << ","
-            << (burn.amount.not_null() ? burn.amount->to_dec_string() : "NULL") << ","
-            << TO_SQL_STRING(burn.response_destination) << ","
-            << TO_SQL_OPTIONAL_STRING(custom_payload_boc)
-            << ")";
+      writer.write_row(PgRow(key_format_, 10)
+        .add_hash(burn.transaction_hash)
+        .add(burn.query_id)
+        .add_address(burn.owner)
+        .add_address(burn.jetton_wallet)
+        .add(burn.amount)
+        .add_address(burn.response_destination)
+        .add(custom_payload_boc));
     }
   }
-  if (is_first) {
-    return;
-  }
-  query << " ON CONFLICT DO NOTHING";
-
-  // LOG(DEBUG) << "Running SQL query: " << query.str();
-  transaction.exec0(query.str());
+  finish_table(writer);
 }
 
 void InsertBatchMcSeqnos::insert_nft_transfers(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks) {
-  std::ostringstream query;
-  query << "INSERT INTO nft_transfers (transaction_hash, query_id, nft_item_address, old_owner, new_owner, response_destination, custom_payload, forward_amount, forward_payload) VALUES ";
-  bool is_first = true;
+  auto columns = PgColumns(key_format_).add("transaction_hash").add("query_id").add_address("nft_item_address").add_address("old_owner")
+    .add_address("new_owner").add_address("response_destination").add("custom_payload").add("forward_amount").add("forward_payload");
+  auto writer = disjoint_table_writer(transaction, "nft_transfers", columns.names());
   for (const auto& mc_block : mc_blocks) {
     for (const auto& transfer : mc_block->get_events<NFTTransfer>()) {
-      if (is_first) {
-        is_first = false;
-      } else {
-        query << ", ";
-      }
       auto custom_payload_boc_r = convert::to_bytes(transfer.custom_payload);
       auto custom_payload_boc = custom_payload_boc_r.is_ok() ? custom_payload_boc_r.move_as_ok() : td::optional<std::string>{};
 
       auto forward_payload_boc_r = convert::to_bytes(transfer.forward_payload);
       auto forward_payload_boc = forward_payload_boc_r.is_ok() ? forward_payload_boc_r.move_as_ok() : td::optional<std::string>{};
 
-      query << "("
-            << TO_SQL_STRING(td::base64_encode(transfer.transaction_hash.as_slice())) << ","
-            << transfer.query_id << ","
-            << TO_SQL_STRING(convert::to_raw_address(transfer.nft_item)) << ","
-            << TO_SQL_STRING(transfer.old_owner) << ","
-            << TO_SQL_STRING(transfer.new_owner) << ","
-            << TO_SQL_STRING(transfer.response_destination) << ","
-            << TO_SQL_OPTIONAL_STRING(custom_payload_boc) << ","
-            << (transfer.forward_amount.not_null() ? transfer.forward_amount->to_dec_string() : "NULL") << ","
-            << TO_SQL_OPTIONAL_STRING(forward_payload_boc)
-            << ")";
+      writer.write_row(PgRow(key_format_, 13)
+        .add_hash(transfer.transaction_hash)
+        .add(transfer.query_id)
+        .add_address(transfer.nft_item)
+        .add_address(transfer.old_owner)
+        .add_address(transfer.new_owner)
+        .add_address(transfer.response_destination)
+        .add(custom_payload_boc)
+        .add(transfer.forward_amount)
+        .add(forward_payload_boc));
     }
   }
-  if (is_first) {
-    return;
-  }
-  query << " ON CONFLICT DO NOTHING";
-
-  // LOG(DEBUG) << "Running SQL query: " << query.str();
-  transaction.exec0(query.str());
+  finish_table(writer);
 }
 
-class UpsertJettonWallet: public td::actor::Actor {
-private:
-  std::string connection_string_;
-  JettonWalletData wallet_;
-  td::Promise<td::Unit> promise_;
-public:
-  UpsertJettonWallet(std::string connection_string, JettonWalletData wallet, td::Promise<td::Unit> promise): 
-    connection_string_(std::move(connection_string)), 
-    wallet_(std::move(wallet)), 
-    promise_(std::move(promise))
-  {
-    LOG(DEBUG) << "Created UpsertJettonWallet";
-  }
-
-  void start_up() {
-    try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
-      }
-      pqxx::work txn(c);
-      
-      std::string query = "INSERT INTO jetton_wallets (balance, address, owner, jetton, last_transaction_lt, code_hash, data_hash) "
-                            "VALUES ($1, $2, $3, $4, $5, $6, $7) "
-                            "ON CONFLICT (address) "
-                            "DO UPDATE SET "
-                            "balance = EXCLUDED.balance, "
-                            "owner = EXCLUDED.owner, "
-                            "jetton = EXCLUDED.jetton, "
-                            "last_transaction_lt = EXCLUDED.last_transaction_lt, "
-                            "code_hash = EXCLUDED.code_hash, "
-                            "data_hash = EXCLUDED.data_hash "
-                            "WHERE jetton_wallets.last_transaction_lt < EXCLUDED.last_transaction_lt;";
-
-      txn.exec_params(query,
-                      wallet_.balance,
-                      wallet_.address,
-                      wallet_.owner,
-                      wallet_.jetton,
-                      wallet_.last_transaction_lt,
-                      td::base64_encode(wallet_.code_hash.as_slice()),
-                      td::base64_encode(wallet_.data_hash.as_slice()));
 
 
-      txn.commit();
-      promise_.set_value(td::Unit());
-    } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error inserting to PG: " << e.what()));
-    }
-    stop();
+template <class T>
+void EntityUpsertWriter::upsert(T entity, td::Promise<td::Unit> promise) {
+  auto& buffer = std::get<Buffer<T>>(buffers_);
+  auto address = entity.address;
+  auto it = buffer.entities.find(address);
+  if (it == buffer.entities.end()) {
+    buffer.entities.emplace(address, std::move(entity));
+  } else if (it->second.last_transaction_lt <= entity.last_transaction_lt) {
+    it->second = std::move(entity);
   }
-};
+  buffer.promises[address].push_back(std::move(promise));
+  buffer.promises_count++;
+  buffered_count_++;
 
-
-class GetJettonWallet : public td::actor::Actor {
-private:
-  std::string connection_string_;
-  std::string address_;
-  td::Promise<JettonWalletData> promise_;
-public:
-  GetJettonWallet(std::string connection_string, std::string address, td::Promise<JettonWalletData> promise)
-    : connection_string_(std::move(connection_string))
-    , address_(std::move(address))
-    , promise_(std::move(promise))
-  {
-    LOG(DEBUG) << "Created GetJettonWallet";
+  if (buffered_count_ >= max_batch_size_) {
+    flush();
+  } else {
+    alarm_timestamp().relax(td::Timestamp::in(flush_interval_));
   }
+}
 
-  void start_up() override {
-    try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
-      }
-      pqxx::work txn(c);
-
-      std::string query = "SELECT balance, address, owner, jetton, last_transaction_lt, code_hash, data_hash "
-                          "FROM jetton_wallets "
-                          "WHERE address = $1;";
-
-      pqxx::result result = txn.exec_params(query, address_);
-
-      if (result.size() != 1) {
-        if (result.size() == 0) {
-          promise_.set_error(td::Status::Error(ErrorCode::ENTITY_NOT_FOUND, PSLICE() << "Jetton Wallet for address " << address_ << " not found"));
-        } else {
-          promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Jetton Wallet for address " << address_ << " is not unique (found " << result.size() << " wallets)"));
-        }
-        stop();
-        return;
-      }
-
-      const auto& row = result[0];
-      
-      JettonWalletData wallet;
-      wallet.balance = row[0].as<uint64_t>();
-      wallet.address = row[1].as<std::string>();
-      wallet.owner = row[2].as<std::string>();
-      wallet.jetton = row[3].as<std::string>();
-      wallet.last_transaction_lt = row[4].as<uint64_t>();
-      wallet.code_hash = vm::CellHash::from_slice(td::base64_decode(row[5].as<std::string>()).move_as_ok());
-      wallet.data_hash = vm::CellHash::from_slice(td::base64_decode(row[6].as<std::string>()).move_as_ok());
+void EntityUpsertWriter::alarm() {
+  flush();
+}
 
-      txn.commit();
-      promise_.set_value(std::move(wallet));
-    } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving wallet from PG: " << e.what()));
+template <>
+std::string EntityUpsertWriter::build_upsert_query<JettonWalletData>(pqxx::work &transaction, const std::map<std::string, JettonWalletData>& entities) {
+  std::ostringstream query;
+  query << "INSERT INTO jetton_wallets (balance, address, owner, jetton, last_transaction_lt, code_hash, data_hash) VALUES ";
+  bool is_first = true;
+  for (const auto& [address, wallet] : entities) {
+    if (is_first) {
+      is_first = false;
+    } else {
+      query << ", ";
     }
-    stop();
+    query << "("
+          << wallet.balance << ","
+          << TO_SQL_STRING(wallet.address) << ","
+          << TO_SQL_STRING(wallet.owner) << ","
+          << TO_SQL_STRING(wallet.jetton) << ","
+          << wallet.last_transaction_lt << ","
+          << TO_SQL_STRING(td::base64_encode(wallet.code_hash.as_slice())) << ","
+          << TO_SQL_STRING(td::base64_encode(wallet.data_hash.as_slice()))
+          << ")";
   }
-};
+  query << " ON CONFLICT (address) DO UPDATE SET "
+        << "balance = EXCLUDED.balance, "
+        << "owner = EXCLUDED.owner, "
+        << "jetton = EXCLUDED.jetton, "
+        << "last_transaction_lt = EXCLUDED.last_transaction_lt, "
+        << "code_hash = EXCLUDED.code_hash, "
+        << "data_hash = EXCLUDED.data_hash "
+        << "WHERE jetton_wallets.last_transaction_lt < EXCLUDED.last_transaction_lt";
+  return query.str();
+}
 
-class UpsertJettonMaster : public td::actor::Actor {
-private:
-  std::string connection_string_;
-  JettonMasterData master_data_;
-  td::Promise<td::Unit> promise_;
-public:
-  UpsertJettonMaster(std::string connection_string, JettonMasterData master_data, td::Promise<td::Unit> promise)
-    : connection_string_(std::move(connection_string))
-    , master_data_(std::move(master_data))
-    , promise_(std::move(promise))
-  {
-    LOG(DEBUG) << "Created UpsertJettonMaster";
+template <>
+std::string EntityUpsertWriter::build_upsert_query<JettonMasterData>(pqxx::work &transaction, const std::map<std::string, JettonMasterData>& entities) {
+  std::ostringstream query;
+  query << "INSERT INTO jetton_masters (address, total_supply, mintable, admin_address, jetton_content, jetton_wallet_code_hash, "
+        << "data_hash, code_hash, last_transaction_lt, code_boc, data_boc) VALUES ";
+  bool is_first = true;
+  for (const auto& [address, master] : entities) {
+    if (is_first) {
+      is_first = false;
+    } else {
+      query << ", ";
+    }
+    query << "("
+          << TO_SQL_STRING(master.address) << ","
+          << master.total_supply << ","
+          << TO_SQL_BOOL(master.mintable) << ","
+          << TO_SQL_OPTIONAL_STRING(master.admin_address) << ","
+          << (master.jetton_content ? transaction.quote(content_to_json_string(master.jetton_content.value())) : "NULL") << ","
+          << TO_SQL_STRING(td::base64_encode(master.jetton_wallet_code_hash.as_slice())) << ","
+          << TO_SQL_STRING(td::base64_encode(master.data_hash.as_slice())) << ","
+          << TO_SQL_STRING(td::base64_encode(master.code_hash.as_slice())) << ","
+          << master.last_transaction_lt << ","
+          << TO_SQL_STRING(cell_to_boc_string(master.code_cell)) << ","
+          << TO_SQL_STRING(cell_to_boc_string(master.data_cell))
+          << ")";
   }
+  query << " ON CONFLICT (address) DO UPDATE SET "
+        << "total_supply = EXCLUDED.total_supply, "
+        << "mintable = EXCLUDED.mintable, "
+        << "admin_address = EXCLUDED.admin_address, "
+        << "jetton_content = EXCLUDED.jetton_content, "
+        << "jetton_wallet_code_hash = EXCLUDED.jetton_wallet_code_hash, "
+        << "data_hash = EXCLUDED.data_hash, "
+        << "code_hash = EXCLUDED.code_hash, "
+        << "last_transaction_lt = EXCLUDED.last_transaction_lt, "
+        << "code_boc = EXCLUDED.code_boc, "
+        << "data_boc = EXCLUDED.data_boc "
+        << "WHERE jetton_masters.last_transaction_lt < EXCLUDED.last_transaction_lt";
+  return query.str();
+}
 
-  void start_up() override {
-    try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
-      }
-      pqxx::work txn(c);
-
-      std::string query = "INSERT INTO jetton_masters "
-                          "(address, total_supply, mintable, admin_address, jetton_content, jetton_wallet_code_hash, data_hash, code_hash, last_transaction_lt, code_boc, data_boc) "
-                          "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11) "
-                          "ON CONFLICT (address) "
-                          "DO UPDATE SET "
-                          "total_supply = EXCLUDED.total_supply, "
-                          "mintable = EXCLUDED.mintable, "
-                          "admin_address = EXCLUDED.admin_address, "
-                          "jetton_content = EXCLUDED.jetton_content,"
-                          "jetton_wallet_code_hash = EXCLUDED.jetton_wallet_code_hash, "
-                          "data_hash = EXCLUDED.data_hash, "
-                          "code_hash = EXCLUDED.code_hash, "
-                          "last_transaction_lt = EXCLUDED.last_transaction_lt, "
-                          "code_boc = EXCLUDED.code_boc, "
-                          "data_boc = EXCLUDED.data_boc "
-                          "WHERE jetton_masters.last_transaction_lt < EXCLUDED.last_transaction_lt;";
-
-      txn.exec_params(query,
-                      master_data_.address,
-                      master_data_.total_supply,
-                      master_data_.mintable,
-                      master_data_.admin_address ? master_data_.admin_address.value().c_str() : nullptr,
-                      master_data_.jetton_content ? content_to_json_string(master_data_.jetton_content.value()).c_str() : nullptr,
-                      td::base64_encode(master_data_.jetton_wallet_code_hash.as_slice()),
-                      td::base64_encode(master_data_.data_hash.as_slice()),
-                      td::base64_encode(master_data_.code_hash.as_slice()),
-                      master_data_.last_transaction_lt,
-                      master_data_.code_boc,
-                      master_data_.data_boc);
-
-      txn.commit();
-      promise_.set_value(td::Unit());
-    } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error inserting to PG: " << e.what()));
+template <>
+std::string EntityUpsertWriter::build_upsert_query<NFTCollectionData>(pqxx::work &transaction, const std::map<std::string, NFTCollectionData>& entities) {
+  std::ostringstream query;
+  query << "INSERT INTO nft_collections (address, next_item_index, owner_address, collection_content, data_hash, code_hash, "
+        << "last_transaction_lt, code_boc, data_boc) VALUES ";
+  bool is_first = true;
+  for (const auto& [address, collection] : entities) {
+    if (is_first) {
+      is_first = false;
+    } else {
+      query << ", ";
     }
-    stop();
+    query << "("
+          << TO_SQL_STRING(collection.address) << ","
+          << collection.next_item_index->to_dec_string() << ","
+          << TO_SQL_OPTIONAL_STRING(collection.owner_address) << ","
+          << (collection.collection_content ? transaction.quote(content_to_json_string(collection.collection_content.value())) : "NULL") << ","
+          << TO_SQL_STRING(td::base64_encode(collection.data_hash.as_slice())) << ","
+          << TO_SQL_STRING(td::base64_encode(collection.code_hash.as_slice())) << ","
+          << collection.last_transaction_lt << ","
+          << TO_SQL_STRING(cell_to_boc_string(collection.code_cell)) << ","
+          << TO_SQL_STRING(cell_to_boc_string(collection.data_cell))
+          << ")";
   }
-};
+  query << " ON CONFLICT (address) DO UPDATE SET "
+        << "next_item_index = EXCLUDED.next_item_index, "
+        << "owner_address = EXCLUDED.owner_address, "
+        << "collection_content = EXCLUDED.collection_content, "
+        << "data_hash = EXCLUDED.data_hash, "
+        << "code_hash = EXCLUDED.code_hash, "
+        << "last_transaction_lt = EXCLUDED.last_transaction_lt, "
+        << "code_boc = EXCLUDED.code_boc, "
+        << "data_boc = EXCLUDED.data_boc "
+        << "WHERE nft_collections.last_transaction_lt < EXCLUDED.last_transaction_lt";
+  return query.str();
+}
 
-class GetJettonMaster : public td::actor::Actor {
-private:
-  std::string connection_string_;
-  std::string address_;
-  td::Promise<JettonMasterData> promise_;
-public:
-  GetJettonMaster(std::string connection_string, std::string address, td::Promise<JettonMasterData> promise)
-    : connection_string_(std::move(connection_string))
-    , address_(std::move(address))
-    , promise_(std::move(promise))
-  {
-    LOG(DEBUG) << "Created GetJettonMaster";
+template <>
+std::string EntityUpsertWriter::build_upsert_query<NFTItemData>(pqxx::work &transaction, const std::map<std::string, NFTItemData>& entities) {
+  std::ostringstream query;
+  query << "INSERT INTO nft_items (address, init, index, collection_address, owner_address, content, last_transaction_lt, code_hash, data_hash) VALUES ";
+  bool is_first = true;
+  for (const auto& [address, item] : entities) {
+    if (is_first) {
+      is_first = false;
+    } else {
+      query << ", ";
+    }
+    query << "("
+          << TO_SQL_STRING(item.address) << ","
+          << TO_SQL_BOOL(item.init) << ","
+          << item.index->to_dec_string() << ","
+          << TO_SQL_STRING(item.collection_address) << ","
+          << TO_SQL_STRING(item.owner_address) << ","
+          << (item.content ? transaction.quote(content_to_json_string(item.content.value())) : "NULL") << ","
+          << item.last_transaction_lt << ","
+          << TO_SQL_STRING(td::base64_encode(item.code_hash.as_slice())) << ","
+          << TO_SQL_STRING(td::base64_encode(item.data_hash.as_slice()))
+          << ")";
   }
+  query << " ON CONFLICT (address) DO UPDATE SET "
+        << "init = EXCLUDED.init, "
+        << "index = EXCLUDED.index, "
+        << "collection_address = EXCLUDED.collection_address, "
+        << "owner_address = EXCLUDED.owner_address, "
+        << "content = EXCLUDED.content, "
+        << "last_transaction_lt = EXCLUDED.last_transaction_lt, "
+        << "code_hash = EXCLUDED.code_hash, "
+        << "data_hash = EXCLUDED.data_hash "
+        << "WHERE nft_items.last_transaction_lt < EXCLUDED.last_transaction_lt";
+  return query.str();
+}
 
-  void start_up() override {
-    try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
-      }
-      pqxx::work txn(c);
-
-      std::string query = "SELECT address, total_supply, mintable, admin_address, jetton_wallet_code_hash, data_hash, code_hash, last_transaction_lt, code_boc, data_boc "
-                          "FROM jetton_masters "
-                          "WHERE address = $1;";
+void EntityUpsertWriter::flush() {
+  for_each_type(Interfaces{}, [&](auto tag) {
+    using T = typename decltype(tag)::type;
+    auto& buffer = std::get<Buffer<T>>(buffers_);
+    if (buffer.entities.empty()) {
+      return;
+    }
+    if (buffer.retry_at && !buffer.retry_at.is_in_past()) {
+      alarm_timestamp().relax(buffer.retry_at);
+      return;
+    }
+    flush_buffer(buffer);
+  });
+}
 
-      pqxx::result result = txn.exec_params(query, address_);
+template <class T>
+void EntityUpsertWriter::flush_buffer(Buffer<T> &buffer) {
+  std::map<std::string, td::Status> failed;
+  auto status = write_entities(buffer.entities);
+  if (status.is_error() && status.code() != ErrorCode::DB_DATA_ERROR) {
+    if (++buffer.attempt < max_write_attempts) {
+      auto delay = insert_retry_delay(buffer.attempt, min_retry_delay, max_retry_delay);
+      LOG(WARNING) << "Failed to upsert " << buffer.entities.size() << " entities, retrying in " << delay << "s (attempt "
+                   << buffer.attempt + 1 << "): " << status;
+      buffer.retry_at = td::Timestamp::in(delay);
+      alarm_timestamp().relax(buffer.retry_at);
+      return;
+    }
+    LOG(ERROR) << "Failed to upsert " << buffer.entities.size() << " entities after " << max_write_attempts
+               << " attempts: " << status;
+    for (const auto& [address, entity] : buffer.entities) {
+      failed.emplace(address, status.clone());
+    }
+  } else if (status.is_error()) {
+    write_bisecting(std::move(buffer.entities), std::move(status), failed);
+  }
 
-      if (result.size() != 1) {
-        if (result.size() == 0) {
-          promise_.set_error(td::Status::Error(ErrorCode::ENTITY_NOT_FOUND, PSLICE() << "Jetton master not found: " << address_));
-        } else {
-          promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Jetton master not unique: " << address_ << ", found " << result.size() << " records"));
-        }
-        
-        stop();
-        return;
+  for (auto& [address, promises] : buffer.promises) {
+    auto it = failed.find(address);
+    for (auto& promise : promises) {
+      if (it != failed.end()) {
+        promise.set_error(it->second.clone());
+      } else {
+        promise.set_value(td::Unit());
       }
+    }
+  }
+  buffered_count_ -= buffer.promises_count;
+  buffer.entities.clear();
+  buffer.promises.clear();
+  buffer.promises_count = 0;
+  buffer.attempt = 0;
+  buffer.retry_at = td::Timestamp();
+}
 
-      pqxx::row row = result[0];
-
-      JettonMasterData master_data;
-      master_data.address = row[0].as<std::string>();
-      master_data.total_supply = row[1].as<uint64_t>();
-      master_data.mintable = row[2].as<bool>();
-      if (!row[3].is_null()) {
-        master_data.admin_address = row[3].as<std::string>();
+template <class T>
+void EntityUpsertWriter::write_bisecting(std::map<std::string, T> entities, td::Status error,
+                                         std::map<std::string, td::Status> &failed) {
+  if (entities.size() == 1) {
+    LOG(ERROR) << "Entity " << entities.begin()->first << " can't be upserted: " << error;
+    failed.emplace(entities.begin()->first, std::move(error));
+    return;
+  }
+  std::map<std::string, T> second;
+  auto half = std::next(entities.begin(), entities.size() / 2);
+  second.insert(std::make_move_iterator(half), std::make_move_iterator(entities.end()));
+  entities.erase(half, entities.end());
+  for (auto* part : {&entities, &second}) {
+    auto status = write_entities(*part);
+    if (status.is_ok()) {
+      continue;
+    }
+    if (status.code() == ErrorCode::DB_DATA_ERROR) {
+      write_bisecting(std::move(*part), std::move(status), failed);
+    } else {
+      // the rows are upserted again with the next update of their addresses
+      for (const auto& [address, entity] : *part) {
+        failed.emplace(address, status.clone());
       }
-      master_data.jetton_wallet_code_hash = vm::CellHash::from_slice(td::base64_decode(row[4].as<std::string>()).move_as_ok());
-      master_data.data_hash = vm::CellHash::from_slice(td::base64_decode(row[5].as<std::string>()).move_as_ok());
-      master_data.code_hash = vm::CellHash::from_slice(td::base64_decode(row[6].as<std::string>()).move_as_ok());
-      master_data.last_transaction_lt = row[7].as<uint64_t>();
-      master_data.code_boc = row[8].as<std::string>();
-      master_data.data_boc = row[9].as<std::string>();
-
-      txn.commit();
-      promise_.set_value(std::move(master_data));
-    } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving master from PG: " << e.what()));
     }
-    stop();
   }
-};
+}
 
-class UpsertNFTCollection: public td::actor::Actor {
-private:
-  std::string connection_string_;
-  NFTCollectionData collection_;
-  td::Promise<td::Unit> promise_;
+template <class T>
+td::Status EntityUpsertWriter::write_entities(const std::map<std::string, T> &entities) {
+  TRY_RESULT(connection, pool_->acquire());
+  try {
+    pqxx::work txn(*connection);
+    txn.exec0(build_upsert_query<T>(txn, entities));
+    txn.commit();
+  } catch (const std::exception &e) {
+    return insert_error(e, "Error upserting entities to PG: ");
+  }
+  return td::Status::OK();
+}
 
+class GetJettonWallets : public td::actor::Actor {
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::vector<std::string> addresses_;
+  td::Promise<std::vector<JettonWalletData>> promise_;
 public:
-  UpsertNFTCollection(std::string connection_string, NFTCollectionData collection, td::Promise<td::Unit> promise)
-    : connection_string_(std::move(connection_string))
-    , collection_(std::move(collection))
+  GetJettonWallets(std::shared_ptr<PgConnectionPool> pool, std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise)
+    : pool_(std::move(pool))
+    , addresses_(std::move(addresses))
     , promise_(std::move(promise))
   {
-    LOG(DEBUG) << "Created UpsertNFTCollection";
+    LOG(DEBUG) << "Created GetJettonWallets";
   }
 
   void start_up() override {
+    if (addresses_.empty()) {
+      promise_.set_value({});
+      stop();
+      return;
+    }
+    auto connection = pool_->acquire();
+    if (connection.is_error()) {
+      promise_.set_error(connection.move_as_error());
+      stop();
+      return;
+    }
     try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
+      auto c = connection.move_as_ok();
+      pqxx::work txn(*c);
+
+      pqxx::result result = txn.exec_prepared("select_jetton_wallets", addresses_);
+
+      std::vector<JettonWalletData> wallets;
+      wallets.reserve(result.size());
+      for (const auto& row : result) {
+        JettonWalletData wallet;
+        wallet.balance = row[0].as<uint64_t>();
+        wallet.address = row[1].as<std::string>();
+        wallet.owner = row[2].as<std::string>();
+        wallet.jetton = row[3].as<std::string>();
+        wallet.last_transaction_lt = row[4].as<uint64_t>();
+        wallet.code_hash = vm::CellHash::from_slice(td::base64_decode(row[5].as<std::string>()).move_as_ok());
+        wallet.data_hash = vm::CellHash::from_slice(td::base64_decode(row[6].as<std::string>()).move_as_ok());
+        wallets.push_back(std::move(wallet));
       }
-      pqxx::work txn(c);
-
-      std::string query = "INSERT INTO nft_collections "
-                          "(address, next_item_index, owner_address, collection_content, data_hash, code_hash, last_transaction_lt, code_boc, data_boc) "
-                          "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9) "
-                          "ON CONFLICT (address) "
-                          "DO UPDATE SET "
-                          "next_item_index = EXCLUDED.next_item_index, "
-                          "owner_address = EXCLUDED.owner_address, "
-                          "collection_content = EXCLUDED.collection_content, "
-                          "data_hash = EXCLUDED.data_hash, "
-                          "code_hash = EXCLUDED.code_hash, "
-                          "last_transaction_lt = EXCLUDED.last_transaction_lt, "
-                          "code_boc = EXCLUDED.code_boc, "
-                          "data_boc = EXCLUDED.data_boc "
-                          "WHERE nft_collections.last_transaction_lt < EXCLUDED.last_transaction_lt;";
-      
-      txn.exec_params(query,
-                      collection_.address,
-                      collection_.next_item_index->to_dec_string(),
-                      collection_.owner_address ? collection_.owner_address.value().c_str() : nullptr,
-                      collection_.collection_content ? content_to_json_string(collection_.collection_content.value()).c_str() : nullptr,
-                      td::base64_encode(collection_.data_hash.as_slice()),
-                      td::base64_encode(collection_.code_hash.as_slice()),
-                      collection_.last_transaction_lt,
-                      collection_.code_boc,
-                      collection_.data_boc);
 
       txn.commit();
-      promise_.set_value(td::Unit());
+      promise_.set_value(std::move(wallets));
     } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error inserting to PG: " << e.what()));
+      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving wallets from PG: " << e.what()));
     }
     stop();
   }
 };
 
-class GetNFTCollection : public td::actor::Actor {
+
+class GetJettonMasters : public td::actor::Actor {
 private:
-  std::string connection_string_;
-  std::string address_;
-  td::Promise<NFTCollectionData> promise_;
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::vector<std::string> addresses_;
+  td::Promise<std::vector<JettonMasterData>> promise_;
 public:
-  GetNFTCollection(std::string connection_string, std::string address, td::Promise<NFTCollectionData> promise)
-    : connection_string_(std::move(connection_string))
-    , address_(std::move(address))
+  GetJettonMasters(std::shared_ptr<PgConnectionPool> pool, std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise)
+    : pool_(std::move(pool))
+    , addresses_(std::move(addresses))
     , promise_(std::move(promise))
   {
-    LOG(DEBUG) << "Created GetNFTCollection";
+    LOG(DEBUG) << "Created GetJettonMasters";
   }
 
   void start_up() override {
+    if (addresses_.empty()) {
+      promise_.set_value({});
+      stop();
+      return;
+    }
+    auto connection = pool_->acquire();
+    if (connection.is_error()) {
+      promise_.set_error(connection.move_as_error());
+      stop();
+      return;
+    }
     try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
-      }
-      pqxx::work txn(c);
-
-      std::string query = "SELECT address, next_item_index, owner_address, collection_content, data_hash, code_hash, last_transaction_lt, code_boc, data_boc "
-                          "FROM nft_collections "
-                          "WHERE address = $1;";
-
-      pqxx::result result = txn.exec_params(query, address_);
-
-      if (result.size() != 1) {
-        if (result.size() == 0) {
-          promise_.set_error(td::Status::Error(ErrorCode::ENTITY_NOT_FOUND, PSLICE() << "NFT Collection not found: " << address_));
-        } else {
-          promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "NFT Collection not unique: " << address_ << ", found " << result.size() << " records"));
+      auto c = connection.move_as_ok();
+      pqxx::work txn(*c);
+
+      pqxx::result result = txn.exec_prepared("select_jetton_masters", addresses_);
+
+      std::vector<JettonMasterData> masters;
+      masters.reserve(result.size());
+      for (const auto& row : result) {
+        JettonMasterData master_data;
+        master_data.address = row[0].as<std::string>();
+        master_data.total_supply = row[1].as<uint64_t>();
+        master_data.mintable = row[2].as<bool>();
+        if (!row[3].is_null()) {
+          master_data.admin_address = row[3].as<std::string>();
         }
-        
-        stop();
-        return;
-      }
-
-      pqxx::row row = result[0];
-
-      NFTCollectionData collection_data;
-      collection_data.address = row[0].as<std::string>();
-      collection_data.next_item_index = td::dec_string_to_int256(row[1].as<std::string>());
-      if (!row[2].is_null()) {
-        collection_data.owner_address = row[2].as<std::string>();
-      }
-      if (!row[3].is_null()) {
-        // TODO: Parse the JSON string into a map
+        master_data.jetton_wallet_code_hash = vm::CellHash::from_slice(td::base64_decode(row[4].as<std::string>()).move_as_ok());
+        master_data.data_hash = vm::CellHash::from_slice(td::base64_decode(row[5].as<std::string>()).move_as_ok());
+        master_data.code_hash = vm::CellHash::from_slice(td::base64_decode(row[6].as<std::string>()).move_as_ok());
+        master_data.last_transaction_lt = row[7].as<uint64_t>();
+        auto code_cell = boc_string_to_cell(row[8].as<std::string>());
+        auto data_cell = boc_string_to_cell(row[9].as<std::string>());
+        if (code_cell.is_error() || data_cell.is_error()) {
+          LOG(WARNING) << "Failed to deserialize code or data of jetton master " << master_data.address;
+          continue;
+        }
+        master_data.code_cell = code_cell.move_as_ok();
+        master_data.data_cell = data_cell.move_as_ok();
+        masters.push_back(std::move(master_data));
       }
-      collection_data.data_hash = vm::CellHash::from_slice(td::base64_decode(row[4].as<std::string>()).move_as_ok());
-      collection_data.code_hash = vm::CellHash::from_slice(td::base64_decode(row[5].as<std::string>()).move_as_ok());
-      collection_data.last_transaction_lt = row[6].as<uint64_t>();
-      collection_data.code_boc = row[7].as<std::string>();
-      collection_data.data_boc = row[8].as<std::string>();
 
       txn.commit();
-      promise_.set_value(std::move(collection_data));
+      promise_.set_value(std::move(masters));
     } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving collection from PG: " << e.what()));
+      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving masters from PG: " << e.what()));
     }
     stop();
   }
 };
 
-class UpsertNFTItem : public td::actor::Actor {
-private:
-  std::string connection_string_;
-  NFTItemData item_data_;
-  td::Promise<td::Unit> promise_;
 
+class GetNFTCollections : public td::actor::Actor {
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::vector<std::string> addresses_;
+  td::Promise<std::vector<NFTCollectionData>> promise_;
 public:
-  UpsertNFTItem(std::string connection_string, NFTItemData item_data, td::Promise<td::Unit> promise)
-    : connection_string_(std::move(connection_string))
-    , item_data_(std::move(item_data))
+  GetNFTCollections(std::shared_ptr<PgConnectionPool> pool, std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise)
+    : pool_(std::move(pool))
+    , addresses_(std::move(addresses))
     , promise_(std::move(promise))
   {
-    LOG(DEBUG) << "Created UpsertNFTItem";
+    LOG(DEBUG) << "Created GetNFTCollections";
   }
 
   void start_up() override {
+    if (addresses_.empty()) {
+      promise_.set_value({});
+      stop();
+      return;
+    }
+    auto connection = pool_->acquire();
+    if (connection.is_error()) {
+      promise_.set_error(connection.move_as_error());
+      stop();
+      return;
+    }
     try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
+      auto c = connection.move_as_ok();
+      pqxx::work txn(*c);
+
+      pqxx::result result = txn.exec_prepared("select_nft_collections", addresses_);
+
+      std::vector<NFTCollectionData> collections;
+      collections.reserve(result.size());
+      for (const auto& row : result) {
+        NFTCollectionData collection_data;
+        collection_data.address = row[0].as<std::string>();
+        collection_data.next_item_index = td::dec_string_to_int256(row[1].as<std::string>());
+        if (!row[2].is_null()) {
+          collection_data.owner_address = row[2].as<std::string>();
+        }
+        if (!row[3].is_null()) {
+          // TODO: Parse the JSON string into a map
+        }
+        collection_data.data_hash = vm::CellHash::from_slice(td::base64_decode(row[4].as<std::string>()).move_as_ok());
+        collection_data.code_hash = vm::CellHash::from_slice(td::base64_decode(row[5].as<std::string>()).move_as_ok());
+        collection_data.last_transaction_lt = row[6].as<uint64_t>();
+        auto code_cell = boc_string_to_cell(row[7].as<std::string>());
+        auto data_cell = boc_string_to_cell(row[8].as<std::string>());
+        if (code_cell.is_error() || data_cell.is_error()) {
+          LOG(WARNING) << "Failed to deserialize code or data of NFT collection " << collection_data.address;
+          continue;
+        }
+        collection_data.code_cell = code_cell.move_as_ok();
+        collection_data.data_cell = data_cell.move_as_ok();
+        collections.push_back(std::move(collection_data));
       }
-      pqxx::work txn(c);
-
-      std::string query = "INSERT INTO nft_items (address, init, index, collection_address, owner_address, content, last_transaction_lt, code_hash, data_hash) "
-                          "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9) "
-                          "ON CONFLICT (address) DO UPDATE "
-                          "SET init = $2, index = $3, collection_address = $4, owner_address = $5, content = $6, last_transaction_lt = $7, code_hash = $8, data_hash = $9;";
-
-      txn.exec_params(query,
-                      item_data_.address,
-                      item_data_.init,
-                      item_data_.index->to_dec_string(),
-                      item_data_.collection_address,
-                      item_data_.owner_address,
-                      item_data_.content ? content_to_json_string(item_data_.content.value()).c_str() : nullptr,
-                      item_data_.last_transaction_lt,
-                      td::base64_encode(item_data_.code_hash.as_slice().str()),
-                      td::base64_encode(item_data_.data_hash.as_slice().str()));
+
       txn.commit();
-      promise_.set_value(td::Unit());
+      promise_.set_value(std::move(collections));
     } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error inserting/updating NFT item in PG: " << e.what()));
+      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving collections from PG: " << e.what()));
     }
     stop();
   }
 };
 
-class GetNFTItem : public td::actor::Actor {
+
+class GetNFTItems : public td::actor::Actor {
 private:
-  std::string connection_string_;
-  std::string address_;
-  td::Promise<NFTItemData> promise_;
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::vector<std::string> addresses_;
+  td::Promise<std::vector<NFTItemData>> promise_;
 
 public:
-  GetNFTItem(std::string connection_string, std::string address, td::Promise<NFTItemData> promise)
-    : connection_string_(std::move(connection_string))
-    , address_(std::move(address))
+  GetNFTItems(std::shared_ptr<PgConnectionPool> pool, std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise)
+    : pool_(std::move(pool))
+    , addresses_(std::move(addresses))
     , promise_(std::move(promise))
   {
-    LOG(DEBUG) << "Created GetNFTItem";
+    LOG(DEBUG) << "Created GetNFTItems";
   }
 
   void start_up() override {
+    if (addresses_.empty()) {
+      promise_.set_value({});
+      stop();
+      return;
+    }
+    auto connection = pool_->acquire();
+    if (connection.is_error()) {
+      promise_.set_error(connection.move_as_error());
+      stop();
+      return;
+    }
     try {
-      pqxx::connection c(connection_string_);
-      if (!c.is_open()) {
-        promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database"));
-        stop();
-        return;
-      }
-      pqxx::work txn(c);
-
-      std::string query = "SELECT address, init, index, collection_address, owner_address, content, last_transaction_lt, code_hash, data_hash "
-                          "FROM nft_items "
-                          "WHERE address = $1;";
-
-      pqxx::result result = txn.exec_params(query, address_);
-
-      if (result.size() != 1) {
-        if (result.empty()) {
-          promise_.set_error(td::Status::Error(ErrorCode::ENTITY_NOT_FOUND, "NFT item not found"));
-        } else {
-          promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, "Multiple NFT items found with same address"));
+      auto c = connection.move_as_ok();
+      pqxx::work txn(*c);
+
+      pqxx::result result = txn.exec_prepared("select_nft_items", addresses_);
+
+      std::vector<NFTItemData> items;
+      items.reserve(result.size());
+      for (const auto& row : result) {
+        NFTItemData item_data;
+        item_data.address = row[0].as<std::string>();
+        item_data.init = row[1].as<bool>();
+        item_data.index = td::dec_string_to_int256(row[2].as<std::string>());
+        if (!row[3].is_null()) {
+          item_data.collection_address = row[3].as<std::string>();
         }
-        stop();
-        return;
-      }
-
-      NFTItemData item_data;
-      const pqxx::row &row = result[0];
-      item_data.address = row[0].as<std::string>();
-      item_data.init = row[1].as<bool>();
-      item_data.index = td::dec_string_to_int256(row[2].as<std::string>());
-      if (!row[3].is_null()) {
-        item_data.collection_address = row[3].as<std::string>();
+        item_data.owner_address = row[4].as<std::string>();
+        // item_data.content = row[5].as<std::string>(); TODO: parse JSON string to std::map<std::string, std::string>
+        item_data.last_transaction_lt = row[6].as<uint64_t>();
+        item_data.code_hash = vm::CellHash::from_slice(td::base64_decode(row[7].as<std::string>()).move_as_ok());
+        item_data.data_hash = vm::CellHash::from_slice(td::base64_decode(row[8].as<std::string>()).move_as_ok());
+        items.push_back(std::move(item_data));
       }
-      item_data.owner_address = row[4].as<std::string>();
-      // item_data.content = row[5].as<std::string>(); TODO: parse JSON string to std::map<std::string, std::string>
-      item_data.last_transaction_lt = row[6].as<uint64_t>();
-      item_data.code_hash = vm::CellHash::from_slice(td::base64_decode(row[7].as<std::string>()).move_as_ok());
-      item_data.data_hash = vm::CellHash::from_slice(td::base64_decode(row[8].as<std::string>()).move_as_ok());
 
-      promise_.set_value(std::move(item_data));
+      txn.commit();
+      promise_.set_value(std::move(items));
     } catch (const std::exception &e) {
-      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving item from PG: " << e.what()));
+      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error retrieving items from PG: " << e.what()));
     }
     stop();
   }
 };
 
 InsertManagerPostgres::InsertManagerPostgres(): 
+    write_stats_(std::make_shared<PgWriteStats>()),
     inserted_count_(0),
     start_time_(std::chrono::high_resolution_clock::now())
 {
@@ -1245,6 +1303,40 @@ void InsertManagerPostgres::start_up() {
   alarm_timestamp() = td::Timestamp::in(1.0);
 }
 
+std::shared_ptr<PgConnectionPool> InsertManagerPostgres::pool() {
+  if (!pool_) {
+    pool_options_.connection_string = credential.getConnectionString();
+    pool_options_.min_size = std::min(pool_options_.min_size, pool_options_.max_size);
+    pool_ = std::make_shared<PgConnectionPool>(pool_options_);
+    pool_->prepare("select_jetton_wallets", "SELECT balance, address, owner, jetton, last_transaction_lt, code_hash, data_hash "
+                                            "FROM jetton_wallets WHERE address = ANY($1)");
+    pool_->prepare("select_jetton_masters", "SELECT address, total_supply, mintable, admin_address, jetton_wallet_code_hash, data_hash, "
+                                            "code_hash, last_transaction_lt, code_boc, data_boc "
+                                            "FROM jetton_masters WHERE address = ANY($1)");
+    pool_->prepare("select_nft_collections", "SELECT address, next_item_index, owner_address, collection_content, data_hash, code_hash, "
+                                             "last_transaction_lt, code_boc, data_boc "
+                                             "FROM nft_collections WHERE address = ANY($1)");
+    pool_->prepare("select_nft_items", "SELECT address, init, index, collection_address, owner_address, content, last_transaction_lt, "
+                                       "code_hash, data_hash "
+                                       "FROM nft_items WHERE address = ANY($1)");
+  }
+  return pool_;
+}
+
+td::actor::ActorId<EntityUpsertWriter> InsertManagerPostgres::entity_writer() {
+  if (entity_writer_.empty()) {
+    entity_writer_ = create_db_actor<EntityUpsertWriter>("entity_writer", pool());
+  }
+  return entity_writer_.get();
+}
+
+td::actor::ActorId<PgPartitionManager> InsertManagerPostgres::partition_manager() {
+  if (partition_manager_.empty()) {
+    partition_manager_ = create_db_actor<PgPartitionManager>("partition_manager", pool(), partition_size_, partitions_ahead_);
+  }
+  return partition_manager_.get();
+}
+
 void InsertManagerPostgres::report_statistics() {
   auto now_time_ = std::chrono::high_resolution_clock::now();
   auto last_report_seconds_ = std::chrono::duration_cast<std::chrono::seconds>(now_time_ - last_verbose_time_);
@@ -1258,6 +1350,36 @@ void InsertManagerPostgres::report_statistics() {
               << " Time: " << total_seconds_.count() 
               << " (TPS: " << tasks_per_second << ")"
               << " Queued: " << insert_queue_.size();
+    LOG(INFO) << "Insert queue: " << queued_bytes_ / (1 << 20) << "MB queued, "
+              << inserting_bytes_ / (1 << 20) << "MB inserting, " << retrying_bytes_ / (1 << 20) << "MB in "
+              << retry_batches_.size() << " batches to retry, limit " << max_queue_bytes_ / (1 << 20) << "MB"
+              << ", dead letters " << dead_letters_count_;
+    LOG(INFO) << "Insert mode " << insert_mode_name(insert_mode_) << ", per table: " << write_stats_->to_string();
+    LOG(INFO) << "Batch sizing: budget " << batch_bytes_budget_ / (1 << 20) << "MB"
+              << " throughput " << insert_throughput_ / (1 << 20) << "MB/s"
+              << " target latency " << target_batch_latency_ << "s"
+              << " last batch " << last_batch_.mc_blocks << " mc blocks " << last_batch_.bytes / (1 << 10) << "KB"
+              << " in " << last_batch_.duration << "s";
+    if (batch_totals_.batches > 0) {
+      LOG(INFO) << "Batches: " << batch_totals_.batches << " committed"
+                << " avg " << batch_totals_.mc_blocks / batch_totals_.batches << " mc blocks"
+                << " avg " << batch_totals_.bytes / batch_totals_.batches / (1 << 10) << "KB"
+                << " avg latency " << batch_totals_.duration / batch_totals_.batches << "s"
+                << " max latency " << batch_totals_.max_duration << "s";
+      batch_totals_ = BatchSizingTotals{};
+    }
+
+    if (pool_) {
+      auto stats = pool_->get_stats();
+      LOG(INFO) << "PG pool: leased " << stats.leased
+                << " idle " << stats.idle
+                << " acquired " << stats.acquired
+                << " avg wait " << (stats.acquired ? stats.total_wait / stats.acquired : 0.0) << "s"
+                << " max wait " << stats.max_wait << "s"
+                << " connects " << stats.connects
+                << " failed " << stats.connect_failures
+                << " dropped " << stats.dropped;
+    }
   }
 }
 
@@ -1266,12 +1388,61 @@ void InsertManagerPostgres::alarm() {
 
   LOG(DEBUG) << "insert queue size: " << insert_queue_.size();
 
-  std::vector<td::Promise<td::Unit>> promises;
-  std::vector<ParsedBlockPtr> schema_blocks;
-  int tx_count = 0;
-  while (!insert_queue_.empty() && tx_count < batch_tx_count_ && schema_blocks.size() < batch_blocks_count_ && parallel_insert_actors_ < max_parallel_insert_actors_) {
+  if (bulk_load_state_ == BulkLoadState::Unchecked && (!bulk_load_retry_at_ || bulk_load_retry_at_.is_in_past())) {
+    if (bulk_load_) {
+      bulk_load_state_ = BulkLoadState::Preparing;
+      auto P = td::PromiseCreator::lambda([SelfId = actor_id(this)](td::Result<td::Unit> R) {
+        td::actor::send_closure(SelfId, &InsertManagerPostgres::bulk_load_prepared, std::move(R));
+      });
+      create_db_actor<PgBulkLoadPrepare>("bulk_load_prepare", pool(), bulk_load_deferred_indexes(partition_size_ > 0), std::move(P)).release();
+    } else if (key_format_ == PgKeyFormat::Binary) {
+      // only the binary schema of scripts/init_postgres_schema.sh has the deferred indexes under these names
+      bulk_load_state_ = BulkLoadState::Checking;
+      auto P = td::PromiseCreator::lambda([SelfId = actor_id(this)](td::Result<std::vector<PgDeferredIndex>> R) {
+        td::actor::send_closure(SelfId, &InsertManagerPostgres::bulk_load_checked, std::move(R));
+      });
+      create_db_actor<PgBulkLoadCheck>("bulk_load_check", pool(), bulk_load_deferred_indexes(partition_size_ > 0), std::move(P)).release();
+    } else {
+      bulk_load_state_ = BulkLoadState::Off;
+    }
+  }
+  if (bulk_load_state_ == BulkLoadState::TipReached && parallel_insert_actors_ == 0 && retry_batches_.empty() &&
+      (!bulk_load_retry_at_ || bulk_load_retry_at_.is_in_past())) {
+    bulk_load_state_ = BulkLoadState::Building;
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this)](td::Result<td::Unit> R) {
+      td::actor::send_closure(SelfId, &InsertManagerPostgres::bulk_load_finished, std::move(R));
+    });
+    create_db_actor<PgBulkLoadFinish>("bulk_load_finish", pool(), bulk_load_deferred_indexes(partition_size_ > 0), std::move(P)).release();
+  }
+  if (bulk_load_state_ != BulkLoadState::Off && bulk_load_state_ != BulkLoadState::Loading) {
+    alarm_timestamp() = td::Timestamp::in(1.0);
+    return;
+  }
+
+  bool scheduled = false;
+  td::Timestamp next_retry;
+  for (auto it = retry_batches_.begin(); it != retry_batches_.end() && parallel_insert_actors_ < max_parallel_insert_actors_;) {
+    if (it->not_before && !it->not_before.is_in_past()) {
+      next_retry.relax(it->not_before);
+      ++it;
+      continue;
+    }
+    auto batch = std::move(*it);
+    it = retry_batches_.erase(it);
+    retrying_bytes_ -= batch.bytes;
+    start_batch(std::move(batch));
+    scheduled = true;
+  }
+
+  InsertBatch batch;
+  size_t tx_count = 0;
+  while (!insert_queue_.empty() && tx_count < batch_tx_count_ && batch.blocks.size() < batch_blocks_count_ && batch.bytes < batch_bytes_budget_
+         && parallel_insert_actors_ < max_parallel_insert_actors_) {
     auto schema_block = std::move(insert_queue_.front());
     insert_queue_.pop();
+    auto block_bytes = schema_block->estimated_size();
+    batch.bytes += block_bytes;
+    queued_bytes_ -= block_bytes;
 
     auto promise = std::move(promise_queue_.front());
     promise_queue_.pop();
@@ -1280,77 +1451,242 @@ void InsertManagerPostgres::alarm() {
       tx_count += bl.transactions.size();
     }
 
-    promises.push_back(std::move(promise));
-    schema_blocks.push_back(std::move(schema_block));
+    batch.promises.push_back(std::move(promise));
+    batch.blocks.push_back(std::move(schema_block));
     if(inserted_count_ == 0) {
       start_time_ = std::chrono::high_resolution_clock::now();
     }
   }
-  bool scheduled = false;
-  if (!schema_blocks.empty()) {
+  if (!batch.blocks.empty()) {
     scheduled = true;
-    auto P = td::PromiseCreator::lambda([this, promises = std::move(promises)](td::Result<td::Unit> R) mutable {
-      parallel_insert_actors_--;
-      if (R.is_error()) {
-        LOG(ERROR) << "Error inserting to PG: " << R.error();
-        for (auto& p : promises) {
-          p.set_error(R.error().clone());
-        }
-        return;
-      }
-      
-      for (auto& p : promises) {
-        p.set_result(td::Unit());
-      }
-      
-      inserted_count_ += promises.size();
-    });
-    parallel_insert_actors_++;
-    td::actor::create_actor<InsertBatchMcSeqnos>("insert_batch_mc_seqnos", credential.getConnectionString(), std::move(schema_blocks), std::move(P)).release();
+    start_batch(std::move(batch));
   }
 
-  if (!insert_queue_.empty() && scheduled) {
+  if ((!insert_queue_.empty() || !retry_batches_.empty()) && scheduled) {
     alarm_timestamp() = td::Timestamp::in(0.1);
   } else {
     alarm_timestamp() = td::Timestamp::in(1.0);
   }
+  alarm_timestamp().relax(next_retry);
+}
+
+void InsertManagerPostgres::start_batch(InsertBatch batch) {
+  parallel_insert_actors_++;
+  inserting_bytes_ += batch.bytes;
+  // the actor gets its own copy of the block pointers, the batch keeps them for a retry
+  auto schema_blocks = batch.blocks;
+  auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), batch = std::move(batch),
+                                       started_at = td::Timestamp::now()](td::Result<td::Unit> R) mutable {
+    td::actor::send_closure(SelfId, &InsertManagerPostgres::insert_batch_done, std::move(batch), started_at, std::move(R));
+  });
+  // a bulk loaded batch must commit atomically, a partially written one could not be retried without conflict checks
+  bool bulk_load = bulk_load_state_ == BulkLoadState::Loading;
+  InsertBatchMcSeqnos::Options options{insert_mode_, key_format_, parallel_tables_ && !bulk_load, partition_size_ > 0, bulk_load};
+  if (partition_size_ == 0) {
+    create_db_actor<InsertBatchMcSeqnos>("insert_batch_mc_seqnos", pool(), options, write_stats_, std::move(schema_blocks), std::move(P)).release();
+    return;
+  }
+  // the batch is started once partitions for all its mc seqnos exist
+  uint32_t from_seqno = std::numeric_limits<uint32_t>::max();
+  uint32_t to_seqno = 0;
+  for (const auto& block : schema_blocks) {
+    from_seqno = std::min<uint32_t>(from_seqno, block->blocks_[0].seqno);
+    to_seqno = std::max<uint32_t>(to_seqno, block->blocks_[0].seqno);
+  }
+  auto Q = td::PromiseCreator::lambda([pool = pool(), options, write_stats = write_stats_, schema_blocks = std::move(schema_blocks),
+                                       P = std::move(P)](td::Result<td::Unit> R) mutable {
+    if (R.is_error()) {
+      P.set_error(R.move_as_error());
+      return;
+    }
+    create_db_actor<InsertBatchMcSeqnos>("insert_batch_mc_seqnos", std::move(pool), options, std::move(write_stats), std::move(schema_blocks), std::move(P)).release();
+  });
+  td::actor::send_closure(partition_manager(), &PgPartitionManager::ensure, from_seqno, to_seqno, std::move(Q));
+}
+
+void InsertManagerPostgres::bulk_load_checked(td::Result<std::vector<PgDeferredIndex>> R) {
+  if (R.is_error()) {
+    auto delay = insert_retry_delay(++bulk_load_attempt_, min_retry_delay, max_retry_delay);
+    LOG(ERROR) << "Failed to check for an interrupted bulk load, retrying in " << delay << "s: " << R.error();
+    bulk_load_state_ = BulkLoadState::Unchecked;
+    bulk_load_retry_at_ = td::Timestamp::in(delay);
+    return;
+  }
+  bulk_load_attempt_ = 0;
+  bulk_load_retry_at_ = td::Timestamp();
+  auto missing = R.move_as_ok();
+  if (missing.empty()) {
+    bulk_load_state_ = BulkLoadState::Off;
+    return;
+  }
+  LOG(WARNING) << missing.size() << " indexes and primary keys are missing, first " << missing[0].name
+               << ", an interrupted bulk load is resumed and they are built once the tip is reached";
+  bulk_load_prepared(td::Unit());
+}
+
+void InsertManagerPostgres::bulk_load_prepared(td::Result<td::Unit> R) {
+  if (R.is_error()) {
+    // the indexes may be dropped in part, inserts wait until the drop succeeds
+    auto delay = insert_retry_delay(++bulk_load_attempt_, min_retry_delay, max_retry_delay);
+    LOG(ERROR) << "Bulk load is not started, retrying in " << delay << "s: " << R.error();
+    bulk_load_state_ = BulkLoadState::Unchecked;
+    bulk_load_retry_at_ = td::Timestamp::in(delay);
+    return;
+  }
+  bulk_load_attempt_ = 0;
+  bulk_load_retry_at_ = td::Timestamp();
+  bulk_load_state_ = tip_reached_ ? BulkLoadState::TipReached : BulkLoadState::Loading;
+}
+
+void InsertManagerPostgres::tip_reached() {
+  tip_reached_ = true;
+  if (bulk_load_state_ == BulkLoadState::Loading) {
+    LOG(WARNING) << "Bulk load reached the tip, building indexes before switching to normal inserts";
+    bulk_load_state_ = BulkLoadState::TipReached;
+  }
+}
+
+void InsertManagerPostgres::bulk_load_finished(td::Result<td::Unit> R) {
+  if (R.is_error()) {
+    // without the unique indexes normal inserts can't resolve conflicts, they are held until the build succeeds
+    auto delay = insert_retry_delay(++bulk_load_attempt_, min_retry_delay, max_retry_delay);
+    LOG(ERROR) << "Bulk load failed to build indexes, inserts are held, retrying in " << delay << "s (attempt "
+               << bulk_load_attempt_ + 1 << "): " << R.error();
+    bulk_load_state_ = BulkLoadState::TipReached;
+    bulk_load_retry_at_ = td::Timestamp::in(delay);
+    return;
+  }
+  LOG(WARNING) << "Bulk load finished, switching to normal inserts";
+  bulk_load_attempt_ = 0;
+  bulk_load_retry_at_ = td::Timestamp();
+  bulk_load_state_ = BulkLoadState::Off;
+}
+
+void InsertManagerPostgres::insert_batch_done(InsertBatch batch, td::Timestamp started_at, td::Result<td::Unit> R) {
+  parallel_insert_actors_--;
+  inserting_bytes_ -= batch.bytes;
+  if (R.is_error()) {
+    retry_batch(std::move(batch), R.move_as_error());
+    return;
+  }
+  // EWMA of per batch throughput, a batch that is mostly fixed overhead underestimates it and the next one grows
+  auto duration = std::max(td::Time::now() - started_at.at(), 1e-3);
+  auto throughput = batch.bytes / duration;
+  insert_throughput_ = insert_throughput_ == 0 ? throughput : 0.3 * throughput + 0.7 * insert_throughput_;
+  auto budget = insert_throughput_ * target_batch_latency_;
+  batch_bytes_budget_ = static_cast<size_t>(std::clamp(budget, static_cast<double>(min_batch_bytes), static_cast<double>(max_batch_bytes)));
+  last_batch_ = {batch.promises.size(), batch.bytes, duration};
+  batch_totals_.batches++;
+  batch_totals_.mc_blocks += batch.promises.size();
+  batch_totals_.bytes += batch.bytes;
+  batch_totals_.duration += duration;
+  batch_totals_.max_duration = std::max(batch_totals_.max_duration, duration);
+
+  for (auto& p : batch.promises) {
+    p.set_result(td::Unit());
+  }
+
+  inserted_count_ += batch.promises.size();
+}
+
+void InsertManagerPostgres::retry_batch(InsertBatch batch, td::Status error) {
+  if (error.code() != ErrorCode::DB_DATA_ERROR) {
+    if (++batch.attempt < max_batch_attempts) {
+      auto delay = insert_retry_delay(batch.attempt, min_retry_delay, max_retry_delay);
+      LOG(WARNING) << "Error inserting to PG, retrying " << batch.blocks.size() << " mc blocks in " << delay << "s (attempt "
+                   << batch.attempt + 1 << "): " << error;
+      batch.not_before = td::Timestamp::in(delay);
+      queue_retry(std::move(batch));
+      return;
+    }
+    LOG(ERROR) << "Giving up on a batch of " << batch.blocks.size() << " mc blocks after " << max_batch_attempts
+               << " attempts, its seqnos go back to the scanner: " << error;
+    for (auto& p : batch.promises) {
+      p.set_error(error.clone());
+    }
+    return;
+  }
+
+  if (batch.blocks.size() == 1) {
+    auto mc_seqno = batch.blocks[0]->blocks_[0].seqno;
+    LOG(ERROR) << "mc seqno " << mc_seqno << " can't be inserted, moving it to insert_dead_letters: " << error;
+    dead_letters_count_++;
+    create_db_actor<InsertDeadLetter>("insert_dead_letter", pool(), mc_seqno, error.message().str(), std::move(batch.promises[0])).release();
+    return;
+  }
+
+  // halves are retried in order, every split halves the number of blocks that are written twice
+  LOG(WARNING) << "Data error in a batch of " << batch.blocks.size() << " mc blocks, splitting it: " << error;
+  auto halves = split_insert_batch(std::move(batch));
+  queue_retry(std::move(halves.first));
+  queue_retry(std::move(halves.second));
+}
+
+void InsertManagerPostgres::queue_retry(InsertBatch batch) {
+  retrying_bytes_ += batch.bytes;
+  retry_batches_.push_back(std::move(batch));
+}
+
+void InsertDeadLetter::start_up() {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    promise_.set_error(connection.move_as_error());
+    stop();
+    return;
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    txn.exec_params0("INSERT INTO insert_dead_letters (mc_seqno, error) VALUES ($1, $2) "
+                     "ON CONFLICT (mc_seqno) DO UPDATE SET error = EXCLUDED.error, failed_at = now()", mc_seqno_, error_);
+    txn.commit();
+    promise_.set_value(td::Unit());
+  } catch (const std::exception &e) {
+    promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error writing dead letter for mc seqno " << mc_seqno_ << ": " << e.what()));
+  }
+  stop();
 }
 
 void InsertManagerPostgres::insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) {
+  queued_bytes_ += block_ds->estimated_size();
   insert_queue_.push(std::move(block_ds));
   promise_queue_.push(std::move(promise));
 }
 
+void InsertManagerPostgres::get_insert_credit(td::Promise<td::int64> promise) {
+  promise.set_value(static_cast<td::int64>(max_queue_bytes_) - static_cast<td::int64>(queued_bytes_ + inserting_bytes_ + retrying_bytes_));
+}
+
 void InsertManagerPostgres::upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) {
-  td::actor::create_actor<UpsertJettonWallet>("upsertjettonwallet", credential.getConnectionString(), std::move(jetton_wallet), std::move(promise)).release();
+  td::actor::send_closure(entity_writer(), &EntityUpsertWriter::upsert<JettonWalletData>, std::move(jetton_wallet), std::move(promise));
 }
 
-void InsertManagerPostgres::get_jetton_wallet(std::string address, td::Promise<JettonWalletData> promise) {
-  td::actor::create_actor<GetJettonWallet>("getjettonwallet", credential.getConnectionString(), std::move(address), std::move(promise)).release();
+void InsertManagerPostgres::get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) {
+  create_db_actor<GetJettonWallets>("getjettonwallets", pool(), std::move(addresses), std::move(promise)).release();
 }
 
 void InsertManagerPostgres::upsert_jetton_master(JettonMasterData jetton_wallet, td::Promise<td::Unit> promise) {
-  td::actor::create_actor<UpsertJettonMaster>("upsertjettonmaster", credential.getConnectionString(), std::move(jetton_wallet), std::move(promise)).release();
+  td::actor::send_closure(entity_writer(), &EntityUpsertWriter::upsert<JettonMasterData>, std::move(jetton_wallet), std::move(promise));
 }
 
-void InsertManagerPostgres::get_jetton_master(std::string address, td::Promise<JettonMasterData> promise) {
-  td::actor::create_actor<GetJettonMaster>("getjettonmaster", credential.getConnectionString(), std::move(address), std::move(promise)).release();
+void InsertManagerPostgres::get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) {
+  create_db_actor<GetJettonMasters>("getjettonmasters", pool(), std::move(addresses), std::move(promise)).release();
 }
 
 void InsertManagerPostgres::upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) {
-  td::actor::create_actor<UpsertNFTCollection>("upsertnftcollection", credential.getConnectionString(), std::move(nft_collection), std::move(promise)).release();
+  td::actor::send_closure(entity_writer(), &EntityUpsertWriter::upsert<NFTCollectionData>, std::move(nft_collection), std::move(promise));
 }
 
-void InsertManagerPostgres::get_nft_collection(std::string address, td::Promise<NFTCollectionData> promise) {
-  td::actor::create_actor<GetNFTCollection>("getnftcollection", credential.getConnectionString(), std::move(address), std::move(promise)).release();
+void InsertManagerPostgres::get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) {
+  create_db_actor<GetNFTCollections>("getnftcollections", pool(), std::move(addresses), std::move(promise)).release();
 }
 
 void InsertManagerPostgres::upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) {
-  td::actor::create_actor<UpsertNFTItem>("upsertnftitem", credential.getConnectionString(), std::move(nft_item), std::move(promise)).release();
+  td::actor::send_closure(entity_writer(), &EntityUpsertWriter::upsert<NFTItemData>, std::move(nft_item), std::move(promise));
 }
 
-void InsertManagerPostgres::get_nft_item(std::string address, td::Promise<NFTItemData> promise) {
-  td::actor::create_actor<GetNFTItem>("getnftitem", credential.getConnectionString(), std::move(address), std::move(promise)).release();
+void InsertManagerPostgres::get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) {
+  create_db_actor<GetNFTItems>("getnftitems", pool(), std::move(addresses), std::move(promise)).release();
 }
 
 std::string InsertManagerPostgres::PostgresCredential::getConnectionString()  {
@@ -1364,17 +1700,58 @@ std::string InsertManagerPostgres::PostgresCredential::getConnectionString()  {
 }
 
 
-void InsertManagerPostgres::get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) {
-  LOG(INFO) << "Reading existing seqnos";
-  std::vector<std::uint32_t> existing_mc_seqnos;
-  try {
-    pqxx::connection c(credential.getConnectionString());
-    pqxx::work txn(c);
-    for (auto [seqno]: txn.query<std::uint32_t>("select seqno from blocks where workchain = -1")) {
-      existing_mc_seqnos.push_back(seqno);
+// The schema may come from ton-indexer, which knows nothing about the bookkeeping tables of this indexer. They are
+// created here, get_existing_seqnos is the first request of both DbScanner and the segment log replay.
+class GetExistingSeqnos : public td::actor::Actor {
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  bool parallel_tables_;
+  td::Promise<std::vector<std::uint32_t>> promise_;
+
+public:
+  GetExistingSeqnos(std::shared_ptr<PgConnectionPool> pool, bool parallel_tables, td::Promise<std::vector<std::uint32_t>> promise)
+    : pool_(std::move(pool))
+    , parallel_tables_(parallel_tables)
+    , promise_(std::move(promise))
+  {
+  }
+
+  void start_up() override {
+    LOG(INFO) << "Reading existing seqnos";
+    std::vector<std::uint32_t> existing_mc_seqnos;
+    auto connection = pool_->acquire();
+    if (connection.is_error()) {
+      promise_.set_error(connection.move_as_error());
+      stop();
+      return;
     }
-    promise.set_result(std::move(existing_mc_seqnos));
-  } catch (const std::exception &e) {
-    promise.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error selecting from PG: " << e.what()));
+    try {
+      auto c = connection.move_as_ok();
+      pqxx::work txn(*c);
+      // same definitions as in scripts/init_postgres_schema.sh
+      txn.exec0("CREATE TABLE IF NOT EXISTS insert_dead_letters (mc_seqno integer not null primary key, "
+                "error text not null, failed_at timestamp not null default now())");
+      std::string query;
+      if (parallel_tables_) {
+        // tables of a batch are committed separately, only batches with a commit marker are complete
+        txn.exec0("CREATE TABLE IF NOT EXISTS mc_block_commits (seqno integer not null primary key, "
+                  "committed_at timestamp not null default now())");
+        query = "SELECT seqno FROM mc_block_commits UNION SELECT mc_seqno FROM insert_dead_letters";
+      } else {
+        query = "SELECT seqno FROM blocks WHERE workchain = -1 UNION SELECT mc_seqno FROM insert_dead_letters";
+      }
+      for (const auto& row : txn.exec(query)) {
+        existing_mc_seqnos.push_back(row[0].as<std::uint32_t>());
+      }
+      txn.commit();
+      promise_.set_result(std::move(existing_mc_seqnos));
+    } catch (const std::exception &e) {
+      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error selecting from PG: " << e.what()));
+    }
+    stop();
   }
+};
+
+void InsertManagerPostgres::get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) {
+  create_db_actor<GetExistingSeqnos>("getexistingseqnos", pool(), parallel_tables_, std::move(promise)).release();
 }
@@ -1,19 +1,92 @@
 #pragma once
 #include <queue>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <functional>
 #include <pqxx/pqxx>
 #include "InsertManager.h"
+#include "InterfaceRegistry.h"
+#include "PgConnectionPool.h"
+#include "PgTableWriter.h"
+#include "PgPartitionManager.h"
+#include "PgBulkLoad.h"
+#include "InsertBatch.h"
 
 class InsertBatchMcSeqnos;
+class EntityUpsertWriter;
 
 class InsertManagerPostgres: public InsertManagerInterface {
 private:
   std::queue<ParsedBlockPtr> insert_queue_;
   std::queue<td::Promise<td::Unit>> promise_queue_;
+  // estimated bytes of the queued blocks, of the batches being inserted and of the failed ones waiting for a retry,
+  // DbScanner admits new seqnos only while their sum stays below max_queue_bytes_
+  size_t max_queue_bytes_{1 << 30};
+  size_t queued_bytes_{0};
+  size_t inserting_bytes_{0};
+  size_t retrying_bytes_{0};
 
-  int batch_blocks_count_{512};
-  int batch_tx_count_{50000};
+  size_t batch_blocks_count_{512};
+  size_t batch_tx_count_{50000};
+
+  // Batches are cut at a byte budget that keeps their commit latency near target_batch_latency_. The budget follows
+  // the smoothed insert throughput, so the batches are small at the tip and grow during backfill.
+  static constexpr size_t min_batch_bytes = 1 << 20;
+  static constexpr size_t max_batch_bytes = 256 << 20;
+  double target_batch_latency_{2.0};
+  size_t batch_bytes_budget_{4 << 20};
+  double insert_throughput_{0};
+  struct BatchSizing {
+    size_t mc_blocks{0};
+    size_t bytes{0};
+    double duration{0};
+  } last_batch_;
+  // committed batches since the last statistics report
+  struct BatchSizingTotals {
+    size_t batches{0};
+    size_t mc_blocks{0};
+    size_t bytes{0};
+    double duration{0};
+    double max_duration{0};
+  } batch_totals_;
   int max_parallel_insert_actors_{3};
-  std::atomic<int> parallel_insert_actors_{0};
+  int parallel_insert_actors_{0};
+
+  // A batch failed on a data error is split in halves until the failing mc block is alone, that block goes to
+  // insert_dead_letters and the rest commit without being refetched. Other errors retry the whole batch with
+  // exponential backoff up to max_batch_attempts times before the seqnos go back to DbScanner, so an outage of about
+  // two minutes is ridden out.
+  static constexpr int max_batch_attempts = 8;
+  static constexpr double min_retry_delay = 1.0;
+  static constexpr double max_retry_delay = 60.0;
+  std::deque<InsertBatch> retry_batches_;
+  size_t dead_letters_count_{0};
+  PgInsertMode insert_mode_{PgInsertMode::Values};
+  PgKeyFormat key_format_{PgKeyFormat::Text};
+  bool parallel_tables_{false};
+  uint32_t partition_size_{0};
+  // Bulk load drops secondary indexes and primary keys, copies disjoint tables without conflict checks and builds
+  // the indexes back once DbScanner reaches the tip. Batches are held while indexes are dropped or built. A failed
+  // build is retried with backoff. Without --bulk-load the binary schema is checked at startup, missing deferred
+  // indexes mean a bulk load was interrupted and it is resumed, so no batch is written without conflict checks.
+  enum class BulkLoadState {
+    Unchecked,
+    Checking,
+    Off,
+    Preparing,
+    Loading,
+    TipReached,
+    Building
+  };
+  bool bulk_load_{false};
+  BulkLoadState bulk_load_state_{BulkLoadState::Unchecked};
+  bool tip_reached_{false};
+  int bulk_load_attempt_{0};
+  td::Timestamp bulk_load_retry_at_;
+  uint32_t partitions_ahead_{2};
+  std::shared_ptr<PgWriteStats> write_stats_;
 
   struct PostgresCredential {
     std::string host = "127.0.0.1";
@@ -25,6 +98,16 @@ private:
     std::string getConnectionString();
   } credential;
 
+  PgConnectionPool::Options pool_options_;
+  std::shared_ptr<PgConnectionPool> pool_;
+  td::actor::ActorOwn<EntityUpsertWriter> entity_writer_;
+  td::actor::ActorOwn<PgPartitionManager> partition_manager_;
+
+  // created on first use, after all setters have been applied
+  std::shared_ptr<PgConnectionPool> pool();
+  td::actor::ActorId<EntityUpsertWriter> entity_writer();
+  td::actor::ActorId<PgPartitionManager> partition_manager();
+
   std::atomic<uint> inserted_count_;
   std::chrono::system_clock::time_point start_time_;
   std::chrono::system_clock::time_point last_verbose_time_;
@@ -37,59 +120,116 @@ public:
   void set_password(std::string value) { credential.password = std::move(value); }
   void set_dbname(std::string value) { credential.dbname = std::move(value); }
 
-  void set_batch_blocks_count(int value) { batch_blocks_count_ = value; }
+  void set_batch_blocks_count(size_t value) { batch_blocks_count_ = value; }
+  void set_max_queue_bytes(size_t value) { max_queue_bytes_ = value; }
+  void set_target_batch_latency(double value) { target_batch_latency_ = value; }
   void set_parallel_inserts_actors(int value) { max_parallel_insert_actors_ = value; }
+  void set_max_db_connections(int value) { pool_options_.max_size = value; }
+  void set_insert_mode(PgInsertMode value) { insert_mode_ = value; }
+  void set_key_format(PgKeyFormat value) { key_format_ = value; }
+  void set_parallel_tables(bool value) { parallel_tables_ = value; }
+  void set_partition_size(uint32_t value) { partition_size_ = value; }
+  void set_bulk_load(bool value) { bulk_load_ = value; }
 
   void start_up() override;
   void alarm() override;
 
   void report_statistics();
+  void bulk_load_checked(td::Result<std::vector<PgDeferredIndex>> R);
+  void bulk_load_prepared(td::Result<td::Unit> R);
+  void bulk_load_finished(td::Result<td::Unit> R);
+  void start_batch(InsertBatch batch);
+  void insert_batch_done(InsertBatch batch, td::Timestamp started_at, td::Result<td::Unit> R);
+  void retry_batch(InsertBatch batch, td::Status error);
+  void queue_retry(InsertBatch batch);
 
   void get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) override;
+  void tip_reached() override;
+  void get_insert_credit(td::Promise<td::int64> promise) override;
   void insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) override;
   void upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) override;
-  void get_jetton_wallet(std::string address, td::Promise<JettonWalletData> promise) override;
+  void get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) override;
   void upsert_jetton_master(JettonMasterData jetton_wallet, td::Promise<td::Unit> promise) override;
-  void get_jetton_master(std::string address, td::Promise<JettonMasterData> promise) override;
+  void get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) override;
   void upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) override;
-  void get_nft_collection(std::string address, td::Promise<NFTCollectionData> promise) override;
+  void get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) override;
   void upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) override;
-  void get_nft_item(std::string address, td::Promise<NFTItemData> promise) override;
+  void get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) override;
 };
 
+// Writes one batch of mc blocks. By default all tables go in one transaction, with parallel_tables every table group
+// is written by an InsertTableGroup on its own connection and the batch becomes visible only after its seqnos are
+// written to mc_block_commits.
 class InsertBatchMcSeqnos: public td::actor::Actor {
 public:
-  InsertBatchMcSeqnos(std::string connection_string, std::vector<ParsedBlockPtr> mc_blocks, td::Promise<td::Unit>&& promise) :
-    connection_string_(std::move(connection_string)), mc_blocks_(std::move(mc_blocks)), promise_(std::move(promise)) {}
+  struct Options {
+    PgInsertMode mode{PgInsertMode::Values};
+    PgKeyFormat key_format{PgKeyFormat::Text};
+    bool parallel_tables{false};
+    // blocks, transactions and account_states get an mc_seqno column, the partition key
+    bool partitioned{false};
+    // tables whose rows belong to exactly one mc block are copied without conflict checks
+    bool bulk_load{false};
+  };
+
+  InsertBatchMcSeqnos(std::shared_ptr<PgConnectionPool> pool, Options options, std::shared_ptr<PgWriteStats> write_stats,
+                      std::vector<ParsedBlockPtr> mc_blocks, td::Promise<td::Unit>&& promise) :
+    pool_(std::move(pool)), mode_(options.mode), key_format_(options.key_format), parallel_tables_(options.parallel_tables),
+    partitioned_(options.partitioned), bulk_load_(options.bulk_load), write_stats_(std::move(write_stats)), mc_blocks_(std::move(mc_blocks)), promise_(std::move(promise)) {}
   
   void start_up();
+  void table_groups_done(td::Result<td::Unit> R);
+
+  // Rows of the tables written for every block, the null sink encodes them too. mc_seqno is the partition key column.
+  static PgRow block_row(PgKeyFormat key_format, const schema::Block& block, std::optional<uint32_t> mc_seqno);
+  static PgRow transaction_row(PgKeyFormat key_format, const schema::Block& blk, const schema::Transaction& transaction,
+                               std::optional<uint32_t> mc_seqno);
+  static PgRow message_row(PgKeyFormat key_format, const schema::Message& message);
+  static PgRow account_state_row(PgKeyFormat key_format, const schema::AccountState& account_state,
+                                 std::optional<uint32_t> mc_seqno);
 private:
-  std::string connection_string_;
+  std::shared_ptr<PgConnectionPool> pool_;
+  PgInsertMode mode_;
+  PgKeyFormat key_format_;
+  bool parallel_tables_;
+  bool partitioned_;
+  bool bulk_load_;
+  std::shared_ptr<PgWriteStats> write_stats_;
   std::vector<ParsedBlockPtr> mc_blocks_;
   td::Promise<td::Unit> promise_;
+  // table groups finish their tables concurrently
+  std::mutex table_stats_mutex_;
+  std::vector<std::pair<std::string, PgTableWriter::Stats>> table_stats_;
+  // statements of the batch in VALUES mode are queued here and sent without waiting for each other
+  pqxx::pipeline *pipeline_{nullptr};
+  double pipeline_wait_{0};
 
   struct TxMsg {
-    std::string tx_hash;
-    std::string msg_hash;
+    td::Bits256 tx_hash;
+    td::Bits256 msg_hash;
     std::string direction; // in or out
   };
 
   struct MsgBody {
-    std::string hash;
+    td::Bits256 hash;
     std::string body;
   };
 
-  std::string stringify(schema::ComputeSkipReason compute_skip_reason);
-  std::string stringify(schema::AccStatusChange acc_status_change);
-  std::string stringify(schema::AccountStatus account_status);
-  std::string jsonify(const schema::SplitMergeInfo& info);
-  std::string jsonify(const schema::StorageUsedShort& s);
-  std::string jsonify(const schema::TrStoragePhase& s);
-  std::string jsonify(const schema::TrCreditPhase& c);
-  std::string jsonify(const schema::TrActionPhase& action);
-  std::string jsonify(const schema::TrBouncePhase& bounce);
-  std::string jsonify(const schema::TrComputePhase& compute);
-  std::string jsonify(schema::TransactionDescr descr);
+  static std::string stringify(schema::ComputeSkipReason compute_skip_reason);
+  static std::string stringify(schema::AccStatusChange acc_status_change);
+  static std::string stringify(schema::AccountStatus account_status);
+  static std::string jsonify(const schema::SplitMergeInfo& info);
+  static std::string jsonify(const schema::StorageUsedShort& s);
+  static std::string jsonify(const schema::TrStoragePhase& s);
+  static std::string jsonify(const schema::TrCreditPhase& c);
+  static std::string jsonify(const schema::TrActionPhase& action);
+  static std::string jsonify(const schema::TrBouncePhase& bounce);
+  static std::string jsonify(const schema::TrComputePhase& compute);
+  static std::string jsonify(schema::TransactionDescr descr);
+  void insert_table_groups();
+  void finish(td::Result<td::Unit> R);
+  void finish_table(PgTableWriter& writer);
+  PgTableWriter disjoint_table_writer(pqxx::work &transaction, std::string table, std::vector<std::string> columns);
   void insert_blocks(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks);
   void insert_transactions(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks);
   void insert_messsages(pqxx::work &transaction, const std::vector<schema::Message> &messages, const std::vector<MsgBody>& msg_bodies, const std::vector<TxMsg> &tx_msgs);
@@ -101,7 +241,87 @@ private:
   void insert_jetton_burns(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks);
   void insert_nft_transfers(pqxx::work &transaction, const std::vector<ParsedBlockPtr>& mc_blocks);
 
+  std::vector<schema::Message> messages_;
+  std::vector<TxMsg> tx_msgs_;
+  std::vector<MsgBody> msg_bodies_;
+
   int transactions_count_{0};
   int messages_count_{0};
   int blocks_count_{0};
 };
+
+// Writes a group of tables of a batch in its own transaction on its own connection
+class InsertTableGroup: public td::actor::Actor {
+public:
+  InsertTableGroup(std::shared_ptr<PgConnectionPool> pool, std::string name, std::function<void(pqxx::work&)> write, td::Promise<td::Unit> promise) :
+    pool_(std::move(pool)), name_(std::move(name)), write_(std::move(write)), promise_(std::move(promise)) {}
+
+  void start_up() override;
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::string name_;
+  std::function<void(pqxx::work&)> write_;
+  td::Promise<td::Unit> promise_;
+};
+
+// Records an mc block that can't be inserted, its seqno is then reported as existing until the row is deleted
+class InsertDeadLetter: public td::actor::Actor {
+public:
+  InsertDeadLetter(std::shared_ptr<PgConnectionPool> pool, std::uint32_t mc_seqno, std::string error, td::Promise<td::Unit> promise) :
+    pool_(std::move(pool)), mc_seqno_(mc_seqno), error_(std::move(error)), promise_(std::move(promise)) {}
+
+  void start_up() override;
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::uint32_t mc_seqno_;
+  std::string error_;
+  td::Promise<td::Unit> promise_;
+};
+
+// Buffers jetton and NFT entity upserts and writes them as multi-row upserts over a pooled connection.
+// Upserts of the same address are collapsed to the one with max last_transaction_lt, every caller gets
+// its promise resolved when the batch containing its address is committed. Each entity type is written in its own
+// transaction. A rejected row is found by splitting the rows in halves and only its callers get the error, other
+// errors keep the rows buffered and retry them with backoff.
+class EntityUpsertWriter: public td::actor::Actor {
+public:
+  EntityUpsertWriter(std::shared_ptr<PgConnectionPool> pool) : pool_(std::move(pool)) {}
+
+  template <class T>
+  void upsert(T entity, td::Promise<td::Unit> promise);
+
+  void alarm() override;
+
+private:
+  template <class T>
+  struct Buffer {
+    std::map<std::string, T> entities;
+    std::map<std::string, std::vector<td::Promise<td::Unit>>> promises;
+    size_t promises_count{0};
+    int attempt{0};
+    // set after a failed write, the buffer is not written before this time
+    td::Timestamp retry_at;
+  };
+
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::tuple<Buffer<JettonWalletData>, Buffer<JettonMasterData>, Buffer<NFTCollectionData>, Buffer<NFTItemData>> buffers_;
+  size_t buffered_count_{0};
+
+  size_t max_batch_size_{2000};
+  double flush_interval_{0.5};
+  static constexpr int max_write_attempts = 8;
+  static constexpr double min_retry_delay = 1.0;
+  static constexpr double max_retry_delay = 60.0;
+
+  void flush();
+  template <class T>
+  void flush_buffer(Buffer<T> &buffer);
+  template <class T>
+  td::Status write_entities(const std::map<std::string, T> &entities);
+  // writes the rows of a rejected write in halves, the addresses of the rows that still fail go to failed
+  template <class T>
+  void write_bisecting(std::map<std::string, T> entities, td::Status error, std::map<std::string, td::Status> &failed);
+
+  template <class T>
+  std::string build_upsert_query(pqxx::work &transaction, const std::map<std::string, T>& entities);
+};
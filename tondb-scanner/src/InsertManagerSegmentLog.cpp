@@ -0,0 +1,138 @@
+#include "td/utils/Time.h"
+#include "InsertManagerSegmentLog.h"
+#include "ParsedBlockSerializer.h"
+
+
+void InsertManagerSegmentLog::start_up() {
+  auto S = init();
+  if (S.is_error()) {
+    LOG(FATAL) << "Failed to start segment log sink in " << options_.directory << ": " << S;
+  }
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+td::Status InsertManagerSegmentLog::init() {
+  TRY_RESULT_ASSIGN(writer_, SegmentLogWriter::open(options_.directory, options_.segment_bytes));
+  TRY_RESULT_ASSIGN(entities_, EntityKvStore::open(options_.directory + "/entities"));
+  segment_log::Reader reader(options_.directory);
+  if (!reader.for_each([&](const segment_log::Record &record) { existing_mc_seqnos_.insert(record.mc_seqno); })) {
+    return td::Status::Error(reader.error());
+  }
+  LOG(INFO) << "Segment log has " << existing_mc_seqnos_.size() << " mc seqnos, writing segment " << writer_->segment();
+  return td::Status::OK();
+}
+
+void InsertManagerSegmentLog::insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) {
+  uint32_t mc_seqno = block_ds->blocks_[0].seqno;
+  if (existing_mc_seqnos_.count(mc_seqno) > 0) {
+    promise.set_value(td::Unit());
+    return;
+  }
+  if (pending_mc_seqnos_.count(mc_seqno) > 0) {
+    pending_promises_.push_back(std::move(promise));
+    return;
+  }
+  auto data = serialize_parsed_block(*block_ds);
+  auto S = writer_->append(mc_seqno, data);
+  if (S.is_error()) {
+    promise.set_error(S.clone());
+    fail_pending(std::move(S));
+    return;
+  }
+  bytes_written_ += data.size();
+  pending_mc_seqnos_.insert(mc_seqno);
+  pending_promises_.push_back(std::move(promise));
+  // inserts already queued in the mailbox are appended before the commit and share its sync
+  if (!commit_at_) {
+    commit_at_ = td::Timestamp::in(0.001);
+    alarm_timestamp().relax(commit_at_);
+  }
+}
+
+void InsertManagerSegmentLog::commit() {
+  commit_at_ = td::Timestamp();
+  if (pending_promises_.empty()) {
+    return;
+  }
+  auto start = td::Time::now();
+  auto S = writer_->commit();
+  if (S.is_error()) {
+    fail_pending(std::move(S));
+    return;
+  }
+  commit_time_ += td::Time::now() - start;
+  commits_++;
+  records_written_ += pending_mc_seqnos_.size();
+  existing_mc_seqnos_.insert(pending_mc_seqnos_.begin(), pending_mc_seqnos_.end());
+  pending_mc_seqnos_.clear();
+  for (auto &promise : pending_promises_) {
+    promise.set_value(td::Unit());
+  }
+  pending_promises_.clear();
+}
+
+// Appended records of a failed segment are never indexed, the writer continues in a new segment and the seqnos
+// of the failed promises are scanned again.
+void InsertManagerSegmentLog::fail_pending(td::Status error) {
+  LOG(ERROR) << "Segment log write failed: " << error;
+  for (auto &promise : pending_promises_) {
+    promise.set_error(error.clone());
+  }
+  pending_promises_.clear();
+  pending_mc_seqnos_.clear();
+  auto writer = SegmentLogWriter::open(options_.directory, options_.segment_bytes);
+  if (writer.is_error()) {
+    LOG(FATAL) << "Failed to reopen segment log in " << options_.directory << ": " << writer.move_as_error();
+  }
+  writer_ = writer.move_as_ok();
+}
+
+void InsertManagerSegmentLog::alarm() {
+  if (commit_at_ && commit_at_.is_in_past()) {
+    commit();
+  }
+  if (next_report_.is_in_past()) {
+    LOG(INFO) << "Segment log: " << records_written_ << " mc blocks, " << bytes_written_ / (1 << 20) << "MB in "
+              << commits_ << " commits, avg commit " << (commits_ ? commit_time_ / commits_ * 1000 : 0)
+              << "ms, segment " << writer_->segment();
+    next_report_ = td::Timestamp::in(10.0);
+  }
+  alarm_timestamp() = td::Timestamp::in(1.0);
+  alarm_timestamp().relax(commit_at_);
+}
+
+void InsertManagerSegmentLog::get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) {
+  promise.set_value(std::vector<std::uint32_t>(existing_mc_seqnos_.begin(), existing_mc_seqnos_.end()));
+}
+
+void InsertManagerSegmentLog::upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(jetton_wallet));
+}
+
+void InsertManagerSegmentLog::get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) {
+  promise.set_result(entities_->get_jetton_wallets(addresses));
+}
+
+void InsertManagerSegmentLog::upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(jetton_master));
+}
+
+void InsertManagerSegmentLog::get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) {
+  promise.set_result(entities_->get_jetton_masters(addresses));
+}
+
+void InsertManagerSegmentLog::upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(nft_collection));
+}
+
+void InsertManagerSegmentLog::get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) {
+  promise.set_result(entities_->get_nft_collections(addresses));
+}
+
+void InsertManagerSegmentLog::upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) {
+  promise.set_result(entities_->upsert(nft_item));
+}
+
+void InsertManagerSegmentLog::get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) {
+  promise.set_result(entities_->get_nft_items(addresses));
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <set>
+#include "InsertManager.h"
+#include "EntityKvStore.h"
+#include "SegmentLogWriter.h"
+
+
+// Appends every inserted ParsedBlock to a segment log in <directory>, see SegmentLogReader.h for the format and the
+// reader consumers use to tail it. Inserts arriving together are committed as a group with one sync, their promises
+// resolve after the commit. Existing mc seqnos are those in the index files, they and the seqnos waiting for a commit
+// are acknowledged again without being appended, so a rescan doesn't duplicate records. Jetton and NFT entities are kept in
+// <directory>/entities, outside the log.
+class InsertManagerSegmentLog: public InsertManagerInterface {
+public:
+  struct Options {
+    std::string directory;
+    size_t segment_bytes{256 << 20};
+  };
+
+  explicit InsertManagerSegmentLog(Options options) : options_(std::move(options)) {}
+
+  void start_up() override;
+  void alarm() override;
+
+  void insert(ParsedBlockPtr block_ds, td::Promise<td::Unit> promise) override;
+  void get_existing_seqnos(td::Promise<std::vector<std::uint32_t>> promise) override;
+  void upsert_jetton_wallet(JettonWalletData jetton_wallet, td::Promise<td::Unit> promise) override;
+  void get_jetton_wallets(std::vector<std::string> addresses, td::Promise<std::vector<JettonWalletData>> promise) override;
+  void upsert_jetton_master(JettonMasterData jetton_master, td::Promise<td::Unit> promise) override;
+  void get_jetton_masters(std::vector<std::string> addresses, td::Promise<std::vector<JettonMasterData>> promise) override;
+  void upsert_nft_collection(NFTCollectionData nft_collection, td::Promise<td::Unit> promise) override;
+  void get_nft_collections(std::vector<std::string> addresses, td::Promise<std::vector<NFTCollectionData>> promise) override;
+  void upsert_nft_item(NFTItemData nft_item, td::Promise<td::Unit> promise) override;
+  void get_nft_items(std::vector<std::string> addresses, td::Promise<std::vector<NFTItemData>> promise) override;
+
+private:
+  Options options_;
+  std::unique_ptr<SegmentLogWriter> writer_;
+  std::unique_ptr<EntityKvStore> entities_;
+  std::set<std::uint32_t> existing_mc_seqnos_;
+  // appended records waiting for the next commit
+  std::set<std::uint32_t> pending_mc_seqnos_;
+  std::vector<td::Promise<td::Unit>> pending_promises_;
+  td::Timestamp commit_at_;
+
+  size_t records_written_{0};
+  size_t bytes_written_{0};
+  size_t commits_{0};
+  double commit_time_{0};
+  td::Timestamp next_report_;
+
+  td::Status init();
+  void commit();
+  void fail_pending(td::Status error);
+};
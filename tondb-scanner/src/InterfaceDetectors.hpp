@@ -1,4 +1,6 @@
 #pragma once
+#include <queue>
+#include <mutex>
 #include "td/actor/actor.h"
 #include "vm/cells/Cell.h"
 #include "vm/stack.hpp"
@@ -15,133 +17,466 @@
 #include "crypto/block/block-parse.h"
 #include "parse_token_data.h"
 #include "DataParser.h"
+#include "LruCache.h"
+#include "InterfaceRegistry.h"
 
-enum SmcInterface {
-  IT_JETTON_MASTER,
-  IT_JETTON_WALLET,
-  IT_NFT_COLLECTION,
-  IT_NFT_ITEM
-};
 
-class FetchAccountFromShard: public td::actor::Actor {
+class InterfaceManager: public td::actor::Actor {
 private:
-  MasterchainBlockDataState blocks_ds_;
-  block::StdAddress address_;
-  td::Promise<schema::AccountState> promise_;
+  // per code hash: interfaces that were already checked and the ones that were found
+  struct CodeHashInterfaces {
+    uint32_t checked{0};
+    uint32_t present{0};
+  };
+  std::unordered_map<vm::CellHash, CodeHashInterfaces> cache_{};
+  td::actor::ActorId<InsertManagerInterface> insert_manager_;
 public:
-  FetchAccountFromShard(MasterchainBlockDataState blocks_ds, block::StdAddress address, td::Promise<schema::AccountState> promise) 
-    : blocks_ds_(blocks_ds), address_(address), promise_(std::move(promise)) {
+  // Interfaces table will consist of 3 columns: code_hash, interface, has_interface
+  InterfaceManager(td::actor::ActorId<InsertManagerInterface> insert_manager) : insert_manager_(insert_manager) {
   }
 
-  void start_up() override {
-    for (auto& block_ds : blocks_ds_) {
-      if (ton::shard_contains(block_ds.block_state->get_shard(), ton::extract_addr_prefix(address_.workchain, address_.addr))) {
-        auto root = block_ds.block_state->root_cell();
-        block::gen::ShardStateUnsplit::Record sstate;
-        if (!tlb::unpack_cell(root, sstate)) {
-          promise_.set_error(td::Status::Error("Failed to unpack ShardStateUnsplit"));
-          stop();
-          return;
-        }
-        vm::AugmentedDictionary accounts_dict{vm::load_cell_slice_ref(sstate.accounts), 256, block::tlb::aug_ShardAccounts};
-        
-        auto shard_account_csr = accounts_dict.lookup(address_.addr);
-        if (shard_account_csr.is_null()) {
-          promise_.set_error(td::Status::Error("Account not found in accounts_dict"));
-          stop();
-          return;
-        } 
-        td::Ref<vm::Cell> account_root = shard_account_csr->prefetch_ref();
-
-        int account_tag = block::gen::t_Account.get_tag(vm::load_cell_slice(account_root));
-        switch (account_tag) {
-        case block::gen::Account::account_none:
-          promise_.set_error(td::Status::Error("Account is empty"));
-          stop();
-          return;
-        case block::gen::Account::account: {
-          auto account_r = ParseQuery::parse_account(account_root);
-          if (account_r.is_error()) {
-            promise_.set_error(account_r.move_as_error());
-            stop();
-            return;
-          }
-          promise_.set_value(account_r.move_as_ok());
-          stop();
-          return;
-        }
-        default:
-          promise_.set_error(td::Status::Error("Unknown account tag"));
-          stop();
-          return;
-        }
+  // for every code hash returns the mask of interfaces it may implement: the present ones plus all not checked yet.
+  // Unknown code hashes get all_interfaces_mask, so they are classified by every detector.
+  void get_candidate_interfaces(std::vector<vm::CellHash> code_hashes, td::Promise<std::vector<uint32_t>> promise) {
+    std::vector<uint32_t> result;
+    result.reserve(code_hashes.size());
+    for (const auto& code_hash : code_hashes) {
+      auto it = cache_.find(code_hash);
+      if (it == cache_.end()) {
+        result.push_back(all_interfaces_mask);
+      } else {
+        result.push_back(it->second.present | (all_interfaces_mask & ~it->second.checked));
       }
     }
-    promise_.set_error(td::Status::Error("Account not found in shards"));
-    stop();
+    promise.set_value(std::move(result));
   }
-};
 
-class InterfaceManager: public td::actor::Actor {
-private:
-  std::map<std::pair<vm::CellHash, SmcInterface>, bool> cache_{};
-  td::actor::ActorId<InsertManagerInterface> insert_manager_;
-public:
-  // Interfaces table will consist of 3 columns: code_hash, interface, has_interface
-  InterfaceManager(td::actor::ActorId<InsertManagerInterface> insert_manager) : insert_manager_(insert_manager) {
+  void set_interface(vm::CellHash code_hash, SmcInterface interface, bool has) {
+    auto& entry = cache_[code_hash];
+    entry.checked |= interface_bit(interface);
+    if (has) {
+      entry.present |= interface_bit(interface);
+    } else {
+      entry.present &= ~interface_bit(interface);
+    }
   }
+};
 
-  void check_interface(vm::CellHash code_hash, SmcInterface interface, td::Promise<bool> promise) {
-    if (cache_.count({code_hash, interface})) {
-      promise.set_value(std::move(cache_[{code_hash, interface}]));
-      return;
+// rough in-memory footprint of cached entities, used to bound InterfaceStorage by bytes rather than by entries
+inline size_t cell_size_estimate(const td::Ref<vm::Cell>& cell) {
+  return cell.is_null() ? 0 : sizeof(vm::Cell) + 128;
+}
+
+inline size_t content_size_estimate(const td::optional<std::map<std::string, std::string>>& content) {
+  size_t size = 0;
+  if (content) {
+    for (const auto& [key, value] : content.value()) {
+      size += 64 + key.size() + value.size();
     }
-    promise.set_error(td::Status::Error(ErrorCode::CODE_HASH_NOT_FOUND, "Unknown code hash"));
   }
+  return size;
+}
+
+inline size_t entity_size(const JettonWalletData& data) {
+  return sizeof(data) + data.address.size() + data.owner.size() + data.jetton.size();
+}
+
+inline size_t entity_size(const JettonMasterData& data) {
+  // code cells are shared between masters, so only the data cell is accounted
+  return sizeof(data) + data.address.size() + (data.admin_address ? data.admin_address.value().size() : 0) 
+    + content_size_estimate(data.jetton_content) + cell_size_estimate(data.data_cell);
+}
+
+inline size_t entity_size(const NFTCollectionData& data) {
+  return sizeof(data) + data.address.size() + (data.owner_address ? data.owner_address.value().size() : 0) 
+    + content_size_estimate(data.collection_content) + cell_size_estimate(data.data_cell);
+}
+
+inline size_t entity_size(const NFTItemData& data) {
+  return sizeof(data) + data.address.size() + data.collection_address.size() + data.owner_address.size() 
+    + content_size_estimate(data.content);
+}
+
+struct AccountKey {
+  ton::WorkchainId workchain;
+  td::Bits256 addr;
+
+  bool operator==(const AccountKey& other) const {
+    return workchain == other.workchain && addr == other.addr;
+  }
+};
 
-  void set_interface(vm::CellHash code_hash, SmcInterface interface, bool has) {
-    cache_[{code_hash, interface}] = has;
+struct AccountKeyHasher {
+  std::size_t operator()(const AccountKey& k) const {
+    return Bits256Hasher()(k.addr) ^ static_cast<std::size_t>(k.workchain);
   }
 };
 
-template <typename T>
-class InterfaceDetector: public td::actor::Actor {
+/// @brief Parsed code cells by hash, so the cached entities of contracts deployed from the same code share one cell.
+/// Bounded by the number of distinct codes, an evicted code is only stored again by the entities cached after it.
+/// Thread safe, one instance is shared by the detectors whose entities keep code cells.
+class CodeCellCache {
 public:
-  virtual void detect(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<T> promise) = 0;
-  virtual ~InterfaceDetector() = default;
+  static constexpr size_t default_max_size = 10000;
+
+  explicit CodeCellCache(size_t max_size = default_max_size) : cells_(max_size) {
+  }
+
+  td::Ref<vm::Cell> get(td::Ref<vm::Cell> code_cell) {
+    auto hash = code_cell->get_hash();
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto cached = cells_.get(hash);
+    if (cached) {
+      return *cached;
+    }
+    cells_.put(hash, code_cell);
+    return code_cell;
+  }
+
+private:
+  std::mutex mutex_;
+  LruCache<vm::CellHash, td::Ref<vm::Cell>> cells_;
 };
 
+/// @brief Entity cache of a detector: bounded in-memory LRU -> Postgres -> shard state.
+/// Misses in memory are collected and resolved with one batched PG read per actor turn, 
+/// the shard state tier is up to the detector, it only reports the outcome via report_shard_lookup().
+/// Must be used only from the owning actor, set_owner() has to be called from its start_up().
 template <class T>
 class InterfaceStorage {
 public:
-  std::map<std::string, T> cache_{};
-  td::actor::ActorId<InsertManagerInterface> insert_manager_;
+  static constexpr size_t default_max_memory = 256 << 20;
+  static constexpr size_t max_db_batch_size = 1000;
+
+  InterfaceStorage(td::actor::ActorId<InsertManagerInterface> insert_manager, size_t max_memory = default_max_memory) 
+    : insert_manager_(insert_manager), cache_(max_memory) {
+  }
 
-  InterfaceStorage(td::actor::ActorId<InsertManagerInterface> insert_manager) 
-    : insert_manager_(insert_manager) {
+  void set_owner(td::actor::ActorId<> owner, std::string name) {
+    owner_ = std::move(owner);
+    name_ = std::move(name);
   }
 
   void check(block::StdAddress address, td::Promise<T> promise) {
-    auto it = cache_.find(convert::to_raw_address(address));
-    if (it != cache_.end()) {
-      auto res = it->second;
-      promise.set_value(std::move(res));
-    } else {
-      promise.set_error(td::Status::Error(ErrorCode::ENTITY_NOT_FOUND));
+    maybe_report_stats();
+
+    AccountKey key{address.workchain, address.addr};
+    auto cached = cache_.get(key);
+    if (cached) {
+      stats_.memory_hits++;
+      promise.set_value(T(*cached));
+      return;
+    }
+
+    auto& waiters = pending_[key];
+    waiters.push_back(std::move(promise));
+    if (waiters.size() > 1) {
+      // the same address is already waiting for the db
+      return;
+    }
+    to_fetch_.push_back(address);
+    if (!flush_scheduled_) {
+      flush_scheduled_ = true;
+      // all checks already in the mailbox are processed before the flush, so they end up in the same batch
+      td::actor::send_lambda(owner_, [this]() { flush(); });
+    }
+  }
+
+  // resolves with one flag per address, true if the entity is known in any tier, fails if the db could not be read
+  void check_many(std::vector<block::StdAddress> addresses, td::Promise<std::vector<bool>> promise) {
+    auto known = std::make_shared<std::vector<bool>>(addresses.size(), false);
+    td::MultiPromise mp;
+    auto ig = mp.init_guard();
+    ig.add_promise(td::PromiseCreator::lambda([known, promise = std::move(promise)](td::Result<td::Unit> R) mutable {
+      if (R.is_error()) {
+        promise.set_error(R.move_as_error());
+        return;
+      }
+      promise.set_value(std::move(*known));
+    }));
+    for (size_t i = 0; i < addresses.size(); i++) {
+      // callbacks are invoked on the owning actor only, so the flags need no locking
+      check(addresses[i], td::PromiseCreator::lambda([known, i, promise = ig.get_promise()](td::Result<T> R) mutable {
+        if (R.is_error() && R.error().code() == ErrorCode::DB_ERROR) {
+          promise.set_error(R.move_as_error());
+          return;
+        }
+        (*known)[i] = R.is_ok();
+        promise.set_value(td::Unit());
+      }));
     }
   }
 
   void add(block::StdAddress address, T data, td::Promise<td::Unit> promise) {
-    cache_.emplace(convert::to_raw_address(address), data);
+    put_if_newer(AccountKey{address.workchain, address.addr}, data);
     
-    auto P = td::PromiseCreator::lambda([this, address, promise = std::move(promise)](td::Result<td::Unit> r_unit) mutable {
+    auto P = td::PromiseCreator::lambda([promise = std::move(promise)](td::Result<td::Unit> r_unit) mutable {
       if (r_unit.is_error()) {
-        promise.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Failed to add to entity to db: " << r_unit.error().message()));
+        // a rejected row fails again on a rescan, it is logged by the writer and doesn't fail the block
+        auto code = r_unit.error().code() == ErrorCode::DB_DATA_ERROR ? ErrorCode::DB_DATA_ERROR : ErrorCode::DB_ERROR;
+        promise.set_error(td::Status::Error(code, PSLICE() << "Failed to add to entity to db: " << r_unit.error().message()));
       } else {
         promise.set_result(td::Unit());
       }
     });
-    td::actor::send_closure(insert_manager_, &InsertManagerInterface::upsert_entity<T>, data, std::move(P));
+    td::actor::send_closure(insert_manager_, &InsertManagerInterface::upsert_entity<T>, std::move(data), std::move(P));
+  }
+
+  // memory tier only, doesn't touch the LRU order
+  bool is_cached(const block::StdAddress& address) const {
+    return cache_.contains(AccountKey{address.workchain, address.addr});
+  }
+
+  void report_shard_lookup(bool found) {
+    if (found) {
+      stats_.shard_hits++;
+    } else {
+      stats_.shard_misses++;
+    }
+  }
+
+private:
+  struct Stats {
+    uint64_t memory_hits{0};
+    uint64_t db_hits{0};
+    uint64_t db_misses{0};
+    uint64_t db_errors{0};
+    uint64_t shard_hits{0};
+    uint64_t shard_misses{0};
+  };
+
+  td::actor::ActorId<InsertManagerInterface> insert_manager_;
+  td::actor::ActorId<> owner_;
+  std::string name_;
+  LruCache<AccountKey, T, AccountKeyHasher> cache_;
+  std::unordered_map<AccountKey, std::vector<td::Promise<T>>, AccountKeyHasher> pending_;
+  std::vector<block::StdAddress> to_fetch_;
+  bool flush_scheduled_{false};
+  Stats stats_;
+  td::Timestamp next_report_ = td::Timestamp::in(60.0);
+
+  void put_if_newer(const AccountKey& key, const T& data) {
+    auto cached = cache_.get(key);
+    if (cached && cached->last_transaction_lt > data.last_transaction_lt) {
+      return;
+    }
+    cache_.put(key, data, entity_size(data));
+  }
+
+  void flush() {
+    flush_scheduled_ = false;
+    auto to_fetch = std::move(to_fetch_);
+    to_fetch_.clear();
+
+    for (size_t offset = 0; offset < to_fetch.size(); offset += max_db_batch_size) {
+      auto end = std::min(to_fetch.size(), offset + max_db_batch_size);
+      std::vector<block::StdAddress> batch(to_fetch.begin() + offset, to_fetch.begin() + end);
+      std::vector<std::string> raw_addresses;
+      raw_addresses.reserve(batch.size());
+      for (const auto& address : batch) {
+        raw_addresses.push_back(convert::to_raw_address(address));
+      }
+
+      auto P = td::PromiseCreator::lambda([this, owner = owner_, batch = std::move(batch)](td::Result<std::vector<T>> R) mutable {
+        td::actor::send_lambda(owner, [this, batch = std::move(batch), R = std::move(R)]() mutable { 
+          on_db_result(std::move(batch), std::move(R)); 
+        });
+      });
+      td::actor::send_closure(insert_manager_, &InsertManagerInterface::get_entities<T>, std::move(raw_addresses), std::move(P));
+    }
+  }
+
+  void on_db_result(std::vector<block::StdAddress> batch, td::Result<std::vector<T>> R) {
+    if (R.is_error()) {
+      LOG(WARNING) << "Failed to read " << batch.size() << " entities from db: " << R.error();
+      stats_.db_errors += batch.size();
+    } else {
+      std::map<std::string, T> found;
+      for (auto& entity : R.move_as_ok()) {
+        found.emplace(entity.address, std::move(entity));
+      }
+      for (const auto& address : batch) {
+        auto it = found.find(convert::to_raw_address(address));
+        if (it != found.end()) {
+          put_if_newer(AccountKey{address.workchain, address.addr}, it->second);
+        }
+      }
+    }
+
+    for (const auto& address : batch) {
+      AccountKey key{address.workchain, address.addr};
+      auto pending_it = pending_.find(key);
+      if (pending_it == pending_.end()) {
+        continue;
+      }
+      auto waiters = std::move(pending_it->second);
+      pending_.erase(pending_it);
+
+      // an add() may have happened while the read was in flight, the cache has the most actual version anyway
+      auto cached = cache_.get(key);
+      if (R.is_ok()) {
+        if (cached) {
+          stats_.db_hits++;
+        } else {
+          stats_.db_misses++;
+        }
+      }
+      for (auto& waiter : waiters) {
+        if (cached) {
+          waiter.set_value(T(*cached));
+        } else if (R.is_error()) {
+          // the entity may exist, the caller has to fail rather than treat it as unknown
+          waiter.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Failed to read entity from db: " << R.error().message()));
+        } else {
+          waiter.set_error(td::Status::Error(ErrorCode::ENTITY_NOT_FOUND));
+        }
+      }
+    }
+  }
+
+  void maybe_report_stats() {
+    if (!next_report_.is_in_past()) {
+      return;
+    }
+    next_report_ = td::Timestamp::in(60.0);
+    LOG(INFO) << name_ << " cache: " << cache_.size() << " entries, " << (cache_.weight() >> 20) << " MB"
+              << " | memory hits: " << stats_.memory_hits
+              << " | db hits: " << stats_.db_hits << " misses: " << stats_.db_misses << " errors: " << stats_.db_errors
+              << " | shard hits: " << stats_.shard_hits << " misses: " << stats_.shard_misses;
+    stats_ = Stats{};
+  }
+};
+
+/// @brief Base of all detectors, coalesces detection requests of the same address.
+/// With many mc blocks in flight the same account is seen in several of them. While detections are running a request
+/// is held for coalesce_window seconds and only the state with the newest last_tx_lt runs get-methods and reaches the
+/// db, an idle detector runs the requests already in its mailbox at once. Requests of older states resolve immediately
+/// with DETECTION_SUPERSEDED when the entity is already cached, their blocks' events are recognized either way.
+/// Otherwise they share the result of the newest state, so their blocks go on only after the new entity is cached.
+template <typename T>
+class InterfaceDetector: public td::actor::Actor {
+public:
+  static constexpr double coalesce_window = 0.2;
+
+  void detect(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<T> promise) {
+    AccountKey key{address.workchain, address.addr};
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+      PendingDetect request{address, std::move(code_cell), std::move(data_cell), last_tx_lt, std::move(account_index), {}};
+      request.waiters.push_back(std::move(promise));
+      pending_.emplace(key, std::move(request));
+      if (running_ == 0) {
+        schedule_idle_flush();
+      }
+      auto deadline = td::Timestamp::in(coalesce_window);
+      deadlines_.push({deadline, key});
+      alarm_timestamp().relax(deadline);
+      return;
+    }
+
+    auto& request = it->second;
+    if (last_tx_lt < request.last_tx_lt && is_cached(address)) {
+      promise.set_error(td::Status::Error(ErrorCode::DETECTION_SUPERSEDED, "Newer state of the account is being detected"));
+      return;
+    }
+    if (last_tx_lt > request.last_tx_lt) {
+      if (is_cached(address)) {
+        for (auto& waiter : request.waiters) {
+          waiter.set_error(td::Status::Error(ErrorCode::DETECTION_SUPERSEDED, "Newer state of the account is being detected"));
+        }
+        request.waiters.clear();
+      }
+      request.code_cell = std::move(code_cell);
+      request.data_cell = std::move(data_cell);
+      request.last_tx_lt = last_tx_lt;
+      request.account_index = std::move(account_index);
+    }
+    request.waiters.push_back(std::move(promise));
+  }
+
+  void alarm() override {
+    while (!deadlines_.empty() && deadlines_.front().first.is_in_past()) {
+      auto key = deadlines_.front().second;
+      deadlines_.pop();
+      run_pending(key);
+    }
+    if (!deadlines_.empty()) {
+      alarm_timestamp() = deadlines_.front().first;
+    }
+  }
+
+  virtual ~InterfaceDetector() = default;
+
+protected:
+  // runs detection of the newest known state of the address
+  virtual void detect_latest(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<T> promise) = 0;
+  // whether the entity of the address is in the detector's memory cache
+  virtual bool is_cached(const block::StdAddress& address) const = 0;
+
+private:
+  struct PendingDetect {
+    block::StdAddress address;
+    td::Ref<vm::Cell> code_cell;
+    td::Ref<vm::Cell> data_cell;
+    uint64_t last_tx_lt;
+    ShardAccountIndexPtr account_index;
+    std::vector<td::Promise<T>> waiters;
+  };
+  std::unordered_map<AccountKey, PendingDetect, AccountKeyHasher> pending_;
+  // the window is constant, so deadlines are ordered by insertion. The entry of a request that already ran at an idle
+  // flush may start a later request of the same address before its own deadline, it only coalesces less.
+  std::queue<std::pair<td::Timestamp, AccountKey>> deadlines_;
+  // detections started and not resolved yet
+  size_t running_{0};
+  bool idle_flush_scheduled_{false};
+
+  void schedule_idle_flush() {
+    if (idle_flush_scheduled_) {
+      return;
+    }
+    idle_flush_scheduled_ = true;
+    // requests already in the mailbox are processed before the flush, so they still coalesce with each other
+    td::actor::send_lambda(actor_id(this), [this]() {
+      idle_flush_scheduled_ = false;
+      std::vector<AccountKey> keys;
+      keys.reserve(pending_.size());
+      for (const auto& [key, request] : pending_) {
+        keys.push_back(key);
+      }
+      for (const auto& key : keys) {
+        run_pending(key);
+      }
+    });
+  }
+
+  void detection_done() {
+    CHECK(running_ > 0);
+    if (--running_ == 0 && !pending_.empty()) {
+      schedule_idle_flush();
+    }
+  }
+
+  void run_pending(const AccountKey& key) {
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+      return;
+    }
+    auto request = std::move(it->second);
+    pending_.erase(it);
+
+    running_++;
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), waiters = std::move(request.waiters)](td::Result<T> R) mutable {
+      for (auto& waiter : waiters) {
+        if (R.is_ok()) {
+          waiter.set_value(T(R.ok()));
+        } else {
+          waiter.set_error(R.error().clone());
+        }
+      }
+      td::actor::send_closure(SelfId, &InterfaceDetector<T>::detection_done);
+    });
+    detect_latest(request.address, std::move(request.code_cell), std::move(request.data_cell), request.last_tx_lt, 
+                  std::move(request.account_index), std::move(P));
   }
 };
 
@@ -153,44 +488,42 @@ private:
   td::actor::ActorId<InterfaceManager> interface_manager_;
   td::actor::ActorId<InsertManagerInterface> insert_manager_;
   InterfaceStorage<JettonMasterData> storage_;
+  std::shared_ptr<CodeCellCache> code_cells_;
 public:
-  JettonMasterDetector(td::actor::ActorId<InterfaceManager> interface_manager, td::actor::ActorId<InsertManagerInterface> insert_manager) 
-    : storage_(insert_manager_)
+  JettonMasterDetector(td::actor::ActorId<InterfaceManager> interface_manager, td::actor::ActorId<InsertManagerInterface> insert_manager,
+      std::shared_ptr<CodeCellCache> code_cells)
+    : storage_(insert_manager)
+    , code_cells_(std::move(code_cells))
     , interface_manager_(interface_manager)
     , insert_manager_(insert_manager) {
   }
 
-  void detect(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<JettonMasterData> promise) override {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), address, code_cell, data_cell, last_tx_lt, promise = std::move(promise)](td::Result<bool> code_hash_is_master) mutable {
-      if (code_hash_is_master.is_error()) {
-        td::actor::send_closure(SelfId, &JettonMasterDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, std::move(promise));
-        return;
-      }
-      if (!code_hash_is_master.move_as_ok()) {
-        promise.set_error(td::Status::Error(ErrorCode::CACHED_CODE_HASH_NO_ENTITY, "Code hash is not a Jetton Master"));
-        return;
-      }
+  void start_up() override {
+    storage_.set_owner(actor_id(this), "Jetton masters");
+  }
 
-      td::actor::send_closure(SelfId, &JettonMasterDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, std::move(promise));
-    });
+  bool is_cached(const block::StdAddress& address) const override {
+    return storage_.is_cached(address);
+  }
 
-    td::actor::send_closure(interface_manager_, &InterfaceManager::check_interface, code_cell->get_hash(), IT_JETTON_MASTER, std::move(P));
+  void detect_latest(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<JettonMasterData> promise) override {
+    // EventProcessor only routes here states whose code hash is not known to lack the interface
+    detect_continue(address, code_cell, data_cell, last_tx_lt, std::move(promise));
   }
 
-  void detect_from_shard(const MasterchainBlockDataState& blocks_ds, block::StdAddress address, td::Promise<JettonMasterData> promise) {
-    auto R = td::PromiseCreator::lambda([SelfId = actor_id(this), address, promise = std::move(promise)](td::Result<schema::AccountState> account_state_r) mutable {
-      if (account_state_r.is_error()) {
-        promise.set_error(account_state_r.move_as_error());
-        return;
-      }
-      auto account_state = account_state_r.move_as_ok();
-      if (account_state.account_status != "active") {
-        promise.set_error(td::Status::Error("Account is not active"));
-        return;
-      }
-      td::actor::send_closure(SelfId, &JettonMasterDetector::detect_impl, address, account_state.code, account_state.data, account_state.last_trans_lt, std::move(promise));
-    });
-    td::actor::create_actor<FetchAccountFromShard>("fetchaccountfromshard", blocks_ds, address, std::move(R)).release();
+  void detect_from_shard(ShardAccountIndexPtr account_index, block::StdAddress address, td::Promise<JettonMasterData> promise) {
+    auto account_state_r = account_index->get_account(address);
+    storage_.report_shard_lookup(account_state_r.is_ok());
+    if (account_state_r.is_error()) {
+      promise.set_error(account_state_r.move_as_error());
+      return;
+    }
+    auto account_state = account_state_r.move_as_ok();
+    if (account_state.account_status != "active") {
+      promise.set_error(td::Status::Error("Account is not active"));
+      return;
+    }
+    detect_impl(address, account_state.code, account_state.data, account_state.last_trans_lt, std::move(promise));
   }
 
   void detect_continue(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt,  td::Promise<JettonMasterData> promise) {
@@ -214,27 +547,17 @@ public:
     args.set_now(td::Time::now());
     args.set_address(std::move(address));
 
-    args.set_method_id("get_jetton_data");
+    using Traits = InterfaceTraits<JettonMasterData>;
+    args.set_method_id(Traits::get_method);
     auto res = smc.run_get_method(args);
 
-    const int return_stack_size = 5;
-    const vm::StackEntry::Type return_types[return_stack_size] = {vm::StackEntry::Type::t_int, vm::StackEntry::Type::t_int, 
-      vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_cell, vm::StackEntry::Type::t_cell};
-
-    if (!res.success || res.stack->depth() != return_stack_size) {
-      td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), IT_JETTON_MASTER, false);
-      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_jetton_data failed"));
+    bool has_interface = res.success && validate_stack<JettonMasterData>(*res.stack);
+    td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), Traits::interface, has_interface);
+    if (!has_interface) {
+      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, PSLICE() << Traits::get_method << " failed"));
       return;
     }
-
     auto stack = res.stack->as_span();
-    
-    for (int i = 0; i < return_stack_size; i++) {
-      if (stack[i].type() != return_types[i]) {
-        promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_jetton_data failed"));
-        return;
-      }
-    }
 
     JettonMasterData data;
     data.address = convert::to_raw_address(address);
@@ -247,9 +570,10 @@ public:
     }
     data.admin_address = admin_address.move_as_ok();
     data.last_transaction_lt = last_tx_lt;
+    data.code_hash = code_cell->get_hash();
     data.data_hash = data_cell->get_hash();
-    data.code_boc = td::base64_encode(vm::std_boc_serialize(code_cell).move_as_ok());
-    data.data_boc = td::base64_encode(vm::std_boc_serialize(data_cell).move_as_ok());
+    data.code_cell = code_cells_->get(code_cell);
+    data.data_cell = data_cell;
     
     auto jetton_content = parse_token_data(stack[3].as_cell());
     if (jetton_content.is_ok()) {
@@ -260,7 +584,7 @@ public:
     }
     data.jetton_wallet_code_hash = stack[4].as_cell()->get_hash();
     
-    auto cache_promise = td::PromiseCreator::lambda([this, code_hash = code_cell->get_hash(), promise = std::move(promise), data](td::Result<td::Unit> r) mutable {
+    auto cache_promise = td::PromiseCreator::lambda([promise = std::move(promise), data](td::Result<td::Unit> r) mutable {
       if (r.is_error()) {
         promise.set_error(r.move_as_error());
         return;
@@ -270,28 +594,87 @@ public:
     storage_.add(address, std::move(data), std::move(cache_promise));
   }
 
-  void get_wallet_address(const MasterchainBlockDataState& blocks_ds, block::StdAddress master_address, block::StdAddress owner_address, td::Promise<block::StdAddress> promise) {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), blocks_ds, master_address, owner_address, promise = std::move(promise)](td::Result<JettonMasterData> r) mutable {
+  void get_wallet_address(ShardAccountIndexPtr account_index, block::StdAddress master_address, block::StdAddress owner_address, td::Promise<block::StdAddress> promise) {
+    auto P = td::PromiseCreator::lambda([promise = std::move(promise)](td::Result<std::vector<td::Result<block::StdAddress>>> R) mutable {
+      if (R.is_error()) {
+        promise.set_error(R.move_as_error());
+        return;
+      }
+      auto addresses = R.move_as_ok();
+      promise.set_result(std::move(addresses[0]));
+    });
+    get_wallet_addresses(account_index, master_address, {owner_address}, std::move(P));
+  }
+
+  // derives wallet addresses of many owners against one master, the master contract is loaded once for the whole batch
+  void get_wallet_addresses(ShardAccountIndexPtr account_index, block::StdAddress master_address, std::vector<block::StdAddress> owner_addresses, 
+                            td::Promise<std::vector<td::Result<block::StdAddress>>> promise) {
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), account_index, master_address, owner_addresses, promise = std::move(promise)](td::Result<JettonMasterData> r) mutable {
       if (r.is_error()) {
-        auto R = td::PromiseCreator::lambda([SelfId, promise = std::move(promise), blocks_ds, master_address, owner_address](td::Result<JettonMasterData> r) mutable {
+        auto R = td::PromiseCreator::lambda([SelfId, promise = std::move(promise), master_address, owner_addresses = std::move(owner_addresses)](td::Result<JettonMasterData> r) mutable {
           if (r.is_error()) {
             promise.set_error(r.move_as_error());
           } else {
-            td::actor::send_closure(SelfId, &JettonMasterDetector::get_wallet_address_impl, r.move_as_ok(), master_address, owner_address, std::move(promise));
+            td::actor::send_closure(SelfId, &JettonMasterDetector::get_wallet_addresses_impl, r.move_as_ok(), master_address, std::move(owner_addresses), std::move(promise));
           }
         });
-        td::actor::send_closure(SelfId, &JettonMasterDetector::detect_from_shard, blocks_ds, master_address, std::move(R));
+        td::actor::send_closure(SelfId, &JettonMasterDetector::detect_from_shard, std::move(account_index), master_address, std::move(R));
         return;
       }
-      td::actor::send_closure(SelfId, &JettonMasterDetector::get_wallet_address_impl, r.move_as_ok(), master_address, owner_address, std::move(promise));
+      td::actor::send_closure(SelfId, &JettonMasterDetector::get_wallet_addresses_impl, r.move_as_ok(), master_address, std::move(owner_addresses), std::move(promise));
     });
     storage_.check(master_address, std::move(P));
   }
 
-  void get_wallet_address_impl(JettonMasterData data, block::StdAddress master_address, block::StdAddress owner_address, td::Promise<block::StdAddress> P) {
-    auto code_cell = vm::std_boc_deserialize(td::base64_decode(data.code_boc).move_as_ok()).move_as_ok();
-    auto data_cell = vm::std_boc_deserialize(td::base64_decode(data.data_boc).move_as_ok()).move_as_ok();
-    ton::SmartContract smc({code_cell, data_cell});
+  void get_wallet_addresses_impl(JettonMasterData data, block::StdAddress master_address, std::vector<block::StdAddress> owner_addresses, 
+                                 td::Promise<std::vector<td::Result<block::StdAddress>>> promise) {
+    std::vector<td::Result<block::StdAddress>> result;
+    result.reserve(owner_addresses.size());
+
+    std::unique_ptr<ton::SmartContract> smc;
+    for (const auto& owner_address : owner_addresses) {
+      WalletAddressKey key{master_address, data.data_hash, owner_address};
+      auto cached = wallet_address_cache_.get(key);
+      if (cached) {
+        result.push_back(*cached);
+        continue;
+      }
+      if (!smc) {
+        smc = std::make_unique<ton::SmartContract>(ton::SmartContract::State{data.code_cell, data.data_cell});
+      }
+      auto wallet_address = run_get_wallet_address(*smc, master_address, owner_address);
+      if (wallet_address.is_ok()) {
+        wallet_address_cache_.put(key, wallet_address.ok());
+      }
+      result.push_back(std::move(wallet_address));
+    }
+    promise.set_value(std::move(result));
+  }
+
+private:
+  struct WalletAddressKey {
+    block::StdAddress master_address;
+    vm::CellHash master_data_hash;
+    block::StdAddress owner_address;
+
+    bool operator==(const WalletAddressKey& other) const {
+      return master_address.workchain == other.master_address.workchain && master_address.addr == other.master_address.addr
+          && master_data_hash == other.master_data_hash
+          && owner_address.workchain == other.owner_address.workchain && owner_address.addr == other.owner_address.addr;
+    }
+  };
+
+  struct WalletAddressKeyHasher {
+    std::size_t operator()(const WalletAddressKey& k) const {
+      Bits256Hasher hasher;
+      return hasher(k.master_address.addr) ^ (hasher(k.owner_address.addr) * 31) ^ std::hash<vm::CellHash>()(k.master_data_hash);
+    }
+  };
+
+  static constexpr size_t wallet_address_cache_size = 100000;
+  LruCache<WalletAddressKey, block::StdAddress, WalletAddressKeyHasher> wallet_address_cache_{wallet_address_cache_size};
+
+  td::Result<block::StdAddress> run_get_wallet_address(const ton::SmartContract& smc, block::StdAddress master_address, block::StdAddress owner_address) {
     ton::SmartContract::Args args;
 
     vm::CellBuilder anycast_cb;
@@ -311,22 +694,16 @@ public:
     auto res = smc.run_get_method(args);
 
     if (!res.success || res.stack->depth() != 1) {
-      P.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_wallet_address failed"));
-      return;
+      return td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_wallet_address failed");
     }
 
     auto stack = res.stack->as_span();
     if (stack[0].type() != vm::StackEntry::Type::t_slice) {
-      P.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_wallet_address failed"));
-      return;
+      return td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_wallet_address failed");
     }
 
-    auto wallet_address = convert::to_raw_address(stack[0].as_slice());
-    if (wallet_address.is_error()) {
-      P.set_error(wallet_address.move_as_error());
-      return;
-    }
-    P.set_result(block::StdAddress::parse(wallet_address.move_as_ok()));
+    TRY_RESULT(wallet_address, convert::to_raw_address(stack[0].as_slice()));
+    return block::StdAddress::parse(wallet_address);
   }
 };
 
@@ -349,25 +726,21 @@ public:
     , insert_manager_(insert_manager) {
   }
 
-  void detect(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<JettonWalletData> promise) override {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), address, code_cell, data_cell, last_tx_lt, blocks_ds, promise = std::move(promise)](td::Result<bool> code_hash_is_wallet) mutable {
-      if (code_hash_is_wallet.is_error()) {
-        td::actor::send_closure(SelfId, &JettonWalletDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(promise));
-        return;
-      }
-      if (!code_hash_is_wallet.move_as_ok()) {
-        promise.set_error(td::Status::Error(ErrorCode::CACHED_CODE_HASH_NO_ENTITY, "Code hash is not a Jetton Wallet"));
-        return;
-      }
+  void start_up() override {
+    storage_.set_owner(actor_id(this), "Jetton wallets");
+  }
 
-      td::actor::send_closure(SelfId, &JettonWalletDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(promise));
-    });
+  bool is_cached(const block::StdAddress& address) const override {
+    return storage_.is_cached(address);
+  }
 
-    td::actor::send_closure(interface_manager_, &InterfaceManager::check_interface, code_cell->get_hash(), IT_JETTON_WALLET, std::move(P));
+  void detect_latest(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<JettonWalletData> promise) override {
+    // EventProcessor only routes here states whose code hash is not known to lack the interface
+    detect_continue(address, code_cell, data_cell, last_tx_lt, account_index, std::move(promise));
   }
 
-  void detect_continue(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<JettonWalletData> promise) {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), this, address, code_cell, data_cell, last_tx_lt, blocks_ds, promise = std::move(promise)](td::Result<JettonWalletData> cached_res) mutable {
+  void detect_continue(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<JettonWalletData> promise) {
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), address, code_cell, data_cell, last_tx_lt, account_index, promise = std::move(promise)](td::Result<JettonWalletData> cached_res) mutable {
       if (cached_res.is_ok()) {
         auto cached_data = cached_res.move_as_ok();
         if ((data_cell->get_hash() == cached_data.data_hash && code_cell->get_hash() == cached_data.code_hash) 
@@ -376,38 +749,29 @@ public:
           return;
         }
       }
-      td::actor::send_closure(SelfId, &JettonWalletDetector::detect_impl, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(promise));
+      td::actor::send_closure(SelfId, &JettonWalletDetector::detect_impl, address, code_cell, data_cell, last_tx_lt, account_index, std::move(promise));
     });
 
     storage_.check(address, std::move(P));
   }
 
-  void detect_impl(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<JettonWalletData> promise) {
+  void detect_impl(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<JettonWalletData> promise) {
     ton::SmartContract smc({code_cell, data_cell});
     ton::SmartContract::Args args;
     args.set_now(td::Time::now());
     args.set_address(std::move(address));
 
-    args.set_method_id("get_wallet_data");
+    using Traits = InterfaceTraits<JettonWalletData>;
+    args.set_method_id(Traits::get_method);
     auto res = smc.run_get_method(args);
 
-    const int return_stack_size = 4;
-    const vm::StackEntry::Type return_types[return_stack_size] = {vm::StackEntry::Type::t_int, vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_cell};
-
-    if (!res.success || res.stack->depth() != return_stack_size) {
-      td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), IT_JETTON_WALLET, false);
-      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_wallet_data failed"));
+    bool has_interface = res.success && validate_stack<JettonWalletData>(*res.stack);
+    td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), Traits::interface, has_interface);
+    if (!has_interface) {
+      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, PSLICE() << Traits::get_method << " failed"));
       return;
     }
-
     auto stack = res.stack->as_span();
-    
-    for (int i = 0; i < 4; i++) {
-      if (stack[i].type() != return_types[i]) {
-        promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_wallet_data failed"));
-        return;
-      }
-    }
 
     JettonWalletData data;
     data.address = convert::to_raw_address(address);
@@ -432,30 +796,19 @@ public:
       // LOG(WARNING) << "Jetton Wallet code hash mismatch: " << stack[3].as_cell()->get_hash().to_hex() << " != " << code_cell->get_hash().to_hex();
     // }
 
-    verify_belonging_to_master(std::move(data), blocks_ds, std::move(promise));
+    verify_belonging_to_master(std::move(data), account_index, std::move(promise));
   }
 
-  void parse_transfer(schema::Transaction transaction, td::Ref<vm::CellSlice> cs, td::Promise<JettonTransfer> promise) {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), this, transaction, cs = std::move(cs), promise = std::move(promise)](td::Result<JettonWalletData> R) mutable {
-      if (R.is_error()) {
-        if (R.error().code() == ErrorCode::ENTITY_NOT_FOUND) {
-          promise.set_error(R.move_as_error_prefix("Jetton Wallet not found: "));
-          return;
-        }
-        promise.set_error(R.move_as_error());
-        return;
-      }
-      td::actor::send_closure(SelfId, &JettonWalletDetector::parse_transfer_impl, transaction, std::move(cs), std::move(promise));
-    });
-
-    storage_.check(transaction.account, std::move(P));
+  // for every address reports whether it is a known Jetton Wallet
+  void check_known(std::vector<block::StdAddress> addresses, td::Promise<std::vector<bool>> promise) {
+    storage_.check_many(std::move(addresses), std::move(promise));
   }
 
-  void parse_transfer_impl(schema::Transaction transaction, td::Ref<vm::CellSlice> cs, td::Promise<JettonTransfer> promise) {
+  // event parsers do not depend on detector state and are called directly by EventProcessor
+  static td::Result<JettonTransfer> parse_transfer(const schema::Transaction& transaction, td::Ref<vm::CellSlice> cs) {
     tokens::gen::InternalMsgBody::Record_transfer_jetton transfer_record;
     if (!tlb::csr_unpack(cs, transfer_record)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer");
     }
 
     JettonTransfer transfer;
@@ -463,93 +816,83 @@ public:
     transfer.query_id = transfer_record.query_id;
     transfer.amount = block::tlb::t_VarUInteger_16.as_integer(transfer_record.amount);
     if (transfer.amount.is_null()) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer amount"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer amount");
     }
     if (!transaction.in_msg || !transaction.in_msg->source) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer source"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer source");
     }
     transfer.source = transaction.in_msg->source.value();
     transfer.jetton_wallet = convert::to_raw_address(transaction.account);
     auto destination = convert::to_raw_address(transfer_record.destination);
     if (destination.is_error()) {
-      promise.set_error(destination.move_as_error());
-      return;
+      return destination.move_as_error();
     }
     transfer.destination = destination.move_as_ok();
     auto response_destination = convert::to_raw_address(transfer_record.response_destination);
     if (response_destination.is_error()) {
-      promise.set_error(response_destination.move_as_error());
-      return;
+      return response_destination.move_as_error();
     }
     transfer.response_destination = response_destination.move_as_ok();
     if (!transfer_record.custom_payload.write().fetch_maybe_ref(transfer.custom_payload)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch custom payload"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch custom payload");
     }
     transfer.forward_ton_amount = block::tlb::t_VarUInteger_16.as_integer(transfer_record.forward_ton_amount);
     if (!transfer_record.forward_payload.write().fetch_maybe_ref(transfer.forward_payload)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch forward payload"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch forward payload");
     }
 
-    promise.set_value(std::move(transfer));
-  }
-
-  void parse_burn(schema::Transaction transaction, td::Ref<vm::CellSlice> cs, td::Promise<JettonBurn> promise) {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), this, transaction, cs = std::move(cs), promise = std::move(promise)](td::Result<JettonWalletData> R) mutable {
-      if (R.is_error()) {
-        if (R.error().code() == ErrorCode::ENTITY_NOT_FOUND) {
-          promise.set_error(R.move_as_error_prefix("Jetton Wallet not found: "));
-          return;
-        }
-        promise.set_error(R.move_as_error());
-      }
-      td::actor::send_closure(SelfId, &JettonWalletDetector::parse_burn_impl, transaction, std::move(cs), std::move(promise));
-    });
-
-    storage_.check(transaction.account, std::move(P));
+    return transfer;
   }
 
-  void parse_burn_impl(schema::Transaction transaction, td::Ref<vm::CellSlice> cs, td::Promise<JettonBurn> promise) {
+  static td::Result<JettonBurn> parse_burn(const schema::Transaction& transaction, td::Ref<vm::CellSlice> cs) {
     tokens::gen::InternalMsgBody::Record_burn burn_record;
     if (!tlb::csr_unpack(cs, burn_record)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack burn"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack burn");
     }
 
     JettonBurn burn;
     burn.transaction_hash = transaction.hash;
     burn.query_id = burn_record.query_id;
     if (!transaction.in_msg || !transaction.in_msg->source) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack burn source"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack burn source");
     }
     burn.owner = transaction.in_msg->source.value();
     burn.jetton_wallet = convert::to_raw_address(transaction.account);
     burn.amount = block::tlb::t_VarUInteger_16.as_integer(burn_record.amount);
     if (burn.amount.is_null()) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack burn amount"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack burn amount");
     }
     auto response_destination = convert::to_raw_address(burn_record.response_destination);
     if (response_destination.is_error()) {
-      promise.set_error(response_destination.move_as_error());
-      return;
+      return response_destination.move_as_error();
     }
     burn.response_destination = response_destination.move_as_ok();
     if (!burn_record.custom_payload.write().fetch_maybe_ref(burn.custom_payload)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch custom payload"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch custom payload");
     }
 
-    promise.set_value(std::move(burn));
+    return burn;
   }
 
 private:
-  // checks belonging of address to Jetton Master by calling get_wallet_address
-  void verify_belonging_to_master(JettonWalletData data, const MasterchainBlockDataState& blocks_ds, td::Promise<JettonWalletData> &&promise) {
+  struct PendingVerification {
+    JettonWalletData data;
+    block::StdAddress owner_address;
+    td::Promise<JettonWalletData> promise;
+  };
+
+  struct PendingVerificationBatch {
+    block::StdAddress master_address;
+    ShardAccountIndexPtr account_index;
+    std::vector<PendingVerification> requests;
+  };
+
+  // wallets waiting for verification grouped by master address
+  std::map<std::string, PendingVerificationBatch> pending_verifications_;
+
+  // checks belonging of address to Jetton Master by calling get_wallet_address.
+  // Requests for the same master are collected until already queued messages are processed and sent as one batch.
+  void verify_belonging_to_master(JettonWalletData data, ShardAccountIndexPtr account_index, td::Promise<JettonWalletData> &&promise) {
     auto master_addr = block::StdAddress::parse(data.jetton);
     if (master_addr.is_error()) {
       promise.set_error(td::Status::Error(ErrorCode::DATA_PARSING_ERROR, PSLICE() << "Failed to parse jetton master address (" << data.jetton << "): "));
@@ -561,29 +904,65 @@ private:
       return;
     }
 
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), this, data, promise = std::move(promise)](td::Result<block::StdAddress> R) mutable {
+    auto master_raw_address = data.jetton;
+    auto& batch = pending_verifications_[master_raw_address];
+    if (batch.requests.empty()) {
+      batch.master_address = master_addr.move_as_ok();
+      batch.account_index = account_index;
+      td::actor::send_closure(actor_id(this), &JettonWalletDetector::flush_verifications, master_raw_address);
+    }
+    batch.requests.push_back({std::move(data), owner_addr.move_as_ok(), std::move(promise)});
+  }
+
+  void flush_verifications(std::string master_raw_address) {
+    auto it = pending_verifications_.find(master_raw_address);
+    if (it == pending_verifications_.end()) {
+      return;
+    }
+    auto batch = std::move(it->second);
+    pending_verifications_.erase(it);
+
+    std::vector<block::StdAddress> owner_addresses;
+    owner_addresses.reserve(batch.requests.size());
+    for (const auto& request : batch.requests) {
+      owner_addresses.push_back(request.owner_address);
+    }
+
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), requests = std::move(batch.requests)](td::Result<std::vector<td::Result<block::StdAddress>>> R) mutable {
       if (R.is_error()) {
-        LOG(WARNING) << "Jetton Master is not available, so we can't verify address " << data.address << ": " << R.error();
-        promise.set_error(td::Status::Error(ErrorCode::ADDITIONAL_CHECKS_FAILED, R.error().message()));
-      } else {
-        auto address = R.move_as_ok();
+        for (auto& request : requests) {
+          LOG(WARNING) << "Jetton Master is not available, so we can't verify address " << request.data.address << ": " << R.error();
+          request.promise.set_error(td::Status::Error(ErrorCode::ADDITIONAL_CHECKS_FAILED, R.error().message()));
+        }
+        return;
+      }
+      auto addresses = R.move_as_ok();
+      for (size_t i = 0; i < requests.size(); i++) {
+        auto& data = requests[i].data;
+        auto& promise = requests[i].promise;
+        if (addresses[i].is_error()) {
+          LOG(WARNING) << "Jetton Master failed to derive address for " << data.address << ": " << addresses[i].error();
+          promise.set_error(td::Status::Error(ErrorCode::ADDITIONAL_CHECKS_FAILED, addresses[i].error().message()));
+          continue;
+        }
+        auto address = addresses[i].move_as_ok();
         if (convert::to_raw_address(address) != data.address) {
           LOG(WARNING) << "Jetton Master returned wrong address: " << convert::to_raw_address(address) << " expected: " << data.address;
           promise.set_error(td::Status::Error(ErrorCode::ADDITIONAL_CHECKS_FAILED, "Couldn't verify Jetton Wallet. Possibly scam."));
-        } else {
-          auto cache_promise = td::PromiseCreator::lambda([this, promise = std::move(promise), data](td::Result<td::Unit> r) mutable {
-            if (r.is_error()) {
-              promise.set_error(r.move_as_error());
-              return;
-            }
-            promise.set_result(std::move(data));
-          });
-          td::actor::send_closure(SelfId, &JettonWalletDetector::add_to_cache, address, std::move(data), std::move(cache_promise));
+          continue;
         }
+        auto cache_promise = td::PromiseCreator::lambda([promise = std::move(promise), data](td::Result<td::Unit> r) mutable {
+          if (r.is_error()) {
+            promise.set_error(r.move_as_error());
+            return;
+          }
+          promise.set_result(std::move(data));
+        });
+        td::actor::send_closure(SelfId, &JettonWalletDetector::add_to_cache, address, std::move(data), std::move(cache_promise));
       }
     });
 
-    td::actor::send_closure(jetton_master_detector_, &JettonMasterDetector::get_wallet_address, blocks_ds, master_addr.move_as_ok(), owner_addr.move_as_ok(), std::move(P));
+    td::actor::send_closure(jetton_master_detector_, &JettonMasterDetector::get_wallet_addresses, std::move(batch.account_index), batch.master_address, std::move(owner_addresses), std::move(P));
   }
 
   void add_to_cache(block::StdAddress address, JettonWalletData data, td::Promise<td::Unit> promise) {
@@ -599,17 +978,24 @@ private:
   td::actor::ActorId<InterfaceManager> interface_manager_;
   td::actor::ActorId<InsertManagerInterface> insert_manager_;
   InterfaceStorage<NFTCollectionData> storage_;
+  std::shared_ptr<CodeCellCache> code_cells_;
 public:
-  NFTCollectionDetector(td::actor::ActorId<InterfaceManager> interface_manager, td::actor::ActorId<InsertManagerInterface> insert_manager) 
+  NFTCollectionDetector(td::actor::ActorId<InterfaceManager> interface_manager, td::actor::ActorId<InsertManagerInterface> insert_manager,
+      std::shared_ptr<CodeCellCache> code_cells)
     : storage_(insert_manager)
+    , code_cells_(std::move(code_cells))
     , interface_manager_(interface_manager)
     , insert_manager_(insert_manager) {
   }
 
-  void get_from_cache_or_shard(block::StdAddress address, const MasterchainBlockDataState& blocks_ds, td::Promise<NFTCollectionData> promise) {
-    auto R = td::PromiseCreator::lambda([SelfId = actor_id(this), address, blocks_ds, promise = std::move(promise)](td::Result<NFTCollectionData> r) mutable {
+  void start_up() override {
+    storage_.set_owner(actor_id(this), "NFT collections");
+  }
+
+  void get_from_cache_or_shard(block::StdAddress address, ShardAccountIndexPtr account_index, td::Promise<NFTCollectionData> promise) {
+    auto R = td::PromiseCreator::lambda([SelfId = actor_id(this), address, account_index, promise = std::move(promise)](td::Result<NFTCollectionData> r) mutable {
       if (r.is_error()) {
-        td::actor::send_closure(SelfId, &NFTCollectionDetector::detect_from_shard, blocks_ds, address, std::move(promise));
+        td::actor::send_closure(SelfId, &NFTCollectionDetector::detect_from_shard, account_index, address, std::move(promise));
       } else {
         promise.set_value(r.move_as_ok());
       }
@@ -617,33 +1003,24 @@ public:
     storage_.check(address, std::move(R));
   }
 
-  void detect(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<NFTCollectionData> promise) override {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), address, code_cell, data_cell, last_tx_lt, promise = std::move(promise)](td::Result<bool> code_hash_is_collection) mutable {
-      if (code_hash_is_collection.is_error()) {
-        td::actor::send_closure(SelfId, &NFTCollectionDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, std::move(promise));
-        return;
-      }
-      if (!code_hash_is_collection.move_as_ok()) {
-        promise.set_error(td::Status::Error(ErrorCode::CACHED_CODE_HASH_NO_ENTITY, "Code hash is not a NFT Collection"));
-        return;
-      }
-
-      td::actor::send_closure(SelfId, &NFTCollectionDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, std::move(promise));
-    });
+  bool is_cached(const block::StdAddress& address) const override {
+    return storage_.is_cached(address);
+  }
 
-    td::actor::send_closure(interface_manager_, &InterfaceManager::check_interface, code_cell->get_hash(), IT_NFT_COLLECTION, std::move(P));
+  void detect_latest(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<NFTCollectionData> promise) override {
+    // EventProcessor only routes here states whose code hash is not known to lack the interface
+    detect_continue(address, code_cell, data_cell, last_tx_lt, std::move(promise));
   }
 private:
-  void detect_from_shard(const MasterchainBlockDataState& blocks_ds, block::StdAddress address, td::Promise<NFTCollectionData> promise) {
-    auto R = td::PromiseCreator::lambda([SelfId = actor_id(this), address, promise = std::move(promise)](td::Result<schema::AccountState> account_state_r) mutable {
-      if (account_state_r.is_error()) {
-        promise.set_error(account_state_r.move_as_error());
-        return;
-      }
-      auto account_state = account_state_r.move_as_ok();
-      td::actor::send_closure(SelfId, &NFTCollectionDetector::detect_impl, address, account_state.code, account_state.data, account_state.last_trans_lt, std::move(promise));
-    });
-    td::actor::create_actor<FetchAccountFromShard>("fetchaccountfromshard", blocks_ds, address, std::move(R)).release();
+  void detect_from_shard(ShardAccountIndexPtr account_index, block::StdAddress address, td::Promise<NFTCollectionData> promise) {
+    auto account_state_r = account_index->get_account(address);
+    storage_.report_shard_lookup(account_state_r.is_ok());
+    if (account_state_r.is_error()) {
+      promise.set_error(account_state_r.move_as_error());
+      return;
+    }
+    auto account_state = account_state_r.move_as_ok();
+    detect_impl(address, account_state.code, account_state.data, account_state.last_trans_lt, std::move(promise));
   }
 
   void detect_continue(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt,  td::Promise<NFTCollectionData> promise) {
@@ -668,27 +1045,17 @@ private:
     args.set_now(td::Time::now());
     args.set_address(std::move(address));
 
-    args.set_method_id("get_collection_data");
+    using Traits = InterfaceTraits<NFTCollectionData>;
+    args.set_method_id(Traits::get_method);
     auto res = smc.run_get_method(args);
 
-    const int return_stack_size = 3;
-    const vm::StackEntry::Type return_types[return_stack_size] = {vm::StackEntry::Type::t_int, 
-      vm::StackEntry::Type::t_cell, vm::StackEntry::Type::t_slice};
-
-    if (!res.success || res.stack->depth() != return_stack_size) {
-      td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), IT_NFT_COLLECTION, false);
-      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_collection_data failed"));
+    bool has_interface = res.success && validate_stack<NFTCollectionData>(*res.stack);
+    td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), Traits::interface, has_interface);
+    if (!has_interface) {
+      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, PSLICE() << Traits::get_method << " failed"));
       return;
     }
-
     auto stack = res.stack->as_span();
-    
-    for (int i = 0; i < return_stack_size; i++) {
-      if (stack[i].type() != return_types[i]) {
-        promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_collection_data failed"));
-        return;
-      }
-    }
 
     NFTCollectionData data;
     data.address = convert::to_raw_address(address);
@@ -701,9 +1068,10 @@ private:
     }
     data.owner_address = owner_address.move_as_ok();
     data.last_transaction_lt = last_tx_lt;
+    data.code_hash = code_cell->get_hash();
     data.data_hash = data_cell->get_hash();
-    data.code_boc = td::base64_encode(vm::std_boc_serialize(code_cell).move_as_ok());
-    data.data_boc = td::base64_encode(vm::std_boc_serialize(data_cell).move_as_ok());
+    data.code_cell = code_cells_->get(code_cell);
+    data.data_cell = data_cell;
 
     auto collection_content = parse_token_data(stack[1].as_cell());
     if (collection_content.is_ok()) {
@@ -713,7 +1081,7 @@ private:
       LOG(WARNING) << convert::to_bytes(stack[1].as_cell()).move_as_ok().value();
     }
     
-    auto cache_promise = td::PromiseCreator::lambda([this, promise = std::move(promise), data](td::Result<td::Unit> r) mutable {
+    auto cache_promise = td::PromiseCreator::lambda([promise = std::move(promise), data](td::Result<td::Unit> r) mutable {
       if (r.is_error()) {
         promise.set_error(r.move_as_error());
         return;
@@ -741,44 +1109,28 @@ public:
     , collection_detector_(collection_detector) {
   }
 
-  void detect(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<NFTItemData> promise) override {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), address, code_cell, data_cell, last_tx_lt, blocks_ds, promise = std::move(promise)](td::Result<bool> code_hash_is_collection) mutable {
-      if (code_hash_is_collection.is_error()) {
-        td::actor::send_closure(SelfId, &NFTItemDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(promise));
-        return;
-      }
-      if (!code_hash_is_collection.move_as_ok()) {
-        promise.set_error(td::Status::Error(ErrorCode::CACHED_CODE_HASH_NO_ENTITY, "Code hash is not a NFT Item"));
-        return;
-      }
-
-      td::actor::send_closure(SelfId, &NFTItemDetector::detect_continue, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(promise));
-    });
+  void start_up() override {
+    storage_.set_owner(actor_id(this), "NFT items");
+  }
 
-    td::actor::send_closure(interface_manager_, &InterfaceManager::check_interface, code_cell->get_hash(), IT_NFT_ITEM, std::move(P));
+  bool is_cached(const block::StdAddress& address) const override {
+    return storage_.is_cached(address);
   }
 
-  void parse_transfer(schema::Transaction transaction, td::Ref<vm::CellSlice> cs, td::Promise<NFTTransfer> promise) {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), this, transaction, cs = std::move(cs), promise = std::move(promise)](td::Result<NFTItemData> R) mutable {
-      if (R.is_error()) {
-        if (R.error().code() == ErrorCode::ENTITY_NOT_FOUND) {
-          promise.set_error(R.move_as_error_prefix("NFT item not found: "));
-          return;
-        }
-        promise.set_error(R.move_as_error());
-        return;
-      }
-      td::actor::send_closure(SelfId, &NFTItemDetector::parse_transfer_impl, transaction, std::move(cs), std::move(promise));
-    });
+  void detect_latest(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<NFTItemData> promise) override {
+    // EventProcessor only routes here states whose code hash is not known to lack the interface
+    detect_continue(address, code_cell, data_cell, last_tx_lt, account_index, std::move(promise));
+  }
 
-    storage_.check(transaction.account, std::move(P));
+  // for every address reports whether it is a known NFT Item
+  void check_known(std::vector<block::StdAddress> addresses, td::Promise<std::vector<bool>> promise) {
+    storage_.check_many(std::move(addresses), std::move(promise));
   }
 
-  void parse_transfer_impl(schema::Transaction transaction, td::Ref<vm::CellSlice> cs, td::Promise<NFTTransfer> promise) {
+  static td::Result<NFTTransfer> parse_transfer(const schema::Transaction& transaction, td::Ref<vm::CellSlice> cs) {
     tokens::gen::InternalMsgBody::Record_transfer_nft transfer_record;
     if (!tlb::csr_unpack(cs, transfer_record)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to unpack transfer");
     }
 
     NFTTransfer transfer;
@@ -786,38 +1138,33 @@ public:
     transfer.query_id = transfer_record.query_id;
     transfer.nft_item = transaction.account;
     if (!transaction.in_msg.has_value() || !transaction.in_msg.value().source) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch NFT old owner address"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch NFT old owner address");
     }
     transfer.old_owner = transaction.in_msg.value().source.value();
     auto new_owner = convert::to_raw_address(transfer_record.new_owner);
     if (new_owner.is_error()) {
-      promise.set_error(new_owner.move_as_error());
-      return;
+      return new_owner.move_as_error();
     }
     transfer.new_owner = new_owner.move_as_ok();
     auto response_destination = convert::to_raw_address(transfer_record.response_destination);
     if (response_destination.is_error()) {
-      promise.set_error(response_destination.move_as_error());
-      return;
+      return response_destination.move_as_error();
     }
     transfer.response_destination = response_destination.move_as_ok();
     if (!transfer_record.custom_payload.write().fetch_maybe_ref(transfer.custom_payload)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch custom payload"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch custom payload");
     }
     transfer.forward_amount = block::tlb::t_VarUInteger_16.as_integer(transfer_record.forward_amount);
     if (!transfer_record.forward_payload.write().fetch_maybe_ref(transfer.forward_payload)) {
-      promise.set_error(td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch forward payload"));
-      return;
+      return td::Status::Error(ErrorCode::EVENT_PARSING_ERROR, "Failed to fetch forward payload");
     }
 
-    promise.set_value(std::move(transfer));
+    return transfer;
   }
 
 private:
-  void detect_continue(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<NFTItemData> promise) {
-    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), this, address, code_cell, data_cell, last_tx_lt, blocks_ds, promise = std::move(promise)](td::Result<NFTItemData> cached_res) mutable {
+  void detect_continue(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<NFTItemData> promise) {
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), address, code_cell, data_cell, last_tx_lt, account_index, promise = std::move(promise)](td::Result<NFTItemData> cached_res) mutable {
       if (cached_res.is_ok()) {
         auto cached_data = cached_res.move_as_ok();
         if ((data_cell->get_hash() == cached_data.data_hash && code_cell->get_hash() == cached_data.code_hash) 
@@ -826,40 +1173,30 @@ private:
           return;
         }
       }
-      td::actor::send_closure(SelfId, &NFTItemDetector::detect_impl, address, code_cell, data_cell, last_tx_lt, blocks_ds, std::move(promise));
+      td::actor::send_closure(SelfId, &NFTItemDetector::detect_impl, address, code_cell, data_cell, last_tx_lt, account_index, std::move(promise));
     });
 
     storage_.check(address, std::move(P));
   }
 
-  void detect_impl(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, const MasterchainBlockDataState& blocks_ds, td::Promise<NFTItemData> promise) {
+  void detect_impl(block::StdAddress address, td::Ref<vm::Cell> code_cell, td::Ref<vm::Cell> data_cell, uint64_t last_tx_lt, ShardAccountIndexPtr account_index, td::Promise<NFTItemData> promise) {
     ton::SmartContract smc({code_cell, data_cell});
     ton::SmartContract::Args args;
     args.set_now(td::Time::now());
     args.set_address(std::move(address));
 
-    args.set_method_id("get_nft_data");
+    using Traits = InterfaceTraits<NFTItemData>;
+    args.set_method_id(Traits::get_method);
     auto res = smc.run_get_method(args);
 
-    const int return_stack_size = 5;
-    const vm::StackEntry::Type return_types[return_stack_size] = {vm::StackEntry::Type::t_int, 
-      vm::StackEntry::Type::t_int, vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_cell};
-
-    if (!res.success || res.stack->depth() != return_stack_size) {
-      td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), IT_NFT_ITEM, false);
-      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_nft_data failed"));
+    bool has_interface = res.success && validate_stack<NFTItemData>(*res.stack);
+    td::actor::send_closure(interface_manager_, &InterfaceManager::set_interface, code_cell->get_hash(), Traits::interface, has_interface);
+    if (!has_interface) {
+      promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, PSLICE() << Traits::get_method << " failed"));
       return;
     }
-
     auto stack = res.stack->as_span();
 
-    for (int i = 0; i < return_stack_size; i++) {
-      if (stack[i].type() != return_types[i]) {
-        promise.set_error(td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_nft_data failed"));
-        return;
-      }
-    }
-
     NFTItemData data;
     data.address = convert::to_raw_address(address);
     data.init = stack[0].as_int()->to_long() != 0;
@@ -906,7 +1243,7 @@ private:
         promise.set_error(td::Status::Error(ErrorCode::DATA_PARSING_ERROR, PSLICE() << "Failed to parse collection address for " << convert::to_raw_address(address) << ": " << collection_address.error()));
         return;
       }
-      td::actor::send_closure(collection_detector_, &NFTCollectionDetector::get_from_cache_or_shard, collection_address.move_as_ok(), blocks_ds,
+      td::actor::send_closure(collection_detector_, &NFTCollectionDetector::get_from_cache_or_shard, collection_address.move_as_ok(), account_index,
                               td::PromiseCreator::lambda([this, SelfId = actor_id(this), ind_content, address, data, code_cell, data_cell, last_tx_lt, promise = std::move(promise)](td::Result<NFTCollectionData> collection_res) mutable {
         if (collection_res.is_error()) {
           LOG(ERROR) << "Failed to get collection for " << convert::to_raw_address(address) << ": " << collection_res.error();
@@ -948,9 +1285,7 @@ private:
   }
 
   td::Status verify_belonging_to_collection(const NFTItemData& item_data, const NFTCollectionData& collection_data) {
-    auto code_cell = vm::std_boc_deserialize(td::base64_decode(collection_data.code_boc).move_as_ok()).move_as_ok();
-    auto data_cell = vm::std_boc_deserialize(td::base64_decode(collection_data.data_boc).move_as_ok()).move_as_ok();
-    ton::SmartContract smc({code_cell, data_cell});
+    ton::SmartContract smc({collection_data.code_cell, collection_data.data_cell});
     ton::SmartContract::Args args;
     args.set_now(td::Time::now());
     args.set_address(block::StdAddress::parse(collection_data.address).move_as_ok());
@@ -976,9 +1311,7 @@ private:
 
   td::Result<std::map<std::string, std::string>> get_content(const td::RefInt256 index, td::Ref<vm::Cell> ind_content, const NFTCollectionData& collection_data, 
                                         td::Ref<vm::Cell> item_code, td::Ref<vm::Cell> item_data) {
-    auto code_cell = vm::std_boc_deserialize(td::base64_decode(collection_data.code_boc).move_as_ok()).move_as_ok();
-    auto data_cell = vm::std_boc_deserialize(td::base64_decode(collection_data.data_boc).move_as_ok()).move_as_ok();
-    ton::SmartContract smc({code_cell, data_cell});
+    ton::SmartContract smc({collection_data.code_cell, collection_data.data_cell});
     ton::SmartContract::Args args;
     args.set_now(td::Time::now());
     args.set_address(block::StdAddress::parse(collection_data.address).move_as_ok());
@@ -1034,3 +1367,44 @@ private:
     return td::Status::Error(ErrorCode::GET_METHOD_WRONG_RESULT, "get_domain returned unexpected result");
   }
 };
+
+template <class T>
+struct DetectorFor;
+
+template <>
+struct DetectorFor<JettonMasterData> {
+  using type = JettonMasterDetector;
+};
+
+template <>
+struct DetectorFor<JettonWalletData> {
+  using type = JettonWalletDetector;
+};
+
+template <>
+struct DetectorFor<NFTCollectionData> {
+  using type = NFTCollectionDetector;
+};
+
+template <>
+struct DetectorFor<NFTItemData> {
+  using type = NFTItemDetector;
+};
+
+template <class E>
+td::Result<E> parse_event(const schema::Transaction& transaction, td::Ref<vm::CellSlice> cs);
+
+template <>
+inline td::Result<JettonTransfer> parse_event<JettonTransfer>(const schema::Transaction& transaction, td::Ref<vm::CellSlice> cs) {
+  return JettonWalletDetector::parse_transfer(transaction, std::move(cs));
+}
+
+template <>
+inline td::Result<JettonBurn> parse_event<JettonBurn>(const schema::Transaction& transaction, td::Ref<vm::CellSlice> cs) {
+  return JettonWalletDetector::parse_burn(transaction, std::move(cs));
+}
+
+template <>
+inline td::Result<NFTTransfer> parse_event<NFTTransfer>(const schema::Transaction& transaction, td::Ref<vm::CellSlice> cs) {
+  return NFTItemDetector::parse_transfer(transaction, std::move(cs));
+}
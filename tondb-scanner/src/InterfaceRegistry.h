@@ -0,0 +1,165 @@
+#pragma once
+#include <array>
+#include <type_traits>
+#include "vm/stack.hpp"
+#include "InsertManager.h"
+#include "tokens.h"
+
+// Compile-time registry of the supported smart contract interfaces.
+// Adding a standard means adding its Data struct, an SmcInterface value, an InterfaceTraits specialization and an
+// entry in Interfaces at the position of its SmcInterface value, which is checked at compile time. Routing, stack
+// validation and insert manager dispatch are derived from the traits.
+
+// bit positions in the interface masks, in the order of Interfaces
+enum SmcInterface {
+  IT_JETTON_MASTER,
+  IT_JETTON_WALLET,
+  IT_NFT_COLLECTION,
+  IT_NFT_ITEM
+};
+
+template <class... Ts>
+struct TypeList {
+  static constexpr size_t size = sizeof...(Ts);
+};
+
+template <class T>
+struct TypeTag {
+  using type = T;
+};
+
+// calls f(TypeTag<T>{}) for every type of the list
+template <class... Ts, class F>
+void for_each_type(TypeList<Ts...>, F&& f) {
+  (f(TypeTag<Ts>{}), ...);
+}
+
+template <class T>
+struct InterfaceTraits;
+
+/// @brief TEP 74 Jetton Master, get_jetton_data() returns (int total_supply, int mintable, slice admin_address, cell jetton_content, cell jetton_wallet_code)
+template <>
+struct InterfaceTraits<JettonMasterData> {
+  static constexpr SmcInterface interface = IT_JETTON_MASTER;
+  static constexpr const char* name = "JETTON_MASTER";
+  static constexpr const char* get_method = "get_jetton_data";
+  static constexpr std::array<vm::StackEntry::Type, 5> stack = {vm::StackEntry::Type::t_int, vm::StackEntry::Type::t_int,
+    vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_cell, vm::StackEntry::Type::t_cell};
+  static constexpr auto upsert = &InsertManagerInterface::upsert_jetton_master;
+  static constexpr auto get = &InsertManagerInterface::get_jetton_masters;
+  static constexpr bool emits_events = false;
+};
+
+/// @brief TEP 74 Jetton Wallet, get_wallet_data() returns (int balance, slice owner, slice jetton, cell jetton_wallet_code)
+template <>
+struct InterfaceTraits<JettonWalletData> {
+  static constexpr SmcInterface interface = IT_JETTON_WALLET;
+  static constexpr const char* name = "JETTON_WALLET";
+  static constexpr const char* get_method = "get_wallet_data";
+  static constexpr std::array<vm::StackEntry::Type, 4> stack = {vm::StackEntry::Type::t_int, vm::StackEntry::Type::t_slice,
+    vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_cell};
+  static constexpr auto upsert = &InsertManagerInterface::upsert_jetton_wallet;
+  static constexpr auto get = &InsertManagerInterface::get_jetton_wallets;
+  static constexpr bool emits_events = true;
+};
+
+/// @brief TEP 62 NFT Collection, get_collection_data() returns (int next_item_index, cell collection_content, slice owner_address)
+template <>
+struct InterfaceTraits<NFTCollectionData> {
+  static constexpr SmcInterface interface = IT_NFT_COLLECTION;
+  static constexpr const char* name = "NFT_COLLECTION";
+  static constexpr const char* get_method = "get_collection_data";
+  static constexpr std::array<vm::StackEntry::Type, 3> stack = {vm::StackEntry::Type::t_int, vm::StackEntry::Type::t_cell,
+    vm::StackEntry::Type::t_slice};
+  static constexpr auto upsert = &InsertManagerInterface::upsert_nft_collection;
+  static constexpr auto get = &InsertManagerInterface::get_nft_collections;
+  static constexpr bool emits_events = false;
+};
+
+/// @brief TEP 62 NFT Item, get_nft_data() returns (int init, int index, slice collection_address, slice owner_address, cell individual_content)
+template <>
+struct InterfaceTraits<NFTItemData> {
+  static constexpr SmcInterface interface = IT_NFT_ITEM;
+  static constexpr const char* name = "NFT_ITEM";
+  static constexpr const char* get_method = "get_nft_data";
+  static constexpr std::array<vm::StackEntry::Type, 5> stack = {vm::StackEntry::Type::t_int, vm::StackEntry::Type::t_int,
+    vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_slice, vm::StackEntry::Type::t_cell};
+  static constexpr auto upsert = &InsertManagerInterface::upsert_nft_item;
+  static constexpr auto get = &InsertManagerInterface::get_nft_items;
+  static constexpr bool emits_events = true;
+};
+
+using Interfaces = TypeList<JettonMasterData, JettonWalletData, NFTCollectionData, NFTItemData>;
+
+// position of T in the list, the size of the list if T is not in it
+template <class T, class... Ts>
+constexpr size_t type_index(TypeList<Ts...>) {
+  size_t index = 0;
+  bool found = false;
+  ((found = found || std::is_same_v<T, Ts>, index += found ? 0 : 1), ...);
+  return index;
+}
+
+template <class... Ts>
+constexpr bool interfaces_follow_list_order(TypeList<Ts...> list) {
+  return ((static_cast<size_t>(InterfaceTraits<Ts>::interface) == type_index<Ts>(list)) && ...);
+}
+
+static_assert(interfaces_follow_list_order(Interfaces{}), "SmcInterface values must follow the order of Interfaces");
+static_assert(Interfaces::size <= 32, "interface masks are 32 bit");
+
+constexpr uint32_t interface_bit(SmcInterface interface) {
+  return 1u << interface;
+}
+
+constexpr uint32_t all_interfaces_mask = (1u << Interfaces::size) - 1;
+
+// checks that the get-method result has exactly the shape declared for the interface
+template <class T>
+bool validate_stack(const vm::Stack& stack) {
+  constexpr auto& expected = InterfaceTraits<T>::stack;
+  if (stack.depth() != static_cast<int>(expected.size())) {
+    return false;
+  }
+  auto entries = stack.as_span();
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (entries[i].type() != expected[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// @brief Token events, every event is decoded from the in_msg body by opcode and belongs to the emitting contract interface
+template <class E>
+struct EventTraits;
+
+template <>
+struct EventTraits<JettonTransfer> {
+  static constexpr int tag = tokens::gen::InternalMsgBody::transfer_jetton;
+  using Emitter = JettonWalletData;
+};
+
+template <>
+struct EventTraits<JettonBurn> {
+  static constexpr int tag = tokens::gen::InternalMsgBody::burn;
+  using Emitter = JettonWalletData;
+};
+
+template <>
+struct EventTraits<NFTTransfer> {
+  static constexpr int tag = tokens::gen::InternalMsgBody::transfer_nft;
+  using Emitter = NFTItemData;
+};
+
+using Events = TypeList<JettonTransfer, JettonBurn, NFTTransfer>;
+
+template <class T>
+void InsertManagerInterface::upsert_entity(T entity, td::Promise<td::Unit> promise) {
+  (this->*InterfaceTraits<T>::upsert)(std::move(entity), std::move(promise));
+}
+
+template <class T>
+void InsertManagerInterface::get_entities(std::vector<std::string> addresses, td::Promise<std::vector<T>> promise) {
+  (this->*InterfaceTraits<T>::get)(std::move(addresses), std::move(promise));
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <list>
+#include <cstring>
+#include <unordered_map>
+#include "common/bitstring.h"
+
+
+// Addresses and cell hashes are uniformly distributed, so the first 8 bytes are a good enough hash
+struct Bits256Hasher {
+  std::size_t operator()(const td::Bits256& k) const {
+    std::size_t seed;
+    std::memcpy(&seed, k.data(), sizeof(seed));
+    return seed;
+  }
+};
+
+// LRU map bounded by the total weight of its entries (entries count by default).
+// Not thread safe, it is meant to be owned by a single actor.
+template <class K, class V, class Hash = std::hash<K>>
+class LruCache {
+private:
+  struct Entry {
+    K key;
+    V value;
+    size_t weight;
+  };
+  using EntryList = std::list<Entry>;
+
+  size_t max_weight_;
+  size_t total_weight_{0};
+  EntryList order_;
+  std::unordered_map<K, typename EntryList::iterator, Hash> map_;
+
+public:
+  explicit LruCache(size_t max_weight) : max_weight_(max_weight) {
+  }
+
+  // returns nullptr on miss, the pointer is valid until the next put()
+  V* get(const K& key) {
+    auto it = map_.find(key);
+    if (it == map_.end()) {
+      return nullptr;
+    }
+    order_.splice(order_.end(), order_, it->second);
+    return &it->second->value;
+  }
+
+  bool contains(const K& key) const {
+    return map_.count(key) > 0;
+  }
+
+  void put(const K& key, V value, size_t weight = 1) {
+    auto it = map_.find(key);
+    if (it != map_.end()) {
+      total_weight_ -= it->second->weight;
+      it->second->value = std::move(value);
+      it->second->weight = weight;
+      total_weight_ += weight;
+      order_.splice(order_.end(), order_, it->second);
+    } else {
+      order_.push_back(Entry{key, std::move(value), weight});
+      map_.emplace(key, std::prev(order_.end()));
+      total_weight_ += weight;
+    }
+    // never evict the entry that was just inserted
+    while (total_weight_ > max_weight_ && order_.size() > 1) {
+      auto& oldest = order_.front();
+      total_weight_ -= oldest.weight;
+      map_.erase(oldest.key);
+      order_.pop_front();
+    }
+  }
+
+  void erase(const K& key) {
+    auto it = map_.find(key);
+    if (it == map_.end()) {
+      return;
+    }
+    total_weight_ -= it->second->weight;
+    order_.erase(it->second);
+    map_.erase(it);
+  }
+
+  size_t size() const {
+    return map_.size();
+  }
+
+  size_t weight() const {
+    return total_weight_;
+  }
+};
@@ -0,0 +1,181 @@
+#include <arrow/io/file.h>
+#include "td/utils/check.h"
+#include "td/utils/port/path.h"
+#include "ParquetTableWriter.h"
+
+
+td::Status to_td_status(const arrow::Status &status) {
+  if (status.ok()) {
+    return td::Status::OK();
+  }
+  return td::Status::Error(PSLICE() << "Arrow error: " << status.ToString());
+}
+
+ParquetTableWriter::ParquetTableWriter(std::string tmp_path, std::vector<ParquetColumn> columns, std::shared_ptr<parquet::WriterProperties> properties)
+  : tmp_path_(std::move(tmp_path)), properties_(std::move(properties)) {
+  arrow::FieldVector fields;
+  for (auto &column : columns) {
+    std::unique_ptr<arrow::ArrayBuilder> builder;
+    // dictionary columns keep int32 indices, the adaptive default would change the index type between batches
+    check(arrow::MakeBuilderExactIndex(arrow::default_memory_pool(), column.type, &builder));
+    builders_.push_back(std::move(builder));
+    fields.push_back(arrow::field(column.name, column.type));
+  }
+  schema_ = arrow::schema(std::move(fields));
+}
+
+void ParquetTableWriter::check(arrow::Status status) {
+  if (!status.ok() && append_status_.ok()) {
+    append_status_ = std::move(status);
+  }
+}
+
+arrow::ArrayBuilder *ParquetTableWriter::next_builder() {
+  CHECK(column_ < builders_.size());
+  return builders_[column_++].get();
+}
+
+ParquetTableWriter &ParquetTableWriter::add(int32_t value) {
+  auto builder = next_builder();
+  if (builder->type()->id() == arrow::Type::DICTIONARY) {
+    check(static_cast<arrow::Dictionary32Builder<arrow::Int32Type> *>(builder)->Append(value));
+  } else {
+    CHECK(builder->type()->id() == arrow::Type::INT32);
+    check(static_cast<arrow::Int32Builder *>(builder)->Append(value));
+  }
+  return *this;
+}
+
+ParquetTableWriter &ParquetTableWriter::add(uint32_t value) {
+  auto builder = next_builder();
+  CHECK(builder->type()->id() == arrow::Type::UINT32);
+  check(static_cast<arrow::UInt32Builder *>(builder)->Append(value));
+  return *this;
+}
+
+ParquetTableWriter &ParquetTableWriter::add(int64_t value) {
+  auto builder = next_builder();
+  CHECK(builder->type()->id() == arrow::Type::INT64);
+  check(static_cast<arrow::Int64Builder *>(builder)->Append(value));
+  return *this;
+}
+
+ParquetTableWriter &ParquetTableWriter::add(uint64_t value) {
+  auto builder = next_builder();
+  CHECK(builder->type()->id() == arrow::Type::UINT64);
+  check(static_cast<arrow::UInt64Builder *>(builder)->Append(value));
+  return *this;
+}
+
+ParquetTableWriter &ParquetTableWriter::add(bool value) {
+  auto builder = next_builder();
+  CHECK(builder->type()->id() == arrow::Type::BOOL);
+  check(static_cast<arrow::BooleanBuilder *>(builder)->Append(value));
+  return *this;
+}
+
+ParquetTableWriter &ParquetTableWriter::add(const std::string &value) {
+  auto builder = next_builder();
+  if (builder->type()->id() == arrow::Type::DICTIONARY) {
+    check(static_cast<arrow::StringDictionary32Builder *>(builder)->Append(value));
+  } else {
+    CHECK(builder->type()->id() == arrow::Type::STRING);
+    check(static_cast<arrow::StringBuilder *>(builder)->Append(value));
+  }
+  return *this;
+}
+
+ParquetTableWriter &ParquetTableWriter::add_hash(const td::Bits256 &hash) {
+  auto builder = next_builder();
+  CHECK(builder->type()->id() == arrow::Type::FIXED_SIZE_BINARY);
+  check(static_cast<arrow::FixedSizeBinaryBuilder *>(builder)->Append(hash.data()));
+  return *this;
+}
+
+ParquetTableWriter &ParquetTableWriter::add_null() {
+  check(next_builder()->AppendNull());
+  return *this;
+}
+
+void ParquetTableWriter::end_row() {
+  CHECK(column_ == builders_.size());
+  column_ = 0;
+  rows_++;
+  buffered_rows_++;
+}
+
+int64_t ParquetTableWriter::file_bytes() const {
+  if (!file_) {
+    return finished_bytes_;
+  }
+  auto position = file_->Tell();
+  return position.ok() ? *position : 0;
+}
+
+td::Status ParquetTableWriter::open() {
+  auto file = arrow::io::FileOutputStream::Open(tmp_path_);
+  if (!file.ok()) {
+    return to_td_status(file.status());
+  }
+  file_ = *file;
+  // the Arrow schema is stored in the file metadata, readers get the dictionary columns back as dictionaries
+  auto arrow_properties = parquet::ArrowWriterProperties::Builder().store_schema()->build();
+  auto writer = parquet::arrow::FileWriter::Open(*schema_, arrow::default_memory_pool(), file_, properties_, arrow_properties);
+  if (!writer.ok()) {
+    return to_td_status(writer.status());
+  }
+  writer_ = std::move(*writer);
+  return td::Status::OK();
+}
+
+td::Status ParquetTableWriter::flush() {
+  TRY_STATUS(to_td_status(append_status_));
+  if (buffered_rows_ == 0) {
+    return td::Status::OK();
+  }
+  if (!writer_) {
+    TRY_STATUS(open());
+  }
+  std::vector<std::shared_ptr<arrow::Array>> arrays;
+  for (auto &builder : builders_) {
+    std::shared_ptr<arrow::Array> array;
+    TRY_STATUS(to_td_status(builder->Finish(&array)));
+    arrays.push_back(std::move(array));
+  }
+  auto batch = arrow::RecordBatch::Make(schema_, buffered_rows_, std::move(arrays));
+  auto table = arrow::Table::FromRecordBatches(schema_, {batch});
+  if (!table.ok()) {
+    return to_td_status(table.status());
+  }
+  TRY_STATUS(to_td_status(writer_->WriteTable(**table, buffered_rows_)));
+  buffered_rows_ = 0;
+  return td::Status::OK();
+}
+
+td::Status ParquetTableWriter::finish() {
+  if (rows_ == 0) {
+    return td::Status::OK();
+  }
+  TRY_STATUS(flush());
+  TRY_STATUS(to_td_status(writer_->Close()));
+  writer_.reset();
+  // the position of a closed stream can't be read
+  finished_bytes_ = file_bytes();
+  TRY_STATUS(to_td_status(file_->Close()));
+  file_.reset();
+  return td::Status::OK();
+}
+
+void ParquetTableWriter::discard() {
+  if (writer_) {
+    auto status = writer_->Close();
+    writer_.reset();
+  }
+  if (file_) {
+    auto status = file_->Close();
+    file_.reset();
+  }
+  if (rows_ > 0) {
+    td::unlink(tmp_path_).ignore();
+  }
+}
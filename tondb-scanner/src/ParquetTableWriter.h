@@ -0,0 +1,78 @@
+#pragma once
+#include <arrow/api.h>
+#include <parquet/arrow/writer.h>
+#include "td/utils/Status.h"
+#include "td/utils/optional.h"
+#include "crypto/common/bitstring.h"
+
+
+struct ParquetColumn {
+  std::string name;
+  std::shared_ptr<arrow::DataType> type;
+};
+
+// Writes rows of one table to a Parquet file. Values are appended column by column in schema order like PgRow, the
+// buffered rows are written as a row group by flush(). The file stays under its temporary name, the owner renames it
+// once the file is listed in its manifest and removes it with discard() if it is never published.
+// Hashes are 32 byte fixed size binary, columns of dictionary type (addresses, statuses, opcodes) are dictionary
+// encoded in the Arrow batches and in the Parquet file.
+class ParquetTableWriter {
+public:
+  ParquetTableWriter(std::string tmp_path, std::vector<ParquetColumn> columns, std::shared_ptr<parquet::WriterProperties> properties);
+
+  ParquetTableWriter &add(int32_t value);
+  ParquetTableWriter &add(uint32_t value);
+  ParquetTableWriter &add(int64_t value);
+  ParquetTableWriter &add(uint64_t value);
+  ParquetTableWriter &add(bool value);
+  ParquetTableWriter &add(const std::string &value);
+  ParquetTableWriter &add(const char *value) { return add(std::string(value)); }
+  ParquetTableWriter &add_hash(const td::Bits256 &hash);
+  ParquetTableWriter &add_null();
+  template <class T>
+  ParquetTableWriter &add(const td::optional<T> &value) {
+    if (value) {
+      return add(value.value());
+    }
+    return add_null();
+  }
+  ParquetTableWriter &add_hash(const td::optional<td::Bits256> &hash) {
+    if (hash) {
+      return add_hash(hash.value());
+    }
+    return add_null();
+  }
+  void end_row();
+
+  size_t rows() const { return rows_; }
+  size_t buffered_rows() const { return buffered_rows_; }
+  // bytes written to the file so far
+  int64_t file_bytes() const;
+
+  td::Status flush();
+  // flushes and closes the file under its temporary name, does nothing if no row was written
+  td::Status finish();
+  // closes the file if it is still open and removes it
+  void discard();
+  const std::string &tmp_path() const { return tmp_path_; }
+
+private:
+  std::string tmp_path_;
+  std::shared_ptr<arrow::Schema> schema_;
+  std::shared_ptr<parquet::WriterProperties> properties_;
+  std::vector<std::unique_ptr<arrow::ArrayBuilder>> builders_;
+  std::shared_ptr<arrow::io::FileOutputStream> file_;
+  std::unique_ptr<parquet::arrow::FileWriter> writer_;
+  size_t column_{0};
+  size_t rows_{0};
+  size_t buffered_rows_{0};
+  int64_t finished_bytes_{0};
+  // first failed append, appends only fail when out of memory
+  arrow::Status append_status_;
+
+  arrow::ArrayBuilder *next_builder();
+  void check(arrow::Status status);
+  td::Status open();
+};
+
+td::Status to_td_status(const arrow::Status &status);
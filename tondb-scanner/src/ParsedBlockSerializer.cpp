@@ -0,0 +1,648 @@
+#include "td/utils/base64.h"
+#include "SerializationHelpers.h"
+#include "ParsedBlockSerializer.h"
+
+
+using namespace serialization;
+
+namespace {
+
+// incremented on any change of the encoding
+constexpr td::int32 parsed_block_version = 1;
+
+template <class StorerT, class T, class F>
+void store_vector(const std::vector<T> &values, StorerT &storer, F &&store_value) {
+  td::store(static_cast<td::int32>(values.size()), storer);
+  for (const auto &value : values) {
+    store_value(value);
+  }
+}
+
+template <class ParserT, class T, class F>
+void parse_vector(std::vector<T> &values, ParserT &parser, F &&parse_value) {
+  td::int32 size;
+  td::parse(size, parser);
+  if (size < 0 || static_cast<size_t>(size) > parser.get_left_len()) {
+    parser.set_error("bad vector size");
+    return;
+  }
+  values.resize(size);
+  for (auto &value : values) {
+    parse_value(value);
+    if (parser.get_error() != nullptr) {
+      return;
+    }
+  }
+}
+
+template <class T, class ParserT>
+void parse_int32_as(T &value, ParserT &parser) {
+  td::int32 v;
+  td::parse(v, parser);
+  value = static_cast<T>(v);
+}
+
+// base64 BOC of the parser is kept as raw BOC
+template <class StorerT>
+void store_boc(const std::string &base64_boc, StorerT &storer) {
+  td::store(td::base64_decode(base64_boc).move_as_ok(), storer);
+}
+
+template <class ParserT>
+void parse_boc(std::string &base64_boc, td::Ref<vm::Cell> &cell, ParserT &parser) {
+  std::string boc;
+  td::parse(boc, parser);
+  if (parser.get_error() != nullptr) {
+    return;
+  }
+  auto cell_r = vm::std_boc_deserialize(boc);
+  if (cell_r.is_error()) {
+    parser.set_error("bad message boc");
+    return;
+  }
+  cell = cell_r.move_as_ok();
+  base64_boc = td::base64_encode(boc);
+}
+
+template <class StorerT>
+void store_storage_used(const schema::StorageUsedShort &storage, StorerT &storer) {
+  td::store(storage.cells, storer);
+  td::store(storage.bits, storer);
+}
+
+template <class ParserT>
+void parse_storage_used(schema::StorageUsedShort &storage, ParserT &parser) {
+  td::parse(storage.cells, parser);
+  td::parse(storage.bits, parser);
+}
+
+template <class StorerT>
+void store_storage_phase(const schema::TrStoragePhase &phase, StorerT &storer) {
+  td::store(phase.storage_fees_collected, storer);
+  store_optional(phase.storage_fees_due, storer);
+  td::store(static_cast<td::int32>(phase.status_change), storer);
+}
+
+template <class ParserT>
+void parse_storage_phase(schema::TrStoragePhase &phase, ParserT &parser) {
+  td::parse(phase.storage_fees_collected, parser);
+  parse_optional(phase.storage_fees_due, parser);
+  parse_int32_as(phase.status_change, parser);
+}
+
+template <class StorerT>
+void store_credit_phase(const schema::TrCreditPhase &phase, StorerT &storer) {
+  td::store(phase.due_fees_collected, storer);
+  td::store(phase.credit, storer);
+}
+
+template <class ParserT>
+void parse_credit_phase(schema::TrCreditPhase &phase, ParserT &parser) {
+  td::parse(phase.due_fees_collected, parser);
+  td::parse(phase.credit, parser);
+}
+
+template <class StorerT>
+void store_compute_phase(const schema::TrComputePhase &phase, StorerT &storer) {
+  td::store(static_cast<td::int32>(phase.index()), storer);
+  if (auto skipped = std::get_if<schema::TrComputePhase_skipped>(&phase)) {
+    td::store(static_cast<td::int32>(skipped->reason), storer);
+  } else {
+    const auto &vm = std::get<schema::TrComputePhase_vm>(phase);
+    td::store(vm.success, storer);
+    td::store(vm.msg_state_used, storer);
+    td::store(vm.account_activated, storer);
+    td::store(vm.gas_fees, storer);
+    td::store(vm.gas_used, storer);
+    td::store(vm.gas_limit, storer);
+    store_optional(vm.gas_credit, storer);
+    td::store(static_cast<td::int32>(vm.mode), storer);
+    td::store(vm.exit_code, storer);
+    store_optional(vm.exit_arg, storer);
+    td::store(vm.vm_steps, storer);
+    store_bits(vm.vm_init_state_hash, storer);
+    store_bits(vm.vm_final_state_hash, storer);
+  }
+}
+
+template <class ParserT>
+void parse_compute_phase(schema::TrComputePhase &phase, ParserT &parser) {
+  td::int32 index;
+  td::parse(index, parser);
+  if (index == 0) {
+    auto &skipped = phase.emplace<schema::TrComputePhase_skipped>();
+    parse_int32_as(skipped.reason, parser);
+  } else if (index == 1) {
+    auto &vm = phase.emplace<schema::TrComputePhase_vm>();
+    td::parse(vm.success, parser);
+    td::parse(vm.msg_state_used, parser);
+    td::parse(vm.account_activated, parser);
+    td::parse(vm.gas_fees, parser);
+    td::parse(vm.gas_used, parser);
+    td::parse(vm.gas_limit, parser);
+    parse_optional(vm.gas_credit, parser);
+    parse_int32_as(vm.mode, parser);
+    td::parse(vm.exit_code, parser);
+    parse_optional(vm.exit_arg, parser);
+    td::parse(vm.vm_steps, parser);
+    parse_bits(vm.vm_init_state_hash, parser);
+    parse_bits(vm.vm_final_state_hash, parser);
+  } else {
+    parser.set_error("bad compute phase");
+  }
+}
+
+template <class StorerT>
+void store_action_phase(const schema::TrActionPhase &phase, StorerT &storer) {
+  td::store(phase.success, storer);
+  td::store(phase.valid, storer);
+  td::store(phase.no_funds, storer);
+  td::store(static_cast<td::int32>(phase.status_change), storer);
+  store_optional(phase.total_fwd_fees, storer);
+  store_optional(phase.total_action_fees, storer);
+  td::store(phase.result_code, storer);
+  store_optional(phase.result_arg, storer);
+  td::store(static_cast<td::int32>(phase.tot_actions), storer);
+  td::store(static_cast<td::int32>(phase.spec_actions), storer);
+  td::store(static_cast<td::int32>(phase.skipped_actions), storer);
+  td::store(static_cast<td::int32>(phase.msgs_created), storer);
+  store_bits(phase.action_list_hash, storer);
+  store_storage_used(phase.tot_msg_size, storer);
+}
+
+template <class ParserT>
+void parse_action_phase(schema::TrActionPhase &phase, ParserT &parser) {
+  td::parse(phase.success, parser);
+  td::parse(phase.valid, parser);
+  td::parse(phase.no_funds, parser);
+  parse_int32_as(phase.status_change, parser);
+  parse_optional(phase.total_fwd_fees, parser);
+  parse_optional(phase.total_action_fees, parser);
+  td::parse(phase.result_code, parser);
+  parse_optional(phase.result_arg, parser);
+  parse_int32_as(phase.tot_actions, parser);
+  parse_int32_as(phase.spec_actions, parser);
+  parse_int32_as(phase.skipped_actions, parser);
+  parse_int32_as(phase.msgs_created, parser);
+  parse_bits(phase.action_list_hash, parser);
+  parse_storage_used(phase.tot_msg_size, parser);
+}
+
+template <class StorerT>
+void store_bounce_phase(const schema::TrBouncePhase &phase, StorerT &storer) {
+  td::store(static_cast<td::int32>(phase.index()), storer);
+  if (auto nofunds = std::get_if<schema::TrBouncePhase_nofunds>(&phase)) {
+    store_storage_used(nofunds->msg_size, storer);
+    td::store(nofunds->req_fwd_fees, storer);
+  } else if (auto ok = std::get_if<schema::TrBouncePhase_ok>(&phase)) {
+    store_storage_used(ok->msg_size, storer);
+    td::store(ok->msg_fees, storer);
+    td::store(ok->fwd_fees, storer);
+  }
+}
+
+template <class ParserT>
+void parse_bounce_phase(schema::TrBouncePhase &phase, ParserT &parser) {
+  td::int32 index;
+  td::parse(index, parser);
+  if (index == 0) {
+    phase.emplace<schema::TrBouncePhase_negfunds>();
+  } else if (index == 1) {
+    auto &nofunds = phase.emplace<schema::TrBouncePhase_nofunds>();
+    parse_storage_used(nofunds.msg_size, parser);
+    td::parse(nofunds.req_fwd_fees, parser);
+  } else if (index == 2) {
+    auto &ok = phase.emplace<schema::TrBouncePhase_ok>();
+    parse_storage_used(ok.msg_size, parser);
+    td::parse(ok.msg_fees, parser);
+    td::parse(ok.fwd_fees, parser);
+  } else {
+    parser.set_error("bad bounce phase");
+  }
+}
+
+template <class StorerT>
+void store_split_info(const schema::SplitMergeInfo &info, StorerT &storer) {
+  td::store(static_cast<td::int32>(info.cur_shard_pfx_len), storer);
+  td::store(static_cast<td::int32>(info.acc_split_depth), storer);
+  store_bits(info.this_addr, storer);
+  store_bits(info.sibling_addr, storer);
+}
+
+template <class ParserT>
+void parse_split_info(schema::SplitMergeInfo &info, ParserT &parser) {
+  parse_int32_as(info.cur_shard_pfx_len, parser);
+  parse_int32_as(info.acc_split_depth, parser);
+  parse_bits(info.this_addr, parser);
+  parse_bits(info.sibling_addr, parser);
+}
+
+template <class StorerT>
+void store_description(const schema::TransactionDescr &description, StorerT &storer) {
+  auto store_action = [&](const schema::TrActionPhase &phase) { store_action_phase(phase, storer); };
+  auto store_storage = [&](const schema::TrStoragePhase &phase) { store_storage_phase(phase, storer); };
+  td::store(static_cast<td::int32>(description.index()), storer);
+  if (auto ord = std::get_if<schema::TransactionDescr_ord>(&description)) {
+    td::store(ord->credit_first, storer);
+    store_storage_phase(ord->storage_ph, storer);
+    store_credit_phase(ord->credit_ph, storer);
+    store_compute_phase(ord->compute_ph, storer);
+    store_optional(ord->action, storer, store_action);
+    td::store(ord->aborted, storer);
+    store_bounce_phase(ord->bounce, storer);
+    td::store(ord->destroyed, storer);
+  } else if (auto storage = std::get_if<schema::TransactionDescr_storage>(&description)) {
+    store_storage_phase(storage->storage_ph, storer);
+  } else if (auto tick_tock = std::get_if<schema::TransactionDescr_tick_tock>(&description)) {
+    td::store(tick_tock->is_tock, storer);
+    store_storage_phase(tick_tock->storage_ph, storer);
+    store_compute_phase(tick_tock->compute_ph, storer);
+    store_optional(tick_tock->action, storer, store_action);
+    td::store(tick_tock->aborted, storer);
+    td::store(tick_tock->destroyed, storer);
+  } else if (auto split_prepare = std::get_if<schema::TransactionDescr_split_prepare>(&description)) {
+    store_split_info(split_prepare->split_info, storer);
+    store_optional(split_prepare->storage_ph, storer, store_storage);
+    store_compute_phase(split_prepare->compute_ph, storer);
+    store_optional(split_prepare->action, storer, store_action);
+    td::store(split_prepare->aborted, storer);
+    td::store(split_prepare->destroyed, storer);
+  } else if (auto split_install = std::get_if<schema::TransactionDescr_split_install>(&description)) {
+    store_split_info(split_install->split_info, storer);
+    td::store(split_install->installed, storer);
+  } else if (auto merge_prepare = std::get_if<schema::TransactionDescr_merge_prepare>(&description)) {
+    store_split_info(merge_prepare->split_info, storer);
+    store_storage_phase(merge_prepare->storage_ph, storer);
+    td::store(merge_prepare->aborted, storer);
+  } else {
+    const auto &merge_install = std::get<schema::TransactionDescr_merge_install>(description);
+    store_split_info(merge_install.split_info, storer);
+    store_optional(merge_install.storage_ph, storer, store_storage);
+    store_optional(merge_install.credit_ph, storer, [&](const schema::TrCreditPhase &phase) { store_credit_phase(phase, storer); });
+    store_compute_phase(merge_install.compute_ph, storer);
+    store_optional(merge_install.action, storer, store_action);
+    td::store(merge_install.aborted, storer);
+    td::store(merge_install.destroyed, storer);
+  }
+}
+
+template <class ParserT>
+void parse_description(schema::TransactionDescr &description, ParserT &parser) {
+  auto parse_action = [&](schema::TrActionPhase &phase) { parse_action_phase(phase, parser); };
+  auto parse_storage = [&](schema::TrStoragePhase &phase) { parse_storage_phase(phase, parser); };
+  td::int32 index;
+  td::parse(index, parser);
+  switch (index) {
+    case 0: {
+      auto &ord = description.emplace<schema::TransactionDescr_ord>();
+      td::parse(ord.credit_first, parser);
+      parse_storage_phase(ord.storage_ph, parser);
+      parse_credit_phase(ord.credit_ph, parser);
+      parse_compute_phase(ord.compute_ph, parser);
+      parse_optional(ord.action, parser, parse_action);
+      td::parse(ord.aborted, parser);
+      parse_bounce_phase(ord.bounce, parser);
+      td::parse(ord.destroyed, parser);
+      break;
+    }
+    case 1: {
+      auto &storage = description.emplace<schema::TransactionDescr_storage>();
+      parse_storage_phase(storage.storage_ph, parser);
+      break;
+    }
+    case 2: {
+      auto &tick_tock = description.emplace<schema::TransactionDescr_tick_tock>();
+      td::parse(tick_tock.is_tock, parser);
+      parse_storage_phase(tick_tock.storage_ph, parser);
+      parse_compute_phase(tick_tock.compute_ph, parser);
+      parse_optional(tick_tock.action, parser, parse_action);
+      td::parse(tick_tock.aborted, parser);
+      td::parse(tick_tock.destroyed, parser);
+      break;
+    }
+    case 3: {
+      auto &split_prepare = description.emplace<schema::TransactionDescr_split_prepare>();
+      parse_split_info(split_prepare.split_info, parser);
+      parse_optional(split_prepare.storage_ph, parser, parse_storage);
+      parse_compute_phase(split_prepare.compute_ph, parser);
+      parse_optional(split_prepare.action, parser, parse_action);
+      td::parse(split_prepare.aborted, parser);
+      td::parse(split_prepare.destroyed, parser);
+      break;
+    }
+    case 4: {
+      auto &split_install = description.emplace<schema::TransactionDescr_split_install>();
+      parse_split_info(split_install.split_info, parser);
+      td::parse(split_install.installed, parser);
+      break;
+    }
+    case 5: {
+      auto &merge_prepare = description.emplace<schema::TransactionDescr_merge_prepare>();
+      parse_split_info(merge_prepare.split_info, parser);
+      parse_storage_phase(merge_prepare.storage_ph, parser);
+      td::parse(merge_prepare.aborted, parser);
+      break;
+    }
+    case 6: {
+      auto &merge_install = description.emplace<schema::TransactionDescr_merge_install>();
+      parse_split_info(merge_install.split_info, parser);
+      parse_optional(merge_install.storage_ph, parser, parse_storage);
+      parse_optional(merge_install.credit_ph, parser, [&](schema::TrCreditPhase &phase) { parse_credit_phase(phase, parser); });
+      parse_compute_phase(merge_install.compute_ph, parser);
+      parse_optional(merge_install.action, parser, parse_action);
+      td::parse(merge_install.aborted, parser);
+      td::parse(merge_install.destroyed, parser);
+      break;
+    }
+    default:
+      parser.set_error("bad transaction description");
+  }
+}
+
+template <class StorerT>
+void store_message(const schema::Message &message, StorerT &storer) {
+  store_bits(message.hash, storer);
+  store_optional(message.source, storer);
+  store_optional(message.destination, storer);
+  store_optional(message.value, storer);
+  store_optional(message.fwd_fee, storer);
+  store_optional(message.ihr_fee, storer);
+  store_optional(message.created_lt, storer);
+  store_optional(message.created_at, storer);
+  store_optional(message.opcode, storer);
+  store_optional(message.ihr_disabled, storer);
+  store_optional(message.bounce, storer);
+  store_optional(message.bounced, storer);
+  store_optional(message.import_fee, storer);
+  store_boc(message.body_boc, storer);
+  store_optional(message.init_state_boc, storer, [&](const std::string &boc) { store_boc(boc, storer); });
+}
+
+template <class ParserT>
+void parse_message(schema::Message &message, ParserT &parser) {
+  parse_bits(message.hash, parser);
+  parse_optional(message.source, parser);
+  parse_optional(message.destination, parser);
+  parse_optional(message.value, parser);
+  parse_optional(message.fwd_fee, parser);
+  parse_optional(message.ihr_fee, parser);
+  parse_optional(message.created_lt, parser);
+  parse_optional(message.created_at, parser);
+  parse_optional(message.opcode, parser);
+  parse_optional(message.ihr_disabled, parser);
+  parse_optional(message.bounce, parser);
+  parse_optional(message.bounced, parser);
+  parse_optional(message.import_fee, parser);
+  parse_boc(message.body_boc, message.body, parser);
+  parse_optional(message.init_state_boc, parser, [&](std::string &boc) { parse_boc(boc, message.init_state, parser); });
+}
+
+template <class StorerT>
+void store_transaction(const schema::Transaction &transaction, StorerT &storer) {
+  store_bits(transaction.hash, storer);
+  store_address(transaction.account, storer);
+  td::store(transaction.lt, storer);
+  store_bits(transaction.prev_trans_hash, storer);
+  td::store(transaction.prev_trans_lt, storer);
+  td::store(transaction.now, storer);
+  td::store(static_cast<td::int32>(transaction.orig_status), storer);
+  td::store(static_cast<td::int32>(transaction.end_status), storer);
+  auto store_msg = [&](const schema::Message &message) { store_message(message, storer); };
+  store_optional(transaction.in_msg, storer, store_msg);
+  store_vector(transaction.out_msgs, storer, store_msg);
+  td::store(transaction.total_fees, storer);
+  store_bits(transaction.account_state_hash_before, storer);
+  store_bits(transaction.account_state_hash_after, storer);
+  store_description(transaction.description, storer);
+}
+
+template <class ParserT>
+void parse_transaction(schema::Transaction &transaction, ParserT &parser) {
+  parse_bits(transaction.hash, parser);
+  parse_address(transaction.account, parser);
+  td::parse(transaction.lt, parser);
+  parse_bits(transaction.prev_trans_hash, parser);
+  td::parse(transaction.prev_trans_lt, parser);
+  td::parse(transaction.now, parser);
+  parse_int32_as(transaction.orig_status, parser);
+  parse_int32_as(transaction.end_status, parser);
+  auto parse_msg = [&](schema::Message &message) { parse_message(message, parser); };
+  parse_optional(transaction.in_msg, parser, parse_msg);
+  parse_vector(transaction.out_msgs, parser, parse_msg);
+  td::parse(transaction.total_fees, parser);
+  parse_bits(transaction.account_state_hash_before, parser);
+  parse_bits(transaction.account_state_hash_after, parser);
+  parse_description(transaction.description, parser);
+}
+
+template <class StorerT>
+void store_block(const schema::Block &block, StorerT &storer) {
+  td::store(block.workchain, storer);
+  td::store(block.shard, storer);
+  td::store(block.seqno, storer);
+  store_bits(block.root_hash, storer);
+  store_bits(block.file_hash, storer);
+  store_optional(block.mc_block_workchain, storer);
+  store_optional(block.mc_block_shard, storer);
+  store_optional(block.mc_block_seqno, storer);
+  td::store(block.global_id, storer);
+  td::store(block.version, storer);
+  td::store(block.after_merge, storer);
+  td::store(block.before_split, storer);
+  td::store(block.after_split, storer);
+  td::store(block.want_split, storer);
+  td::store(block.key_block, storer);
+  td::store(block.vert_seqno_incr, storer);
+  td::store(block.flags, storer);
+  td::store(block.gen_utime, storer);
+  td::store(block.start_lt, storer);
+  td::store(block.end_lt, storer);
+  td::store(block.validator_list_hash_short, storer);
+  td::store(block.gen_catchain_seqno, storer);
+  td::store(block.min_ref_mc_seqno, storer);
+  td::store(block.prev_key_block_seqno, storer);
+  td::store(block.vert_seqno, storer);
+  store_optional(block.master_ref_seqno, storer);
+  store_bits(block.rand_seed, storer);
+  store_bits(block.created_by, storer);
+  store_vector(block.transactions, storer, [&](const schema::Transaction &transaction) { store_transaction(transaction, storer); });
+}
+
+template <class ParserT>
+void parse_block(schema::Block &block, ParserT &parser) {
+  td::parse(block.workchain, parser);
+  td::parse(block.shard, parser);
+  td::parse(block.seqno, parser);
+  parse_bits(block.root_hash, parser);
+  parse_bits(block.file_hash, parser);
+  parse_optional(block.mc_block_workchain, parser);
+  parse_optional(block.mc_block_shard, parser);
+  parse_optional(block.mc_block_seqno, parser);
+  td::parse(block.global_id, parser);
+  td::parse(block.version, parser);
+  td::parse(block.after_merge, parser);
+  td::parse(block.before_split, parser);
+  td::parse(block.after_split, parser);
+  td::parse(block.want_split, parser);
+  td::parse(block.key_block, parser);
+  td::parse(block.vert_seqno_incr, parser);
+  td::parse(block.flags, parser);
+  td::parse(block.gen_utime, parser);
+  td::parse(block.start_lt, parser);
+  td::parse(block.end_lt, parser);
+  td::parse(block.validator_list_hash_short, parser);
+  td::parse(block.gen_catchain_seqno, parser);
+  td::parse(block.min_ref_mc_seqno, parser);
+  td::parse(block.prev_key_block_seqno, parser);
+  td::parse(block.vert_seqno, parser);
+  parse_optional(block.master_ref_seqno, parser);
+  parse_bits(block.rand_seed, parser);
+  parse_bits(block.created_by, parser);
+  parse_vector(block.transactions, parser, [&](schema::Transaction &transaction) { parse_transaction(transaction, parser); });
+}
+
+template <class StorerT>
+void store_account_state(const schema::AccountState &state, StorerT &storer) {
+  auto store_hash_bits = [&](const td::Bits256 &bits) { store_bits(bits, storer); };
+  store_bits(state.hash, storer);
+  store_address(state.account, storer);
+  td::store(state.balance, storer);
+  td::store(state.account_status, storer);
+  store_optional(state.frozen_hash, storer, store_hash_bits);
+  store_cell(state.code, storer);
+  store_optional(state.code_hash, storer, store_hash_bits);
+  store_cell(state.data, storer);
+  store_optional(state.data_hash, storer, store_hash_bits);
+  td::store(state.last_trans_lt, storer);
+}
+
+template <class ParserT>
+void parse_account_state(schema::AccountState &state, ParserT &parser) {
+  auto parse_hash_bits = [&](td::Bits256 &bits) { parse_bits(bits, parser); };
+  parse_bits(state.hash, parser);
+  parse_address(state.account, parser);
+  td::parse(state.balance, parser);
+  td::parse(state.account_status, parser);
+  parse_optional(state.frozen_hash, parser, parse_hash_bits);
+  parse_cell(state.code, parser);
+  parse_optional(state.code_hash, parser, parse_hash_bits);
+  parse_cell(state.data, parser);
+  parse_optional(state.data_hash, parser, parse_hash_bits);
+  td::parse(state.last_trans_lt, parser);
+}
+
+template <class StorerT>
+void store_event(const BlockchainEvent &event, StorerT &storer) {
+  td::store(static_cast<td::int32>(event.index()), storer);
+  if (auto transfer = std::get_if<JettonTransfer>(&event)) {
+    store_bits(transfer->transaction_hash, storer);
+    td::store(transfer->query_id, storer);
+    store_int(transfer->amount, storer);
+    td::store(transfer->source, storer);
+    td::store(transfer->destination, storer);
+    td::store(transfer->jetton_wallet, storer);
+    td::store(transfer->response_destination, storer);
+    store_cell(transfer->custom_payload, storer);
+    store_int(transfer->forward_ton_amount, storer);
+    store_cell(transfer->forward_payload, storer);
+  } else if (auto burn = std::get_if<JettonBurn>(&event)) {
+    store_bits(burn->transaction_hash, storer);
+    td::store(burn->query_id, storer);
+    td::store(burn->owner, storer);
+    td::store(burn->jetton_wallet, storer);
+    store_int(burn->amount, storer);
+    td::store(burn->response_destination, storer);
+    store_cell(burn->custom_payload, storer);
+  } else {
+    const auto &transfer = std::get<NFTTransfer>(event);
+    store_bits(transfer.transaction_hash, storer);
+    td::store(transfer.query_id, storer);
+    store_address(transfer.nft_item, storer);
+    td::store(transfer.old_owner, storer);
+    td::store(transfer.new_owner, storer);
+    td::store(transfer.response_destination, storer);
+    store_cell(transfer.custom_payload, storer);
+    store_int(transfer.forward_amount, storer);
+    store_cell(transfer.forward_payload, storer);
+  }
+}
+
+template <class ParserT>
+void parse_event(BlockchainEvent &event, ParserT &parser) {
+  td::int32 index;
+  td::parse(index, parser);
+  if (index == 0) {
+    auto &transfer = event.emplace<JettonTransfer>();
+    parse_bits(transfer.transaction_hash, parser);
+    td::parse(transfer.query_id, parser);
+    parse_int(transfer.amount, parser);
+    td::parse(transfer.source, parser);
+    td::parse(transfer.destination, parser);
+    td::parse(transfer.jetton_wallet, parser);
+    td::parse(transfer.response_destination, parser);
+    parse_cell(transfer.custom_payload, parser);
+    parse_int(transfer.forward_ton_amount, parser);
+    parse_cell(transfer.forward_payload, parser);
+  } else if (index == 1) {
+    auto &burn = event.emplace<JettonBurn>();
+    parse_bits(burn.transaction_hash, parser);
+    td::parse(burn.query_id, parser);
+    td::parse(burn.owner, parser);
+    td::parse(burn.jetton_wallet, parser);
+    parse_int(burn.amount, parser);
+    td::parse(burn.response_destination, parser);
+    parse_cell(burn.custom_payload, parser);
+  } else if (index == 2) {
+    auto &transfer = event.emplace<NFTTransfer>();
+    parse_bits(transfer.transaction_hash, parser);
+    td::parse(transfer.query_id, parser);
+    parse_address(transfer.nft_item, parser);
+    td::parse(transfer.old_owner, parser);
+    td::parse(transfer.new_owner, parser);
+    td::parse(transfer.response_destination, parser);
+    parse_cell(transfer.custom_payload, parser);
+    parse_int(transfer.forward_amount, parser);
+    parse_cell(transfer.forward_payload, parser);
+  } else {
+    parser.set_error("bad event");
+  }
+}
+
+// td::serialize and td::unserialize call the members
+struct ParsedBlockRecord {
+  ParsedBlock *block;
+
+  template <class StorerT>
+  void store(StorerT &storer) const {
+    td::store(parsed_block_version, storer);
+    store_vector(block->blocks_, storer, [&](const schema::Block &blk) { store_block(blk, storer); });
+    store_vector(block->account_states_, storer, [&](const schema::AccountState &state) { store_account_state(state, storer); });
+    store_vector(block->events_, storer, [&](const BlockchainEvent &event) { store_event(event, storer); });
+  }
+
+  template <class ParserT>
+  void parse(ParserT &parser) {
+    td::int32 version;
+    td::parse(version, parser);
+    if (version != parsed_block_version) {
+      parser.set_error(PSTRING() << "unsupported parsed block version " << version);
+      return;
+    }
+    parse_vector(block->blocks_, parser, [&](schema::Block &blk) { parse_block(blk, parser); });
+    parse_vector(block->account_states_, parser, [&](schema::AccountState &state) { parse_account_state(state, parser); });
+    parse_vector(block->events_, parser, [&](BlockchainEvent &event) { parse_event(event, parser); });
+  }
+};
+
+}  // namespace
+
+std::string serialize_parsed_block(const ParsedBlock &block) {
+  return td::serialize(ParsedBlockRecord{const_cast<ParsedBlock *>(&block)});
+}
+
+td::Result<ParsedBlockPtr> deserialize_parsed_block(td::Slice data) {
+  auto block = std::make_shared<ParsedBlock>();
+  ParsedBlockRecord record{block.get()};
+  TRY_STATUS(td::unserialize(record, data));
+  return block;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "IndexData.h"
+
+
+// Binary encoding of the rows of a ParsedBlock: blocks with transactions and messages, account states and events.
+// The shard states and account index are not encoded, a decoded block can be inserted but not run through the
+// interface detectors again. Message bodies and init states are stored as raw BOC, not base64.
+std::string serialize_parsed_block(const ParsedBlock &block);
+td::Result<ParsedBlockPtr> deserialize_parsed_block(td::Slice data);
@@ -0,0 +1,219 @@
+#include <set>
+#include <sstream>
+#include "td/utils/logging.h"
+#include "PgBulkLoad.h"
+#include "InsertManager.h"
+#include "DbExecutor.h"
+
+
+std::string PgDeferredIndex::drop_sql() const {
+  if (primary_key) {
+    return "ALTER TABLE " + table + " DROP CONSTRAINT IF EXISTS " + name;
+  }
+  return "DROP INDEX IF EXISTS " + name;
+}
+
+std::string PgDeferredIndex::create_sql() const {
+  if (primary_key) {
+    return "ALTER TABLE " + table + " ADD CONSTRAINT " + name + " PRIMARY KEY (" + columns + ")";
+  }
+  return "CREATE INDEX IF NOT EXISTS " + name + " ON " + table + " (" + columns + ")";
+}
+
+// names follow scripts/init_postgres_schema.sh, the partition key is part of every primary key of a partitioned table
+std::vector<PgDeferredIndex> bulk_load_deferred_indexes(bool partitioned) {
+  std::string mc_seqno = partitioned ? ", mc_seqno" : "";
+  return {
+    {"blocks", "blocks_pkey", "workchain, shard, seqno" + mc_seqno, true},
+    {"blocks", "blocks_mc_block_idx", "mc_block_workchain, mc_block_shard, mc_block_seqno"},
+    {"transactions", "transactions_pkey", "hash" + mc_seqno, true},
+    {"transactions", "transactions_block_idx", "block_workchain, block_shard, block_seqno"},
+    {"transactions", "transactions_account_lt_idx", "account_workchain, account, lt"},
+    {"transaction_messages", "transaction_messages_pkey", "transaction_hash, message_hash, direction", true},
+    {"transaction_messages", "transaction_messages_message_idx", "message_hash"},
+    {"messages", "messages_source_idx", "source_workchain, source, created_lt"},
+    {"messages", "messages_destination_idx", "destination_workchain, destination, created_lt"},
+    {"account_states", "account_states_account_idx", "account_workchain, account"},
+    {"jetton_transfers", "jetton_transfers_pkey", "transaction_hash", true},
+    {"jetton_burns", "jetton_burns_pkey", "transaction_hash", true},
+    {"nft_transfers", "nft_transfers_pkey", "transaction_hash", true},
+  };
+}
+
+std::vector<PgDeferredIndex> missing_deferred_indexes(pqxx::work &txn, std::vector<PgDeferredIndex> indexes) {
+  std::set<std::string> existing;
+  // partitioned tables list their parent indexes here too
+  for (const auto& row : txn.exec("SELECT indexname FROM pg_indexes WHERE schemaname = current_schema()")) {
+    existing.insert(row[0].as<std::string>());
+  }
+  std::vector<PgDeferredIndex> missing;
+  for (auto &index : indexes) {
+    if (existing.count(index.name) == 0) {
+      missing.push_back(std::move(index));
+    }
+  }
+  return missing;
+}
+
+void PgBulkLoadCheck::start_up() {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    promise_.set_error(connection.move_as_error());
+    stop();
+    return;
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    auto missing = missing_deferred_indexes(txn, std::move(indexes_));
+    txn.commit();
+    promise_.set_value(std::move(missing));
+  } catch (const std::exception &e) {
+    promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error reading indexes: " << e.what()));
+  }
+  stop();
+}
+
+void PgBulkLoadPrepare::start_up() {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    promise_.set_error(connection.move_as_error());
+    stop();
+    return;
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    for (const auto& index : indexes_) {
+      txn.exec0(index.drop_sql());
+    }
+    txn.commit();
+    LOG(WARNING) << "Bulk load: dropped " << indexes_.size() << " indexes and primary keys, they are rebuilt when the tip is reached";
+    promise_.set_value(td::Unit());
+  } catch (const std::exception &e) {
+    promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error dropping indexes for bulk load: " << e.what()));
+  }
+  stop();
+}
+
+// Builds one deferred index on its own connection
+class PgIndexBuild: public td::actor::Actor {
+public:
+  PgIndexBuild(std::shared_ptr<PgConnectionPool> pool, PgDeferredIndex index, td::Promise<td::Unit> promise)
+    : pool_(std::move(pool)), index_(std::move(index)), promise_(std::move(promise)) {}
+
+  void start_up() override {
+    auto connection = pool_->acquire();
+    if (connection.is_error()) {
+      promise_.set_error(connection.move_as_error());
+      stop();
+      return;
+    }
+    try {
+      auto c = connection.move_as_ok();
+      pqxx::work txn(*c);
+      txn.exec0(index_.create_sql());
+      txn.commit();
+      promise_.set_value(td::Unit());
+    } catch (const std::exception &e) {
+      promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error building " << index_.name << ": " << e.what()));
+    }
+    stop();
+  }
+
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  PgDeferredIndex index_;
+  td::Promise<td::Unit> promise_;
+};
+
+void PgBulkLoadFinish::start_up() {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    promise_.set_error(connection.move_as_error());
+    stop();
+    return;
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    for (auto &index : missing_deferred_indexes(txn, std::move(indexes_))) {
+      pending_.push(std::move(index));
+    }
+    txn.commit();
+  } catch (const std::exception &e) {
+    promise_.set_error(td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error reading indexes: " << e.what()));
+    stop();
+    return;
+  }
+  LOG(WARNING) << "Bulk load: building " << pending_.size() << " indexes and primary keys";
+  start_builds();
+  alarm_timestamp() = td::Timestamp::in(10.0);
+}
+
+void PgBulkLoadFinish::alarm() {
+  report_progress();
+  alarm_timestamp() = td::Timestamp::in(10.0);
+}
+
+void PgBulkLoadFinish::start_builds() {
+  while (!pending_.empty() && running_ < max_parallel_builds) {
+    auto index = std::move(pending_.front());
+    pending_.pop();
+    running_++;
+    auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), name = index.name, start = td::Time::now()](td::Result<td::Unit> R) {
+      td::actor::send_closure(SelfId, &PgBulkLoadFinish::build_done, name, td::Time::now() - start, std::move(R));
+    });
+    create_db_actor<PgIndexBuild>("index_build", pool_, std::move(index), std::move(P)).release();
+  }
+  if (running_ == 0) {
+    if (error_.is_error()) {
+      promise_.set_error(std::move(error_));
+    } else {
+      promise_.set_value(td::Unit());
+    }
+    stop();
+  }
+}
+
+void PgBulkLoadFinish::build_done(std::string name, double duration, td::Result<td::Unit> R) {
+  running_--;
+  if (R.is_error()) {
+    LOG(ERROR) << "Bulk load: " << R.error();
+    if (error_.is_ok()) {
+      error_ = R.move_as_error();
+    }
+  } else {
+    LOG(WARNING) << "Bulk load: built " << name << " in " << duration << "s, " << pending_.size() + running_ << " left";
+  }
+  start_builds();
+}
+
+void PgBulkLoadFinish::report_progress() {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    return;
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    auto result = txn.exec("SELECT relid::regclass::text, phase, blocks_done, blocks_total, tuples_done, tuples_total "
+                           "FROM pg_stat_progress_create_index");
+    for (const auto& row : result) {
+      auto blocks_total = row[3].as<int64_t>(0);
+      auto tuples_total = row[5].as<int64_t>(0);
+      std::ostringstream progress;
+      progress << row[0].as<std::string>() << ": " << row[1].as<std::string>();
+      if (blocks_total > 0) {
+        progress << ", blocks " << row[2].as<int64_t>(0) * 100 / blocks_total << "%";
+      }
+      if (tuples_total > 0) {
+        progress << ", tuples " << row[4].as<int64_t>(0) * 100 / tuples_total << "%";
+      }
+      LOG(INFO) << "Bulk load index build " << progress.str();
+    }
+    txn.commit();
+  } catch (const std::exception &e) {
+    LOG(WARNING) << "Failed to read index build progress: " << e.what();
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <queue>
+#include "td/actor/actor.h"
+#include "PgConnectionPool.h"
+
+
+// Index or primary key that is dropped for the duration of a bulk load and built once the tip is reached
+struct PgDeferredIndex {
+  std::string table;
+  std::string name;
+  std::string columns;
+  bool primary_key{false};
+
+  std::string drop_sql() const;
+  std::string create_sql() const;
+};
+
+std::vector<PgDeferredIndex> bulk_load_deferred_indexes(bool partitioned);
+
+// the indexes that don't exist in the current schema, primary keys are found by the index backing them
+std::vector<PgDeferredIndex> missing_deferred_indexes(pqxx::work &txn, std::vector<PgDeferredIndex> indexes);
+
+// Finds the deferred indexes that are missing, e.g. after a bulk load was interrupted before building them
+class PgBulkLoadCheck: public td::actor::Actor {
+public:
+  PgBulkLoadCheck(std::shared_ptr<PgConnectionPool> pool, std::vector<PgDeferredIndex> indexes,
+                  td::Promise<std::vector<PgDeferredIndex>> promise)
+    : pool_(std::move(pool)), indexes_(std::move(indexes)), promise_(std::move(promise)) {}
+
+  void start_up() override;
+
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::vector<PgDeferredIndex> indexes_;
+  td::Promise<std::vector<PgDeferredIndex>> promise_;
+};
+
+// Drops the deferred indexes and primary keys before the first bulk loaded batch
+class PgBulkLoadPrepare: public td::actor::Actor {
+public:
+  PgBulkLoadPrepare(std::shared_ptr<PgConnectionPool> pool, std::vector<PgDeferredIndex> indexes, td::Promise<td::Unit> promise)
+    : pool_(std::move(pool)), indexes_(std::move(indexes)), promise_(std::move(promise)) {}
+
+  void start_up() override;
+
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::vector<PgDeferredIndex> indexes_;
+  td::Promise<td::Unit> promise_;
+};
+
+// Builds the deferred indexes and primary keys that are missing, up to max_parallel_builds at a time on separate
+// connections, so a retry after a failure builds only the rest. Progress of the running builds is read from
+// pg_stat_progress_create_index and logged every 10 seconds.
+class PgBulkLoadFinish: public td::actor::Actor {
+public:
+  PgBulkLoadFinish(std::shared_ptr<PgConnectionPool> pool, std::vector<PgDeferredIndex> indexes, td::Promise<td::Unit> promise)
+    : pool_(std::move(pool)), indexes_(std::move(indexes)), promise_(std::move(promise)) {}
+
+  void start_up() override;
+  void alarm() override;
+  void build_done(std::string name, double duration, td::Result<td::Unit> R);
+
+private:
+  static constexpr size_t max_parallel_builds = 4;
+
+  std::shared_ptr<PgConnectionPool> pool_;
+  std::vector<PgDeferredIndex> indexes_;
+  std::queue<PgDeferredIndex> pending_;
+  size_t running_{0};
+  td::Status error_;
+  td::Promise<td::Unit> promise_;
+
+  void start_builds();
+  void report_progress();
+};
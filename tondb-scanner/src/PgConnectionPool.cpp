@@ -0,0 +1,132 @@
+#include "td/utils/logging.h"
+#include "PgConnectionPool.h"
+#include "InsertManager.h"
+
+
+td::Result<PgConnectionPool::Lease> PgConnectionPool::acquire() {
+  auto start = td::Time::now();
+  auto record_wait = [&]() {
+    auto wait = td::Time::now() - start;
+    stats_.acquired++;
+    stats_.total_wait += wait;
+    stats_.max_wait = std::max(stats_.max_wait, wait);
+  };
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (!idle_.empty()) {
+      // most recently used connection first, so the surplus ones stay idle and get trimmed
+      auto idle = std::move(idle_.back());
+      idle_.pop_back();
+      leased_++;
+      bool needs_check = td::Time::now() - idle.idle_since > options_.health_check_idle;
+      if (needs_check) {
+        lock.unlock();
+        bool healthy = is_healthy(*idle.connection);
+        lock.lock();
+        if (!healthy) {
+          leased_--;
+          stats_.dropped++;
+          continue;
+        }
+      }
+      record_wait();
+      return Lease(this, std::move(idle.connection));
+    }
+
+    if (leased_ + connecting_ < options_.max_size) {
+      if (next_connect_attempt_ && !next_connect_attempt_.is_in_past()) {
+        return td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Database is unavailable, next connect attempt in "
+                                                                << next_connect_attempt_.in() << "s");
+      }
+      connecting_++;
+      auto statements = statements_;
+      lock.unlock();
+      auto connection = connect(std::move(statements));
+      lock.lock();
+      connecting_--;
+      if (connection.is_error()) {
+        stats_.connect_failures++;
+        backoff_ = backoff_ == 0 ? options_.min_backoff : std::min(backoff_ * 2, options_.max_backoff);
+        next_connect_attempt_ = td::Timestamp::in(backoff_);
+        released_.notify_all();
+        return connection.move_as_error();
+      }
+      backoff_ = 0;
+      next_connect_attempt_ = td::Timestamp();
+      stats_.connects++;
+      leased_++;
+      record_wait();
+      return Lease(this, connection.move_as_ok());
+    }
+
+    auto remaining = options_.acquire_timeout - (td::Time::now() - start);
+    if (remaining <= 0) {
+      return td::Status::Error(ErrorCode::DB_ERROR, "Timed out waiting for a free database connection");
+    }
+    released_.wait_for(lock, std::chrono::duration<double>(remaining));
+  }
+}
+
+void PgConnectionPool::prepare(std::string name, std::string definition) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  statements_[std::move(name)] = std::move(definition);
+}
+
+PgConnectionPool::Stats PgConnectionPool::get_stats() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto stats = stats_;
+  stats.idle = idle_.size();
+  stats.leased = leased_;
+  return stats;
+}
+
+td::Result<std::unique_ptr<pqxx::connection>> PgConnectionPool::connect(std::map<std::string, std::string> statements) {
+  try {
+    auto connection = std::make_unique<pqxx::connection>(options_.connection_string);
+    if (!connection->is_open()) {
+      return td::Status::Error(ErrorCode::DB_ERROR, "Failed to open database");
+    }
+    for (const auto& [name, definition] : statements) {
+      connection->prepare(name, definition);
+    }
+    return std::move(connection);
+  } catch (const std::exception &e) {
+    return td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Failed to connect to PG: " << e.what());
+  }
+}
+
+bool PgConnectionPool::is_healthy(pqxx::connection& connection) {
+  if (!connection.is_open()) {
+    return false;
+  }
+  try {
+    pqxx::nontransaction txn(connection);
+    txn.exec0("SELECT 1");
+    return true;
+  } catch (const std::exception &e) {
+    LOG(WARNING) << "Dropping unhealthy PG connection: " << e.what();
+    return false;
+  }
+}
+
+void PgConnectionPool::release(std::unique_ptr<pqxx::connection> connection, bool broken) {
+  std::vector<std::unique_ptr<pqxx::connection>> to_close;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    leased_--;
+    if (broken || !connection->is_open()) {
+      stats_.dropped++;
+      to_close.push_back(std::move(connection));
+    } else {
+      idle_.push_back({std::move(connection), td::Time::now()});
+    }
+    // close connections idle for long, but keep at least min_size open
+    while (!idle_.empty() && idle_.size() + leased_ > options_.min_size
+           && td::Time::now() - idle_.front().idle_since > options_.idle_timeout) {
+      to_close.push_back(std::move(idle_.front().connection));
+      idle_.pop_front();
+    }
+  }
+  released_.notify_one();
+}
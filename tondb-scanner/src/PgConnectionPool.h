@@ -0,0 +1,116 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <vector>
+#include <pqxx/pqxx>
+#include "td/utils/Status.h"
+#include "td/utils/Time.h"
+
+
+// Pool of persistent Postgres connections shared by all DB actors.
+// Connections are opened on demand up to max_size and kept open down to min_size, idle ones are health checked
+// before reuse and failed connects are retried with exponential backoff. Statements registered with prepare()
+// are prepared once on every connection. Thread safe, acquire() blocks while all connections are leased.
+class PgConnectionPool {
+public:
+  struct Options {
+    std::string connection_string;
+    size_t min_size{2};
+    size_t max_size{16};
+    double acquire_timeout{60.0};
+    double health_check_idle{30.0};
+    double idle_timeout{300.0};
+    double min_backoff{0.5};
+    double max_backoff{30.0};
+  };
+
+  struct Stats {
+    uint64_t acquired{0};
+    uint64_t connects{0};
+    uint64_t connect_failures{0};
+    uint64_t dropped{0};
+    double total_wait{0};
+    double max_wait{0};
+    size_t idle{0};
+    size_t leased{0};
+  };
+
+  class Lease {
+  public:
+    Lease() = default;
+    Lease(Lease&& other) noexcept : pool_(other.pool_), connection_(std::move(other.connection_)), broken_(other.broken_) {
+      other.pool_ = nullptr;
+    }
+    Lease& operator=(Lease&& other) noexcept {
+      release();
+      pool_ = other.pool_;
+      connection_ = std::move(other.connection_);
+      broken_ = other.broken_;
+      other.pool_ = nullptr;
+      return *this;
+    }
+    ~Lease() {
+      release();
+    }
+
+    pqxx::connection& operator*() {
+      return *connection_;
+    }
+    pqxx::connection* operator->() {
+      return connection_.get();
+    }
+
+    // the connection is closed instead of returning to the pool, e.g. after a broken_connection error
+    void invalidate() {
+      broken_ = true;
+    }
+
+  private:
+    friend class PgConnectionPool;
+    Lease(PgConnectionPool* pool, std::unique_ptr<pqxx::connection> connection) : pool_(pool), connection_(std::move(connection)) {}
+
+    void release() {
+      if (pool_ && connection_) {
+        pool_->release(std::move(connection_), broken_);
+      }
+      pool_ = nullptr;
+    }
+
+    PgConnectionPool* pool_{nullptr};
+    std::unique_ptr<pqxx::connection> connection_;
+    bool broken_{false};
+  };
+
+  explicit PgConnectionPool(Options options) : options_(std::move(options)) {}
+
+  td::Result<Lease> acquire();
+
+  // registers a statement to be prepared on every connection of the pool
+  void prepare(std::string name, std::string definition);
+
+  Stats get_stats();
+
+private:
+  struct IdleConnection {
+    std::unique_ptr<pqxx::connection> connection;
+    double idle_since;
+  };
+
+  Options options_;
+  std::mutex mutex_;
+  std::condition_variable released_;
+  std::deque<IdleConnection> idle_;
+  size_t leased_{0};
+  size_t connecting_{0};
+  std::map<std::string, std::string> statements_;
+  Stats stats_;
+
+  td::Timestamp next_connect_attempt_;
+  double backoff_{0};
+
+  td::Result<std::unique_ptr<pqxx::connection>> connect(std::map<std::string, std::string> statements);
+  static bool is_healthy(pqxx::connection& connection);
+  void release(std::unique_ptr<pqxx::connection> connection, bool broken);
+};
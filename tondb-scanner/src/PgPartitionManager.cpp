@@ -0,0 +1,114 @@
+#include <map>
+#include <sstream>
+#include "td/utils/logging.h"
+#include "PgPartitionManager.h"
+#include "InsertManager.h"
+
+
+void PgPartitionManager::start_up() {
+  alarm_timestamp() = td::Timestamp::in(60.0);
+}
+
+void PgPartitionManager::alarm() {
+  report_sizes();
+  alarm_timestamp() = td::Timestamp::in(60.0);
+}
+
+void PgPartitionManager::ensure(uint32_t from_seqno, uint32_t to_seqno, td::Promise<td::Unit> promise) {
+  auto from_start = from_seqno / partition_size_ * partition_size_;
+  auto to_start = to_seqno / partition_size_ * partition_size_;
+  auto ahead_start = to_start + partitions_ahead_ * partition_size_;
+  bool covered = true;
+  for (auto start = from_start; start <= ahead_start; start += partition_size_) {
+    if (!created_.count(start)) {
+      covered = false;
+      break;
+    }
+  }
+  if (covered) {
+    promise.set_value(td::Unit());
+    return;
+  }
+  promise.set_result(create_partitions(from_start, ahead_start));
+}
+
+td::Status PgPartitionManager::create_partitions(uint32_t from_start, uint32_t to_start) {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    return connection.move_as_error();
+  }
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    std::vector<uint32_t> starts;
+    for (auto start = from_start; start <= to_start; start += partition_size_) {
+      if (created_.count(start)) {
+        continue;
+      }
+      for (auto table : tables) {
+        txn.exec0(PSTRING() << "CREATE TABLE IF NOT EXISTS " << table << "_p" << start << " PARTITION OF " << table
+                            << " FOR VALUES FROM (" << start << ") TO (" << static_cast<uint64_t>(start) + partition_size_ << ")");
+      }
+      starts.push_back(start);
+    }
+    txn.commit();
+    for (auto start : starts) {
+      created_.insert(start);
+    }
+    if (!starts.empty()) {
+      LOG(INFO) << "Created partitions for mc seqnos " << starts.front() << ".." << starts.back() + partition_size_ - 1;
+    }
+  } catch (const std::exception &e) {
+    return td::Status::Error(ErrorCode::DB_ERROR, PSLICE() << "Error creating partitions: " << e.what());
+  }
+  return td::Status::OK();
+}
+
+void PgPartitionManager::report_sizes() {
+  auto connection = pool_->acquire();
+  if (connection.is_error()) {
+    LOG(WARNING) << "Failed to read partition sizes: " << connection.error();
+    return;
+  }
+  struct TableSize {
+    size_t partitions{0};
+    int64_t total{0};
+    uint32_t newest_start{0};
+    int64_t newest{0};
+  };
+  std::map<std::string, TableSize> sizes;
+  try {
+    auto c = connection.move_as_ok();
+    pqxx::work txn(*c);
+    auto result = txn.exec("SELECT parent.relname, child.relname, pg_total_relation_size(child.oid) "
+                           "FROM pg_inherits "
+                           "JOIN pg_class parent ON pg_inherits.inhparent = parent.oid "
+                           "JOIN pg_class child ON pg_inherits.inhrelid = child.oid "
+                           "WHERE parent.relname IN ('blocks', 'transactions', 'account_states')");
+    for (const auto& row : result) {
+      auto table = row[0].as<std::string>();
+      auto partition = row[1].as<std::string>();
+      auto size = row[2].as<int64_t>();
+      auto start_pos = partition.rfind("_p");
+      uint32_t start = start_pos == std::string::npos ? 0 : std::strtoul(partition.c_str() + start_pos + 2, nullptr, 10);
+      auto &table_size = sizes[table];
+      table_size.partitions++;
+      table_size.total += size;
+      if (start >= table_size.newest_start) {
+        table_size.newest_start = start;
+        table_size.newest = size;
+      }
+    }
+    txn.commit();
+  } catch (const std::exception &e) {
+    LOG(WARNING) << "Failed to read partition sizes: " << e.what();
+    return;
+  }
+
+  std::ostringstream report;
+  for (const auto& [table, size] : sizes) {
+    report << " " << table << " " << size.partitions << " partitions " << size.total / (1 << 20) << "MB, newest "
+           << table << "_p" << size.newest_start << " " << size.newest / (1 << 20) << "MB;";
+  }
+  LOG(INFO) << "Partitions:" << report.str();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <set>
+#include "td/actor/actor.h"
+#include "PgConnectionPool.h"
+
+
+// Keeps blocks, transactions and account_states range partitioned by mc_seqno. Partitions of partition_size mc seqnos
+// are created before the first batch that needs them, together with partitions_ahead more in front of the insert
+// frontier, so the inserts only touch the small, cache resident indexes of the newest partitions. Sizes of the
+// partitioned tables are logged every minute. Primary keys of the partitioned tables include mc_seqno, so
+// account_states keeps a row per state hash and mc block, see scripts/init_postgres_schema.sh.
+class PgPartitionManager: public td::actor::Actor {
+public:
+  PgPartitionManager(std::shared_ptr<PgConnectionPool> pool, uint32_t partition_size, uint32_t partitions_ahead)
+    : pool_(std::move(pool)), partition_size_(partition_size), partitions_ahead_(partitions_ahead) {}
+
+  void start_up() override;
+  void alarm() override;
+
+  // resolves when partitions for all mc seqnos in [from_seqno, to_seqno] exist
+  void ensure(uint32_t from_seqno, uint32_t to_seqno, td::Promise<td::Unit> promise);
+
+  static constexpr const char *tables[] = {"blocks", "transactions", "account_states"};
+
+private:
+  std::shared_ptr<PgConnectionPool> pool_;
+  uint32_t partition_size_;
+  uint32_t partitions_ahead_;
+  // start seqnos of partitions known to exist
+  std::set<uint32_t> created_;
+
+  td::Status create_partitions(uint32_t from_start, uint32_t to_start);
+  void report_sizes();
+};
@@ -0,0 +1,218 @@
+#include <sstream>
+#include "td/utils/logging.h"
+#include "PgTableWriter.h"
+#include "InsertManager.h"
+#include "td/utils/base64.h"
+#include "convert-utils.h"
+
+
+PgRow &PgRow::add_hash(const td::Bits256 &hash) {
+  if (format_ == PgKeyFormat::Binary) {
+    values_.push_back("\\x" + hash.to_hex());
+  } else {
+    values_.push_back(td::base64_encode(hash.as_slice()));
+  }
+  return *this;
+}
+
+PgRow &PgRow::add_hash(const td::optional<td::Bits256> &hash) {
+  if (!hash) {
+    return add_null();
+  }
+  return add_hash(hash.value());
+}
+
+PgRow &PgRow::add_address(const block::StdAddress &address) {
+  if (format_ == PgKeyFormat::Binary) {
+    values_.push_back(std::to_string(address.workchain));
+    values_.push_back("\\x" + address.addr.to_hex());
+  } else {
+    values_.push_back(convert::to_raw_address(address));
+  }
+  return *this;
+}
+
+PgRow &PgRow::add_address(const std::string &address) {
+  if (format_ == PgKeyFormat::Text) {
+    values_.push_back(address);
+    return *this;
+  }
+  auto pos = address.find(':');
+  if (pos == std::string::npos) {
+    values_.push_back(std::nullopt);
+    values_.push_back(std::nullopt);
+  } else {
+    values_.push_back(address.substr(0, pos));
+    values_.push_back("\\x" + address.substr(pos + 1));
+  }
+  return *this;
+}
+
+PgRow &PgRow::add_address(const td::optional<std::string> &address) {
+  if (!address) {
+    add_null();
+    if (format_ == PgKeyFormat::Binary) {
+      add_null();
+    }
+    return *this;
+  }
+  return add_address(address.value());
+}
+
+void append_copy_row(std::string &out, const std::vector<SqlValue> &row) {
+  for (size_t i = 0; i < row.size(); i++) {
+    if (i > 0) {
+      out += '\t';
+    }
+    if (!row[i]) {
+      out += "\\N";
+      continue;
+    }
+    for (char c : row[i].value()) {
+      switch (c) {
+        case '\\': out += "\\\\"; break;
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        default: out += c;
+      }
+    }
+  }
+  out += '\n';
+}
+
+td::Result<PgKeyFormat> parse_key_format(std::string value) {
+  if (value == "text") {
+    return PgKeyFormat::Text;
+  }
+  if (value == "binary") {
+    return PgKeyFormat::Binary;
+  }
+  return td::Status::Error(PSLICE() << "unknown key format " << value << ", expected text or binary");
+}
+
+td::Result<PgInsertMode> parse_insert_mode(std::string value) {
+  if (value == "values") {
+    return PgInsertMode::Values;
+  }
+  if (value == "copy") {
+    return PgInsertMode::Copy;
+  }
+  return td::Status::Error(PSLICE() << "unknown insert mode " << value << ", expected values or copy");
+}
+
+const char *insert_mode_name(PgInsertMode mode) {
+  switch (mode) {
+    case PgInsertMode::Values: return "values";
+    case PgInsertMode::Copy: return "copy";
+  }
+  UNREACHABLE();
+}
+
+PgTableWriter::PgTableWriter(pqxx::work &txn, std::string table, std::vector<std::string> columns, PgInsertMode mode,
+                             pqxx::pipeline *pipeline, std::string on_conflict)
+    : txn_(txn), table_(std::move(table)), mode_(mode), pipeline_(mode == PgInsertMode::Values ? pipeline : nullptr)
+    , on_conflict_(std::move(on_conflict)) {
+  for (size_t i = 0; i < columns.size(); i++) {
+    if (i > 0) {
+      columns_ += ", ";
+    }
+    columns_ += columns[i];
+  }
+}
+
+void PgTableWriter::write_row(const std::vector<SqlValue> &row) {
+  auto start = td::Time::now();
+  if (mode_ == PgInsertMode::Copy) {
+    if (!stream_ && on_conflict_.empty()) {
+      // nothing to resolve, rows go straight into the table
+      stream_ = std::make_unique<pqxx::stream_to>(pqxx::stream_to::raw_table(txn_, table_, columns_));
+    } else if (!stream_) {
+      staging_table_ = "staging_" + table_;
+      txn_.exec0("CREATE TEMP TABLE " + staging_table_ + " ON COMMIT DROP AS SELECT " + columns_ + " FROM " + table_ + " WITH NO DATA");
+      stream_ = std::make_unique<pqxx::stream_to>(pqxx::stream_to::raw_table(txn_, staging_table_, columns_));
+    }
+    stream_->write_row(row);
+    for (const auto &value : row) {
+      stats_.bytes += value ? value->size() + 1 : 3;
+    }
+  } else {
+    // values_.size() is O(1), unlike measuring an ostringstream, so chunking stays linear in the batch size
+    auto old_size = values_.size();
+    if (values_.empty()) {
+      values_ = "INSERT INTO " + table_ + " (" + columns_ + ") VALUES ";
+    } else {
+      values_ += ", ";
+    }
+    values_ += "(";
+    for (size_t i = 0; i < row.size(); i++) {
+      if (i > 0) {
+        values_ += ",";
+      }
+      values_ += row[i] ? txn_.quote(row[i].value()) : "NULL";
+    }
+    values_ += ")";
+    stats_.bytes += values_.size() - old_size;
+    if (values_.size() >= max_chunk_size) {
+      exec_values();
+    }
+  }
+  stats_.rows++;
+  stats_.time += td::Time::now() - start;
+}
+
+void PgTableWriter::finish() {
+  auto start = td::Time::now();
+  if (stream_) {
+    stream_->complete();
+    stream_.reset();
+  }
+  if (!staging_table_.empty()) {
+    // merge and drop go as one simple query, one round trip instead of two. The fresh staging table is scanned in
+    // insertion order, so the merge inserts rows in the order they were written.
+    txn_.exec0("INSERT INTO " + table_ + " (" + columns_ + ") SELECT " + columns_ + " FROM " + staging_table_ + " " + on_conflict_
+               + "; DROP TABLE " + staging_table_);
+  }
+  if (!values_.empty()) {
+    exec_values();
+  }
+  stats_.time += td::Time::now() - start;
+}
+
+void PgTableWriter::exec_values() {
+  values_ += " ";
+  values_ += on_conflict_;
+  if (pipeline_) {
+    // results are checked when the owner completes the pipeline
+    pipeline_->insert(values_);
+  } else {
+    txn_.exec0(values_);
+  }
+  values_.clear();
+}
+
+void PgWriteStats::add(const std::string &table, const PgTableWriter::Stats &stats) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto &total = tables_[table];
+  total.rows += stats.rows;
+  total.bytes += stats.bytes;
+  total.time += stats.time;
+}
+
+std::string PgWriteStats::to_string() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::ostringstream result;
+  bool is_first = true;
+  for (const auto &[table, stats] : tables_) {
+    if (is_first) {
+      is_first = false;
+    } else {
+      result << ", ";
+    }
+    result << table << ": " << stats.rows << " rows " << stats.bytes / (1 << 20) << "MB " << stats.time << "s";
+    if (stats.time > 0) {
+      result << " (" << static_cast<uint64_t>(stats.rows / stats.time) << " rows/s)";
+    }
+  }
+  return result.str();
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <optional>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <pqxx/pqxx>
+#include "td/utils/optional.h"
+#include "td/utils/Time.h"
+#include "common/refint.h"
+#include "common/bitstring.h"
+#include "crypto/block/block.h"
+
+
+// Text representation of a column value, std::nullopt is NULL
+using SqlValue = std::optional<std::string>;
+
+inline SqlValue to_sql_value(std::string value) {
+  return value;
+}
+
+inline SqlValue to_sql_value(const char *value) {
+  return std::string(value);
+}
+
+inline SqlValue to_sql_value(bool value) {
+  return value ? "true" : "false";
+}
+
+template <class T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+SqlValue to_sql_value(T value) {
+  return std::to_string(value);
+}
+
+inline SqlValue to_sql_value(const td::RefInt256 &value) {
+  if (value.is_null()) {
+    return std::nullopt;
+  }
+  return value->to_dec_string();
+}
+
+template <class T>
+SqlValue to_sql_value(const td::optional<T> &value) {
+  if (!value) {
+    return std::nullopt;
+  }
+  return to_sql_value(value.value());
+}
+
+template <class T>
+SqlValue to_sql_value(const std::optional<T> &value) {
+  if (!value) {
+    return std::nullopt;
+  }
+  return to_sql_value(value.value());
+}
+
+// How hashes and addresses are stored. Text keeps base64 hashes and "wc:HEX" addresses, Binary stores hashes
+// as 32 byte bytea and every address as an (int workchain, bytea) column pair named <name>_workchain and <name>.
+enum class PgKeyFormat {
+  Text,
+  Binary
+};
+
+class PgColumns {
+public:
+  explicit PgColumns(PgKeyFormat format) : format_(format) {}
+
+  PgColumns &add(std::string name) {
+    names_.push_back(std::move(name));
+    return *this;
+  }
+  PgColumns &add_address(std::string name) {
+    if (format_ == PgKeyFormat::Binary) {
+      names_.push_back(name + "_workchain");
+    }
+    names_.push_back(std::move(name));
+    return *this;
+  }
+  std::vector<std::string> names() const {
+    return names_;
+  }
+
+private:
+  PgKeyFormat format_;
+  std::vector<std::string> names_;
+};
+
+// One row of column values, hashes and addresses are encoded according to the key format here, at the wire
+class PgRow {
+public:
+  explicit PgRow(PgKeyFormat format, size_t size = 0) : format_(format) {
+    values_.reserve(size);
+  }
+
+  template <class T>
+  PgRow &add(const T &value) {
+    values_.push_back(to_sql_value(value));
+    return *this;
+  }
+  PgRow &add_null() {
+    values_.push_back(std::nullopt);
+    return *this;
+  }
+  PgRow &add_hash(const td::Bits256 &hash);
+  PgRow &add_hash(const td::optional<td::Bits256> &hash);
+  PgRow &add_address(const block::StdAddress &address);
+  // raw "wc:HEX" address, non standard ones (addr_none, addr_extern, addr_var) are NULL in the binary format
+  PgRow &add_address(const std::string &address);
+  PgRow &add_address(const td::optional<std::string> &address);
+
+  const std::vector<SqlValue> &values() const {
+    return values_;
+  }
+
+private:
+  PgKeyFormat format_;
+  std::vector<SqlValue> values_;
+};
+
+td::Result<PgKeyFormat> parse_key_format(std::string value);
+
+// Appends the row as a line of the COPY text format, what the COPY insert mode streams to the server
+void append_copy_row(std::string &out, const std::vector<SqlValue> &row);
+
+enum class PgInsertMode {
+  Values,  // multi-row INSERT ... VALUES statements
+  Copy     // COPY into a temporary staging table, then INSERT ... SELECT
+};
+
+td::Result<PgInsertMode> parse_insert_mode(std::string value);
+const char *insert_mode_name(PgInsertMode mode);
+
+// Writes rows of one table inside a transaction, either as chunked INSERT ... VALUES statements or by streaming
+// them with COPY into a staging table that is merged into the target table on finish(). Conflicting rows are
+// resolved by on_conflict in both modes. With a pipeline VALUES statements are queued on it instead of being
+// executed one round trip at a time, COPY can't share the connection with a pipeline and ignores it. With an empty
+// on_conflict COPY streams straight into the target table, for rows known not to exist yet.
+class PgTableWriter {
+public:
+  struct Stats {
+    size_t rows{0};
+    size_t bytes{0};
+    double time{0};
+  };
+
+  PgTableWriter(pqxx::work &txn, std::string table, std::vector<std::string> columns, PgInsertMode mode,
+                pqxx::pipeline *pipeline = nullptr, std::string on_conflict = "ON CONFLICT DO NOTHING");
+
+  void write_row(const std::vector<SqlValue> &row);
+  void write_row(const PgRow &row) {
+    write_row(row.values());
+  }
+  void finish();
+
+  const std::string &table() const {
+    return table_;
+  }
+  const Stats &stats() const {
+    return stats_;
+  }
+
+private:
+  static constexpr size_t max_chunk_size = 1000000;
+
+  pqxx::work &txn_;
+  std::string table_;
+  std::string columns_;
+  PgInsertMode mode_;
+  pqxx::pipeline *pipeline_;
+  std::string on_conflict_;
+  Stats stats_;
+
+  std::string values_;
+  std::string staging_table_;
+  std::unique_ptr<pqxx::stream_to> stream_;
+
+  void exec_values();
+};
+
+// Cumulative per table statistics shared by the insert actors, used to compare insert modes on the same range
+class PgWriteStats {
+public:
+  void add(const std::string &table, const PgTableWriter::Stats &stats);
+  std::string to_string();
+
+private:
+  std::mutex mutex_;
+  std::map<std::string, PgTableWriter::Stats> tables_;
+};
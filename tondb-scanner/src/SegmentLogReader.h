@@ -0,0 +1,273 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Reader of the segment log written by InsertManagerSegmentLog. Header only and without TON or td dependencies, so
+// consumers can copy it into their own build.
+//
+// The log is a directory of segments numbered from 1. Segment N is a pair of files:
+//   <N as 16 digits>.log  magic "TONSEGL1", then serialized ParsedBlock records back to back
+//   <N as 16 digits>.idx  magic "TONSEGI1", then one IndexEntry per record in append order
+// A record is committed once its index entry is written, after its bytes are synced, so readers never see partial
+// records. mc seqnos are not in order within a segment and a seqno may appear again after a crash of the writer.
+// Segment N is complete once segment N + 1 has an index file.
+namespace segment_log {
+
+constexpr char log_magic[8] = {'T', 'O', 'N', 'S', 'E', 'G', 'L', '1'};
+constexpr char index_magic[8] = {'T', 'O', 'N', 'S', 'E', 'G', 'I', '1'};
+constexpr size_t header_size = 8;
+
+struct IndexEntry {
+  uint32_t mc_seqno;
+  uint32_t size;
+  uint64_t offset;
+};
+static_assert(sizeof(IndexEntry) == 16, "IndexEntry is written as is");
+
+inline std::string segment_path(const std::string &directory, uint64_t segment, const char *extension) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llu.%s", static_cast<unsigned long long>(segment), extension);
+  return directory + "/" + name;
+}
+
+// Read only mapping of a file that may grow, remap() extends it to the current file size.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+    close();
+  }
+
+  bool open(const std::string &path) {
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    return fd_ >= 0 && remap();
+  }
+
+  void close() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  bool is_open() const {
+    return fd_ >= 0;
+  }
+
+  // pointers into the previous mapping become invalid when the file grew
+  bool remap() {
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      return false;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    if (size == size_) {
+      return true;
+    }
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+    if (size == 0) {
+      return true;
+    }
+    auto data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    data_ = static_cast<char *>(data);
+    size_ = size;
+    return true;
+  }
+
+  const char *data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+private:
+  int fd_{-1};
+  char *data_{nullptr};
+  size_t size_{0};
+};
+
+struct Record {
+  uint32_t mc_seqno;
+  // serialized ParsedBlock, valid until the next call to the reader
+  const char *data;
+  size_t size;
+  uint64_t segment;
+  size_t index;
+};
+
+class Reader {
+public:
+  explicit Reader(std::string directory) : directory_(std::move(directory)) {
+  }
+
+  const std::string &error() const {
+    return error_;
+  }
+
+  // first and last segment in the directory, 0 if there is none
+  bool segment_range(uint64_t &first, uint64_t &last) {
+    first = 0;
+    last = 0;
+    auto dir = opendir(directory_.c_str());
+    if (dir == nullptr) {
+      error_ = "open " + directory_ + ": " + std::strerror(errno);
+      return false;
+    }
+    while (auto entry = readdir(dir)) {
+      unsigned long long segment;
+      char extension[4];
+      if (std::sscanf(entry->d_name, "%16llu.%3s", &segment, extension) == 2 && std::strcmp(extension, "idx") == 0) {
+        first = first == 0 ? segment : std::min<uint64_t>(first, segment);
+        last = std::max<uint64_t>(last, segment);
+      }
+    }
+    closedir(dir);
+    return true;
+  }
+
+  // positions the reader before the first record of the log
+  bool seek_to_begin() {
+    uint64_t first, last;
+    if (!segment_range(first, last)) {
+      return false;
+    }
+    seek(first == 0 ? 1 : first, 0);
+    return true;
+  }
+
+  // positions the reader at a record returned earlier, e.g. to resume after a restart
+  void seek(uint64_t segment, size_t index) {
+    index_.close();
+    log_.close();
+    segment_ = segment;
+    position_ = index;
+  }
+
+  // Returns the next committed record, false at the current end of the log or on error. Tail by calling it again
+  // later, a new record is visible as soon as its index entry is written.
+  bool next(Record &record) {
+    error_.clear();
+    while (true) {
+      if (!index_.is_open() && !open_segment(segment_, position_)) {
+        return false;
+      }
+      if (position_ < entries() || (index_.remap() && position_ < entries())) {
+        return read_entry(position_++, record);
+      }
+      // the segment is complete once the next one exists, entries written before that are read first
+      if (!exists(segment_path(directory_, segment_ + 1, "idx"))) {
+        return false;
+      }
+      if (!index_.remap()) {
+        return fail("remap index");
+      }
+      if (position_ < entries()) {
+        continue;
+      }
+      if (!open_segment(segment_ + 1, 0)) {
+        return false;
+      }
+    }
+  }
+
+  // Calls f(record) for every record of the log in order, the log keeps growing while it is read.
+  template <class F>
+  bool for_each(F &&f) {
+    if (!seek_to_begin()) {
+      return false;
+    }
+    Record record;
+    while (next(record)) {
+      f(record);
+    }
+    return error_.empty();
+  }
+
+private:
+  std::string directory_;
+  std::string error_;
+  MappedFile index_;
+  MappedFile log_;
+  uint64_t segment_{1};
+  size_t position_{0};
+
+  static bool exists(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+  }
+
+  bool fail(const char *what) {
+    error_ = std::string(what) + " of segment " + std::to_string(segment_) + " in " + directory_ + ": " + std::strerror(errno);
+    return false;
+  }
+
+  size_t entries() const {
+    // an entry being written is not counted
+    return index_.size() < header_size ? 0 : (index_.size() - header_size) / sizeof(IndexEntry);
+  }
+
+  bool open_segment(uint64_t segment, size_t position) {
+    index_.close();
+    log_.close();
+    segment_ = segment;
+    position_ = position;
+    if (!exists(segment_path(directory_, segment, "idx"))) {
+      // not created yet, next() retries
+      return false;
+    }
+    if (!index_.open(segment_path(directory_, segment, "idx")) || !log_.open(segment_path(directory_, segment, "log"))) {
+      index_.close();
+      return fail("open");
+    }
+    if (index_.size() >= header_size && std::memcmp(index_.data(), index_magic, header_size) != 0) {
+      index_.close();
+      error_ = "bad index magic of segment " + std::to_string(segment) + " in " + directory_;
+      return false;
+    }
+    return true;
+  }
+
+  bool read_entry(size_t position, Record &record) {
+    IndexEntry entry;
+    std::memcpy(&entry, index_.data() + header_size + position * sizeof(IndexEntry), sizeof(entry));
+    if (entry.offset + entry.size > log_.size() && (!log_.remap() || entry.offset + entry.size > log_.size())) {
+      error_ = "record " + std::to_string(position) + " of segment " + std::to_string(segment_) + " is past the end of the log file";
+      return false;
+    }
+    record.mc_seqno = entry.mc_seqno;
+    record.data = log_.data() + entry.offset;
+    record.size = entry.size;
+    record.segment = segment_;
+    record.index = position;
+    return true;
+  }
+};
+
+}  // namespace segment_log
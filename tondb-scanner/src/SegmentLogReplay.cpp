@@ -0,0 +1,85 @@
+#include "SegmentLogReplay.h"
+#include "ParsedBlockSerializer.h"
+
+
+void SegmentLogReplay::start_up() {
+  auto P = td::PromiseCreator::lambda([SelfId = actor_id(this)](td::Result<std::vector<std::uint32_t>> R) {
+    td::actor::send_closure(SelfId, &SegmentLogReplay::got_existing_seqnos, std::move(R));
+  });
+  td::actor::send_closure(insert_manager_, &InsertManagerInterface::get_existing_seqnos, std::move(P));
+}
+
+void SegmentLogReplay::got_existing_seqnos(td::Result<std::vector<std::uint32_t>> R) {
+  if (R.is_error()) {
+    LOG(FATAL) << "Failed to get existing seqnos for replay: " << R.move_as_error();
+  }
+  for (auto seqno : R.move_as_ok()) {
+    done_mc_seqnos_.insert(seqno);
+  }
+  if (!reader_.seek_to_begin()) {
+    LOG(FATAL) << "Failed to open segment log for replay: " << reader_.error();
+  }
+  LOG(INFO) << "Replaying segment log, " << done_mc_seqnos_.size() << " mc seqnos already inserted";
+  started_ = true;
+  replay();
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
+
+void SegmentLogReplay::replay() {
+  while (in_flight_ < max_in_flight && !retry_.empty()) {
+    insert(std::move(retry_.front()));
+    retry_.pop();
+  }
+  segment_log::Record record;
+  while (in_flight_ < max_in_flight && reader_.next(record)) {
+    if (!done_mc_seqnos_.insert(record.mc_seqno).second) {
+      skipped_++;
+      continue;
+    }
+    auto block = deserialize_parsed_block(td::Slice(record.data, record.size));
+    if (block.is_error()) {
+      LOG(FATAL) << "Bad record " << record.index << " of segment " << record.segment << " (mc seqno " << record.mc_seqno
+                 << "): " << block.move_as_error();
+    }
+    insert(block.move_as_ok());
+  }
+  if (!reader_.error().empty()) {
+    LOG(FATAL) << "Failed to read segment log: " << reader_.error();
+  }
+  if (in_flight_ == 0 && retry_.empty() && !finished_) {
+    finished_ = true;
+    LOG(INFO) << "Replay finished: " << replayed_ << " mc blocks inserted, " << skipped_ << " skipped";
+    td::actor::send_closure(insert_manager_, &InsertManagerInterface::tip_reached);
+  }
+}
+
+void SegmentLogReplay::insert(ParsedBlockPtr block) {
+  in_flight_++;
+  auto P = td::PromiseCreator::lambda([SelfId = actor_id(this), block](td::Result<td::Unit> R) mutable {
+    td::actor::send_closure(SelfId, &SegmentLogReplay::inserted, std::move(block), std::move(R));
+  });
+  td::actor::send_closure(insert_manager_, &InsertManagerInterface::insert, block, std::move(P));
+}
+
+void SegmentLogReplay::inserted(ParsedBlockPtr block, td::Result<td::Unit> R) {
+  in_flight_--;
+  if (R.is_error()) {
+    LOG(ERROR) << "Failed to insert replayed mc seqno " << block->blocks_[0].seqno << ": " << R.move_as_error();
+    retry_.push(std::move(block));
+    return;
+  }
+  replayed_++;
+  replay();
+}
+
+void SegmentLogReplay::alarm() {
+  // picks up retries and records appended to the log after the reader reached its end
+  if (started_) {
+    replay();
+  }
+  if (next_report_.is_in_past()) {
+    LOG(INFO) << "Replay: " << replayed_ << " mc blocks inserted, " << skipped_ << " skipped, " << in_flight_ << " in flight";
+    next_report_ = td::Timestamp::in(10.0);
+  }
+  alarm_timestamp() = td::Timestamp::in(1.0);
+}
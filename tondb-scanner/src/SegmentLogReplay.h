@@ -0,0 +1,38 @@
+#pragma once
+#include <queue>
+#include <set>
+#include "InsertManager.h"
+#include "SegmentLogReader.h"
+
+
+// Inserts the mc blocks of a segment log instead of reading the TON DB, e.g. to re-index a range into Postgres.
+// Seqnos the insert manager already has are skipped, as are repeated records of a seqno. Failed inserts are retried.
+// Blocks are inserted as they were detected, the interface detectors do not run again.
+class SegmentLogReplay: public td::actor::Actor {
+public:
+  SegmentLogReplay(std::string directory, td::actor::ActorId<InsertManagerInterface> insert_manager)
+    : reader_(std::move(directory)), insert_manager_(insert_manager) {}
+
+  void start_up() override;
+  void alarm() override;
+
+private:
+  static constexpr int max_in_flight = 256;
+
+  segment_log::Reader reader_;
+  td::actor::ActorId<InsertManagerInterface> insert_manager_;
+  std::set<std::uint32_t> done_mc_seqnos_;
+  std::queue<ParsedBlockPtr> retry_;
+  int in_flight_{0};
+  bool started_{false};
+  bool finished_{false};
+
+  size_t replayed_{0};
+  size_t skipped_{0};
+  td::Timestamp next_report_;
+
+  void got_existing_seqnos(td::Result<std::vector<std::uint32_t>> R);
+  void replay();
+  void insert(ParsedBlockPtr block);
+  void inserted(ParsedBlockPtr block, td::Result<td::Unit> R);
+};
@@ -0,0 +1,72 @@
+#include "td/utils/logging.h"
+#include "td/utils/port/path.h"
+#include "td/utils/port/Stat.h"
+#include "SegmentLogWriter.h"
+
+
+namespace {
+
+td::Status write_all(td::FileFd &fd, td::Slice data) {
+  while (!data.empty()) {
+    TRY_RESULT(written, fd.write(data));
+    data.remove_prefix(written);
+  }
+  return td::Status::OK();
+}
+
+}  // namespace
+
+td::Result<std::unique_ptr<SegmentLogWriter>> SegmentLogWriter::open(std::string directory, size_t segment_bytes) {
+  TRY_STATUS(td::mkpath(directory + "/"));
+  segment_log::Reader reader(directory);
+  uint64_t first, last;
+  if (!reader.segment_range(first, last)) {
+    return td::Status::Error(reader.error());
+  }
+  // a crash between creating the log file and the index file of a segment leaves a log file without records, readers
+  // wait for the index file of the next segment, so the number is reused
+  auto orphan_log = segment_log::segment_path(directory, last + 1, "log");
+  if (td::stat(orphan_log).is_ok()) {
+    LOG(WARNING) << "Removing " << orphan_log << " left without an index file";
+    TRY_STATUS(td::unlink(orphan_log));
+  }
+  std::unique_ptr<SegmentLogWriter> writer(new SegmentLogWriter(std::move(directory), segment_bytes));
+  TRY_STATUS(writer->open_segment(last + 1));
+  return std::move(writer);
+}
+
+td::Status SegmentLogWriter::open_segment(uint64_t segment) {
+  log_.close();
+  index_.close();
+  auto flags = td::FileFd::Write | td::FileFd::CreateNew;
+  // the log file goes first, readers open a segment once its index file exists
+  TRY_RESULT_ASSIGN(log_, td::FileFd::open(segment_log::segment_path(directory_, segment, "log"), flags));
+  TRY_STATUS(write_all(log_, td::Slice(segment_log::log_magic, segment_log::header_size)));
+  TRY_RESULT_ASSIGN(index_, td::FileFd::open(segment_log::segment_path(directory_, segment, "idx"), flags));
+  TRY_STATUS(write_all(index_, td::Slice(segment_log::index_magic, segment_log::header_size)));
+  segment_ = segment;
+  log_size_ = segment_log::header_size;
+  return td::Status::OK();
+}
+
+td::Status SegmentLogWriter::append(uint32_t mc_seqno, td::Slice data) {
+  TRY_STATUS(write_all(log_, data));
+  pending_.push_back({mc_seqno, static_cast<uint32_t>(data.size()), log_size_});
+  log_size_ += data.size();
+  return td::Status::OK();
+}
+
+td::Status SegmentLogWriter::commit() {
+  if (pending_.empty()) {
+    return td::Status::OK();
+  }
+  // index entries never point to bytes a crash could lose
+  TRY_STATUS(log_.sync());
+  TRY_STATUS(write_all(index_, td::Slice(reinterpret_cast<const char *>(pending_.data()),
+                                         pending_.size() * sizeof(segment_log::IndexEntry))));
+  pending_.clear();
+  if (log_size_ >= segment_bytes_) {
+    TRY_STATUS(open_segment(segment_ + 1));
+  }
+  return td::Status::OK();
+}
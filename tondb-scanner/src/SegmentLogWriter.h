@@ -0,0 +1,34 @@
+#pragma once
+#include "td/utils/Status.h"
+#include "td/utils/port/FileFd.h"
+#include "SegmentLogReader.h"
+
+
+// Appends records to the segment log described in SegmentLogReader.h. Records are appended to the log file right
+// away and committed in groups: commit() syncs the log file and only then writes their index entries, which makes
+// them visible to readers. A writer always starts a new segment, entries of a segment torn by a crash stay unread.
+class SegmentLogWriter {
+public:
+  static td::Result<std::unique_ptr<SegmentLogWriter>> open(std::string directory, size_t segment_bytes);
+
+  td::Status append(uint32_t mc_seqno, td::Slice data);
+  td::Status commit();
+
+  uint64_t segment() const { return segment_; }
+  size_t pending() const { return pending_.size(); }
+
+private:
+  SegmentLogWriter(std::string directory, size_t segment_bytes)
+    : directory_(std::move(directory)), segment_bytes_(segment_bytes) {}
+
+  std::string directory_;
+  size_t segment_bytes_;
+  uint64_t segment_{0};
+  td::FileFd log_;
+  td::FileFd index_;
+  uint64_t log_size_{0};
+  // appended but not committed
+  std::vector<segment_log::IndexEntry> pending_;
+
+  td::Status open_segment(uint64_t segment);
+};
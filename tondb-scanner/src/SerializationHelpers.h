@@ -0,0 +1,162 @@
+#pragma once
+#include <map>
+#include <optional>
+#include "td/utils/tl_helpers.h"
+#include "td/utils/optional.h"
+#include "vm/boc.h"
+#include "crypto/common/bigint.hpp"
+#include "crypto/block/block.h"
+
+
+// td::store / td::parse for field types of IndexData.h that tl_helpers does not know. Values are written in TL
+// encoding: integers are 4 or 8 bytes, strings are length prefixed and padded to 4 bytes.
+namespace serialization {
+
+// 32 raw bytes without length prefix
+template <class StorerT>
+void store_bits(const td::Bits256 &bits, StorerT &storer) {
+  storer.store_slice(bits.as_slice());
+}
+
+template <class ParserT>
+void parse_bits(td::Bits256 &bits, ParserT &parser) {
+  auto slice = parser.template fetch_string_raw<td::Slice>(32);
+  if (parser.get_error() == nullptr) {
+    bits.as_slice().copy_from(slice);
+  }
+}
+
+template <class StorerT>
+void store_hash(const vm::CellHash &hash, StorerT &storer) {
+  td::store(hash.as_slice().str(), storer);
+}
+
+template <class ParserT>
+void parse_hash(vm::CellHash &hash, ParserT &parser) {
+  std::string str;
+  td::parse(str, parser);
+  if (str.size() != 32) {
+    parser.set_error("bad cell hash");
+    return;
+  }
+  hash = vm::CellHash::from_slice(str);
+}
+
+template <class StorerT>
+void store_address(const block::StdAddress &address, StorerT &storer) {
+  td::store(static_cast<td::int32>(address.workchain), storer);
+  store_bits(address.addr, storer);
+}
+
+template <class ParserT>
+void parse_address(block::StdAddress &address, ParserT &parser) {
+  td::int32 workchain;
+  td::parse(workchain, parser);
+  address.workchain = workchain;
+  parse_bits(address.addr, parser);
+}
+
+// null is stored as an empty string
+template <class StorerT>
+void store_int(const td::RefInt256 &value, StorerT &storer) {
+  td::store(value.not_null() ? value->to_dec_string() : std::string(), storer);
+}
+
+template <class ParserT>
+void parse_int(td::RefInt256 &value, ParserT &parser) {
+  std::string str;
+  td::parse(str, parser);
+  if (!str.empty()) {
+    value = td::dec_string_to_int256(str);
+  }
+}
+
+// cells are stored as BOC, null as an empty string
+template <class StorerT>
+void store_cell(const td::Ref<vm::Cell> &cell, StorerT &storer) {
+  td::store(cell.not_null() ? vm::std_boc_serialize(cell).move_as_ok().as_slice().str() : std::string(), storer);
+}
+
+template <class ParserT>
+void parse_cell(td::Ref<vm::Cell> &cell, ParserT &parser) {
+  std::string boc;
+  td::parse(boc, parser);
+  if (boc.empty()) {
+    return;
+  }
+  auto cell_r = vm::std_boc_deserialize(boc);
+  if (cell_r.is_error()) {
+    parser.set_error("bad cell boc");
+    return;
+  }
+  cell = cell_r.move_as_ok();
+}
+
+template <class T, class StorerT, class F>
+void store_optional(const T &value, StorerT &storer, F &&store_value) {
+  td::store(static_cast<bool>(value), storer);
+  if (value) {
+    store_value(value.value());
+  }
+}
+
+template <class T, class ParserT, class F>
+void parse_optional(td::optional<T> &value, ParserT &parser, F &&parse_value) {
+  bool has_value;
+  td::parse(has_value, parser);
+  if (has_value) {
+    T result;
+    parse_value(result);
+    value = std::move(result);
+  }
+}
+
+template <class T, class ParserT, class F>
+void parse_optional(std::optional<T> &value, ParserT &parser, F &&parse_value) {
+  bool has_value;
+  td::parse(has_value, parser);
+  if (has_value) {
+    T result;
+    parse_value(result);
+    value = std::move(result);
+  }
+}
+
+// optional values of types tl_helpers handles
+template <class T, class StorerT>
+void store_optional(const T &value, StorerT &storer) {
+  store_optional(value, storer, [&](const auto &v) { td::store(v, storer); });
+}
+
+template <class T, class ParserT>
+void parse_optional(T &value, ParserT &parser) {
+  parse_optional(value, parser, [&](auto &v) { td::parse(v, parser); });
+}
+
+template <class StorerT>
+void store_content(const td::optional<std::map<std::string, std::string>> &content, StorerT &storer) {
+  store_optional(content, storer, [&](const std::map<std::string, std::string> &map) {
+    td::store(static_cast<td::int32>(map.size()), storer);
+    for (const auto &[key, value] : map) {
+      td::store(key, storer);
+      td::store(value, storer);
+    }
+  });
+}
+
+template <class ParserT>
+void parse_content(td::optional<std::map<std::string, std::string>> &content, ParserT &parser) {
+  parse_optional(content, parser, [&](std::map<std::string, std::string> &map) {
+    td::int32 size;
+    td::parse(size, parser);
+    for (td::int32 i = 0; i < size && parser.get_error() == nullptr; i++) {
+      std::string key;
+      std::string value;
+      td::parse(key, parser);
+      td::parse(value, parser);
+      map.emplace(std::move(key), std::move(value));
+    }
+  });
+}
+
+}  // namespace serialization
@@ -1,12 +1,22 @@
+#include <algorithm>
 #include "td/utils/port/signals.h"
 #include "td/utils/OptionParser.h"
 #include "td/utils/format.h"
 #include "td/utils/logging.h"
 #include "td/utils/check.h"
+#include "td/utils/misc.h"
 
 #include "crypto/vm/cp0.h"
 
 #include "InsertManagerPostgres.h"
+#include "InsertManagerSegmentLog.h"
+#include "InsertManagerNull.h"
+#include "CompositeInsertManager.h"
+#include "SegmentLogReplay.h"
+#ifdef TONDB_PARQUET
+#include "InsertManagerParquet.h"
+#endif
+#include "DbExecutor.h"
 #include "DataParser.h"
 #include "DbScanner.h"
 
@@ -30,6 +40,23 @@ int main(int argc, char *argv[]) {
   td::actor::ActorOwn<DbScanner> scanner;
   td::actor::ActorOwn<InsertManagerPostgres> insert_manager;
   td::actor::ActorOwn<ParseManager> parse_manager;
+  // --bulk-load knows only the indexes of the binary schema
+  bool bulk_load = false;
+  auto key_format = PgKeyFormat::Text;
+  std::vector<std::string> sinks{"postgres"};
+  auto sink_ack = CompositeInsertManager::AckPolicy::all;
+  size_t sink_max_lag_bytes = 1 << 30;
+  td::actor::ActorOwn<CompositeInsertManager> composite_manager;
+  td::actor::ActorOwn<InsertManagerSegmentLog> segment_log_manager;
+  InsertManagerSegmentLog::Options segment_log_options;
+  td::actor::ActorOwn<InsertManagerNull> null_manager;
+  InsertManagerNull::Options null_options;
+  td::actor::ActorOwn<SegmentLogReplay> replay;
+  std::string replay_dir;
+#ifdef TONDB_PARQUET
+  td::actor::ActorOwn<InsertManagerParquet> parquet_manager;
+  InsertManagerParquet::Options parquet_options;
+#endif
 
   p.add_option('D', "db", "Path to TON DB folder",
                [&](td::Slice fname) { td::actor::send_closure(scanner, &DbScanner::set_db_root, fname.str()); });
@@ -86,7 +113,40 @@ int main(int argc, char *argv[]) {
     } catch (...) {
       return td::Status::Error(ton::ErrorCode::error, "bad value for --insert-batch-size: not a number");
     }
-    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_batch_blocks_count, v);
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --insert-batch-size: should be positive");
+    }
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_batch_blocks_count, static_cast<size_t>(v));
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "insert-batch-latency", "Target commit latency of an insert batch in seconds, batch size adapts to it (default: 2)",
+               [&](td::Slice fname) { 
+    double v;
+    try {
+      v = std::stod(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --insert-batch-latency: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --insert-batch-latency: should be positive");
+    }
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_target_batch_latency, v);
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "max-insert-queue-mb", "Estimated size of parsed blocks queued for insert in MB, the scanner slows down above it (default: 1024)",
+               [&](td::Slice fname) { 
+    int v;
+    try {
+      v = std::stoi(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --max-insert-queue-mb: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --max-insert-queue-mb: should be positive");
+    }
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_max_queue_bytes, static_cast<size_t>(v) << 20);
     return td::Status::OK();
   });
 
@@ -102,13 +162,254 @@ int main(int argc, char *argv[]) {
     return td::Status::OK();
   });
 
+  p.add_checked_option('c', "max-db-connections", "Max connections in the PostgreSQL pool (default: 16)",
+               [&](td::Slice fname) { 
+    int v;
+    try {
+      v = std::stoi(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --max-db-connections: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --max-db-connections: should be positive");
+    }
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_max_db_connections, v);
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "insert-mode", "How rows are sent to PostgreSQL: values or copy (default: values)",
+               [&](td::Slice value) {
+    auto mode = parse_insert_mode(value.str());
+    if (mode.is_error()) {
+      return td::Status::Error(ton::ErrorCode::error, PSLICE() << "bad value for --insert-mode: " << mode.error().message());
+    }
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_insert_mode, mode.move_as_ok());
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "key-format", "How hashes and addresses are stored: text or binary (default: text)",
+               [&](td::Slice value) {
+    auto format = parse_key_format(value.str());
+    if (format.is_error()) {
+      return td::Status::Error(ton::ErrorCode::error, PSLICE() << "bad value for --key-format: " << format.error().message());
+    }
+    key_format = format.move_as_ok();
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_key_format, key_format);
+    return td::Status::OK();
+  });
+
+  p.add_option('\0', "parallel-tables", "Write table groups of a batch in parallel on separate connections, batches are marked complete in mc_block_commits "
+               "(created at startup if missing)",
+               [&]() {
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_parallel_tables, true);
+  });
+
+  p.add_option('\0', "bulk-load", "Drop indexes and primary keys, copy blocks without conflict checks and rebuild indexes when the tip is reached",
+               [&]() {
+    bulk_load = true;
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_bulk_load, true);
+  });
+
+  p.add_checked_option('\0', "partition-size", "Partition blocks, transactions and account_states by ranges of this many mc seqnos (default: 0, not partitioned)",
+               [&](td::Slice fname) { 
+    int v;
+    try {
+      v = std::stoi(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --partition-size: not a number");
+    }
+    if (v < 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --partition-size: should not be negative");
+    }
+    td::actor::send_closure(insert_manager, &InsertManagerPostgres::set_partition_size, static_cast<uint32_t>(v));
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "sink", "Comma separated sinks parsed blocks are written to, the first is the primary: postgres, segment-log, parquet, null (default: postgres)",
+               [&](td::Slice value) {
+    std::vector<std::string> names;
+    for (auto name : td::full_split(value, ',')) {
+      if (name != "postgres" && name != "segment-log" && name != "parquet" && name != "null") {
+        return td::Status::Error(ton::ErrorCode::error, PSLICE() << "bad value for --sink: unknown sink " << name);
+      }
+#ifndef TONDB_PARQUET
+      if (name == "parquet") {
+        return td::Status::Error(ton::ErrorCode::error, "bad value for --sink: built without TONDB_PARQUET");
+      }
+#endif
+      if (std::find(names.begin(), names.end(), name.str()) != names.end()) {
+        return td::Status::Error(ton::ErrorCode::error, PSLICE() << "bad value for --sink: " << name << " is listed twice");
+      }
+      names.push_back(name.str());
+    }
+    sinks = std::move(names);
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "sink-ack", "With several sinks, when an insert is complete: all, primary or quorum (default: all)",
+               [&](td::Slice value) {
+    auto policy = CompositeInsertManager::parse_ack_policy(value);
+    if (policy.is_error()) {
+      return td::Status::Error(ton::ErrorCode::error, PSLICE() << "bad value for --sink-ack: " << policy.error().message());
+    }
+    sink_ack = policy.move_as_ok();
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "sink-max-lag-mb", "With several sinks, how far in MB of parsed blocks a sink may fall behind before the scanner slows down (default: 1024)",
+               [&](td::Slice fname) {
+    int v;
+    try {
+      v = std::stoi(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --sink-max-lag-mb: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --sink-max-lag-mb: should be positive");
+    }
+    sink_max_lag_bytes = static_cast<size_t>(v) << 20;
+    return td::Status::OK();
+  });
+
+  p.add_option('\0', "segment-log-dir", "Output directory of the segment-log sink",
+               [&](td::Slice value) { segment_log_options.directory = value.str(); });
+
+  p.add_checked_option('\0', "segment-log-segment-mb", "Start a new segment of the segment log after this many MB (default: 256)",
+               [&](td::Slice fname) {
+    int v;
+    try {
+      v = std::stoi(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --segment-log-segment-mb: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --segment-log-segment-mb: should be positive");
+    }
+    segment_log_options.segment_bytes = static_cast<size_t>(v) << 20;
+    return td::Status::OK();
+  });
+
+  p.add_option('\0', "replay-segment-log", "Insert the mc blocks of a segment log directory into the sink instead of reading the TON DB",
+               [&](td::Slice value) { replay_dir = value.str(); });
+
+  p.add_option('\0', "null-encode-rows", "The null sink encodes the Postgres rows of every block before discarding it",
+               [&]() { null_options.encode_rows = true; });
+
+#ifdef TONDB_PARQUET
+  p.add_option('\0', "parquet-dir", "Output directory of the parquet sink",
+               [&](td::Slice value) { parquet_options.directory = value.str(); });
+
+  p.add_checked_option('\0', "parquet-compression", "Parquet column compression: zstd, snappy, lz4, gzip or uncompressed (default: zstd)",
+               [&](td::Slice value) {
+    auto compression = InsertManagerParquet::parse_compression(value);
+    if (compression.is_error()) {
+      return td::Status::Error(ton::ErrorCode::error, PSLICE() << "bad value for --parquet-compression: " << compression.error().message());
+    }
+    parquet_options.compression = compression.move_as_ok();
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "parquet-roll-mb", "Close a parquet segment when its parsed blocks reach this size in MB (default: 128)",
+               [&](td::Slice fname) {
+    int v;
+    try {
+      v = std::stoi(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --parquet-roll-mb: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --parquet-roll-mb: should be positive");
+    }
+    parquet_options.roll_bytes = static_cast<size_t>(v) << 20;
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "parquet-roll-seconds", "Close a parquet segment this many seconds after it was opened (default: 300)",
+               [&](td::Slice fname) {
+    double v;
+    try {
+      v = std::stod(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --parquet-roll-seconds: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --parquet-roll-seconds: should be positive");
+    }
+    parquet_options.roll_seconds = v;
+    return td::Status::OK();
+  });
+
+  p.add_checked_option('\0', "parquet-partition-size", "Parquet files are partitioned by ranges of this many mc seqnos (default: 100000)",
+               [&](td::Slice fname) {
+    int v;
+    try {
+      v = std::stoi(fname.str());
+    } catch (...) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --parquet-partition-size: not a number");
+    }
+    if (v <= 0) {
+      return td::Status::Error(ton::ErrorCode::error, "bad value for --parquet-partition-size: should be positive");
+    }
+    parquet_options.partition_size = static_cast<uint32_t>(v);
+    return td::Status::OK();
+  });
+#endif
 
   // SET_VERBOSITY_LEVEL(VERBOSITY_NAME(DEBUG));
-  td::actor::Scheduler scheduler({32});
+  td::actor::Scheduler scheduler({cpu_scheduler_threads, db_scheduler_threads});
   scheduler.run_in_context([&] { insert_manager = td::actor::create_actor<InsertManagerPostgres>("insertmanager"); });
   scheduler.run_in_context([&] { parse_manager = td::actor::create_actor<ParseManager>("parsemanager"); });
   scheduler.run_in_context([&] { scanner = td::actor::create_actor<DbScanner>("scanner", insert_manager.get(), parse_manager.get()); });
   scheduler.run_in_context([&] { p.run(argc, argv).ensure(); });
-  scheduler.run_in_context([&] { td::actor::send_closure(scanner, &DbScanner::run); });
+  if (bulk_load && key_format != PgKeyFormat::Binary) {
+    LOG(FATAL) << "--bulk-load requires --key-format binary, it rebuilds the indexes of scripts/init_postgres_schema.sh";
+  }
+  td::actor::ActorId<InsertManagerInterface> sink_id;
+  scheduler.run_in_context([&] {
+    std::vector<CompositeInsertManager::Sink> sink_actors;
+    for (const auto &sink : sinks) {
+      if (sink == "postgres") {
+        sink_actors.push_back({sink, insert_manager.get()});
+      }
+      if (sink == "segment-log") {
+        if (segment_log_options.directory.empty()) {
+          LOG(FATAL) << "--segment-log-dir is required with --sink segment-log";
+        }
+        segment_log_manager = create_db_actor<InsertManagerSegmentLog>("insertmanager_segment_log", segment_log_options);
+        sink_actors.push_back({sink, segment_log_manager.get()});
+      }
+      if (sink == "null") {
+        null_options.key_format = key_format;
+        null_manager = td::actor::create_actor<InsertManagerNull>("insertmanager_null", null_options);
+        sink_actors.push_back({sink, null_manager.get()});
+      }
+#ifdef TONDB_PARQUET
+      if (sink == "parquet") {
+        if (parquet_options.directory.empty()) {
+          LOG(FATAL) << "--parquet-dir is required with --sink parquet";
+        }
+        parquet_manager = td::actor::create_actor<InsertManagerParquet>("insertmanager_parquet", parquet_options);
+        sink_actors.push_back({sink, parquet_manager.get()});
+      }
+#endif
+    }
+    if (std::find(sinks.begin(), sinks.end(), "postgres") == sinks.end()) {
+      insert_manager.reset();
+    }
+    sink_id = sink_actors[0].actor;
+    if (sink_actors.size() > 1) {
+      composite_manager = td::actor::create_actor<CompositeInsertManager>("insertmanager_composite", std::move(sink_actors),
+                                                                          sink_ack, sink_max_lag_bytes);
+      sink_id = composite_manager.get();
+    }
+  });
+  scheduler.run_in_context([&] {
+    if (!replay_dir.empty()) {
+      replay = td::actor::create_actor<SegmentLogReplay>("replay", replay_dir, sink_id);
+      return;
+    }
+    td::actor::send_closure(scanner, &DbScanner::set_insert_manager, sink_id);
+    td::actor::send_closure(scanner, &DbScanner::run);
+  });
   scheduler.run();
 }
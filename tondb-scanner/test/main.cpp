@@ -0,0 +1,9 @@
+#include "td/utils/tests.h"
+#include "td/utils/logging.h"
+
+
+int main() {
+  SET_VERBOSITY_LEVEL(VERBOSITY_NAME(ERROR));
+  td::TestsRunner::get_default().run_all();
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include "td/utils/tests.h"
+#include "CompositeInsertManager.h"
+
+
+using AckPolicy = CompositeInsertManager::AckPolicy;
+
+// records how the promise of the ack was resolved: 0 unresolved, 1 ok, -1 error
+static CompositeInsertManager::Ack make_ack(int &resolved) {
+  CompositeInsertManager::Ack ack;
+  ack.promise = td::PromiseCreator::lambda([&resolved](td::Result<td::Unit> R) {
+    resolved = R.is_ok() ? 1 : -1;
+  });
+  return ack;
+}
+
+static td::Result<td::Unit> ok() {
+  return td::Unit();
+}
+
+static td::Result<td::Unit> failed() {
+  return td::Status::Error("insert failed");
+}
+
+TEST(CompositeAck, required_acks) {
+  ASSERT_EQ(3u, CompositeInsertManager::required_acks(AckPolicy::all, 3));
+  ASSERT_EQ(1u, CompositeInsertManager::required_acks(AckPolicy::primary, 3));
+  ASSERT_EQ(1u, CompositeInsertManager::required_acks(AckPolicy::quorum, 1));
+  ASSERT_EQ(2u, CompositeInsertManager::required_acks(AckPolicy::quorum, 2));
+  ASSERT_EQ(2u, CompositeInsertManager::required_acks(AckPolicy::quorum, 3));
+  ASSERT_EQ(3u, CompositeInsertManager::required_acks(AckPolicy::quorum, 4));
+  ASSERT_EQ(3u, CompositeInsertManager::required_acks(AckPolicy::quorum, 5));
+}
+
+TEST(CompositeAck, all_needs_every_sink) {
+  int resolved = 0;
+  auto ack = make_ack(resolved);
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::all, 3, ack, 1, ok()));
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::all, 3, ack, 0, ok()));
+  ASSERT_EQ(0, resolved);
+  ASSERT_TRUE(CompositeInsertManager::acknowledge(AckPolicy::all, 3, ack, 2, ok()));
+  ASSERT_EQ(1, resolved);
+
+  resolved = 0;
+  ack = make_ack(resolved);
+  ASSERT_TRUE(CompositeInsertManager::acknowledge(AckPolicy::all, 3, ack, 2, failed()));
+  ASSERT_EQ(-1, resolved);
+  // later results are counted but don't resolve the promise again
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::all, 3, ack, 0, ok()));
+  ASSERT_EQ(1u, ack.succeeded);
+  ASSERT_EQ(1u, ack.failed);
+}
+
+TEST(CompositeAck, primary_follows_first_sink) {
+  int resolved = 0;
+  auto ack = make_ack(resolved);
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::primary, 2, ack, 1, ok()));
+  ASSERT_EQ(0, resolved);
+  ASSERT_TRUE(CompositeInsertManager::acknowledge(AckPolicy::primary, 2, ack, 0, failed()));
+  ASSERT_EQ(-1, resolved);
+
+  resolved = 0;
+  ack = make_ack(resolved);
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::primary, 2, ack, 1, failed()));
+  ASSERT_EQ(0, resolved);
+  ASSERT_TRUE(CompositeInsertManager::acknowledge(AckPolicy::primary, 2, ack, 0, ok()));
+  ASSERT_EQ(1, resolved);
+}
+
+TEST(CompositeAck, quorum_needs_majority) {
+  int resolved = 0;
+  auto ack = make_ack(resolved);
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::quorum, 3, ack, 0, failed()));
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::quorum, 3, ack, 1, ok()));
+  ASSERT_EQ(0, resolved);
+  ASSERT_TRUE(CompositeInsertManager::acknowledge(AckPolicy::quorum, 3, ack, 2, ok()));
+  ASSERT_EQ(1, resolved);
+
+  // two failures of three sinks leave no majority
+  resolved = 0;
+  ack = make_ack(resolved);
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::quorum, 3, ack, 2, failed()));
+  ASSERT_TRUE(CompositeInsertManager::acknowledge(AckPolicy::quorum, 3, ack, 0, failed()));
+  ASSERT_EQ(-1, resolved);
+
+  // with four sinks two failures already decide it, two successes are not enough
+  resolved = 0;
+  ack = make_ack(resolved);
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::quorum, 4, ack, 0, ok()));
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::quorum, 4, ack, 1, ok()));
+  ASSERT_TRUE(!CompositeInsertManager::acknowledge(AckPolicy::quorum, 4, ack, 2, failed()));
+  ASSERT_EQ(0, resolved);
+  ASSERT_TRUE(CompositeInsertManager::acknowledge(AckPolicy::quorum, 4, ack, 3, failed()));
+  ASSERT_EQ(-1, resolved);
+}
+
+TEST(CompositeAck, parse_ack_policy) {
+  ASSERT_TRUE(CompositeInsertManager::parse_ack_policy("all").ok() == AckPolicy::all);
+  ASSERT_TRUE(CompositeInsertManager::parse_ack_policy("primary").ok() == AckPolicy::primary);
+  ASSERT_TRUE(CompositeInsertManager::parse_ack_policy("quorum").ok() == AckPolicy::quorum);
+  ASSERT_TRUE(CompositeInsertManager::parse_ack_policy("majority").is_error());
+}
@@ -0,0 +1,84 @@
+#include "td/utils/tests.h"
+#include "InsertBatch.h"
+
+
+// a batch of mc blocks estimated at 200 bytes per account state, block i has i + 1 states
+static InsertBatch make_batch(size_t count, std::vector<int> &resolved) {
+  InsertBatch batch;
+  for (size_t i = 0; i < count; i++) {
+    auto block = std::make_shared<ParsedBlock>();
+    block->account_states_.resize(i + 1);
+    batch.bytes += block->estimated_size();
+    batch.blocks.push_back(std::move(block));
+    batch.promises.push_back(td::PromiseCreator::lambda([&resolved, i](td::Result<td::Unit> R) {
+      if (R.is_ok()) {
+        resolved.push_back(static_cast<int>(i));
+      }
+    }));
+  }
+  batch.attempt = 3;
+  return batch;
+}
+
+TEST(InsertBatch, split_keeps_order_and_bytes) {
+  std::vector<int> resolved;
+  auto batch = make_batch(5, resolved);
+  auto bytes = batch.bytes;
+  auto halves = split_insert_batch(std::move(batch));
+  ASSERT_EQ(2u, halves.first.blocks.size());
+  ASSERT_EQ(3u, halves.second.blocks.size());
+  ASSERT_EQ(halves.first.blocks.size(), halves.first.promises.size());
+  ASSERT_EQ(halves.second.blocks.size(), halves.second.promises.size());
+  ASSERT_EQ(1u, halves.first.blocks[0]->account_states_.size());
+  ASSERT_EQ(3u, halves.second.blocks[0]->account_states_.size());
+  ASSERT_EQ(size_t{(1 + 2) * 200}, halves.first.bytes);
+  ASSERT_EQ(size_t{(3 + 4 + 5) * 200}, halves.second.bytes);
+  ASSERT_EQ(bytes, halves.first.bytes + halves.second.bytes);
+  // halves start over with a fresh attempt count
+  ASSERT_EQ(0, halves.first.attempt);
+  ASSERT_EQ(0, halves.second.attempt);
+
+  for (auto &p : halves.second.promises) {
+    p.set_value(td::Unit());
+  }
+  for (auto &p : halves.first.promises) {
+    p.set_value(td::Unit());
+  }
+  ASSERT_EQ(5u, resolved.size());
+  ASSERT_EQ(2, resolved[0]);
+  ASSERT_EQ(0, resolved[3]);
+}
+
+TEST(InsertBatch, bisection_isolates_single_block) {
+  std::vector<int> resolved;
+  auto batch = make_batch(7, resolved);
+  // the block with index 4 always fails, halves containing it are split until it is alone
+  size_t splits = 0;
+  while (batch.blocks.size() > 1) {
+    auto halves = split_insert_batch(std::move(batch));
+    splits++;
+    bool in_first = false;
+    for (auto &block : halves.first.blocks) {
+      in_first |= block->account_states_.size() == 5;
+    }
+    batch = std::move(in_first ? halves.first : halves.second);
+    auto &ok = in_first ? halves.second : halves.first;
+    for (auto &p : ok.promises) {
+      p.set_value(td::Unit());
+    }
+  }
+  ASSERT_EQ(5u, batch.blocks[0]->account_states_.size());
+  ASSERT_EQ(size_t{5 * 200}, batch.bytes);
+  ASSERT_EQ(6u, resolved.size());
+  ASSERT_TRUE(splits <= 3);
+  batch.promises[0].set_value(td::Unit());
+}
+
+TEST(InsertBatch, retry_delay_backs_off_exponentially) {
+  ASSERT_EQ(1.0, insert_retry_delay(1, 1.0, 60.0));
+  ASSERT_EQ(2.0, insert_retry_delay(2, 1.0, 60.0));
+  ASSERT_EQ(32.0, insert_retry_delay(6, 1.0, 60.0));
+  ASSERT_EQ(60.0, insert_retry_delay(7, 1.0, 60.0));
+  ASSERT_EQ(60.0, insert_retry_delay(100, 1.0, 60.0));
+  ASSERT_EQ(1.0, insert_retry_delay(0, 1.0, 60.0));
+}
@@ -0,0 +1,55 @@
+#include "td/utils/tests.h"
+#include "LruCache.h"
+
+
+TEST(LruCache, evicts_least_recently_used) {
+  LruCache<int, std::string> cache(2);
+  cache.put(1, "one");
+  cache.put(2, "two");
+  // a hit makes the entry the most recently used one
+  ASSERT_TRUE(cache.get(1) != nullptr);
+  cache.put(3, "three");
+  ASSERT_TRUE(cache.contains(1));
+  ASSERT_TRUE(!cache.contains(2));
+  ASSERT_TRUE(cache.contains(3));
+  ASSERT_EQ(2u, cache.size());
+  ASSERT_EQ(std::string("one"), *cache.get(1));
+}
+
+TEST(LruCache, bounded_by_weight) {
+  LruCache<int, int> cache(10);
+  cache.put(1, 1, 4);
+  cache.put(2, 2, 4);
+  ASSERT_EQ(8u, cache.weight());
+  cache.put(3, 3, 4);
+  ASSERT_TRUE(!cache.contains(1));
+  ASSERT_EQ(8u, cache.weight());
+  // replacing a value updates its weight
+  cache.put(2, 20, 1);
+  ASSERT_EQ(5u, cache.weight());
+  ASSERT_EQ(20, *cache.get(2));
+  cache.erase(3);
+  ASSERT_EQ(1u, cache.weight());
+  ASSERT_EQ(1u, cache.size());
+}
+
+TEST(LruCache, keeps_entry_heavier_than_limit) {
+  LruCache<int, int> cache(10);
+  cache.put(1, 1, 5);
+  cache.put(2, 2, 20);
+  ASSERT_TRUE(!cache.contains(1));
+  ASSERT_TRUE(cache.contains(2));
+  ASSERT_EQ(20u, cache.weight());
+}
+
+TEST(LruCache, bits256_keys) {
+  LruCache<td::Bits256, int, Bits256Hasher> cache(1);
+  td::Bits256 a;
+  td::Bits256 b;
+  a.set_zero();
+  b.set_ones();
+  cache.put(a, 1);
+  cache.put(b, 2);
+  ASSERT_TRUE(cache.get(a) == nullptr);
+  ASSERT_EQ(2, *cache.get(b));
+}
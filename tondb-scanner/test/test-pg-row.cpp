@@ -0,0 +1,84 @@
+#include "td/utils/tests.h"
+#include "td/utils/base64.h"
+#include "PgTableWriter.h"
+
+
+static td::Bits256 test_hash() {
+  td::Bits256 hash;
+  for (size_t i = 0; i < 32; i++) {
+    hash.data()[i] = static_cast<unsigned char>(0x11 * (i % 10));
+  }
+  return hash;
+}
+
+TEST(PgRow, binary_hash_is_bytea) {
+  auto hash = test_hash();
+  PgRow row(PgKeyFormat::Binary);
+  row.add_hash(hash).add_hash(td::optional<td::Bits256>());
+  ASSERT_EQ(2u, row.values().size());
+  ASSERT_EQ("\\x" + hash.to_hex(), row.values()[0].value());
+  ASSERT_EQ(66u, row.values()[0].value().size());
+  ASSERT_TRUE(!row.values()[1]);
+}
+
+TEST(PgRow, text_hash_is_base64) {
+  auto hash = test_hash();
+  PgRow row(PgKeyFormat::Text);
+  row.add_hash(hash);
+  ASSERT_EQ(1u, row.values().size());
+  ASSERT_EQ(td::base64_encode(hash.as_slice()), row.values()[0].value());
+}
+
+TEST(PgRow, binary_address_is_column_pair) {
+  block::StdAddress address(-1, test_hash());
+  PgRow row(PgKeyFormat::Binary);
+  row.add_address(address).add_address(std::string("0:" + test_hash().to_hex()));
+  ASSERT_EQ(4u, row.values().size());
+  ASSERT_EQ(std::string("-1"), row.values()[0].value());
+  ASSERT_EQ("\\x" + test_hash().to_hex(), row.values()[1].value());
+  ASSERT_EQ(std::string("0"), row.values()[2].value());
+  ASSERT_EQ("\\x" + test_hash().to_hex(), row.values()[3].value());
+}
+
+TEST(PgRow, binary_non_standard_address_is_null) {
+  PgRow row(PgKeyFormat::Binary);
+  row.add_address(std::string("addr_none")).add_address(td::optional<std::string>());
+  ASSERT_EQ(4u, row.values().size());
+  for (auto &value : row.values()) {
+    ASSERT_TRUE(!value);
+  }
+}
+
+TEST(PgRow, text_address_is_raw) {
+  block::StdAddress address(0, test_hash());
+  PgRow row(PgKeyFormat::Text);
+  row.add_address(address).add_address(std::string("addr_none")).add_address(td::optional<std::string>());
+  ASSERT_EQ(3u, row.values().size());
+  ASSERT_EQ("0:" + test_hash().to_hex(), row.values()[0].value());
+  ASSERT_EQ(std::string("addr_none"), row.values()[1].value());
+  ASSERT_TRUE(!row.values()[2]);
+}
+
+TEST(PgRow, columns_match_values) {
+  for (auto format : {PgKeyFormat::Text, PgKeyFormat::Binary}) {
+    PgColumns columns(format);
+    columns.add("hash").add_address("account").add("lt");
+    PgRow row(format);
+    row.add_hash(test_hash()).add_address(block::StdAddress(0, test_hash())).add(td::uint64{42});
+    ASSERT_EQ(columns.names().size(), row.values().size());
+    ASSERT_EQ(std::string("42"), row.values().back().value());
+  }
+}
+
+TEST(PgRow, parse_key_format) {
+  ASSERT_TRUE(parse_key_format("text").ok() == PgKeyFormat::Text);
+  ASSERT_TRUE(parse_key_format("binary").ok() == PgKeyFormat::Binary);
+  ASSERT_TRUE(parse_key_format("hex").is_error());
+}
+
+TEST(PgRow, copy_row_escapes_text_format) {
+  std::string out;
+  append_copy_row(out, {std::string("a\tb"), std::nullopt, std::string("c\\d\ne")});
+  append_copy_row(out, {std::string("1")});
+  ASSERT_EQ(std::string("a\\tb\t\\N\tc\\\\d\\ne\n1\n"), out);
+}
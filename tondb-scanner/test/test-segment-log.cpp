@@ -0,0 +1,190 @@
+#include <cstring>
+#include "td/utils/tests.h"
+#include "td/utils/base64.h"
+#include "td/utils/port/path.h"
+#include "td/utils/ScopeGuard.h"
+#include "vm/boc.h"
+#include "vm/cells/CellBuilder.h"
+#include "ParsedBlockSerializer.h"
+#include "SegmentLogWriter.h"
+
+
+static td::Bits256 test_bits(unsigned char value) {
+  td::Bits256 bits;
+  std::memset(bits.data(), value, 32);
+  return bits;
+}
+
+static std::string test_boc(unsigned long long value) {
+  auto cell = vm::CellBuilder().store_long(value, 32).finalize();
+  return td::base64_encode(vm::std_boc_serialize(cell).move_as_ok().as_slice());
+}
+
+static ParsedBlock make_parsed_block(uint32_t mc_seqno) {
+  schema::Message msg{};
+  msg.hash = test_bits(1);
+  msg.source = "0:" + test_bits(2).to_hex();
+  msg.value = 1000000000;
+  msg.opcode = 0x0f8a7ea5;
+  msg.bounce = true;
+  msg.body_boc = test_boc(0x0f8a7ea5);
+
+  schema::Transaction transaction{};
+  transaction.hash = test_bits(3);
+  transaction.account = block::StdAddress(0, test_bits(4));
+  transaction.lt = 42000001;
+  transaction.now = 1700000000;
+  transaction.total_fees = 1234;
+  transaction.in_msg = msg;
+  msg.init_state_boc = test_boc(7);
+  transaction.out_msgs.push_back(msg);
+
+  schema::Block blk{};
+  blk.workchain = -1;
+  blk.shard = static_cast<td::int64>(0x8000000000000000ull);
+  blk.seqno = static_cast<td::int32>(mc_seqno);
+  blk.root_hash = test_bits(5);
+  blk.mc_block_seqno = static_cast<td::int32>(mc_seqno);
+  blk.transactions.push_back(transaction);
+
+  schema::AccountState state{};
+  state.hash = test_bits(6);
+  state.account = transaction.account;
+  state.balance = 500;
+  state.account_status = "active";
+  state.code = vm::CellBuilder().store_long(1, 8).finalize();
+  state.code_hash = td::Bits256(state.code->get_hash().bits());
+
+  JettonTransfer transfer{};
+  transfer.transaction_hash = transaction.hash;
+  transfer.query_id = 7;
+  transfer.amount = td::make_refint(100500);
+  transfer.source = "0:" + test_bits(8).to_hex();
+
+  ParsedBlock parsed;
+  parsed.blocks_.push_back(blk);
+  parsed.account_states_.push_back(state);
+  parsed.events_.push_back(transfer);
+  return parsed;
+}
+
+TEST(ParsedBlockSerializer, round_trip) {
+  auto parsed = make_parsed_block(100);
+  auto data = serialize_parsed_block(parsed);
+  auto R = deserialize_parsed_block(data);
+  ASSERT_TRUE(R.is_ok());
+  auto decoded = R.move_as_ok();
+  // an encoding that keeps every field serializes to the same bytes
+  ASSERT_EQ(data, serialize_parsed_block(*decoded));
+  ASSERT_EQ(parsed.estimated_size(), decoded->estimated_size());
+
+  ASSERT_EQ(1u, decoded->blocks_.size());
+  auto &blk = decoded->blocks_[0];
+  ASSERT_EQ(100, blk.seqno);
+  ASSERT_TRUE(blk.root_hash == test_bits(5));
+  ASSERT_EQ(1u, blk.transactions.size());
+  auto &transaction = blk.transactions[0];
+  ASSERT_EQ(td::uint64{42000001}, transaction.lt);
+  ASSERT_TRUE(transaction.account == parsed.blocks_[0].transactions[0].account);
+  ASSERT_TRUE(transaction.in_msg.has_value());
+  ASSERT_EQ(parsed.blocks_[0].transactions[0].in_msg->body_boc, transaction.in_msg->body_boc);
+  ASSERT_TRUE(transaction.in_msg->body.not_null());
+  ASSERT_TRUE(!transaction.in_msg->init_state_boc);
+  ASSERT_EQ(1u, transaction.out_msgs.size());
+  ASSERT_TRUE(transaction.out_msgs[0].init_state.not_null());
+
+  ASSERT_EQ(1u, decoded->account_states_.size());
+  ASSERT_TRUE(decoded->account_states_[0].code->get_hash() == parsed.account_states_[0].code->get_hash());
+  ASSERT_TRUE(decoded->account_states_[0].data.is_null());
+
+  ASSERT_EQ(1u, decoded->events_.size());
+  auto &transfer = std::get<JettonTransfer>(decoded->events_[0]);
+  ASSERT_EQ(std::string("100500"), transfer.amount->to_dec_string());
+  ASSERT_TRUE(transfer.forward_ton_amount.is_null());
+}
+
+TEST(ParsedBlockSerializer, rejects_truncated_data) {
+  auto data = serialize_parsed_block(make_parsed_block(100));
+  ASSERT_TRUE(deserialize_parsed_block(td::Slice(data).substr(0, data.size() / 2)).is_error());
+  ASSERT_TRUE(deserialize_parsed_block(td::Slice()).is_error());
+}
+
+TEST(SegmentLog, reads_committed_records_in_order) {
+  auto directory = td::mkdtemp(td::get_temporary_dir(), "tondb-scanner-test").move_as_ok();
+  SCOPE_EXIT {
+    td::rmrf(directory).ignore();
+  };
+  // every commit starts a new segment
+  auto writer = SegmentLogWriter::open(directory, 1).move_as_ok();
+  std::vector<std::string> records;
+  for (uint32_t seqno = 100; seqno < 105; seqno++) {
+    records.push_back(serialize_parsed_block(make_parsed_block(seqno)));
+  }
+  ASSERT_TRUE(writer->append(101, records[1]).is_ok());
+  ASSERT_TRUE(writer->append(100, records[0]).is_ok());
+  ASSERT_TRUE(writer->commit().is_ok());
+  ASSERT_TRUE(writer->append(102, records[2]).is_ok());
+  ASSERT_TRUE(writer->commit().is_ok());
+  ASSERT_TRUE(writer->append(103, records[3]).is_ok());
+
+  segment_log::Reader reader(directory);
+  std::vector<uint32_t> seqnos;
+  std::vector<uint64_t> segments;
+  ASSERT_TRUE(reader.for_each([&](const segment_log::Record &record) {
+    seqnos.push_back(record.mc_seqno);
+    segments.push_back(record.segment);
+    auto R = deserialize_parsed_block(td::Slice(record.data, record.size));
+    CHECK(R.is_ok());
+    CHECK(static_cast<uint32_t>(R.ok()->blocks_[0].seqno) == record.mc_seqno);
+  }));
+  // append order, the uncommitted record is not visible
+  ASSERT_EQ(3u, seqnos.size());
+  ASSERT_EQ(101u, seqnos[0]);
+  ASSERT_EQ(100u, seqnos[1]);
+  ASSERT_EQ(102u, seqnos[2]);
+  ASSERT_EQ(segments[0], segments[1]);
+  ASSERT_TRUE(segments[1] < segments[2]);
+
+  // the reader tails the log
+  segment_log::Record record;
+  ASSERT_TRUE(!reader.next(record));
+  ASSERT_TRUE(reader.error().empty());
+  ASSERT_TRUE(writer->commit().is_ok());
+  ASSERT_TRUE(reader.next(record));
+  ASSERT_EQ(103u, record.mc_seqno);
+  ASSERT_EQ(records[3], std::string(record.data, record.size));
+
+  // a new writer starts a new segment after the existing ones
+  writer = SegmentLogWriter::open(directory, 1).move_as_ok();
+  ASSERT_TRUE(writer->append(104, records[4]).is_ok());
+  ASSERT_TRUE(writer->commit().is_ok());
+  ASSERT_TRUE(reader.next(record));
+  ASSERT_EQ(104u, record.mc_seqno);
+  ASSERT_TRUE(!reader.next(record));
+}
+
+TEST(SegmentLog, writer_removes_orphan_log_file) {
+  auto directory = td::mkdtemp(td::get_temporary_dir(), "tondb-scanner-test").move_as_ok();
+  SCOPE_EXIT {
+    td::rmrf(directory).ignore();
+  };
+  auto writer = SegmentLogWriter::open(directory, 1 << 20).move_as_ok();
+  ASSERT_EQ(1u, writer->segment());
+  writer.reset();
+  // a crash right after creating the log file of segment 2
+  auto orphan = td::FileFd::open(segment_log::segment_path(directory, 2, "log"), td::FileFd::Write | td::FileFd::CreateNew);
+  ASSERT_TRUE(orphan.is_ok());
+  orphan.ok_ref().close();
+
+  writer = SegmentLogWriter::open(directory, 1 << 20).move_as_ok();
+  ASSERT_EQ(2u, writer->segment());
+  auto data = serialize_parsed_block(make_parsed_block(100));
+  ASSERT_TRUE(writer->append(100, data).is_ok());
+  ASSERT_TRUE(writer->commit().is_ok());
+
+  segment_log::Reader reader(directory);
+  std::vector<uint32_t> seqnos;
+  ASSERT_TRUE(reader.for_each([&](const segment_log::Record &record) { seqnos.push_back(record.mc_seqno); }));
+  ASSERT_EQ(1u, seqnos.size());
+  ASSERT_EQ(100u, seqnos[0]);
+}
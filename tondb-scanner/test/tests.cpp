@@ -1,3 +1,5 @@
+// Disabled detector test kept from before the unit test target. It is not built, tondb-scanner-tests is made of
+// main.cpp and the test-*.cpp files listed in tondb-scanner/CMakeLists.txt.
 #include "td/utils/port/signals.h"
 #include "td/utils/OptionParser.h"
 #include "td/utils/format.h"